@@ -1,6 +1,7 @@
 #include "ast.h"
 #include <typeinfo>
 #include <iostream>
+#include <cstdint>
 
 #ifndef UNUSED
 #define UNUSED(x) (void)(x)
@@ -9,31 +10,19 @@
 namespace H {
 
 
-int indentlvl = 0;
-void newIndent(int i = 0)
+/// Labels are printed at the start of the line, everything else at the current indentation.
+void newIndentDumpBlockItem(PrettyPrinter& o, Stmt* blockItem)
 {   
-    putchar('\n');
-    for (i = 0; i < indentlvl; i++)
-        putchar('\t');
+    if (dynamic_cast<LabeledStmt*>(blockItem)) o << '\n';
+    else o.newline();
+    blockItem->stream(o);
 }
 
-void newIndentDumpBlockItem(Stmt* blockItem)
+void newIndentDumpStmt(PrettyPrinter& o, Stmt* statement, int temporaryIndentAdjust = 0)
 {   
-    if (dynamic_cast<LabeledStmt*>(blockItem)) putchar('\n');
-    else newIndent();
-    blockItem->dump();
-}
-
-void newIndentDumpStmt(Stmt* statement, int temporaryIndentAdjust = 0)
-{   
-    indentlvl = indentlvl+temporaryIndentAdjust;
-    putchar('\n');
-    if (dynamic_cast<LabeledStmt*>(statement)) statement->dump();
-    else {
-        for (int i = 0; i < indentlvl; i++) putchar('\t');
-        statement->dump();
-    }
-    indentlvl = indentlvl-temporaryIndentAdjust;
+    for (int i = 0; i < temporaryIndentAdjust; i++) o.indent();
+    newIndentDumpBlockItem(o, statement);
+    for (int i = 0; i < temporaryIndentAdjust; i++) o.dedent();
 }
 
 
@@ -54,7 +43,12 @@ void TranslationUnit::check(Sema &sema) {
 //! =================================================
 
 void ExternalDeclaration::check(Sema &sema) {
-    if (specifierDeclarator() == nullptr) return;
+    if (!declare(sema)) return;
+    checkBody(sema);
+}
+
+bool ExternalDeclaration::declare(Sema &sema) {
+    if (specifierDeclarator() == nullptr) return false;
     auto typeString = specifierDeclarator()->typeString();
     //auto type = specifierDeclarator()->type();
     auto name = specifierDeclarator()->name();
@@ -76,17 +70,21 @@ void ExternalDeclaration::check(Sema &sema) {
 
     if (specifierDeclarator()->declarator() == nullptr && specifierDeclarator()->typeString()!="struct"){
         loc().err() << "External declarations should declare at least one declarator!" << loc().endErr();
-        return;
+        return false;
     }
+    if (specifierDeclarator()->isInline() && !dynamic_cast<FunctionType*>(specifierDeclarator()->type()))
+        loc().err() << "'" << name << "' declared inline but not a function!" << loc().endErr();
 
     sema.addDeclaration(specifierDeclarator());                                            //  Declaration to the current scope
+    return true;
+}
 
-    
+void ExternalDeclaration::checkBody(Sema &sema) {
     if (functionBody()!=nullptr) {                                              // If Declaration is in fact a Function Definition
         sema.external_declaration(this);
         
         CompoundStmt* compoundFunctionBody = dynamic_cast<CompoundStmt*>(functionBody());
-        const Ptrs<SpecifierDeclarator>& paramList = specifierDeclarator()->parameterList();
+        const SmallPtrs<SpecifierDeclarator>& paramList = specifierDeclarator()->parameterList();
 
         for (size_t i = 0; i < paramList.size(); i++)
         {
@@ -95,9 +93,13 @@ void ExternalDeclaration::check(Sema &sema) {
         }
         
         sema.external_declaration(this);                                        // Remember the current  
+        LabelTable labels;
+        sema.setLabels(&labels);
 
         compoundFunctionBody->check(sema);
-        
+        labels.resolve();                                                       // Forward gotos
+
+        sema.setLabels(nullptr);
         sema.external_declaration(nullptr);
     }
 
@@ -139,7 +141,7 @@ void ReturnStmt::check(Sema &sema) {
 }
 
 void GoToStmt::check(Sema &sema) {
-    if (sema.lookupLabel(gotoLabel())==nullptr) loc().err() << "Label " << gotoLabel() << " not declared!" << loc().endErr();
+    sema.labels()->use(this);
 }
 
 void BreakStmt::check(Sema &sema) {
@@ -185,7 +187,7 @@ void CompoundStmt::check(Sema &sema) {
     sema.push();                                                                                    // Start new scope
 
     if (sema.external_declaration() != nullptr && sema.size()==2) {                                 // Add Parameters only to function body environment
-        const Ptrs<SpecifierDeclarator>& paramList = sema.external_declaration()->specifierDeclarator()->parameterList();
+        const SmallPtrs<SpecifierDeclarator>& paramList = sema.external_declaration()->specifierDeclarator()->parameterList();
         for (size_t i = 0; i < paramList.size(); i++) {
             auto param = paramList[i].get();
             sema.addDeclaration(param);
@@ -201,23 +203,43 @@ void CompoundStmt::check(Sema &sema) {
     //std::cout << std::endl;
 }
 
-void LabeledStmt::check(Sema &sema) {UNUSED(sema);}
+void LabeledStmt::check(Sema &sema) {
+    sema.labels()->define(this);
+    statement()->check(sema);
+}
 
 void ErrStmt::check(Sema &sema) {UNUSED(sema);}
 
 
+//! =================================================
+//! ============= Expressions =======================
+//! =================================================
+
+Type* Exp::check(Sema& sema) {
+#ifndef NDEBUG
+    assert(++num_checks_ == 1 && "expression checked twice; read the cached type() instead");
+#endif
+    if (type_ == nullptr) {
+        num_typechecks_++;
+        type_ = typecheck(sema);
+        if (!dynamic_cast<ErrorType*>(type_)) fold();
+    }
+    return type_;
+}
+
+
 //! =================================================
 //! ============= Infix Expressions =================
 //! =================================================
 
-Type* InfixExp::check(Sema &sema) {
+Type* InfixExp::typecheck(Sema& sema) {
     Type* lhs_type = lhs()->check(sema);
     // std::cout << "LHS: " << lhs_type->str() << std::endl;
     Type* rhs_type = rhs()->check(sema);
     // std::cout << "RHS: " << rhs_type->str() << std::endl;
 
 
-    if (lhs_type->str() == "error" || rhs_type->str() =="error") return type_ = new ErrorType();
+    if (lhs_type->str() == "error" || rhs_type->str() =="error") return new ErrorType();
 
     // Logical Operators
     if (operation().isa(Tok::Tag::P_Less) || 
@@ -227,13 +249,13 @@ Type* InfixExp::check(Sema &sema) {
         operation().isa(Tok::Tag::P_Equal) ||
         operation().isa(Tok::Tag::P_Unequal)) {
             if ((dynamic_cast<ArithmeticType*>(lhs_type) && dynamic_cast<ArithmeticType*>(rhs_type)) || lhs_type->str()==rhs_type->str()) {
-                return type_ = new IntType();
+                return new IntType();
         }    
     }
 
     // Logical And/Or
     if (operation().isa(Tok::Tag::P_Logical_And) || operation().isa(Tok::Tag::P_Logical_Or)) {
-        if (lhs_type->isScalar() && rhs_type->isScalar()) return type_ = new IntType();
+        if (lhs_type->isScalar() && rhs_type->isScalar()) return new IntType();
     }
     
     //Assignment
@@ -244,35 +266,41 @@ Type* InfixExp::check(Sema &sema) {
         } else if (lhs_type->str() != rhs_type->str()) {
             operation().loc().err() << "Incompatible Types for operand '" << operation().str() << "' (" << lhs_type->str() << "<->" << rhs_type->str() <<")!" << loc().endErr();
         }
-        return type_ = lhs_type;
+        return lhs_type;
     }
 
     // Addition
     if (operation().isa(Tok::Tag::P_Addition)){
-        if (dynamic_cast<ArithmeticType*>(lhs_type) && dynamic_cast<ArithmeticType*>(rhs_type)) return type_ = new IntType();
-        else if (dynamic_cast<PointerType*>(lhs_type) && dynamic_cast<PointerType*>(lhs_type)->pointee()->isComplete() && dynamic_cast<const ArithmeticType*>(rhs_type)) return type_ = lhs_type;
-        else if (dynamic_cast<PointerType*>(rhs_type) && dynamic_cast<PointerType*>(rhs_type)->pointee()->isComplete() && dynamic_cast<const ArithmeticType*>(lhs_type)) return type_ = rhs_type;
+        if (dynamic_cast<ArithmeticType*>(lhs_type) && dynamic_cast<ArithmeticType*>(rhs_type)) return new IntType();
+        else if (dynamic_cast<PointerType*>(lhs_type) && dynamic_cast<PointerType*>(lhs_type)->pointee()->isComplete() && dynamic_cast<const ArithmeticType*>(rhs_type)) return lhs_type;
+        else if (dynamic_cast<PointerType*>(rhs_type) && dynamic_cast<PointerType*>(rhs_type)->pointee()->isComplete() && dynamic_cast<const ArithmeticType*>(lhs_type)) return rhs_type;
 
     }
 
     //Substraction
     if (operation().isa(Tok::Tag::P_Substraction)){
-        if (dynamic_cast<ArithmeticType*>(lhs_type) && dynamic_cast<ArithmeticType*>(rhs_type)) return type_ = new IntType();
-        else if (dynamic_cast<PointerType*>(lhs_type) && dynamic_cast<PointerType*>(lhs_type)->pointee()->isComplete() && dynamic_cast<PointerType*>(rhs_type) && dynamic_cast<PointerType*>(rhs_type)->pointee()->isComplete() && lhs_type->str()==rhs_type->str()) return type_ = new IntType();
-        else if (dynamic_cast<PointerType*>(lhs_type) && dynamic_cast<PointerType*>(lhs_type)->pointee()->isComplete() && dynamic_cast<const IntType*>(rhs_type)) return type_ = lhs_type;
+        if (dynamic_cast<ArithmeticType*>(lhs_type) && dynamic_cast<ArithmeticType*>(rhs_type)) return new IntType();
+        else if (dynamic_cast<PointerType*>(lhs_type) && dynamic_cast<PointerType*>(lhs_type)->pointee()->isComplete() && dynamic_cast<PointerType*>(rhs_type) && dynamic_cast<PointerType*>(rhs_type)->pointee()->isComplete() && lhs_type->str()==rhs_type->str()) return new IntType();
+        else if (dynamic_cast<PointerType*>(lhs_type) && dynamic_cast<PointerType*>(lhs_type)->pointee()->isComplete() && dynamic_cast<const IntType*>(rhs_type)) return lhs_type;
     }
 
-    // Multiplication and Division
-    if (operation().isa(Tok::Tag::P_Multiplication) || operation().isa(Tok::Tag::P_Division)){
-        if (dynamic_cast<ArithmeticType*>(lhs_type) && dynamic_cast<ArithmeticType*>(rhs_type)) return type_ = new IntType(); 
+    // Multiplication, Division and Modulo
+    if (operation().isa(Tok::Tag::P_Multiplication) || operation().isa(Tok::Tag::P_Division) || operation().isa(Tok::Tag::P_Modulo)){
+        if (dynamic_cast<ArithmeticType*>(lhs_type) && dynamic_cast<ArithmeticType*>(rhs_type)) return new IntType(); 
+    }
+
+    // Shifts and Bitwise Operators
+    if (operation().isa(Tok::Tag::P_Bitwise_Shift_L) || operation().isa(Tok::Tag::P_Bitwise_Shift_R) ||
+        operation().isa(Tok::Tag::P_Bitwise_And) || operation().isa(Tok::Tag::P_Bitwise_Xor) || operation().isa(Tok::Tag::P_Bitwise_Or)){
+        if (dynamic_cast<ArithmeticType*>(lhs_type) && dynamic_cast<ArithmeticType*>(rhs_type)) return new IntType(); 
     }
 
     operation().loc().err() << "Incompatible Types for operand '" << operation().str() << "' (" << lhs_type->str() << "<->" << rhs_type->str() <<")!" << loc().endErr();
-    return type_ = sema.error_type();
+    return sema.error_type();
 }
 
-Type* TernaryExp::check(Sema &sema) {
-    //auto conditionType = condition()->check(sema);
+Type* TernaryExp::typecheck(Sema& sema) {
+    condition()->check(sema);
     auto consequenceType = consequence()->check(sema);
     auto alternativeType = alternative()->check(sema);
 
@@ -283,53 +311,53 @@ Type* TernaryExp::check(Sema &sema) {
     return consequenceType;
 }
 
-Type* PrefixExp::check(Sema &sema) {
+Type* PrefixExp::typecheck(Sema& sema) {
     
     auto opType = operand()->check(sema);
 
     if (prefix().isa(Tok::Tag::P_Multiplication)) { 
         if (dynamic_cast<PointerType*>(opType)) {
             auto operandType = dynamic_cast<PointerType*>(opType);
-            return type_ = operandType->pointee();
+            return operandType->pointee();
         } else {
             loc().err() << "Invalid type argument of unary '*' (have " << opType->str() << ")" << loc().endErr();
             return new ErrorType();
         }
     }
     if (prefix().isa(Tok::Tag::P_Bitwise_And)) { 
-        return type_ = new PointerType(opType);
+        return new PointerType(opType);
     }
     if (prefix().isa(Tok::Tag::P_Addition) || prefix().isa(Tok::Tag::P_Substraction)){
-        if (dynamic_cast<ArithmeticType*>(opType)) return type_ = opType;
+        if (dynamic_cast<ArithmeticType*>(opType)) return opType;
         else {
             loc().err() << "Invalid type argument of unary '"<< prefix() <<"' (have " << opType->str() << ")" << loc().endErr();
             return new ErrorType();
         }
     }
     if (prefix().isa(Tok::Tag::P_Logical_Not)){
-        if (opType->isScalar()) return type_ = new IntType();
+        if (opType->isScalar()) return new IntType();
         else {
             loc().err() << "Invalid type argument of unary '"<< prefix() <<"' (have " << opType->str() << ")" << loc().endErr();
             return new ErrorType();
         }
     }
     if (prefix().isa(Tok::Tag::P_Bitwise_Not)){
-        if (dynamic_cast<IntType*>(opType)) return type_ = opType;
+        if (dynamic_cast<IntType*>(opType)) return opType;
         else {
             loc().err() << "Invalid type argument of unary '"<< prefix() <<"' (have " << opType->str() << ")" << loc().endErr();
             return new ErrorType();
         }
     }
 
-    return type_ = opType;
+    return opType;
 }
 
-Type* MemberAccessExp::check(Sema &sema) {
+Type* MemberAccessExp::typecheck(Sema& sema) {
     
     // TODO: Check that member_name is actually part of the object
     auto objectType = object()->check(sema);
 
-    if (dynamic_cast<ErrorType*>(objectType)) return type_ = new ErrorType();
+    if (dynamic_cast<ErrorType*>(objectType)) return new ErrorType();
 
     // Correct operation for correct type
     if (dynamic_cast<PointerType*>(objectType) && operation()==Tok::Tag::P_Dot){
@@ -340,36 +368,53 @@ Type* MemberAccessExp::check(Sema &sema) {
 
     if (dynamic_cast<Identifier*>(object())) {
         auto obj = dynamic_cast<Identifier*>(object());
-        StructSpecifier* structSpecif = dynamic_cast<StructSpecifier*>(sema.lookup(obj->name())->specifier());
+        StructSpecifier* structSpecif = dynamic_cast<StructSpecifier*>(sema.lookup(obj->name())->specifier()->underlying());
+        if (structSpecif == nullptr) {
+            loc().err() << "'" <<  obj->name() << "' is not a struct!" << loc().endErr();
+            return new ErrorType();
+        }
         std::string structIdent = structSpecif->structIdentifierString();
         SpecifierDeclarator* member = sema.lookupMember(structIdent, member_name());
 
         if (!sema.structDefined(structIdent)) loc().err() << "'" <<  obj->name() << "' is not a struct!" << loc().endErr();
         else if (member == nullptr) loc().err() << "'struct " <<  structIdent << "' has no member named '" << member_name() << "'!" << loc().endErr();
-        else return type_ = member->type();
+        else return member->type();
+    } else {
+        // Member, element or pointee: the struct comes from the type of the object
+        auto pointer = dynamic_cast<PointerType*>(objectType);
+        auto structType = dynamic_cast<StructType*>(pointer ? pointer->pointee() : objectType);
+        if (structType == nullptr || structType->definition() == nullptr) {
+            loc().err() << "Object is not a struct!" << loc().endErr();
+            return new ErrorType();
+        }
+        auto definition = structType->definition();
+        for (size_t i = 0; i < definition->num_structDeclarations(); i++)
+            if (definition->structDeclaration(i)->name() == member_name()) return definition->structDeclaration(i)->type();
+        loc().err() << "'struct " << definition->structIdentifierString() << "' has no member named '" << member_name() << "'!" << loc().endErr();
     }
-        
-    return type_ = new ErrorType();
+
+    return new ErrorType();
 }
 
 
-Type* ArrayExp::check(Sema &sema) {
-    // TODO
+Type* ArrayExp::typecheck(Sema& sema) {
     auto arrayType = object()->check(sema);
+    index()->check(sema);
 
-    return type_ = arrayType;    
+    if (auto pointer = dynamic_cast<PointerType*>(arrayType)) return pointer->pointee();
+    return arrayType;
 }
 
-Type* FuncCallExp::check(Sema &sema) {
+Type* FuncCallExp::typecheck(Sema& sema) {
     auto idType = func()->check(sema);
-    if (dynamic_cast<ErrorType*>(idType)) return type_ = sema.error_type();
+    if (dynamic_cast<ErrorType*>(idType)) return sema.error_type();
     if (!dynamic_cast<FunctionType*>(idType)){
         loc().err() << "Try to make a function call, but the used function is unknown (or at least can not be casted to function type)" << loc().endErr();
-        return type_ = sema.error_type();
+        return sema.error_type();
     }
     auto funcType = dynamic_cast<FunctionType*>(idType);
     auto returnType = funcType->returnType();
-    const Ptrs<Exp>& funcCallParamList = parameters();
+    const SmallPtrs<Exp>& funcCallParamList = parameters();
 
     // Check all params
     int counter = 1;
@@ -390,9 +435,9 @@ Type* FuncCallExp::check(Sema &sema) {
     if (dynamic_cast<Identifier*>(func())){
         std::string functionName = dynamic_cast<Identifier*>(func())->name();
         auto functionDefinition = sema.lookup(functionName);
-        const Ptrs<SpecifierDeclarator>& funcDefParamList = functionDefinition->parameterList();
+        const SmallPtrs<SpecifierDeclarator>& funcDefParamList = functionDefinition->parameterList();
 
-        if (funcDefParamList[0].get()->typeString() == "void") {
+        if (funcDefParamList.size() == 1 && funcDefParamList[0]->declarator() == nullptr && funcDefParamList[0].get()->typeString() == "void") {
             if (funcCallParamList.size() != 0) funcCallParamList[0].get()->loc().err() << "Too many arguments in function call (got "<< funcCallParamList.size() << ", expected 0)!" << loc().endErr();
         } else {
             if (funcDefParamList.size() > funcCallParamList.size()) {
@@ -405,7 +450,7 @@ Type* FuncCallExp::check(Sema &sema) {
             else {
                 for (size_t i = 0; i < funcCallParamList.size(); i++) {
                     auto funcCallParam = funcCallParamList[i].get();
-                    Type* funcCallParamType = funcCallParam->check(sema);
+                    Type* funcCallParamType = funcCallParam->type();           // already checked above
                     
                     auto funcDefParam = funcDefParamList[i].get();
                     
@@ -417,75 +462,231 @@ Type* FuncCallExp::check(Sema &sema) {
         }
     }    
 
-    return type_ = returnType;
+    return returnType;
 }
 
-Type* SizeOfTypeExp::check(Sema &sema) {
-    if (typeString()=="char" || typeString()=="int") return type_ = new IntType();
+Type* SizeOfTypeExp::typecheck(Sema& sema) {
+    if (typeTok().isa(Tok::Tag::M_Id)) {
+        auto definition = sema.lookup(typeString());
+        if (definition != nullptr && definition->isTypedef()) {
+            Type* type = definition->type();
+            if (type->isComplete() && !dynamic_cast<FunctionType*>(type)) {
+                definition_ = definition;
+                return new IntType();
+            }
+            loc().err() << "sizeof operator shall not be applied to function or incomplete type (got " << type->str() << ")!" << loc().endErr();
+            return sema.error_type();
+        }
+    }
+    if (typeString()=="char" || typeString()=="int") return new IntType();
     else {
         loc().err() << "sizeof operator shall not be applied to function or incomplete type (got " << typeString() << ")!" << loc().endErr();
         return sema.error_type();
     }
 }
 
-Type* SizeOfUnaryExp::check(Sema &sema) {
-    if (exp()->check(sema)->isComplete() && !dynamic_cast<FunctionType*>(exp()->check(sema))) return type_ = new IntType();
+Type* SizeOfUnaryExp::typecheck(Sema& sema) {
+    Type* expType = exp()->check(sema);
+    if (expType->isComplete() && !dynamic_cast<FunctionType*>(expType)) return new IntType();
     else {
-        loc().err() << "sizeof operator shall not be applied to expression with function or incomplete type (got " << exp()->check(sema)->str() << ")!" << loc().endErr();
+        loc().err() << "sizeof operator shall not be applied to expression with function or incomplete type (got " << expType->str() << ")!" << loc().endErr();
         return sema.error_type();
     }
 }
 
-Type* PostfixExp::check(Sema &sema) {
+Type* PostfixExp::typecheck(Sema& sema) {
     auto postFixType = operand()->check(sema);
 
     if (!postFixType->isScalar()) { //scalar = Integer Types and Pointer Type
         loc().err() << "The operand of the postfix increment/decrement must be arithmetic or pointer type (got " << postFixType->str() << ")!" << loc().endErr();
     }
 
-    return type_ = postFixType;
+    return postFixType;
 }
 
 
 
-Type* Integer::check(Sema& sema) {
+Type* Integer::typecheck(Sema& sema) {
     UNUSED(sema);
     return new IntType();
 }
 
-Type* Character::check(Sema& sema) {
+Type* Character::typecheck(Sema& sema) {
     UNUSED(sema);
     return new CharType();
 }
 
-Type* Literal::check(Sema& sema) {
+Type* Literal::typecheck(Sema& sema) {
     UNUSED(sema);
     return new PointerType(new CharType());
 }
 
 
-Type* Identifier::check(Sema &sema) {
+Type* Identifier::typecheck(Sema& sema) {
     setSpecifierDeclarator(sema.lookup(name()));
     
-    if(specifierDeclarator() != nullptr) return specifierDeclarator()->type();
+    if (specifierDeclarator() != nullptr && specifierDeclarator()->isTypedef()) loc().err() << "Type name '" << name() << "' used as an expression!" << loc().endErr();
+    else if(specifierDeclarator() != nullptr) return specifierDeclarator()->type();
     else loc().err() << "Identifier '" << name() << "' not declared!" << loc().endErr();
     
     return sema.error_type();
 }
 
-Type* ErrExp::check(Sema &sema) {
+Type* ErrExp::typecheck(Sema& sema) {
     return sema.error_type();
 }
 
 
 
+//! =================================================
+//! ============= Constant Folding ==================
+//! =================================================
+
+// Integer constant expressions are evaluated with the semantics of a 32 bit 'int'.
+// Operands are already folded when a node folds, so every subexpression is evaluated once.
+
+static int64_t wrapInt(Loc loc, int64_t value) {
+    if (value < INT32_MIN || value > INT32_MAX) loc.warn() << "Integer overflow in constant expression!" << loc.endErr();
+    return static_cast<int32_t>(static_cast<uint32_t>(value));
+}
+
+void InfixExp::fold() {
+    auto op = operation().tag();
+
+    // Logical operators only need the operand that decides the result
+    if (op == Tok::Tag::P_Logical_And || op == Tok::Tag::P_Logical_Or) {
+        bool isAnd = op == Tok::Tag::P_Logical_And;
+        if (lhs()->isConstant() && (lhs()->constant() != 0) != isAnd) return setConstant(isAnd ? 0 : 1);
+        if (lhs()->isConstant() && rhs()->isConstant()) setConstant(rhs()->constant() != 0);
+        return;
+    }
+
+    if (!lhs()->isConstant() || !rhs()->isConstant()) return;
+    int64_t l = lhs()->constant();
+    int64_t r = rhs()->constant();
+
+    switch (op) {
+        case Tok::Tag::P_Addition:          return setConstant(wrapInt(loc(), l + r));
+        case Tok::Tag::P_Substraction:      return setConstant(wrapInt(loc(), l - r));
+        case Tok::Tag::P_Multiplication:    return setConstant(wrapInt(loc(), l * r));
+        case Tok::Tag::P_Division:
+        case Tok::Tag::P_Modulo:
+            if (r == 0) {
+                operation().loc().warn() << "Division by zero in constant expression!" << loc().endErr();
+                return;
+            }
+            return setConstant(wrapInt(loc(), op == Tok::Tag::P_Division ? l / r : l % r));
+        case Tok::Tag::P_Bitwise_Shift_L:
+        case Tok::Tag::P_Bitwise_Shift_R:
+            if (r < 0 || r >= 32) {
+                operation().loc().warn() << "Shift count out of range in constant expression (got " << r << ")!" << loc().endErr();
+                return;
+            }
+            return setConstant(op == Tok::Tag::P_Bitwise_Shift_L ? wrapInt(loc(), l * (int64_t(1) << r)) : l >> r);
+        case Tok::Tag::P_Less:              return setConstant(l < r);
+        case Tok::Tag::P_Greater:           return setConstant(l > r);
+        case Tok::Tag::P_Less_Equal:        return setConstant(l <= r);
+        case Tok::Tag::P_Greater_Equal:     return setConstant(l >= r);
+        case Tok::Tag::P_Equal:             return setConstant(l == r);
+        case Tok::Tag::P_Unequal:           return setConstant(l != r);
+        case Tok::Tag::P_Bitwise_And:       return setConstant(l & r);
+        case Tok::Tag::P_Bitwise_Xor:       return setConstant(l ^ r);
+        case Tok::Tag::P_Bitwise_Or:        return setConstant(l | r);
+        default: return;                                                        // Assignments are no constant expressions
+    }
+}
+
+void TernaryExp::fold() {
+    if (!condition()->isConstant()) return;
+    Exp* chosen = condition()->constant() != 0 ? consequence() : alternative();
+    if (chosen->isConstant()) setConstant(chosen->constant());
+}
+
+void PrefixExp::fold() {
+    if (!operand()->isConstant()) return;
+    int64_t value = operand()->constant();
+
+    switch (prefix().tag()) {
+        case Tok::Tag::P_Addition:          return setConstant(value);
+        case Tok::Tag::P_Substraction:      return setConstant(wrapInt(loc(), -value));
+        case Tok::Tag::P_Bitwise_Not:       return setConstant(~value);
+        case Tok::Tag::P_Logical_Not:       return setConstant(value == 0);
+        default: return;                                                        // &, *, ++ and -- need an object
+    }
+}
+
+void SizeOfTypeExp::fold() {
+    if (definition() != nullptr && definition()->type()->size() != 0) setConstant(definition()->type()->size());
+    else if (typeString() == "char") setConstant(CharType().size());
+    else if (typeString() == "int") setConstant(IntType().size());
+}
+
+void SizeOfUnaryExp::fold() {
+    if (exp()->type()->size() != 0) setConstant(exp()->type()->size());
+}
+
+void Integer::fold() {
+    if (value() > INT32_MAX) {
+        loc().warn() << "Integer constant " << value() << " is too large for type 'int'!" << loc().endErr();
+        return setConstant(static_cast<int32_t>(static_cast<uint32_t>(value())));
+    }
+    setConstant(value());
+}
+
+void Character::fold() {
+    // value() is the spelling including the quotes, e.g. 'a' or '\n'
+    const std::string& spelling = value();
+    char c = spelling[1];
+    if (c == '\\') {
+        switch (spelling[2]) {
+            case 'a': c = '\a'; break;
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'v': c = '\v'; break;
+            default:  c = spelling[2];                                          // \' \" \? \\ stand for themselves
+        }
+    }
+    setConstant(static_cast<signed char>(c));
+}
+
+size_t StructType::size() const {
+    if (definition() == nullptr) return 0;
+    size_t offset = 0;
+    for (size_t i = 0; i < definition()->num_structDeclarations(); i++) {
+        Type* memberType = definition()->structDeclaration(i)->type();
+        offset = (offset + memberType->align() - 1) / memberType->align() * memberType->align() + memberType->size();
+    }
+    return (offset + align() - 1) / align() * align();
+}
+
+size_t StructType::align() const {
+    size_t alignment = 1;
+    if (definition() == nullptr) return alignment;
+    for (size_t i = 0; i < definition()->num_structDeclarations(); i++) alignment = std::max(alignment, definition()->structDeclaration(i)->type()->align());
+    return alignment;
+}
+
+Type* TypeNameSpecifier::type() const {
+    return definition() != nullptr ? definition()->type() : Specifier::type();
+}
+
+Specifier* TypeNameSpecifier::underlying() {
+    return definition() != nullptr ? definition()->specifier()->underlying() : this;
+}
+
+
+
 //! ========================================================================================================
 //! ================= Stream/Dump ==========================================================================
 //! ========================================================================================================
 
 
-void ASTNode::dump() const {
-    stream(std::cout);
+void ASTNode::dump(std::ostream& sink) const {
+    PrettyPrinter printer(sink);
+    stream(printer);
 }
 
 
@@ -493,11 +694,15 @@ void ASTNode::dump() const {
 //! ================= Specifiers ====================
 //! =================================================
 
-std::ostream& PrimitiveSpecifier::stream(std::ostream& o) const {
+PrettyPrinter& PrimitiveSpecifier::stream(PrettyPrinter& o) const {
     return o << typeString();
 }
 
-std::ostream& StructSpecifier::stream(std::ostream& o) const {
+PrettyPrinter& TypeNameSpecifier::stream(PrettyPrinter& o) const {
+    return o << typeString();
+}
+
+PrettyPrinter& StructSpecifier::stream(PrettyPrinter& o) const {
     o << "struct";
     if (structIdentifierString()!="") o << " " << structIdentifierString();
     
@@ -505,16 +710,17 @@ std::ostream& StructSpecifier::stream(std::ostream& o) const {
         if (num_structDeclarations()==0) {
             o << " {}";
         } else {
-            newIndent();
-            o << "{";
-            newIndent(++indentlvl);
+            o.newline() << "{";
+            o.indent();
+            o.newline();
             for (size_t i = 0; i < num_structDeclarations(); i++)
             {
-                structDeclaration(i)->dump();
+                structDeclaration(i)->stream(o);
                 o << ";";
-                if (i+1<num_structDeclarations()) newIndent();
+                if (i+1<num_structDeclarations()) o.newline();
             }
-            newIndent(--indentlvl);
+            o.dedent();
+            o.newline();
             o<<"}";
         }
     }
@@ -527,29 +733,29 @@ std::ostream& StructSpecifier::stream(std::ostream& o) const {
 //! ================= Declarator ====================
 //! =================================================
 
-std::ostream& NamedDeclarator::stream(std::ostream& o) const {
+PrettyPrinter& NamedDeclarator::stream(PrettyPrinter& o) const {
     return o << name();
 }
 
-std::ostream& FunctionDeclarator::stream(std::ostream& o) const {
+PrettyPrinter& FunctionDeclarator::stream(PrettyPrinter& o) const {
     o << "(";
     if (declarator()!=nullptr){
-        declarator()->dump();
+        declarator()->stream(o);
             o << "(";
     }
     
     for (size_t i = 0; i < num_parameters(); i++) {
-        parameter(i)->dump();
+        parameter(i)->stream(o);
         if (i+1 < num_parameters()) o << ", ";
     }
     if (declarator()!=nullptr) o<<")";
     return o << ")";
 }
 
-std::ostream& PointerDeclarator::stream(std::ostream& o) const {
+PrettyPrinter& PointerDeclarator::stream(PrettyPrinter& o) const {
     o << "(*";
     if (declarator() != nullptr){
-        declarator()->dump();
+        declarator()->stream(o);
     }
     return o<<")";
 }
@@ -558,39 +764,41 @@ std::ostream& PointerDeclarator::stream(std::ostream& o) const {
 //! ================= Base Stuff ====================
 //! =================================================
 
-std::ostream& SpecifierDeclarator::stream(std::ostream& o) const {
-    specifier()->dump();
+PrettyPrinter& SpecifierDeclarator::stream(PrettyPrinter& o) const {
+    if (isTypedef()) o << "typedef ";
+    if (isInline()) o << "inline ";
+    specifier()->stream(o);
     if (declarator() != nullptr){
         o<<" ";
-        declarator()->dump();
+        declarator()->stream(o);
     } 
     return o;
 }
 
-std::ostream& ExternalDeclaration::stream(std::ostream& o) const {
+PrettyPrinter& ExternalDeclaration::stream(PrettyPrinter& o) const {
     if (!specifierDeclarator()) return o<<"error";
-    specifierDeclarator()->dump();
+    specifierDeclarator()->stream(o);
     if (functionBody() != nullptr){
         o<<"\n";
-        functionBody()->dump();
+        functionBody()->stream(o);
     } else {
         o << ";";
     }
     return o;
 }
 
-std::ostream& TranslationUnit::stream(std::ostream& o) const {
+PrettyPrinter& TranslationUnit::stream(PrettyPrinter& o) const {
     
     for (size_t i = 0; i < num_ext_declarations(); i++) {
-        external_declaration(i)->dump();
-        newIndent();
-        if (i+1<num_ext_declarations()) newIndent();
+        external_declaration(i)->stream(o);
+        o.newline();
+        if (i+1<num_ext_declarations()) o.newline();
     }        
     return o;
 }
 
-std::ostream& Declaration::stream(std::ostream& o) const {
-    specifierDeclarator()->dump();    
+PrettyPrinter& Declaration::stream(PrettyPrinter& o) const {
+    specifierDeclarator()->stream(o);    
     return o<<";";
 }
 
@@ -601,98 +809,94 @@ std::ostream& Declaration::stream(std::ostream& o) const {
 //! ================ Statements =====================
 //! =================================================
 
-std::ostream& ExpressionStmt::stream(std::ostream& o) const {
-    exp()->dump();
+PrettyPrinter& ExpressionStmt::stream(PrettyPrinter& o) const {
+    exp()->stream(o);
     return o<<";";
 }
 
-std::ostream& EmptyReturnStmt::stream(std::ostream& o) const {
+PrettyPrinter& EmptyReturnStmt::stream(PrettyPrinter& o) const {
     return o<<"return;";
 }
 
-std::ostream& ReturnStmt::stream(std::ostream& o) const {
+PrettyPrinter& ReturnStmt::stream(PrettyPrinter& o) const {
     o << "return ";
-    exp()->dump();
+    exp()->stream(o);
     return o<<";";
 }
 
-std::ostream& GoToStmt::stream(std::ostream& o) const {
+PrettyPrinter& GoToStmt::stream(PrettyPrinter& o) const {
     return o << "goto " << gotoLabel() << ";";
 }
 
-std::ostream& BreakStmt::stream(std::ostream& o) const {
+PrettyPrinter& BreakStmt::stream(PrettyPrinter& o) const {
     return o<<"break;";
 }
 
-std::ostream& ContinueStmt::stream(std::ostream& o) const {
+PrettyPrinter& ContinueStmt::stream(PrettyPrinter& o) const {
     return o<<"continue;";
 }
 
-std::ostream& WhileStmt::stream(std::ostream& o) const {
+PrettyPrinter& WhileStmt::stream(PrettyPrinter& o) const {
     o<<"while (";
-    condition()->dump();
+    condition()->stream(o);
     o<<")";
     if (dynamic_cast<CompoundStmt*>(loop())) {
         o << " ";
-        loop()->dump();
+        loop()->stream(o);
     } else {
-        indentlvl++;
-        newIndentDumpStmt(loop());
-        indentlvl--;
+        newIndentDumpStmt(o, loop(), +1);
     }
     return o;
 }
 
-std::ostream& IfElseStmt::stream(std::ostream& o) const {
+PrettyPrinter& IfElseStmt::stream(PrettyPrinter& o) const {
     o<<"if (";
-    condition()->dump();
+    condition()->stream(o);
     o<<")";
     if (dynamic_cast<CompoundStmt*>(consequence())) {
         o << " ";
-        consequence()->dump();
+        consequence()->stream(o);
         o << " ";
     } else {
-        newIndentDumpStmt(consequence(), +1);
-        newIndent();
+        newIndentDumpStmt(o, consequence(), +1);
+        o.newline();
     }
     o<<"else";
     if (dynamic_cast<IfStmt*>(alternative()) || dynamic_cast<IfElseStmt*>(alternative()) || dynamic_cast<CompoundStmt*>(alternative())) {
         o<<" ";
-        alternative()->dump();
-    } else newIndentDumpStmt(alternative(), +1);
+        alternative()->stream(o);
+    } else newIndentDumpStmt(o, alternative(), +1);
     return o;
 }
 
-std::ostream& IfStmt::stream(std::ostream& o) const {
+PrettyPrinter& IfStmt::stream(PrettyPrinter& o) const {
     o<<"if (";
-    condition()->dump();
+    condition()->stream(o);
     o<<")";
-    if (dynamic_cast<CompoundStmt*>(consequence())) consequence()->dump();
-    else newIndentDumpStmt(consequence(), +1);
+    if (dynamic_cast<CompoundStmt*>(consequence())) consequence()->stream(o);
+    else newIndentDumpStmt(o, consequence(), +1);
     return o;
 }
 
-std::ostream& NullStmt::stream(std::ostream& o) const {
+PrettyPrinter& NullStmt::stream(PrettyPrinter& o) const {
     return o << ";";
 }
 
-std::ostream& CompoundStmt::stream(std::ostream& o) const {
+PrettyPrinter& CompoundStmt::stream(PrettyPrinter& o) const {
     o<<("{"); 
-    indentlvl++;
+    o.indent();
 
     for(size_t ind=0; ind<num_blockItems(); ind++) {
-        newIndentDumpBlockItem(blockItem(ind));
+        newIndentDumpBlockItem(o, blockItem(ind));
     }
-    indentlvl--; 
-    newIndent();
+    o.dedent(); 
+    o.newline();
     return o<<"}";
 }
 
-std::ostream& LabeledStmt::stream(std::ostream& o) const {
-    int oldIndentLvl = indentlvl;
+PrettyPrinter& LabeledStmt::stream(PrettyPrinter& o) const {
     o << labelString() << ":";
-    indentlvl = oldIndentLvl; 
-    newIndentDumpStmt(statement());
+    newIndentDumpStmt(o, statement());
     return o;
 }
 
@@ -701,76 +905,70 @@ std::ostream& LabeledStmt::stream(std::ostream& o) const {
 //! =================================================
 //! ================ Expressions ====================
 //! =================================================
-std::ostream& InfixExp::stream(std::ostream& o) const {
+PrettyPrinter& InfixExp::stream(PrettyPrinter& o) const {
     o << "(";
-    lhs()->dump();
+    lhs()->stream(o);
     o << " " << operation().str() << " ";
-    rhs()->dump();
+    rhs()->stream(o);
     o << ")";
     return o;
 }
 
-std::ostream& TernaryExp::stream(std::ostream& o) const {
+PrettyPrinter& TernaryExp::stream(PrettyPrinter& o) const {
     o << "(";
-    condition()->dump();
+    condition()->stream(o);
     o << " ? ";
-    consequence()->dump();
+    consequence()->stream(o);
     o << " : ";
-    alternative()->dump();
+    alternative()->stream(o);
     o << ")";
     return o;
 }
 
-std::ostream& PrefixExp::stream(std::ostream& o) const {
+PrettyPrinter& PrefixExp::stream(PrettyPrinter& o) const {
     o <<"(" << prefixString() ;
-    operand()->dump();
+    operand()->stream(o);
     return o<<")";
 }
 
-std::ostream& MemberAccessExp::stream(std::ostream& o) const {
+PrettyPrinter& MemberAccessExp::stream(PrettyPrinter& o) const {
     o << "(";
-    object()->dump();
+    object()->stream(o);
     return o << Tok::tag2str(operation()) << member_name() << ")";
 }
 
-std::ostream& ArrayExp::stream(std::ostream& o) const {
+PrettyPrinter& ArrayExp::stream(PrettyPrinter& o) const {
     o << "(";
-    object()->dump();
+    object()->stream(o);
     o << "[";
-    index()->dump();
+    index()->stream(o);
     return o << "]" << ")";
 }
 
-std::ostream& FuncCallExp::stream(std::ostream& o) const {
+PrettyPrinter& FuncCallExp::stream(PrettyPrinter& o) const {
     o<<("(");
-    func()->dump();
+    func()->stream(o);
     o<<"(";
-    size_t ind = 0;
-    if (num_parameters()>0){
-        //auto p = parameter(0);
-
-        do {
-            //auto p = parameter(ind);
-            parameter(ind)->dump();
-            ind++;
-        } while (ind < num_parameters() && o<<", ");
+    for (size_t ind = 0; ind < num_parameters(); ind++) {
+        parameter(ind)->stream(o);
+        if (ind+1 < num_parameters()) o << ", ";
     }
     return o<<"))";
 }
 
-std::ostream& SizeOfTypeExp::stream(std::ostream& o) const {
+PrettyPrinter& SizeOfTypeExp::stream(PrettyPrinter& o) const {
     return o << "(sizeof(" << typeString() << "))";
 }
 
-std::ostream& SizeOfUnaryExp::stream(std::ostream& o) const {
+PrettyPrinter& SizeOfUnaryExp::stream(PrettyPrinter& o) const {
     o << "(sizeof ";
-    exp()->dump();
+    exp()->stream(o);
     return o<<")";
 }
 
-std::ostream& PostfixExp::stream(std::ostream& o) const {
+PrettyPrinter& PostfixExp::stream(PrettyPrinter& o) const {
     o <<"(" ;
-    operand()->dump();
+    operand()->stream(o);
     return o<< postfixString() <<")";
 }
 
@@ -778,19 +976,19 @@ std::ostream& PostfixExp::stream(std::ostream& o) const {
 //! ============== Basic Expressions ================
 //! =================================================
 
-std::ostream& Identifier::stream(std::ostream& o) const {
+PrettyPrinter& Identifier::stream(PrettyPrinter& o) const {
     return o << name();
 }
 
-std::ostream& Integer::stream(std::ostream& o) const {
+PrettyPrinter& Integer::stream(PrettyPrinter& o) const {
     return o << value();
 }
 
-std::ostream& Character::stream(std::ostream& o) const {
+PrettyPrinter& Character::stream(PrettyPrinter& o) const {
     return o << value();
 }
 
-std::ostream& Literal::stream(std::ostream& o) const {
+PrettyPrinter& Literal::stream(PrettyPrinter& o) const {
     return o << value();
 }
 
@@ -798,15 +996,15 @@ std::ostream& Literal::stream(std::ostream& o) const {
 //! =================================================
 //! ============= Error Exp/Stmt/Decl ===============
 //! =================================================
-std::ostream& ErrExp::stream(std::ostream& o) const {
+PrettyPrinter& ErrExp::stream(PrettyPrinter& o) const {
     return o << "<errorExp>";
 }
 
-std::ostream& ErrStmt::stream(std::ostream& o) const {
+PrettyPrinter& ErrStmt::stream(PrettyPrinter& o) const {
     return o << "<errorStmt>";
 }
 
-std::ostream& ErrDecl::stream(std::ostream& o) const {
+PrettyPrinter& ErrDecl::stream(PrettyPrinter& o) const {
     return o << "<errorDecl>";
 }
 
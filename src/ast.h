@@ -5,11 +5,16 @@
 #include <memory>
 #include <ostream>
 #include <unordered_set>
+#include <unordered_map>
 #include <map>
 #include <vector>
 #include <iostream>
 
+#include "json_writer.h"
 #include "loc.h"
+#include "pretty_printer.h"
+#include "small_vector.h"
+#include "sym.h"
 #include "tok.h"
 
 namespace H {
@@ -17,6 +22,7 @@ namespace H {
 
 template<class T> using Ptr = std::unique_ptr<T>;
 template<class T> using Ptrs = std::vector<Ptr<T>>;
+template<class T, size_t N = 4> using SmallPtrs = SmallVector<Ptr<T>, N>;       // Child lists that are usually short
 
 template<class T, class... Args>
 Ptr<T> mk(Args&&... args) { return std::make_unique<T>(std::forward<Args>(args)...); }
@@ -30,9 +36,7 @@ class Specifier;
 class CompoundStmt;
 class SpecifierDeclarator;
 class LabeledStmt;
-
-inline std::map<std::string, LabeledStmt*> labels;
-
+class StructSpecifier;
 
 
 class Type {
@@ -45,6 +49,9 @@ class Type {
         bool isUnqualified() const { return true; }
         virtual bool isScalar() const = 0;
 
+        // Storage layout in bytes (x86-64 SysV); 0 for types without a size
+        virtual size_t size() const { return 0; }
+        virtual size_t align() const { return 1; }
 };
 
 // Scalar Types
@@ -66,6 +73,8 @@ class IntType: public ArithmeticType {
         {}
 
         std::string str() const { return "int";}
+        size_t size() const override { return 4; }
+        size_t align() const override { return 4; }
 };
 
 class CharType: public ArithmeticType {
@@ -75,6 +84,7 @@ class CharType: public ArithmeticType {
         {}
 
         std::string str() const { return "char";}
+        size_t size() const override { return 1; }
 };
 
 class PointerType: public Type {
@@ -88,6 +98,8 @@ class PointerType: public Type {
         Type* pointee() const { return pointee_; }
         bool isComplete() const override { return true; }
         bool isScalar() const override { return true; }
+        size_t size() const override { return 8; }
+        size_t align() const override { return 8; }
 
     private:
         Type* pointee_;
@@ -106,9 +118,15 @@ class StructType: public Type {
         bool isComplete() const override { return structComplete_; }
         void completed() { structComplete_ = true; }
         bool isScalar() const override { return false; }
+        size_t size() const override;
+        size_t align() const override;
+
+        StructSpecifier* definition() const { return definition_; }             // Specifier holding the member list; set by Sema
+        void setDefinition(StructSpecifier* definition) { definition_ = definition; completed(); }
 
     private:
         bool structComplete_ = false;
+        StructSpecifier* definition_ = nullptr;
 };
 
 class ArrayType: public Type {
@@ -186,8 +204,9 @@ class ASTNode {
 
         Loc loc() const { return loc_; }
 
-        void dump() const;
-        virtual std::ostream& stream(std::ostream& o) const = 0;
+        void dump(std::ostream& sink = std::cout) const;           ///< Pretty prints the subtree to @p sink.
+        virtual PrettyPrinter& stream(PrettyPrinter& o) const = 0;
+        virtual void json(JsonWriter& w) const = 0;
         void check(Sema&);
 
     private:
@@ -200,7 +219,8 @@ public:
         : ASTNode(loc)
     {}
 
-    virtual std::ostream& stream(std::ostream& o) const = 0;
+    virtual PrettyPrinter& stream(PrettyPrinter& o) const = 0;
+    virtual void json(JsonWriter& w) const = 0;
     virtual void check (Sema&) = 0;
 };
 
@@ -210,11 +230,33 @@ public:
         : ASTNode(loc)
     {}
 
-    virtual std::ostream& stream(std::ostream& o) const = 0;
-    virtual Type* check (Sema&) = 0;
+    virtual PrettyPrinter& stream(PrettyPrinter& o) const = 0;
+    virtual void json(JsonWriter& w) const = 0;
+
+    /// Types this expression exactly once and caches the result in @p type_.
+    /// Parents check each child once and afterwards only read @p type().
+    Type* check(Sema&);
+    Type* type() const { return type_; }
+    /// Number of expressions typed so far; @c --stats reports it to show that checking stays linear.
+    static size_t num_typechecks() { return num_typechecks_; }
 
+    /// Value of an integer constant expression, folded once during @p check().
+    bool isConstant() const { return constant_; }
+    int64_t constant() const { assert(constant_); return value_; }
+    void setConstant(int64_t value) { constant_ = true; value_ = value; }
 
-    Type* type_;
+protected:
+    virtual Type* typecheck(Sema&) = 0;              ///< Node-specific typing; only ever invoked through @p check().
+    virtual void fold() {}                          ///< Records the value via @p setConstant() if the node is an integer constant expression.
+
+private:
+    Type* type_ = nullptr;
+    bool constant_ = false;
+    int64_t value_ = 0;
+    static inline size_t num_typechecks_ = 0;
+#ifndef NDEBUG
+    int num_checks_ = 0;                            ///< Debug counter: every node is visited by @p check() exactly once.
+#endif
 };
 
 
@@ -238,10 +280,12 @@ class Specifier : public ASTNode {
         // Direct Getters
         std::string typeString() const { return tokType_.str(); }
 
-        Type* type() const { return type_.get(); }
+        virtual Type* type() const { return type_.get(); }
+        virtual Specifier* underlying() { return this; }                // Specifier behind typedef names
 
         // AST-Functions
-        virtual std::ostream& stream(std::ostream& o) const = 0;
+        virtual PrettyPrinter& stream(PrettyPrinter& o) const = 0;
+        virtual void json(JsonWriter& w) const = 0;
     
     private:
         Tok tokType_;
@@ -256,7 +300,8 @@ class PrimitiveSpecifier : public Specifier {                        // Class fo
         {}
 
         // AST-Functions
-        std::ostream& stream(std::ostream& o) const override;
+        PrettyPrinter& stream(PrettyPrinter& o) const override;
+        void json(JsonWriter& w) const override;
 };
 
 class StructSpecifier : public Specifier {                           // Class for handling the struct specifier
@@ -269,12 +314,12 @@ class StructSpecifier : public Specifier {                           // Class fo
             , structIdentifier_(structIdentifier)
             , declarationListSet_(false)
         {}
-        StructSpecifier(Loc loc, Tok type, Ptrs<SpecifierDeclarator>&& structDeclarationList)
+        StructSpecifier(Loc loc, Tok type, SmallPtrs<SpecifierDeclarator>&& structDeclarationList)
             : Specifier(loc, type)
             , structDeclarationList_(std::move(structDeclarationList))
             , declarationListSet_(true)
         {}
-        StructSpecifier(Loc loc, Tok type, Tok structIdentifier, Ptrs<SpecifierDeclarator>&& structDeclarationList)
+        StructSpecifier(Loc loc, Tok type, Tok structIdentifier, SmallPtrs<SpecifierDeclarator>&& structDeclarationList)
             : Specifier(loc, type)
             , structIdentifier_(structIdentifier)
             , structDeclarationList_(std::move(structDeclarationList))
@@ -286,17 +331,39 @@ class StructSpecifier : public Specifier {                           // Class fo
         std::string structIdentifierString() const { return structIdentifier_.str(); }
         bool declarationListSet() const {return declarationListSet_; }
 
-        const Ptrs<SpecifierDeclarator>& structDeclarationList() const { return structDeclarationList_; }
+        const SmallPtrs<SpecifierDeclarator>& structDeclarationList() const { return structDeclarationList_; }
         size_t num_structDeclarations() const { return structDeclarationList_.size(); }
         SpecifierDeclarator* structDeclaration(size_t i) const { return structDeclarationList_[i].get(); }
 
         // AST-Functions
-        std::ostream& stream(std::ostream& o) const override;
+        PrettyPrinter& stream(PrettyPrinter& o) const override;
+        void json(JsonWriter& w) const override;
 
     private: 
         Tok structIdentifier_;
-        Ptrs<SpecifierDeclarator> structDeclarationList_;
-        bool declarationListSet_;
+        SmallPtrs<SpecifierDeclarator> structDeclarationList_;
+        bool declarationListSet_ = false;
+};
+
+class TypeNameSpecifier : public Specifier {                         // Class for handling typedef names used as specifier
+    public:
+        TypeNameSpecifier(Loc loc, Tok name)
+            : Specifier(loc, name)
+        {}
+
+        // Direct Getters
+        SpecifierDeclarator* definition() const { return definition_; }  // Typedef declaration of the name; set by Sema
+        void setDefinition(SpecifierDeclarator* definition) { definition_ = definition; }
+
+        Type* type() const override;
+        Specifier* underlying() override;
+
+        // AST-Functions
+        PrettyPrinter& stream(PrettyPrinter& o) const override;
+        void json(JsonWriter& w) const override;
+
+    private:
+        SpecifierDeclarator* definition_ = nullptr;
 };
 
 
@@ -314,10 +381,11 @@ class Declarator : public ASTNode {
         // Direct Getters
         bool abstract() { return abstract_; }
         virtual std::string name() const = 0;
-        virtual const Ptrs<SpecifierDeclarator>& parameterList() const = 0;
+        virtual const SmallPtrs<SpecifierDeclarator>& parameterList() const = 0;
 
         // AST-Functions
-        virtual std::ostream& stream(std::ostream& o) const = 0;
+        virtual PrettyPrinter& stream(PrettyPrinter& o) const = 0;
+        virtual void json(JsonWriter& w) const = 0;
 
         virtual Type* type(Type* specifierType) const = 0;
 
@@ -335,11 +403,11 @@ class NamedDeclarator : public Declarator {
         // Direct Getters
         Tok identifier() const {return identifier_; }
         std::string name() const { return identifier_.str(); }
-        Ptrs<SpecifierDeclarator> Specifier_Declarator_ = std::move(Ptrs<SpecifierDeclarator>());
-        const Ptrs<SpecifierDeclarator>& parameterList() const {return Specifier_Declarator_; };
+        const SmallPtrs<SpecifierDeclarator>& parameterList() const { static const SmallPtrs<SpecifierDeclarator> none; return none; };
 
         // AST-Functions
-        std::ostream& stream(std::ostream& o) const;
+        PrettyPrinter& stream(PrettyPrinter& o) const;
+        void json(JsonWriter& w) const;
 
         Type* type(Type* specifierType) const override { return specifierType; }
 
@@ -350,7 +418,7 @@ class NamedDeclarator : public Declarator {
 
 class FunctionDeclarator : public Declarator {
     public:
-        FunctionDeclarator(Loc loc, Ptr<Declarator>&& declarator, Ptrs<SpecifierDeclarator>&& parameterList, bool abstract=false)
+        FunctionDeclarator(Loc loc, Ptr<Declarator>&& declarator, SmallPtrs<SpecifierDeclarator>&& parameterList, bool abstract=false)
             : Declarator(loc, abstract)
             , declarator_(std::move(declarator))
             , parameterList_(std::move(parameterList))
@@ -360,18 +428,22 @@ class FunctionDeclarator : public Declarator {
         Declarator* declarator() const { return declarator_.get(); }
         std::string name() const { if (declarator()!=nullptr) return declarator()->name(); else return "";}
 
-        const Ptrs<SpecifierDeclarator>& parameterList() const { return parameterList_; }
+        const SmallPtrs<SpecifierDeclarator>& parameterList() const { return parameterList_; }
         size_t num_parameters() const { return parameterList_.size(); }
         const SpecifierDeclarator* parameter(size_t i) const { return parameterList_[i].get(); }
 
         // AST-Functions
-        std::ostream& stream(std::ostream& o) const;
+        PrettyPrinter& stream(PrettyPrinter& o) const;
+        void json(JsonWriter& w) const;
 
-        Type* type(Type* specifierType) const override { return new FunctionType(declarator_->type(specifierType)); }        
+        Type* type(Type* specifierType) const override {                  // Declarators apply from the inside out
+            Type* function = new FunctionType(specifierType);
+            return declarator_ ? declarator_->type(function) : function;
+        }
 
     private: 
         Ptr<Declarator> declarator_;
-        Ptrs<SpecifierDeclarator> parameterList_;
+        SmallPtrs<SpecifierDeclarator> parameterList_;
 };
 
 class PointerDeclarator : public Declarator {
@@ -384,14 +456,15 @@ class PointerDeclarator : public Declarator {
         // Direct Getters
         Declarator* declarator() const { return declarator_.get(); }
         std::string name() const { if (declarator()!=nullptr) return declarator()->name(); else return "";}
-        const Ptrs<SpecifierDeclarator>& parameterList() const {return declarator()->parameterList(); };
+        const SmallPtrs<SpecifierDeclarator>& parameterList() const {return declarator()->parameterList(); };
 
         // AST-Functions
-        std::ostream& stream(std::ostream& o) const;
+        PrettyPrinter& stream(PrettyPrinter& o) const;
+        void json(JsonWriter& w) const;
 
         Type* type(Type* specifierType) const override {
-            if (declarator_ && declarator_->type(specifierType)) return new PointerType(declarator_->type(specifierType)); 
-            else return new ErrorType();
+            Type* pointer = new PointerType(specifierType);
+            return declarator_ ? declarator_->type(pointer) : pointer;
         }
 
     private: 
@@ -406,10 +479,12 @@ class PointerDeclarator : public Declarator {
 
 class SpecifierDeclarator : public ASTNode {
     public:
-        SpecifierDeclarator(Loc loc, Ptr<Specifier>&& specifier, Ptr<Declarator>&& declarator)
+        SpecifierDeclarator(Loc loc, Ptr<Specifier>&& specifier, Ptr<Declarator>&& declarator, bool isTypedef=false, bool isInline=false)
         : ASTNode(loc)
         , specifier_(std::move(specifier))
         , declarator_(std::move(declarator))
+        , isTypedef_(isTypedef)
+        , isInline_(isInline)
         {}
 
         SpecifierDeclarator(Loc loc, Ptr<Specifier>&& specifier)
@@ -420,20 +495,25 @@ class SpecifierDeclarator : public ASTNode {
         // Direct Getter
         Specifier* specifier() const { return specifier_.get(); }
         Declarator* declarator() const { return declarator_.get(); }
+        bool isTypedef() const { return isTypedef_; }                   // Declares a type name rather than an object or function
+        bool isInline() const { return isInline_; }                     // Asks for calls to the function to be inlined
 
         // Indirect Getter
         std::string name() const { if (declarator()!=nullptr) return declarator()->name(); else return "";}
         //Type* type() const { return specifier()->type();}
         Type* type() const { if(declarator()!=nullptr) return declarator()->type(specifier()->type()); else return specifier()->type(); }
         std::string typeString() const { return specifier()->typeString();}
-        const Ptrs<SpecifierDeclarator>& parameterList() {return declarator()->parameterList(); };
+        const SmallPtrs<SpecifierDeclarator>& parameterList() {return declarator()->parameterList(); };
 
         // AST-Functions
-        std::ostream& stream(std::ostream& o) const override;
+        PrettyPrinter& stream(PrettyPrinter& o) const override;
+        void json(JsonWriter& w) const override;
 
     private:
         Ptr<Specifier> specifier_;
         Ptr<Declarator> declarator_;
+        bool isTypedef_ = false;
+        bool isInline_ = false;
 };
 
 class ExternalDeclaration : public ASTNode {
@@ -458,8 +538,11 @@ class ExternalDeclaration : public ASTNode {
         Stmt* functionBody() const { return functionBody_.get(); }
 
         // AST-Functions
-        std::ostream& stream(std::ostream& o) const override;
+        PrettyPrinter& stream(PrettyPrinter& o) const override;
+        void json(JsonWriter& w) const override;
         void check(Sema&);
+        bool declare(Sema&);                                            // Global part of check(); false if nothing was declared
+        void checkBody(Sema&);                                          // Function body part of check()
 
     private:
         Ptr<SpecifierDeclarator> specifierDeclarator_;
@@ -480,7 +563,9 @@ class TranslationUnit : public ASTNode {
 
 
         // AST-Function
-        std::ostream& stream(std::ostream& o) const override;
+        PrettyPrinter& stream(PrettyPrinter& o) const override;
+        void json(JsonWriter& w) const override;
+        void jsonLines(JsonWriter& w) const;                            ///< One line per external declaration (NDJSON)
         void check(Sema&);
 
     private:
@@ -506,7 +591,8 @@ class Declaration : public Stmt {
         std::string typeString() { return specifierDeclarator()->typeString(); }
 
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
         void check(Sema& sema) override;
 
     private:
@@ -534,7 +620,8 @@ class ExpressionStmt : public Stmt {
         Exp* exp() const { return exp_.get(); }
 
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
         void check(Sema& sema) override;
 
     private:
@@ -547,7 +634,8 @@ class EmptyReturnStmt : public Stmt {
             : Stmt(loc)
         {}
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
         void check(Sema& sema) override;
 };
 
@@ -561,7 +649,8 @@ class ReturnStmt : public Stmt {
         Exp* exp() const { return exp_.get(); }
 
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
         void check(Sema& sema) override;
 
     private:
@@ -573,18 +662,26 @@ class GoToStmt : public Stmt {
         GoToStmt(Loc loc, Tok tok)
             : Stmt(loc)
             , tok_(tok)
+            , labelSym_(tok.str())
         {}
 
         // Direct Getter
         Tok tok() const { return tok_; }
         std::string gotoLabel() const { return tok_.str(); } 
+        Sym labelSym() const { return labelSym_; }
+
+        LabeledStmt* target() const { return target_; }              // Resolved by the function's LabelTable
+        void setTarget(LabeledStmt* target) { target_ = target; }
 
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
         void check(Sema& sema) override;
 
     private:
         Tok tok_;
+        Sym labelSym_;
+        LabeledStmt* target_ = nullptr;
 };
 
 class BreakStmt : public Stmt {
@@ -593,7 +690,8 @@ class BreakStmt : public Stmt {
             : Stmt(loc)
         {}
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
         void check(Sema& sema) override;
 };
 
@@ -603,7 +701,8 @@ class ContinueStmt : public Stmt {
             : Stmt(loc)
         {}
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
         void check(Sema& sema) override;
 };
 
@@ -619,7 +718,8 @@ class WhileStmt : public Stmt {
         Stmt* loop() const { return loop_.get(); }
         
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
         void check(Sema& sema) override;
 
     private:
@@ -641,7 +741,8 @@ class IfElseStmt : public Stmt {
         Stmt* alternative() const { return alternative_.get(); }
 
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
         void check(Sema& sema) override;
 
     private:
@@ -662,7 +763,8 @@ class IfStmt : public Stmt {
         Stmt* consequence() const { return consequence_.get(); }
 
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
         void check(Sema& sema) override;
 
     private:
@@ -676,27 +778,29 @@ class NullStmt : public Stmt {
             : Stmt(loc)
         {}
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
         void check(Sema& sema) override;
 };
 
 class CompoundStmt : public Stmt {
     public:
-        CompoundStmt(Loc loc, Ptrs<Stmt>&& blockItems)
+        CompoundStmt(Loc loc, SmallPtrs<Stmt>&& blockItems)
             : Stmt(loc)
             , blockItems_(std::move(blockItems))
         {}
 
-        const Ptrs<Stmt>& blockItems() const { return blockItems_; }
+        const SmallPtrs<Stmt>& blockItems() const { return blockItems_; }
         size_t num_blockItems() const { return blockItems_.size(); }
         Stmt* blockItem(size_t i) const { return blockItems_[i].get(); }
 
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
         void check(Sema& sema) override;
 
     private:
-        Ptrs<Stmt> blockItems_;
+        SmallPtrs<Stmt> blockItems_;
 };
 
 class LabeledStmt : public Stmt {
@@ -704,24 +808,23 @@ class LabeledStmt : public Stmt {
         LabeledStmt(Loc loc, Tok label, Ptr<Stmt>&& statement)
             : Stmt(loc)
             , label_(label)
+            , labelSym_(label.str())
             , statement_(std::move(statement))
-            
-        {
-            if (labels.find(label.str()) != labels.end()){
-                loc.err() << "Duplicate label '" << label.str() << "'!" << loc.endErr();
-            } else labels[label.str()] = this;
-        }
+        {}
 
         Stmt* statement() const { return statement_.get(); }
         Tok label() const { return label_; }
         std::string labelString() const { return label_.str(); }
+        Sym labelSym() const { return labelSym_; }
 
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
         void check(Sema& sema) override;
 
     private:
         Tok label_;
+        Sym labelSym_;
         Ptr<Stmt> statement_;
 };
 
@@ -743,8 +846,10 @@ class InfixExp : public Exp {
         
         
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
-        Type* check(Sema&) override;
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
+        Type* typecheck(Sema&) override;
+        void fold() override;
 
     private:
         Ptr<Exp> lhs_;
@@ -766,8 +871,10 @@ class TernaryExp : public Exp {
         Exp* alternative() const { return alternative_.get(); }
         
     // AST-Functions
-    std::ostream& stream(std::ostream&) const override; 
-    Type* check(Sema&) override;
+    PrettyPrinter& stream(PrettyPrinter&) const override; 
+    void json(JsonWriter& w) const override;
+    Type* typecheck(Sema&) override;
+    void fold() override;
 
     private:
         Ptr<Exp> condition_;
@@ -789,8 +896,10 @@ class PrefixExp : public Exp {
         Exp* operand() const { return operand_.get(); }
         
     // AST-Functions
-    std::ostream& stream(std::ostream&) const override; 
-    Type* check(Sema&) override;
+    PrettyPrinter& stream(PrettyPrinter&) const override; 
+    void json(JsonWriter& w) const override;
+    Type* typecheck(Sema&) override;
+    void fold() override;
 
     private:
         Tok prefix_;
@@ -812,8 +921,9 @@ class MemberAccessExp : public Exp {
         std::string member_name() const { return member_name_; }
         
     // AST-Functions
-    std::ostream& stream(std::ostream&) const override; 
-    Type* check(Sema&) override;
+    PrettyPrinter& stream(PrettyPrinter&) const override; 
+    void json(JsonWriter& w) const override;
+    Type* typecheck(Sema&) override;
 
     private:
         Tok::Tag operation_;
@@ -833,8 +943,9 @@ class ArrayExp : public Exp {
         Exp* index() const { return index_.get(); }
         
     // AST-Functions
-    std::ostream& stream(std::ostream&) const override; 
-    Type* check(Sema&) override;
+    PrettyPrinter& stream(PrettyPrinter&) const override; 
+    void json(JsonWriter& w) const override;
+    Type* typecheck(Sema&) override;
 
     private:
         Ptr<Exp> object_;
@@ -843,24 +954,25 @@ class ArrayExp : public Exp {
 
 class FuncCallExp : public Exp {
 public:
-    FuncCallExp(Loc loc, Ptr<Exp>&& func, Ptrs<Exp>&& parameters)
+    FuncCallExp(Loc loc, Ptr<Exp>&& func, SmallPtrs<Exp>&& parameters)
         : Exp(loc)
         , func_(std::move(func))
         , parameters_(std::move(parameters))
     {}
 
     Exp* func() const { return func_.get(); }
-    const Ptrs<Exp>& parameters() const { return parameters_; }
+    const SmallPtrs<Exp>& parameters() const { return parameters_; }
     size_t num_parameters() const { return parameters_.size(); }
     const Exp* parameter(size_t i) const { return parameters_[i].get(); }
 
     // AST-Functions
-    std::ostream& stream(std::ostream&) const override; 
-    Type* check(Sema&) override;
+    PrettyPrinter& stream(PrettyPrinter&) const override; 
+    void json(JsonWriter& w) const override;
+    Type* typecheck(Sema&) override;
 
 private:
     Ptr<Exp> func_;
-    Ptrs<Exp> parameters_;
+    SmallPtrs<Exp> parameters_;
 };
 
 class SizeOfTypeExp : public Exp {
@@ -872,13 +984,17 @@ public:
 
     Tok typeTok() const { return typeTok_; }
     std::string typeString() const {return typeTok_.str(); }
+    SpecifierDeclarator* definition() const { return definition_; }     // Typedef of a type name; set by typecheck()
 
     // AST-Functions
-    std::ostream& stream(std::ostream&) const override; 
-    Type* check(Sema&) override;
+    PrettyPrinter& stream(PrettyPrinter&) const override; 
+    void json(JsonWriter& w) const override;
+    Type* typecheck(Sema&) override;
+    void fold() override;
 
 private:
     Tok typeTok_;
+    SpecifierDeclarator* definition_ = nullptr;
 };
 
 class SizeOfUnaryExp : public Exp {
@@ -891,8 +1007,10 @@ public:
     Exp* exp() const { return exp_.get(); }
 
     // AST-Functions
-    std::ostream& stream(std::ostream&) const override; 
-    Type* check(Sema&) override;
+    PrettyPrinter& stream(PrettyPrinter&) const override; 
+    void json(JsonWriter& w) const override;
+    Type* typecheck(Sema&) override;
+    void fold() override;
 
 private:
     Ptr<Exp> exp_;
@@ -912,8 +1030,9 @@ class PostfixExp : public Exp {
         Exp* operand() const { return operand_.get(); }
         
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
-        Type* check(Sema&) override;
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
+        Type* typecheck(Sema&) override;
 
     private:
         Tok postfix_;
@@ -939,8 +1058,9 @@ class Identifier : public Exp {
         void setSpecifierDeclarator(SpecifierDeclarator* ptr_specifierDeclarator) {specifierDeclarator_ = ptr_specifierDeclarator;}
 
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
-        Type* check(Sema&);
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
+        Type* typecheck(Sema&) override;
 
     private:
         std::string name_;
@@ -949,19 +1069,21 @@ class Identifier : public Exp {
 
 class Integer : public Exp {
     public:
-        Integer(Loc loc, int value)
+        Integer(Loc loc, uint64_t value)
             : Exp(loc)
             , value_(value)
         {}
 
-        int value() const { return value_; }
+        uint64_t value() const { return value_; }
         
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
-        Type* check(Sema&);
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
+        Type* typecheck(Sema&) override;
+        void fold() override;
 
     private:
-        int value_;
+        uint64_t value_;
 };
 
 class Character : public Exp {
@@ -974,8 +1096,10 @@ class Character : public Exp {
         std::string value() const { return value_; }
         
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
-        Type* check(Sema&);
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
+        Type* typecheck(Sema&) override;
+        void fold() override;
 
     private:
         std::string value_;
@@ -992,8 +1116,9 @@ class Literal : public Exp {
         std::string value() const { return value_; }
         
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
-        Type* check(Sema&);
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
+        Type* typecheck(Sema&) override;
 
     private:
         std::string value_;
@@ -1009,8 +1134,9 @@ class ErrExp : public Exp {
             : Exp(loc)
         {}
 
-        std::ostream& stream(std::ostream& o) const override;
-        Type* check(Sema& sema) override;
+        PrettyPrinter& stream(PrettyPrinter& o) const override;
+        void json(JsonWriter& w) const override;
+        Type* typecheck(Sema& sema) override;
 
     private:
         std::string name_;
@@ -1023,7 +1149,8 @@ class ErrStmt : public Stmt {
         {}
 
         // AST-Functions
-        std::ostream& stream(std::ostream&) const override; 
+        PrettyPrinter& stream(PrettyPrinter&) const override; 
+        void json(JsonWriter& w) const override;
         void check(Sema& sema) override;
 
     private:
@@ -1036,7 +1163,8 @@ class ErrDecl : public ExternalDeclaration {
             : ExternalDeclaration(loc)
         {}
 
-        std::ostream& stream(std::ostream& o) const override;
+        PrettyPrinter& stream(PrettyPrinter& o) const override;
+        void json(JsonWriter& w) const override;
 };
 
 
@@ -1046,6 +1174,38 @@ class ErrDecl : public ExternalDeclaration {
 //! ============= Semantic Analysis =================
 //! =================================================
 
+class LabelTable {                                                      // Labels of the function body currently being checked
+    public:
+        void define(LabeledStmt* labeledStmt) {
+            auto inserted = labels_.emplace(labeledStmt->labelSym(), labeledStmt);
+            if (!inserted.second) labeledStmt->loc().err() << "Duplicate label '" << labeledStmt->labelString() << "'!" << labeledStmt->loc().endErr();
+        }
+
+        void use(GoToStmt* gotoStmt) {
+            auto it = labels_.find(gotoStmt->labelSym());
+            if (it != labels_.end()) gotoStmt->setTarget(it->second);
+            else fixups_.push_back(gotoStmt);                          // Forward goto: resolved at the end of the function
+        }
+
+        void resolve() {
+            for (auto gotoStmt : fixups_) {
+                auto it = labels_.find(gotoStmt->labelSym());
+                if (it != labels_.end()) gotoStmt->setTarget(it->second);
+                else gotoStmt->loc().err() << "Label " << gotoStmt->gotoLabel() << " not declared!" << gotoStmt->loc().endErr();
+            }
+            fixups_.clear();
+        }
+
+        LabeledStmt* lookup(Sym name) const {
+            auto it = labels_.find(name);
+            return it != labels_.end() ? it->second : nullptr;
+        }
+
+    private:
+        std::unordered_map<Sym, LabeledStmt*> labels_;
+        std::vector<GoToStmt*> fixups_;
+};
+
 class Sema {
     public:
         Sema(){
@@ -1057,6 +1217,9 @@ class Sema {
             std::string name = specifierDeclarator->name();
             //Type* type = specifierDeclarator->type();
 
+            resolveTypeNames(specifierDeclarator);
+            resolveStruct(specifierDeclarator->specifier());
+
             if (lookup(name, true) != nullptr) {
                 specifierDeclarator->declarator()->loc().err() << "Redeclaration of variable '" << name << "'!" << specifierDeclarator->declarator()->loc().endErr();     // TODO: How to emit error??
                 return;
@@ -1075,10 +1238,12 @@ class Sema {
         void push() { 
             hashmaps_.emplace_back(std::map<std::string, SpecifierDeclarator*>()); 
             struct_definitions_.emplace_back(std::map<std::string, std::map<std::string, SpecifierDeclarator*>>());
+            struct_specifiers_.emplace_back(std::map<std::string, StructSpecifier*>());
         }
         void pop() { 
             hashmaps_.pop_back(); 
             struct_definitions_.pop_back();
+            struct_specifiers_.pop_back();
         }
 
         SpecifierDeclarator* lookup(std::string name, bool checkCurrentLvl = false) {
@@ -1090,10 +1255,8 @@ class Sema {
             return nullptr;                                                 // TODO: Maybe this is not a good idea ...
         }
         
-        LabeledStmt* lookupLabel(std::string name){
-            if (labels.find(name) != labels.end()) return labels[name];
-            else return nullptr;
-        }
+        LabelTable* labels() const { return labels_; }
+        void setLabels(LabelTable* labels) { labels_ = labels; }
 
         std::map<std::string, SpecifierDeclarator*> lookupStruct(std::string name) {
             for (size_t i = struct_definitions_.size()-1; i<=struct_definitions_.size()-1; i--)
@@ -1142,14 +1305,58 @@ class Sema {
                     continue;
                 }
                 //Type* member_type = member->type();
+                resolveTypeNames(member);
                 structDefinition.insert(std::pair<std::string,SpecifierDeclarator*>(member_name,member));
             }
 
             //if (structDefinition.size() == 0) structSpecif->structIdentifier().loc().err() << "Struct '"<< name <<"' has no members!" << structSpecif->structIdentifier().loc().endErr();
             
             struct_definitions_.back().insert(std::pair<std::string, std::map<std::string, SpecifierDeclarator*>>(name, structDefinition));
+            struct_specifiers_.back().insert(std::pair<std::string, StructSpecifier*>(name, structSpecif));
+
+            resolveStruct(structSpecif);
+            for (size_t i = 0; i < structSpecif->num_structDeclarations(); i++) resolveStruct(structSpecif->structDeclaration(i)->specifier());
         }
 
+        StructSpecifier* lookupStructSpecifier(std::string name) {
+            for (size_t i = struct_specifiers_.size()-1; i<=struct_specifiers_.size()-1; i--)
+            {
+                if (struct_specifiers_[i].find(name) != struct_specifiers_[i].end()) return struct_specifiers_[i][name];
+            }
+            return nullptr;
+        }
+
+        void resolveStruct(Specifier* specifier) {                     // Link the StructType of a struct specifier to its member list (for layout and completeness)
+            auto structSpecif = dynamic_cast<StructSpecifier*>(specifier);
+            if (structSpecif == nullptr) return;
+            StructSpecifier* definition = structSpecif->declarationListSet() ? structSpecif : lookupStructSpecifier(structSpecif->structIdentifierString());
+            if (definition != nullptr) static_cast<StructType*>(structSpecif->type())->setDefinition(definition);
+        }
+
+
+        void resolveTypeNames(SpecifierDeclarator* specifierDeclarator) {  // Link the typedef names in a declaration and its parameters to their typedefs
+            auto typeName = dynamic_cast<TypeNameSpecifier*>(specifierDeclarator->specifier());
+            if (typeName != nullptr) {                                      // Always look up again: a kept AST may be checked against new typedefs
+                SpecifierDeclarator* definition = lookup(typeName->typeString());
+                if (definition != nullptr && definition->isTypedef()) {
+                    typeName->setDefinition(definition);
+                } else {
+                    typeName->setDefinition(nullptr);
+                    typeName->loc().err() << "Unknown type name '" << typeName->typeString() << "'!" << typeName->loc().endErr();
+                }
+            }
+
+            for (Declarator* declarator = specifierDeclarator->declarator(); declarator != nullptr; ) {
+                if (auto function = dynamic_cast<FunctionDeclarator*>(declarator)) {
+                    for (auto& param : function->parameterList()) resolveTypeNames(param.get());
+                    declarator = function->declarator();
+                } else if (auto pointer = dynamic_cast<PointerDeclarator*>(declarator)) {
+                    declarator = pointer->declarator();
+                } else {
+                    break;
+                }
+            }
+        }
 
         Type* error_type() { return new ErrorType(); }
 
@@ -1167,8 +1374,10 @@ class Sema {
     private:
         std::vector<std::map<std::string, SpecifierDeclarator*>> hashmaps_;         // List of Hashmaps with <key=name | value=pointer to declaration>
         std::vector<std::map<std::string, std::map<std::string, SpecifierDeclarator*>>> struct_definitions_;
+        std::vector<std::map<std::string, StructSpecifier*>> struct_specifiers_;
         ExternalDeclaration* external_declaration_ = nullptr;
         WhileStmt* loop_ = nullptr;
+        LabelTable* labels_ = nullptr;
 
 };
 
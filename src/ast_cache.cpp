@@ -0,0 +1,373 @@
+#include "ast_cache.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace H {
+
+//! =================================================
+//! =============== AST Recording ===================
+//! =================================================
+
+uint32_t AstRecord::intern(const std::string& str) {
+    auto [it, inserted] = offsets_.emplace(str, uint32_t(strings.size()));
+    if (inserted) {
+        uint32_t size = str.size();
+        strings.append(reinterpret_cast<const char*>(&size), sizeof(size));
+        strings.append(str);
+    }
+    return it->second;
+}
+
+std::string AstRecord::string(uint32_t offset) const {
+    uint32_t size;
+    std::memcpy(&size, strings.data() + offset, sizeof(size));
+    return strings.substr(offset + sizeof(size), size);
+}
+
+void AstRecord::addTok(const Tok& tok) {
+    auto loc = tok.loc();
+    toks.push_back({tok.value(), {{loc.begin.row, loc.begin.col}, {loc.finish.row, loc.finish.col}}, intern(tok.str()), intern(tok.token_type()), uint32_t(tok.tag()), 0});
+}
+
+
+//! =================================================
+//! =================== Replay ======================
+//! =================================================
+
+namespace {
+    constexpr size_t num_kinds = 0
+        #define CODE(k, str) + 1
+            H_AST(CODE)
+        #undef CODE
+        ;
+
+    constexpr uint32_t num_tags = 0
+        #define CODE(t, str) + 1
+            H_KEY(CODE)
+            H_LIT(CODE)
+            H_TOK(CODE)
+        #undef CODE
+        #define CODE(t, str, prec_l, prec_r) + 1
+            H_OP(CODE)
+        #undef CODE
+        ;
+
+    struct Malformed {};
+
+    /// Feeds the recorded builder calls back into an @p AstBuilder with a node stack.
+    class Replayer {
+        public:
+            Replayer(const char* file, const CacheTok* toks, size_t num_toks, const char* strings, size_t strings_size)
+                : file_(file)
+                , toks_(toks)
+                , num_toks_(num_toks)
+                , strings_(strings)
+                , strings_size_(strings_size)
+            {}
+
+            void node(const CacheNode& n) {
+                if (n.kind >= num_kinds || size_t(n.tok) + n.num_toks > num_toks_) throw Malformed();
+                Loc loc = this->loc(n.loc);
+                bool first = n.present & 1, second = n.present & 2, third = n.present & 4;
+
+                switch (NodeKind(n.kind)) {
+                    case NodeKind::TranslationUnit: return push(builder_.translation_unit(loc, popList<Ptrs<ExternalDeclaration>>(n.count)));
+                    case NodeKind::ExternalDeclaration: {
+                        auto body = pop<Stmt>(second);
+                        auto specDecl = pop<SpecifierDeclarator>(first);
+                        if (second) return push(builder_.function_definition(loc, std::move(specDecl), std::move(body)));
+                        return push(builder_.external_declaration(loc, std::move(specDecl)));
+                    }
+                    case NodeKind::ErrDecl: return push(builder_.err_decl(loc));
+                    case NodeKind::SpecifierDeclarator:
+                    case NodeKind::TypedefDeclarator:
+                    case NodeKind::InlineDeclarator: {
+                        auto declarator = pop<Declarator>(second);
+                        auto specifier = pop<Specifier>(first);
+                        if (NodeKind(n.kind) == NodeKind::TypedefDeclarator) return push(builder_.typedef_declarator(loc, std::move(specifier), std::move(declarator)));
+                        if (NodeKind(n.kind) == NodeKind::InlineDeclarator) return push(builder_.inline_declarator(loc, std::move(specifier), std::move(declarator)));
+                        return push(builder_.specifier_declarator(loc, std::move(specifier), std::move(declarator)));
+                    }
+                    case NodeKind::PrimitiveSpecifier: return push(builder_.primitive_specifier(loc, tok(n, 0)));
+                    case NodeKind::StructSpecifier: {
+                        if (!second) {
+                            if (first) return push(builder_.struct_specifier(loc, tok(n, 0), tok(n, 1)));
+                            return push(builder_.struct_specifier(loc, tok(n, 0)));
+                        }
+                        auto members = popList<SmallPtrs<SpecifierDeclarator>>(n.count);
+                        if (first) return push(builder_.struct_specifier(loc, tok(n, 0), tok(n, 1), std::move(members)));
+                        return push(builder_.struct_specifier(loc, tok(n, 0), std::move(members)));
+                    }
+                    case NodeKind::TypeNameSpecifier: return push(builder_.type_name_specifier(loc, tok(n, 0)));
+                    case NodeKind::NamedDeclarator: return push(builder_.named_declarator(loc, tok(n, 0)));
+                    case NodeKind::FunctionDeclarator: {
+                        auto params = popList<SmallPtrs<SpecifierDeclarator>>(n.count);
+                        auto declarator = pop<Declarator>(first);
+                        return push(builder_.function_declarator(loc, std::move(declarator), std::move(params)));
+                    }
+                    case NodeKind::PointerDeclarator: return push(builder_.pointer_declarator(loc, pop<Declarator>(first)));
+
+                    case NodeKind::Declaration: return push(builder_.declaration(loc, pop<SpecifierDeclarator>(first)));
+                    case NodeKind::ExpressionStmt: return push(builder_.expression_stmt(loc, pop<Exp>(first)));
+                    case NodeKind::EmptyReturnStmt: return push(builder_.empty_return_stmt(loc));
+                    case NodeKind::ReturnStmt: return push(builder_.return_stmt(loc, pop<Exp>(first)));
+                    case NodeKind::GoToStmt: return push(builder_.goto_stmt(loc, tok(n, 0)));
+                    case NodeKind::BreakStmt: return push(builder_.break_stmt(loc));
+                    case NodeKind::ContinueStmt: return push(builder_.continue_stmt(loc));
+                    case NodeKind::WhileStmt: {
+                        auto loop = pop<Stmt>(second);
+                        auto condition = pop<Exp>(first);
+                        return push(builder_.while_stmt(loc, std::move(condition), std::move(loop)));
+                    }
+                    case NodeKind::IfElseStmt: {
+                        auto alternative = pop<Stmt>(third);
+                        auto consequence = pop<Stmt>(second);
+                        auto condition = pop<Exp>(first);
+                        return push(builder_.if_else_stmt(loc, std::move(condition), std::move(consequence), std::move(alternative)));
+                    }
+                    case NodeKind::IfStmt: {
+                        auto consequence = pop<Stmt>(second);
+                        auto condition = pop<Exp>(first);
+                        return push(builder_.if_stmt(loc, std::move(condition), std::move(consequence)));
+                    }
+                    case NodeKind::NullStmt: return push(builder_.null_stmt(loc));
+                    case NodeKind::CompoundStmt: return push(builder_.compound_stmt(loc, popList<SmallPtrs<Stmt>>(n.count)));
+                    case NodeKind::LabeledStmt: return push(builder_.labeled_stmt(loc, tok(n, 0), pop<Stmt>(first)));
+                    case NodeKind::ErrStmt: return push(builder_.err_stmt(loc));
+
+                    case NodeKind::InfixExp: {
+                        auto rhs = pop<Exp>(second);
+                        auto lhs = pop<Exp>(first);
+                        return push(builder_.infix_exp(loc, std::move(lhs), tok(n, 0), std::move(rhs)));
+                    }
+                    case NodeKind::TernaryExp: {
+                        auto alternative = pop<Exp>(third);
+                        auto consequence = pop<Exp>(second);
+                        auto condition = pop<Exp>(first);
+                        return push(builder_.ternary_exp(loc, std::move(condition), std::move(consequence), std::move(alternative)));
+                    }
+                    case NodeKind::PrefixExp: return push(builder_.prefix_exp(loc, tok(n, 0), pop<Exp>(first)));
+                    case NodeKind::MemberAccessExp: {
+                        if (n.count >= num_tags) throw Malformed();
+                        return push(builder_.member_access_exp(loc, Tok::Tag(n.count), pop<Exp>(first), tok(n, 0)));
+                    }
+                    case NodeKind::ArrayExp: {
+                        auto index = pop<Exp>(second);
+                        auto object = pop<Exp>(first);
+                        return push(builder_.array_exp(loc, std::move(object), std::move(index)));
+                    }
+                    case NodeKind::FuncCallExp: {
+                        auto args = popList<SmallPtrs<Exp>>(n.count);
+                        auto func = pop<Exp>(first);
+                        return push(builder_.func_call_exp(loc, std::move(func), std::move(args)));
+                    }
+                    case NodeKind::SizeOfTypeExp: return push(builder_.sizeof_type_exp(loc, tok(n, 0)));
+                    case NodeKind::SizeOfUnaryExp: return push(builder_.sizeof_unary_exp(loc, pop<Exp>(first)));
+                    case NodeKind::PostfixExp: return push(builder_.postfix_exp(loc, pop<Exp>(first), tok(n, 0)));
+                    case NodeKind::Identifier: return push(builder_.identifier(loc, tok(n, 0)));
+                    case NodeKind::Integer: return push(builder_.integer(loc, tok(n, 0)));
+                    case NodeKind::Character: return push(builder_.character(loc, tok(n, 0)));
+                    case NodeKind::Literal: return push(builder_.literal(loc, tok(n, 0)));
+                    case NodeKind::ErrExp: return push(builder_.err_exp(loc));
+                }
+                throw Malformed();
+            }
+
+            Ptr<TranslationUnit> finish() {
+                if (stack_.size() != 1) throw Malformed();
+                return pop<TranslationUnit>(true);
+            }
+
+        private:
+            template<class T>
+            void push(Ptr<T>&& node) { stack_.emplace_back(std::move(node)); }
+
+            /// Pops the top node, which must be a @p T, if the child is @p present.
+            template<class T>
+            Ptr<T> pop(bool present) {
+                if (!present) return nullptr;
+                if (stack_.empty()) throw Malformed();
+                auto node = dynamic_cast<T*>(stack_.back().get());
+                if (node == nullptr) throw Malformed();
+                stack_.back().release();
+                stack_.pop_back();
+                return Ptr<T>(node);
+            }
+
+            /// Pops the top @p size nodes in their original order.
+            template<class List>
+            List popList(size_t size) {
+                using T = typename List::value_type::element_type;
+                if (size > stack_.size()) throw Malformed();
+                List list;
+                size_t first = stack_.size() - size;
+                for (size_t i = first; i != stack_.size(); ++i) {
+                    auto node = dynamic_cast<T*>(stack_[i].get());
+                    if (node == nullptr) throw Malformed();
+                    stack_[i].release();
+                    list.emplace_back(node);
+                }
+                stack_.resize(first);
+                return list;
+            }
+
+            Loc loc(const CacheLoc& l) const { return {file_, {l.begin.row, l.begin.col}, {l.finish.row, l.finish.col}}; }
+
+            Tok tok(const CacheNode& n, size_t i) const {
+                Tok result;
+                if (i >= n.num_toks || !readTok(toks_[n.tok + i], file_, strings_, strings_size_, result)) throw Malformed();
+                return result;
+            }
+
+            const char* file_;
+            const CacheTok* toks_;
+            size_t num_toks_;
+            const char* strings_;
+            size_t strings_size_;
+            AstBuilder builder_;
+            std::vector<Ptr<ASTNode>> stack_;
+    };
+}
+
+Ptr<TranslationUnit> AstCache::replay(const char* file, const CacheNode* nodes, size_t num_nodes, const CacheTok* toks, size_t num_toks, const char* strings, size_t strings_size) {
+    try {
+        Replayer replayer(file, toks, num_toks, strings, strings_size);
+        for (size_t i = 0; i != num_nodes; ++i) replayer.node(nodes[i]);
+        return replayer.finish();
+    } catch (const Malformed&) {
+        return nullptr;
+    }
+}
+
+
+//! =================================================
+//! ================= AST Cache =====================
+//! =================================================
+
+AstCache::AstCache(std::string dir)
+    : dir_(std::move(dir))
+{
+    mkdir(dir_.c_str(), 0755);                                          // Fails harmlessly if it already exists
+}
+
+uint64_t AstCache::hash(const char* data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i != size; ++i) {
+        hash ^= (unsigned char) data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+std::string AstCache::path(uint64_t key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.hast", (unsigned long long) key);
+    return dir_ + "/" + name;
+}
+
+Ptr<TranslationUnit> AstCache::load(const char* file, uint64_t key) const {
+    MappedFile map(path(key));
+    if (!map || map.size() < sizeof(CacheHeader)) return nullptr;
+
+    auto base = map.data();
+    auto header = reinterpret_cast<const CacheHeader*>(base);
+    size_t deps_size = header->num_deps * sizeof(CacheDep);
+    size_t nodes_size = header->num_nodes * sizeof(CacheNode);
+    size_t toks_size = header->num_toks * sizeof(CacheTok);
+    if (std::memcmp(header->magic, "HAST", 4) != 0 || header->version != version || header->key != key
+            || header->num_deps > map.size() || header->num_nodes > map.size() || header->num_toks > map.size()
+            || header->strings_size > map.size()
+            || sizeof(CacheHeader) + deps_size + nodes_size + toks_size + header->strings_size != map.size())
+        return nullptr;
+
+    auto deps = reinterpret_cast<const CacheDep*>(base + sizeof(CacheHeader));
+    auto nodes = reinterpret_cast<const CacheNode*>(base + sizeof(CacheHeader) + deps_size);
+    auto toks = reinterpret_cast<const CacheTok*>(base + sizeof(CacheHeader) + deps_size + nodes_size);
+    auto strings = base + sizeof(CacheHeader) + deps_size + nodes_size + toks_size;
+
+    // A header that is gone or reads differently makes the entry stale
+    for (size_t i = 0; i != header->num_deps; ++i) {
+        std::string included;
+        if (!readString(strings, header->strings_size, deps[i].path, included)) return nullptr;
+        MappedFile text(included);
+        if (!text && access(included.c_str(), R_OK) != 0) return nullptr;
+        if (hash(text.data(), text.size()) != deps[i].hash) return nullptr;
+    }
+    return replay(file, nodes, header->num_nodes, toks, header->num_toks, strings, header->strings_size);
+}
+
+void AstCache::store(uint64_t key, AstRecord& record, const std::vector<Dependency>& dependencies) const {
+    std::vector<CacheDep> deps;
+    for (auto& dependency : dependencies) deps.push_back({record.intern(dependency.path), 0, dependency.hash});
+    CacheHeader header = {{'H', 'A', 'S', 'T'}, version, key, deps.size(), record.nodes.size(), record.toks.size(), record.strings.size()};
+    std::string head(reinterpret_cast<const char*>(&header), sizeof(header));
+    head.append(reinterpret_cast<const char*>(deps.data()), deps.size() * sizeof(CacheDep));
+    writeRecord(path(key), head.data(), head.size(), record);
+}
+
+
+//! =================================================
+//! ================== File I/O =====================
+//! =================================================
+
+bool readString(const char* strings, size_t size, uint32_t offset, std::string& result) {
+    uint32_t length;
+    if (size_t(offset) + sizeof(length) > size) return false;
+    std::memcpy(&length, strings + offset, sizeof(length));
+    if (size_t(offset) + sizeof(length) + length > size) return false;
+    result.assign(strings + offset + sizeof(length), length);
+    return true;
+}
+
+bool readTok(const CacheTok& tok, const char* file, const char* strings, size_t size, Tok& result) {
+    std::string str, token_type;
+    if (tok.tag >= num_tags || !readString(strings, size, tok.str, str) || !readString(strings, size, tok.token_type, token_type))
+        return false;
+    Loc loc = {file, {tok.loc.begin.row, tok.loc.begin.col}, {tok.loc.finish.row, tok.loc.finish.col}};
+    result = Tok(loc, Tok::Tag(tok.tag), str, token_type, tok.value);
+    return true;
+}
+
+bool writeRecord(const std::string& target, const void* header, size_t header_size, const AstRecord& record) {
+    // Write to a private file first so concurrent runs never map a half-written file
+    std::string tmp = target + "." + std::to_string(getpid());
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (f == nullptr) return false;
+    bool ok = std::fwrite(header, header_size, 1, f) == 1
+        && std::fwrite(record.nodes.data(), sizeof(CacheNode), record.nodes.size(), f) == record.nodes.size()
+        && std::fwrite(record.toks.data(), sizeof(CacheTok), record.toks.size(), f) == record.toks.size()
+        && std::fwrite(record.strings.data(), 1, record.strings.size(), f) == record.strings.size();
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok || std::rename(tmp.c_str(), target.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            data_ = static_cast<const char*>(map);
+            size_ = st.st_size;
+        }
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) munmap(const_cast<char*>(data_), size_);
+}
+
+}
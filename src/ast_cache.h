@@ -0,0 +1,246 @@
+#ifndef PROG_AST_CACHE_H
+#define PROG_AST_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "builder.h"
+
+namespace H {
+
+//! =================================================
+//! ============== Cache File Format ================
+//! =================================================
+//
+// A cache file holds the builder calls of one error-free parse in post-order, after the headers the parse included:
+//
+//     CacheHeader | CacheDep[num_deps] | CacheNode[num_nodes] | CacheTok[num_toks] | strings
+//
+// Everything is addressed by index or byte offset, so the file can be mapped anywhere.
+// Strings are stored as a 32-bit length followed by the characters.
+
+struct CachePos {
+    int32_t row;
+    int32_t col;
+};
+
+struct CacheLoc {
+    CachePos begin;
+    CachePos finish;
+};
+
+struct CacheHeader {
+    char magic[4];                                                      // "HAST"
+    uint32_t version;
+    uint64_t key;                                                       // Content hash of the source
+    uint64_t num_deps;
+    uint64_t num_nodes;
+    uint64_t num_toks;
+    uint64_t strings_size;
+};
+
+struct CacheDep {
+    uint32_t path;                                                      // Offset into the string table
+    uint32_t padding;
+    uint64_t hash;                                                      // Content hash of the file when it was included
+};
+
+struct CacheNode {
+    uint8_t kind;                                                       // NodeKind
+    uint8_t present;                                                    // Bit i is set if the i-th fixed child exists
+    uint16_t num_toks;
+    uint32_t count;                                                     // Length of the child list; the operator of a member access
+    uint32_t tok;                                                       // Index of the first token
+    CacheLoc loc;
+
+    /// Number of child nodes this node pops (struct specifiers use @p present for their tokens).
+    size_t arity() const {
+        size_t nodes = __builtin_popcount(present);
+        switch (NodeKind(kind)) {
+            case NodeKind::StructSpecifier: return count;
+            case NodeKind::MemberAccessExp: return nodes;
+            default: return nodes + count;
+        }
+    }
+};
+
+struct CacheTok {
+    uint64_t value;
+    CacheLoc loc;
+    uint32_t str;                                                       // Offsets into the string table
+    uint32_t token_type;
+    uint32_t tag;
+    uint32_t padding;
+};
+
+
+//! =================================================
+//! =============== AST Recording ===================
+//! =================================================
+
+/// In-memory image of a cache file.
+class AstRecord {
+    public:
+        std::vector<CacheNode> nodes;
+        std::vector<CacheTok> toks;
+        std::string strings;
+
+        /// Adds @p str to the string table (once) and returns its offset.
+        uint32_t intern(const std::string& str);
+
+        /// String at @p offset of the string table.
+        std::string string(uint32_t offset) const;
+
+        /// Adds @p tok to the token table.
+        void addTok(const Tok& tok);
+
+    private:
+        std::unordered_map<std::string, uint32_t> offsets_;
+};
+
+/// The string at @p offset of a mapped string table of @p size bytes; @c false if it does not fit.
+bool readString(const char* strings, size_t size, uint32_t offset, std::string& result);
+
+/// The token @p tok of a mapped file, located in @p file; @c false if it is malformed.
+bool readTok(const CacheTok& tok, const char* file, const char* strings, size_t size, Tok& result);
+
+/// Writes @p header followed by @p record to @p target through a temporary file, so readers never see a partial file.
+bool writeRecord(const std::string& target, const void* header, size_t header_size, const AstRecord& record);
+
+/// Read-only mapping of a whole file; empty if it cannot be opened.
+class MappedFile {
+    public:
+        MappedFile(const std::string& path);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const char* data() const { return data_; }
+        size_t size() const { return size_; }
+        explicit operator bool() const { return data_ != nullptr; }
+
+    private:
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+};
+
+/// Records the parser's builder calls into an @p AstRecord instead of building nodes.
+class RecordingBuilder : public NullBuilder {
+    public:
+        RecordingBuilder(AstRecord& record)
+            : record_(&record)
+        {}
+
+        Node translation_unit(Loc loc, List&& decls) { return emit(NodeKind::TranslationUnit, loc, 0, decls.size); }
+        Node external_declaration(Loc loc, Node specDecl) { return emit(NodeKind::ExternalDeclaration, loc, present(specDecl), 0); }
+        Node function_definition(Loc loc, Node specDecl, Node body) { return emit(NodeKind::ExternalDeclaration, loc, present(specDecl, body), 0); }
+        Node err_decl(Loc loc) { return emit(NodeKind::ErrDecl, loc, 0, 0); }
+        Node specifier_declarator(Loc loc, Node specifier, Node declarator) { return emit(NodeKind::SpecifierDeclarator, loc, present(specifier, declarator), 0); }
+        Node typedef_declarator(Loc loc, Node specifier, Node declarator) { return emit(NodeKind::TypedefDeclarator, loc, present(specifier, declarator), 0); }
+        Node inline_declarator(Loc loc, Node specifier, Node declarator) { return emit(NodeKind::InlineDeclarator, loc, present(specifier, declarator), 0); }
+        Node primitive_specifier(Loc loc, const Tok& type) { return emit(NodeKind::PrimitiveSpecifier, loc, 0, 0, type); }
+        Node struct_specifier(Loc loc, const Tok& type) { return emit(NodeKind::StructSpecifier, loc, 0, 0, type); }
+        Node struct_specifier(Loc loc, const Tok& type, const Tok& identifier) { return emit(NodeKind::StructSpecifier, loc, 1, 0, type, identifier); }
+        Node struct_specifier(Loc loc, const Tok& type, List&& members) { return emit(NodeKind::StructSpecifier, loc, 2, members.size, type); }
+        Node struct_specifier(Loc loc, const Tok& type, const Tok& identifier, List&& members) { return emit(NodeKind::StructSpecifier, loc, 3, members.size, type, identifier); }
+        Node type_name_specifier(Loc loc, const Tok& name) { return emit(NodeKind::TypeNameSpecifier, loc, 0, 0, name); }
+        Node named_declarator(Loc loc, const Tok& identifier) { return emit(NodeKind::NamedDeclarator, loc, 0, 0, identifier); }
+        Node pointer_declarator(Loc loc, Node declarator) { return emit(NodeKind::PointerDeclarator, loc, present(declarator), 0); }
+        Node function_declarator(Loc loc, Node declarator, List&& params) { return emit(NodeKind::FunctionDeclarator, loc, present(declarator), params.size); }
+
+        Node declaration(Loc loc, Node specDecl) { return emit(NodeKind::Declaration, loc, present(specDecl), 0); }
+        Node expression_stmt(Loc loc, Node exp) { return emit(NodeKind::ExpressionStmt, loc, present(exp), 0); }
+        Node empty_return_stmt(Loc loc) { return emit(NodeKind::EmptyReturnStmt, loc, 0, 0); }
+        Node return_stmt(Loc loc, Node exp) { return emit(NodeKind::ReturnStmt, loc, present(exp), 0); }
+        Node goto_stmt(Loc loc, const Tok& label) { return emit(NodeKind::GoToStmt, loc, 0, 0, label); }
+        Node break_stmt(Loc loc) { return emit(NodeKind::BreakStmt, loc, 0, 0); }
+        Node continue_stmt(Loc loc) { return emit(NodeKind::ContinueStmt, loc, 0, 0); }
+        Node while_stmt(Loc loc, Node condition, Node loop) { return emit(NodeKind::WhileStmt, loc, present(condition, loop), 0); }
+        Node if_else_stmt(Loc loc, Node condition, Node consequence, Node alternative) { return emit(NodeKind::IfElseStmt, loc, present(condition, consequence, alternative), 0); }
+        Node if_stmt(Loc loc, Node condition, Node consequence) { return emit(NodeKind::IfStmt, loc, present(condition, consequence), 0); }
+        Node null_stmt(Loc loc) { return emit(NodeKind::NullStmt, loc, 0, 0); }
+        Node compound_stmt(Loc loc, List&& blockItems) { return emit(NodeKind::CompoundStmt, loc, 0, blockItems.size); }
+        Node labeled_stmt(Loc loc, const Tok& label, Node statement) { return emit(NodeKind::LabeledStmt, loc, present(statement), 0, label); }
+        Node err_stmt(Loc loc) { return emit(NodeKind::ErrStmt, loc, 0, 0); }
+
+        Node infix_exp(Loc loc, Node lhs, const Tok& operation, Node rhs) { return emit(NodeKind::InfixExp, loc, present(lhs, rhs), 0, operation); }
+        Node ternary_exp(Loc loc, Node condition, Node consequence, Node alternative) { return emit(NodeKind::TernaryExp, loc, present(condition, consequence, alternative), 0); }
+        Node prefix_exp(Loc loc, const Tok& prefix, Node operand) { return emit(NodeKind::PrefixExp, loc, present(operand), 0, prefix); }
+        Node member_access_exp(Loc loc, Tok::Tag operation, Node object, const Tok& member) { return emit(NodeKind::MemberAccessExp, loc, present(object), uint32_t(operation), member); }
+        Node array_exp(Loc loc, Node object, Node index) { return emit(NodeKind::ArrayExp, loc, present(object, index), 0); }
+        Node func_call_exp(Loc loc, Node func, List&& args) { return emit(NodeKind::FuncCallExp, loc, present(func), args.size); }
+        Node sizeof_type_exp(Loc loc, const Tok& type) { return emit(NodeKind::SizeOfTypeExp, loc, 0, 0, type); }
+        Node sizeof_unary_exp(Loc loc, Node exp) { return emit(NodeKind::SizeOfUnaryExp, loc, present(exp), 0); }
+        Node postfix_exp(Loc loc, Node operand, const Tok& postfix) { return emit(NodeKind::PostfixExp, loc, present(operand), 0, postfix); }
+        Node identifier(Loc loc, const Tok& tok) { return emit(NodeKind::Identifier, loc, 0, 0, tok); }
+        Node integer(Loc loc, const Tok& tok) { return emit(NodeKind::Integer, loc, 0, 0, tok); }
+        Node character(Loc loc, const Tok& tok) { return emit(NodeKind::Character, loc, 0, 0, tok); }
+        Node literal(Loc loc, const Tok& tok) { return emit(NodeKind::Literal, loc, 0, 0, tok); }
+        Node err_exp(Loc loc) { return emit(NodeKind::ErrExp, loc, 0, 0); }
+
+    private:
+        template<class... Toks>
+        Node emit(NodeKind kind, Loc loc, uint8_t present, size_t count, const Toks&... toks) {
+            record_->nodes.push_back({uint8_t(kind), present, uint16_t(sizeof...(toks)), uint32_t(count), uint32_t(record_->toks.size()), cacheLoc(loc)});
+            (addTok(toks), ...);
+            return true;
+        }
+
+        template<class... Nodes>
+        static uint8_t present(Nodes... nodes) {
+            uint8_t bits = 0, bit = 1;
+            ((bits |= nodes ? bit : 0, bit <<= 1), ...);
+            return bits;
+        }
+
+        static CacheLoc cacheLoc(Loc loc) { return {{loc.begin.row, loc.begin.col}, {loc.finish.row, loc.finish.col}}; }
+        void addTok(const Tok& tok) { record_->addTok(tok); }
+
+        AstRecord* record_;
+};
+
+
+//! =================================================
+//! ================= AST Cache =====================
+//! =================================================
+
+/// Directory of serialized ASTs keyed by the content hash of their source (@c --cache-dir).
+/// Only error-free parses are stored, so a hit never has to repeat parser diagnostics. An entry also lists the files the
+/// parse included with their content hashes, and is only used while all of them are unchanged.
+class AstCache {
+    public:
+        static constexpr uint32_t version = 5;
+
+        /// A file read through @c #include, as recorded in an entry.
+        struct Dependency {
+            std::string path;
+            uint64_t hash;
+        };
+
+        AstCache(std::string dir);
+
+        /// 64-bit FNV-1a hash of @p source.
+        static uint64_t hash(const char* data, size_t size);
+        static uint64_t hash(const std::string& source) { return hash(source.data(), source.size()); }
+
+        /// Maps the entry for @p key and rebuilds its AST; @c nullptr if there is no valid entry or one of the files it
+        /// depends on changed.
+        Ptr<TranslationUnit> load(const char* file, uint64_t key) const;
+
+        /// Writes @p record, which read @p dependencies, as the entry for @p key; failures only cost the next run a parse.
+        void store(uint64_t key, AstRecord& record, const std::vector<Dependency>& dependencies) const;
+
+        /// Rebuilds the AST from a recorded parse; @c nullptr if the record is malformed.
+        static Ptr<TranslationUnit> replay(const char* file, const CacheNode* nodes, size_t num_nodes, const CacheTok* toks, size_t num_toks, const char* strings, size_t strings_size);
+
+    private:
+        std::string path(uint64_t key) const;
+
+        std::string dir_;
+};
+
+}
+
+#endif
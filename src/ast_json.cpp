@@ -0,0 +1,283 @@
+#include "ast.h"
+
+namespace H {
+
+//! ========================================================================================================
+//! ================= JSON Export ==========================================================================
+//! ========================================================================================================
+//
+// Every node is an object
+//
+//     {"kind": "InfixExp", "range": [row, col, end_row, end_col], <attributes>, "children": [...]}
+//
+// Expressions carry the "type" Sema gave them (null if they were not checked) and, if they are integer constant
+// expressions, their "constant" value. External declarations also carry their "file". Absent optional children
+// (e.g. the declarator of an abstract parameter) are left out of "children".
+
+namespace {
+    /// Writes the object of one node; the attributes go first, then @p child() adds the children in order.
+    /// The object is closed when the @p Node goes out of scope.
+    class Node {
+        public:
+            Node(JsonWriter& w, const ASTNode& node, const char* kind)
+                : w_(w)
+            {
+                auto loc = node.loc();
+                w.begin_object();
+                w.field("kind", kind);
+                w.key("range");
+                w.begin_array();
+                w.value(loc.begin.row);
+                w.value(loc.begin.col);
+                w.value(loc.finish.row);
+                w.value(loc.finish.col);
+                w.end_array();
+            }
+            ~Node() {
+                if (!children_) child(nullptr);
+                w_.end_array();
+                w_.end_object();
+            }
+
+            template<class T>
+            Node& attr(const char* name, T&& value) { w_.field(name, std::forward<T>(value)); return *this; }
+
+            Node& type(const Type* type) {
+                if (type == nullptr) w_.field("type", nullptr);
+                else w_.field("type", type->str());
+                return *this;
+            }
+
+            Node& exp(const Exp& exp) {
+                type(exp.type());
+                if (exp.isConstant()) w_.field("constant", exp.constant());
+                return *this;
+            }
+
+            Node& child(const ASTNode* node) {
+                if (!children_) {
+                    w_.key("children");
+                    w_.begin_array();
+                    children_ = true;
+                }
+                if (node != nullptr) node->json(w_);
+                return *this;
+            }
+
+        private:
+            JsonWriter& w_;
+            bool children_ = false;
+    };
+}
+
+
+//! =================================================
+//! ================= Specifiers ====================
+//! =================================================
+
+void PrimitiveSpecifier::json(JsonWriter& w) const {
+    Node(w, *this, "PrimitiveSpecifier").attr("name", typeString()).type(type());
+}
+
+void TypeNameSpecifier::json(JsonWriter& w) const {
+    Node(w, *this, "TypeNameSpecifier").attr("name", typeString()).type(type());
+}
+
+void StructSpecifier::json(JsonWriter& w) const {
+    Node node(w, *this, "StructSpecifier");
+    if (structIdentifierString() != "") node.attr("tag", structIdentifierString());
+    node.attr("definition", declarationListSet());
+    for (size_t i = 0; i < num_structDeclarations(); i++) node.child(structDeclaration(i));
+}
+
+
+//! =================================================
+//! ================= Declarator ====================
+//! =================================================
+
+void NamedDeclarator::json(JsonWriter& w) const {
+    Node(w, *this, "NamedDeclarator").attr("name", name());
+}
+
+void FunctionDeclarator::json(JsonWriter& w) const {
+    Node node(w, *this, "FunctionDeclarator");
+    node.child(declarator());
+    for (size_t i = 0; i < num_parameters(); i++) node.child(parameter(i));
+}
+
+void PointerDeclarator::json(JsonWriter& w) const {
+    Node(w, *this, "PointerDeclarator").child(declarator());
+}
+
+
+//! =================================================
+//! ================= Base Stuff ====================
+//! =================================================
+
+void SpecifierDeclarator::json(JsonWriter& w) const {
+    Node node(w, *this, "SpecifierDeclarator");
+    if (!name().empty()) node.attr("name", name());
+    if (isTypedef()) node.attr("typedef", true);
+    if (isInline()) node.attr("inline", true);
+    node.child(specifier()).child(declarator());
+}
+
+void ExternalDeclaration::json(JsonWriter& w) const {
+    Node node(w, *this, "ExternalDeclaration");
+    node.attr("file", loc().file ? loc().file : "");
+    node.child(specifierDeclarator()).child(functionBody());
+}
+
+void TranslationUnit::json(JsonWriter& w) const {
+    Node node(w, *this, "TranslationUnit");
+    node.attr("file", loc().file ? loc().file : "");
+    for (size_t i = 0; i < num_ext_declarations(); i++) node.child(external_declaration(i));
+}
+
+void TranslationUnit::jsonLines(JsonWriter& w) const {
+    for (size_t i = 0; i < num_ext_declarations(); i++) {
+        external_declaration(i)->json(w);
+        w.end_line();
+    }
+}
+
+void Declaration::json(JsonWriter& w) const {
+    Node(w, *this, "Declaration").child(specifierDeclarator());
+}
+
+
+//! =================================================
+//! ================ Statements =====================
+//! =================================================
+
+void ExpressionStmt::json(JsonWriter& w) const {
+    Node(w, *this, "ExpressionStmt").child(exp());
+}
+
+void EmptyReturnStmt::json(JsonWriter& w) const {
+    Node(w, *this, "EmptyReturnStmt");
+}
+
+void ReturnStmt::json(JsonWriter& w) const {
+    Node(w, *this, "ReturnStmt").child(exp());
+}
+
+void GoToStmt::json(JsonWriter& w) const {
+    Node(w, *this, "GoToStmt").attr("label", gotoLabel());
+}
+
+void BreakStmt::json(JsonWriter& w) const {
+    Node(w, *this, "BreakStmt");
+}
+
+void ContinueStmt::json(JsonWriter& w) const {
+    Node(w, *this, "ContinueStmt");
+}
+
+void WhileStmt::json(JsonWriter& w) const {
+    Node(w, *this, "WhileStmt").child(condition()).child(loop());
+}
+
+void IfElseStmt::json(JsonWriter& w) const {
+    Node(w, *this, "IfElseStmt").child(condition()).child(consequence()).child(alternative());
+}
+
+void IfStmt::json(JsonWriter& w) const {
+    Node(w, *this, "IfStmt").child(condition()).child(consequence());
+}
+
+void NullStmt::json(JsonWriter& w) const {
+    Node(w, *this, "NullStmt");
+}
+
+void CompoundStmt::json(JsonWriter& w) const {
+    Node node(w, *this, "CompoundStmt");
+    for (size_t ind = 0; ind < num_blockItems(); ind++) node.child(blockItem(ind));
+}
+
+void LabeledStmt::json(JsonWriter& w) const {
+    Node(w, *this, "LabeledStmt").attr("label", labelString()).child(statement());
+}
+
+
+//! =================================================
+//! ================ Expressions ====================
+//! =================================================
+
+void InfixExp::json(JsonWriter& w) const {
+    Node(w, *this, "InfixExp").attr("op", operation().str()).exp(*this).child(lhs()).child(rhs());
+}
+
+void TernaryExp::json(JsonWriter& w) const {
+    Node(w, *this, "TernaryExp").exp(*this).child(condition()).child(consequence()).child(alternative());
+}
+
+void PrefixExp::json(JsonWriter& w) const {
+    Node(w, *this, "PrefixExp").attr("op", prefixString()).exp(*this).child(operand());
+}
+
+void MemberAccessExp::json(JsonWriter& w) const {
+    Node(w, *this, "MemberAccessExp").attr("op", Tok::tag2str(operation())).attr("member", member_name()).exp(*this).child(object());
+}
+
+void ArrayExp::json(JsonWriter& w) const {
+    Node(w, *this, "ArrayExp").exp(*this).child(object()).child(index());
+}
+
+void FuncCallExp::json(JsonWriter& w) const {
+    Node node(w, *this, "FuncCallExp");
+    node.exp(*this).child(func());
+    for (size_t ind = 0; ind < num_parameters(); ind++) node.child(parameter(ind));
+}
+
+void SizeOfTypeExp::json(JsonWriter& w) const {
+    Node(w, *this, "SizeOfTypeExp").attr("operand", typeString()).exp(*this);
+}
+
+void SizeOfUnaryExp::json(JsonWriter& w) const {
+    Node(w, *this, "SizeOfUnaryExp").exp(*this).child(exp());
+}
+
+void PostfixExp::json(JsonWriter& w) const {
+    Node(w, *this, "PostfixExp").attr("op", postfixString()).exp(*this).child(operand());
+}
+
+
+//! =================================================
+//! ============== Basic Expressions ================
+//! =================================================
+
+void Identifier::json(JsonWriter& w) const {
+    Node(w, *this, "Identifier").attr("name", name()).exp(*this);
+}
+
+void Integer::json(JsonWriter& w) const {
+    Node(w, *this, "Integer").attr("value", value()).exp(*this);
+}
+
+void Character::json(JsonWriter& w) const {
+    Node(w, *this, "Character").attr("value", value()).exp(*this);
+}
+
+void Literal::json(JsonWriter& w) const {
+    Node(w, *this, "Literal").attr("value", value()).exp(*this);
+}
+
+
+//! =================================================
+//! ============= Error Exp/Stmt/Decl ===============
+//! =================================================
+
+void ErrExp::json(JsonWriter& w) const {
+    Node(w, *this, "ErrExp").exp(*this);
+}
+
+void ErrStmt::json(JsonWriter& w) const {
+    Node(w, *this, "ErrStmt");
+}
+
+void ErrDecl::json(JsonWriter& w) const {
+    Node(w, *this, "ErrDecl");
+}
+
+}
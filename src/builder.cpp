@@ -0,0 +1,21 @@
+#include "builder.h"
+
+namespace H {
+
+const char* kind2str(NodeKind kind) {
+    switch (kind) {
+        #define CODE(k, str) \
+            case NodeKind::k: return str;
+            H_AST(CODE)
+        #undef CODE
+        default: return "<unknown node>";
+    }
+}
+
+void EventBuilder::TextSink::node(NodeKind kind, Loc loc, size_t arity, const std::string& spelling) {
+    o_ << kind2str(kind) << '\t' << loc.begin.row << ':' << loc.begin.col << '\t' << arity;
+    if (!spelling.empty()) o_ << '\t' << spelling;
+    o_ << '\n';
+}
+
+}
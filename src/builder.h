@@ -0,0 +1,306 @@
+#ifndef PROG_BUILDER_H
+#define PROG_BUILDER_H
+
+#include <ostream>
+#include <string>
+
+#include "ast.h"
+
+namespace H {
+
+/// Node kinds as reported by the @p EventBuilder and stored in the AST cache.
+#define H_AST(m) \
+m(TranslationUnit,      "translation unit") \
+m(ExternalDeclaration,  "external declaration") \
+m(ErrDecl,              "error declaration") \
+m(SpecifierDeclarator,  "specifier declarator") \
+m(TypedefDeclarator,    "typedef declarator") \
+m(InlineDeclarator,     "inline declarator") \
+m(PrimitiveSpecifier,   "primitive specifier") \
+m(StructSpecifier,      "struct specifier") \
+m(TypeNameSpecifier,    "type name specifier") \
+m(NamedDeclarator,      "named declarator") \
+m(FunctionDeclarator,   "function declarator") \
+m(PointerDeclarator,    "pointer declarator") \
+m(Declaration,          "declaration") \
+m(ExpressionStmt,       "expression statement") \
+m(EmptyReturnStmt,      "empty return statement") \
+m(ReturnStmt,           "return statement") \
+m(GoToStmt,             "goto statement") \
+m(BreakStmt,            "break statement") \
+m(ContinueStmt,         "continue statement") \
+m(WhileStmt,            "while statement") \
+m(IfElseStmt,           "if-else statement") \
+m(IfStmt,               "if statement") \
+m(NullStmt,             "null statement") \
+m(CompoundStmt,         "compound statement") \
+m(LabeledStmt,          "labeled statement") \
+m(ErrStmt,              "error statement") \
+m(InfixExp,             "infix expression") \
+m(TernaryExp,           "ternary expression") \
+m(PrefixExp,            "prefix expression") \
+m(MemberAccessExp,      "member access") \
+m(ArrayExp,             "array subscript") \
+m(FuncCallExp,          "function call") \
+m(SizeOfTypeExp,        "sizeof type") \
+m(SizeOfUnaryExp,       "sizeof expression") \
+m(PostfixExp,           "postfix expression") \
+m(Identifier,           "identifier") \
+m(Integer,              "integer constant") \
+m(Character,            "character constant") \
+m(Literal,              "string literal") \
+m(ErrExp,               "error expression")
+
+enum class NodeKind {
+    #define CODE(k, str) k,
+        H_AST(CODE)
+    #undef CODE
+};
+
+const char* kind2str(NodeKind);
+
+
+//! =================================================
+//! ================= AST Builder ===================
+//! =================================================
+
+/// Builds the full AST of ast.h; used for everything that needs semantic analysis.
+class AstBuilder {
+    public:
+        using ExpNode = Ptr<Exp>;
+        using StmtNode = Ptr<Stmt>;
+        using SpecifierNode = Ptr<Specifier>;
+        using DeclaratorNode = Ptr<Declarator>;
+        using SpecDeclNode = Ptr<SpecifierDeclarator>;
+        using ExtDeclNode = Ptr<ExternalDeclaration>;
+        using UnitNode = Ptr<TranslationUnit>;
+
+        using ExpList = SmallPtrs<Exp>;
+        using StmtList = SmallPtrs<Stmt>;
+        using SpecDeclList = SmallPtrs<SpecifierDeclarator>;
+        using ExtDeclList = Ptrs<ExternalDeclaration>;
+
+        // Declarations
+        UnitNode translation_unit(Loc loc, ExtDeclList&& decls) { return mk<TranslationUnit>(loc, std::move(decls)); }
+        ExtDeclNode external_declaration(Loc loc, SpecDeclNode&& specDecl) { return mk<ExternalDeclaration>(loc, std::move(specDecl)); }
+        ExtDeclNode function_definition(Loc loc, SpecDeclNode&& specDecl, StmtNode&& body) { return mk<ExternalDeclaration>(loc, std::move(specDecl), std::move(body)); }
+        ExtDeclNode err_decl(Loc loc) { return mk<ErrDecl>(loc); }
+        SpecDeclNode specifier_declarator(Loc loc, SpecifierNode&& specifier, DeclaratorNode&& declarator) {
+            if (!declarator) return mk<SpecifierDeclarator>(loc, std::move(specifier));
+            return mk<SpecifierDeclarator>(loc, std::move(specifier), std::move(declarator));
+        }
+        SpecDeclNode typedef_declarator(Loc loc, SpecifierNode&& specifier, DeclaratorNode&& declarator) { return mk<SpecifierDeclarator>(loc, std::move(specifier), std::move(declarator), true); }
+        SpecDeclNode inline_declarator(Loc loc, SpecifierNode&& specifier, DeclaratorNode&& declarator) { return mk<SpecifierDeclarator>(loc, std::move(specifier), std::move(declarator), false, true); }
+        SpecifierNode primitive_specifier(Loc loc, Tok type) { return mk<PrimitiveSpecifier>(loc, type); }
+        SpecifierNode struct_specifier(Loc loc, Tok type) { return mk<StructSpecifier>(loc, type); }
+        SpecifierNode struct_specifier(Loc loc, Tok type, Tok identifier) { return mk<StructSpecifier>(loc, type, identifier); }
+        SpecifierNode struct_specifier(Loc loc, Tok type, SpecDeclList&& members) { return mk<StructSpecifier>(loc, type, std::move(members)); }
+        SpecifierNode struct_specifier(Loc loc, Tok type, Tok identifier, SpecDeclList&& members) { return mk<StructSpecifier>(loc, type, identifier, std::move(members)); }
+        SpecifierNode type_name_specifier(Loc loc, Tok name) { return mk<TypeNameSpecifier>(loc, name); }
+        DeclaratorNode named_declarator(Loc loc, Tok identifier) { return mk<NamedDeclarator>(loc, identifier); }
+        DeclaratorNode pointer_declarator(Loc loc, DeclaratorNode&& declarator) { return mk<PointerDeclarator>(loc, std::move(declarator)); }
+        DeclaratorNode function_declarator(Loc loc, DeclaratorNode&& declarator, SpecDeclList&& params) { return mk<FunctionDeclarator>(loc, std::move(declarator), std::move(params)); }
+
+        // Statements
+        StmtNode declaration(Loc loc, SpecDeclNode&& specDecl) { return mk<Declaration>(loc, std::move(specDecl)); }
+        StmtNode expression_stmt(Loc loc, ExpNode&& exp) { return mk<ExpressionStmt>(loc, std::move(exp)); }
+        StmtNode empty_return_stmt(Loc loc) { return mk<EmptyReturnStmt>(loc); }
+        StmtNode return_stmt(Loc loc, ExpNode&& exp) { return mk<ReturnStmt>(loc, std::move(exp)); }
+        StmtNode goto_stmt(Loc loc, Tok label) { return mk<GoToStmt>(loc, label); }
+        StmtNode break_stmt(Loc loc) { return mk<BreakStmt>(loc); }
+        StmtNode continue_stmt(Loc loc) { return mk<ContinueStmt>(loc); }
+        StmtNode while_stmt(Loc loc, ExpNode&& condition, StmtNode&& loop) { return mk<WhileStmt>(loc, std::move(condition), std::move(loop)); }
+        StmtNode if_else_stmt(Loc loc, ExpNode&& condition, StmtNode&& consequence, StmtNode&& alternative) { return mk<IfElseStmt>(loc, std::move(condition), std::move(consequence), std::move(alternative)); }
+        StmtNode if_stmt(Loc loc, ExpNode&& condition, StmtNode&& consequence) { return mk<IfStmt>(loc, std::move(condition), std::move(consequence)); }
+        StmtNode null_stmt(Loc loc) { return mk<NullStmt>(loc); }
+        StmtNode compound_stmt(Loc loc, StmtList&& blockItems) { return mk<CompoundStmt>(loc, std::move(blockItems)); }
+        StmtNode labeled_stmt(Loc loc, Tok label, StmtNode&& statement) { return mk<LabeledStmt>(loc, label, std::move(statement)); }
+        StmtNode err_stmt(Loc loc) { return mk<ErrStmt>(loc); }
+
+        // Expressions
+        ExpNode infix_exp(Loc loc, ExpNode&& lhs, Tok operation, ExpNode&& rhs) { return mk<InfixExp>(loc, std::move(lhs), operation, std::move(rhs)); }
+        ExpNode ternary_exp(Loc loc, ExpNode&& condition, ExpNode&& consequence, ExpNode&& alternative) { return mk<TernaryExp>(loc, std::move(condition), std::move(consequence), std::move(alternative)); }
+        ExpNode prefix_exp(Loc loc, Tok prefix, ExpNode&& operand) { return mk<PrefixExp>(loc, prefix, std::move(operand)); }
+        ExpNode member_access_exp(Loc loc, Tok::Tag operation, ExpNode&& object, Tok member) { return mk<MemberAccessExp>(loc, operation, std::move(object), member); }
+        ExpNode array_exp(Loc loc, ExpNode&& object, ExpNode&& index) { return mk<ArrayExp>(loc, std::move(object), std::move(index)); }
+        ExpNode func_call_exp(Loc loc, ExpNode&& func, ExpList&& args) { return mk<FuncCallExp>(loc, std::move(func), std::move(args)); }
+        ExpNode sizeof_type_exp(Loc loc, Tok type) { return mk<SizeOfTypeExp>(loc, type); }
+        ExpNode sizeof_unary_exp(Loc loc, ExpNode&& exp) { return mk<SizeOfUnaryExp>(loc, std::move(exp)); }
+        ExpNode postfix_exp(Loc loc, ExpNode&& operand, Tok postfix) { return mk<PostfixExp>(loc, std::move(operand), postfix); }
+        ExpNode identifier(Loc loc, const Tok& tok) { return mk<Identifier>(loc, tok.str()); }
+        ExpNode integer(Loc loc, const Tok& tok) { return mk<Integer>(loc, tok.value()); }
+        ExpNode character(Loc loc, const Tok& tok) { return mk<Character>(loc, tok.str()); }
+        ExpNode literal(Loc loc, const Tok& tok) { return mk<Literal>(loc, tok.str()); }
+        ExpNode err_exp(Loc loc) { return mk<ErrExp>(loc); }
+};
+
+
+//! =================================================
+//! ================ Null Builder ===================
+//! =================================================
+
+/// Allocates nothing: the parser only reports syntax errors (@c -fsyntax-only).
+class NullBuilder {
+    public:
+        struct Node {                                                   // Only remembers whether the parser produced a node
+            Node() = default;
+            Node(bool valid) : valid(valid) {}
+            explicit operator bool() const { return valid; }
+            bool valid = false;
+        };
+        struct List {                                                   // Counts the nodes that were actually produced
+            void emplace_back(Node node) { if (node) ++size; }
+            size_t size = 0;
+        };
+
+        using ExpNode = Node;
+        using StmtNode = Node;
+        using SpecifierNode = Node;
+        using DeclaratorNode = Node;
+        using SpecDeclNode = Node;
+        using ExtDeclNode = Node;
+        using UnitNode = Node;
+
+        using ExpList = List;
+        using StmtList = List;
+        using SpecDeclList = List;
+        using ExtDeclList = List;
+
+        template<class... Args> Node translation_unit(Args&&...) { return true; }
+        template<class... Args> Node external_declaration(Args&&...) { return true; }
+        template<class... Args> Node function_definition(Args&&...) { return true; }
+        template<class... Args> Node err_decl(Args&&...) { return true; }
+        template<class... Args> Node specifier_declarator(Args&&...) { return true; }
+        template<class... Args> Node typedef_declarator(Args&&...) { return true; }
+        template<class... Args> Node inline_declarator(Args&&...) { return true; }
+        template<class... Args> Node primitive_specifier(Args&&...) { return true; }
+        template<class... Args> Node struct_specifier(Args&&...) { return true; }
+        template<class... Args> Node type_name_specifier(Args&&...) { return true; }
+        template<class... Args> Node named_declarator(Args&&...) { return true; }
+        template<class... Args> Node pointer_declarator(Args&&...) { return true; }
+        template<class... Args> Node function_declarator(Args&&...) { return true; }
+        template<class... Args> Node declaration(Args&&...) { return true; }
+        template<class... Args> Node expression_stmt(Args&&...) { return true; }
+        template<class... Args> Node empty_return_stmt(Args&&...) { return true; }
+        template<class... Args> Node return_stmt(Args&&...) { return true; }
+        template<class... Args> Node goto_stmt(Args&&...) { return true; }
+        template<class... Args> Node break_stmt(Args&&...) { return true; }
+        template<class... Args> Node continue_stmt(Args&&...) { return true; }
+        template<class... Args> Node while_stmt(Args&&...) { return true; }
+        template<class... Args> Node if_else_stmt(Args&&...) { return true; }
+        template<class... Args> Node if_stmt(Args&&...) { return true; }
+        template<class... Args> Node null_stmt(Args&&...) { return true; }
+        template<class... Args> Node compound_stmt(Args&&...) { return true; }
+        template<class... Args> Node labeled_stmt(Args&&...) { return true; }
+        template<class... Args> Node err_stmt(Args&&...) { return true; }
+        template<class... Args> Node infix_exp(Args&&...) { return true; }
+        template<class... Args> Node ternary_exp(Args&&...) { return true; }
+        template<class... Args> Node prefix_exp(Args&&...) { return true; }
+        template<class... Args> Node member_access_exp(Args&&...) { return true; }
+        template<class... Args> Node array_exp(Args&&...) { return true; }
+        template<class... Args> Node func_call_exp(Args&&...) { return true; }
+        template<class... Args> Node sizeof_type_exp(Args&&...) { return true; }
+        template<class... Args> Node sizeof_unary_exp(Args&&...) { return true; }
+        template<class... Args> Node postfix_exp(Args&&...) { return true; }
+        template<class... Args> Node identifier(Args&&...) { return true; }
+        template<class... Args> Node integer(Args&&...) { return true; }
+        template<class... Args> Node character(Args&&...) { return true; }
+        template<class... Args> Node literal(Args&&...) { return true; }
+        template<class... Args> Node err_exp(Args&&...) { return true; }
+};
+
+
+//! =================================================
+//! =============== Event Builder ===================
+//! =================================================
+
+/// Streams the tree to a @p Sink instead of building it.
+/// Nodes arrive in post-order: children are reported before their parent, so a consumer can rebuild the tree with a stack.
+class EventBuilder : public NullBuilder {
+    public:
+        class Sink {
+            public:
+                virtual ~Sink() {}
+                /// @p arity is the number of preceding nodes that are children of this one (absent optional children are not counted).
+                virtual void node(NodeKind kind, Loc loc, size_t arity, const std::string& spelling) = 0;
+        };
+
+        /// Writes one line per node: <kind> <row:col> <arity> [<spelling>]
+        class TextSink : public Sink {
+            public:
+                TextSink(std::ostream& o)
+                    : o_(o)
+                {}
+
+                void node(NodeKind kind, Loc loc, size_t arity, const std::string& spelling) override;
+
+            private:
+                std::ostream& o_;
+        };
+
+        EventBuilder(Sink& sink)
+            : sink_(&sink)
+        {}
+
+        Node translation_unit(Loc loc, List&& decls) { return emit(NodeKind::TranslationUnit, loc, decls.size); }
+        Node external_declaration(Loc loc, Node specDecl) { return emit(NodeKind::ExternalDeclaration, loc, count(specDecl)); }
+        Node function_definition(Loc loc, Node specDecl, Node body) { return emit(NodeKind::ExternalDeclaration, loc, count(specDecl, body)); }
+        Node err_decl(Loc loc) { return emit(NodeKind::ErrDecl, loc, 0); }
+        Node specifier_declarator(Loc loc, Node specifier, Node declarator) { return emit(NodeKind::SpecifierDeclarator, loc, count(specifier, declarator)); }
+        Node typedef_declarator(Loc loc, Node specifier, Node declarator) { return emit(NodeKind::TypedefDeclarator, loc, count(specifier, declarator)); }
+        Node inline_declarator(Loc loc, Node specifier, Node declarator) { return emit(NodeKind::InlineDeclarator, loc, count(specifier, declarator)); }
+        Node primitive_specifier(Loc loc, Tok type) { return emit(NodeKind::PrimitiveSpecifier, loc, 0, type.str()); }
+        Node struct_specifier(Loc loc, Tok) { return emit(NodeKind::StructSpecifier, loc, 0); }
+        Node struct_specifier(Loc loc, Tok, Tok identifier) { return emit(NodeKind::StructSpecifier, loc, 0, identifier.str()); }
+        Node struct_specifier(Loc loc, Tok, List&& members) { return emit(NodeKind::StructSpecifier, loc, members.size); }
+        Node struct_specifier(Loc loc, Tok, Tok identifier, List&& members) { return emit(NodeKind::StructSpecifier, loc, members.size, identifier.str()); }
+        Node type_name_specifier(Loc loc, Tok name) { return emit(NodeKind::TypeNameSpecifier, loc, 0, name.str()); }
+        Node named_declarator(Loc loc, Tok identifier) { return emit(NodeKind::NamedDeclarator, loc, 0, identifier.str()); }
+        Node pointer_declarator(Loc loc, Node declarator) { return emit(NodeKind::PointerDeclarator, loc, count(declarator)); }
+        Node function_declarator(Loc loc, Node declarator, List&& params) { return emit(NodeKind::FunctionDeclarator, loc, count(declarator) + params.size); }
+
+        Node declaration(Loc loc, Node specDecl) { return emit(NodeKind::Declaration, loc, count(specDecl)); }
+        Node expression_stmt(Loc loc, Node exp) { return emit(NodeKind::ExpressionStmt, loc, count(exp)); }
+        Node empty_return_stmt(Loc loc) { return emit(NodeKind::EmptyReturnStmt, loc, 0); }
+        Node return_stmt(Loc loc, Node exp) { return emit(NodeKind::ReturnStmt, loc, count(exp)); }
+        Node goto_stmt(Loc loc, Tok label) { return emit(NodeKind::GoToStmt, loc, 0, label.str()); }
+        Node break_stmt(Loc loc) { return emit(NodeKind::BreakStmt, loc, 0); }
+        Node continue_stmt(Loc loc) { return emit(NodeKind::ContinueStmt, loc, 0); }
+        Node while_stmt(Loc loc, Node condition, Node loop) { return emit(NodeKind::WhileStmt, loc, count(condition, loop)); }
+        Node if_else_stmt(Loc loc, Node condition, Node consequence, Node alternative) { return emit(NodeKind::IfElseStmt, loc, count(condition, consequence, alternative)); }
+        Node if_stmt(Loc loc, Node condition, Node consequence) { return emit(NodeKind::IfStmt, loc, count(condition, consequence)); }
+        Node null_stmt(Loc loc) { return emit(NodeKind::NullStmt, loc, 0); }
+        Node compound_stmt(Loc loc, List&& blockItems) { return emit(NodeKind::CompoundStmt, loc, blockItems.size); }
+        Node labeled_stmt(Loc loc, Tok label, Node statement) { return emit(NodeKind::LabeledStmt, loc, count(statement), label.str()); }
+        Node err_stmt(Loc loc) { return emit(NodeKind::ErrStmt, loc, 0); }
+
+        Node infix_exp(Loc loc, Node lhs, Tok operation, Node rhs) { return emit(NodeKind::InfixExp, loc, count(lhs, rhs), operation.str()); }
+        Node ternary_exp(Loc loc, Node condition, Node consequence, Node alternative) { return emit(NodeKind::TernaryExp, loc, count(condition, consequence, alternative)); }
+        Node prefix_exp(Loc loc, Tok prefix, Node operand) { return emit(NodeKind::PrefixExp, loc, count(operand), prefix.str()); }
+        Node member_access_exp(Loc loc, Tok::Tag operation, Node object, Tok member) { return emit(NodeKind::MemberAccessExp, loc, count(object), Tok::tag2str(operation) + member.str()); }
+        Node array_exp(Loc loc, Node object, Node index) { return emit(NodeKind::ArrayExp, loc, count(object, index)); }
+        Node func_call_exp(Loc loc, Node func, List&& args) { return emit(NodeKind::FuncCallExp, loc, count(func) + args.size); }
+        Node sizeof_type_exp(Loc loc, Tok type) { return emit(NodeKind::SizeOfTypeExp, loc, 0, type.str()); }
+        Node sizeof_unary_exp(Loc loc, Node exp) { return emit(NodeKind::SizeOfUnaryExp, loc, count(exp)); }
+        Node postfix_exp(Loc loc, Node operand, Tok postfix) { return emit(NodeKind::PostfixExp, loc, count(operand), postfix.str()); }
+        Node identifier(Loc loc, const Tok& tok) { return emit(NodeKind::Identifier, loc, 0, tok.str()); }
+        Node integer(Loc loc, const Tok& tok) { return emit(NodeKind::Integer, loc, 0, std::to_string(tok.value())); }
+        Node character(Loc loc, const Tok& tok) { return emit(NodeKind::Character, loc, 0, tok.str()); }
+        Node literal(Loc loc, const Tok& tok) { return emit(NodeKind::Literal, loc, 0, tok.str()); }
+        Node err_exp(Loc loc) { return emit(NodeKind::ErrExp, loc, 0); }
+
+    private:
+        Node emit(NodeKind kind, Loc loc, size_t arity, const std::string& spelling = std::string()) {
+            sink_->node(kind, loc, arity, spelling);
+            return true;
+        }
+
+        template<class... Nodes>
+        static size_t count(Nodes... nodes) { return (size_t(bool(nodes)) + ... + 0); }
+
+        Sink* sink_;
+};
+
+}
+
+#endif
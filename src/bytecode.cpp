@@ -0,0 +1,682 @@
+#include "bytecode.h"
+
+#include <algorithm>
+#include <iomanip>
+
+namespace H {
+
+const char* op2str(Op op) {
+    switch (op) {
+#define CODE(op, str) case Op::op: return str;
+        H_BYTECODE(CODE)
+#undef CODE
+        default: return "<unknown>";
+    }
+}
+
+void Program::dump(std::ostream& o) const {
+    for (auto& fn : functions) {
+        o << fn.name << ": params " << fn.num_params << ", registers " << fn.num_regs << ", frame " << fn.frame_size << "\n";
+        size_t end = &fn == &functions.back() ? code.size() : (&fn + 1)->entry;
+        for (size_t i = fn.entry; i != end; ++i) {
+            auto& insn = code[i];
+            o << std::setw(6) << i << "  " << std::left << std::setw(10) << op2str(insn.op) << std::right
+              << insn.a << ", " << insn.b << ", " << insn.c << "\n";
+        }
+    }
+}
+
+namespace {
+
+/// Lowering of one translation unit; functions are compiled one after the other into @p Program::code.
+class BytecodeCompiler {
+    public:
+        BytecodeCompiler(Program& program)
+            : p_(program)
+        {}
+
+        void unit(TranslationUnit* unit, TranslationUnit* prelude);
+
+    private:
+        struct Storage {
+            enum class Kind { Reg, Frame, Data } kind;
+            int32_t index;                                              // Register or byte offset
+        };
+
+        /// Object designated by an lvalue: the register of a local, or memory at register @p r plus @p off.
+        struct Place {
+            bool reg;
+            int32_t r;
+            int32_t off;
+            Type* type;
+        };
+
+        struct Loop {
+            std::vector<uint32_t> breaks;
+            std::vector<uint32_t> continues;
+        };
+
+        using Fixups = std::vector<uint32_t>;
+
+        // Emission
+        uint32_t here() const { return p_.code.size(); }
+        uint32_t emit(Op op, int32_t a = 0, int32_t b = 0, int32_t c = 0) { p_.code.push_back({op, a, b, c}); return here() - 1; }
+        void patch(const Fixups& fixups) { for (auto at : fixups) p_.code[at].c = here(); }
+        int32_t temp() { int32_t r = next_++; num_regs_ = std::max(num_regs_, next_); return r; }
+        int32_t into(int32_t dst) { return dst >= 0 ? dst : temp(); }
+        int32_t frameSlot(Type* type);
+        uint32_t dataSlot(size_t size, size_t align);
+        void error(ASTNode* node, const char* what);
+
+        // Declarations
+        void global(SpecifierDeclarator* specDecl);
+        void function(ExternalDeclaration* ext);
+        void local(SpecifierDeclarator* specDecl);
+        const Storage* storage(SpecifierDeclarator* specDecl) const;
+
+        // Statements
+        void stmt(Stmt* stmt);
+
+        // Expressions
+        int32_t value(Exp* exp, int32_t dst);
+        void branch(Exp* exp, bool when, Fixups& fixups);
+        Place place(Exp* exp);
+        int32_t load(const Place& place, int32_t dst);
+        void store(const Place& place, int32_t value);
+        int32_t assign(InfixExp* exp, int32_t dst);
+        int32_t binary(InfixExp* exp, int32_t dst);
+        int32_t incDec(Exp* operand, bool inc, bool post, int32_t dst);
+        int32_t call(FuncCallExp* exp, int32_t dst);
+
+        Program& p_;
+        std::unordered_map<const SpecifierDeclarator*, Storage> globals_;
+        std::unordered_map<const SpecifierDeclarator*, uint32_t> functions_;
+        std::unordered_map<const SpecifierDeclarator*, uint32_t> externs_;
+        std::unordered_map<std::string, uint32_t> strings_;
+
+        // Per function
+        std::unordered_map<const SpecifierDeclarator*, Storage> locals_;
+        std::unordered_set<const SpecifierDeclarator*> addressTaken_;
+        std::unordered_map<const LabeledStmt*, uint32_t> labels_;
+        std::vector<std::pair<uint32_t, const LabeledStmt*>> gotos_;
+        std::vector<Loop> loops_;
+        Repr ret_ = Repr::Void;
+        int32_t next_ = 0;                                              // Registers below are locals or live temporaries
+        int32_t num_regs_ = 0;
+        int32_t frame_ = 0;                                             // Frame memory in use
+        int32_t frame_size_ = 0;
+};
+
+void BytecodeCompiler::error(ASTNode* node, const char* what) {
+    node->loc().err() << what << node->loc().endErr();
+}
+
+int32_t BytecodeCompiler::frameSlot(Type* type) {
+    size_t align = std::max<size_t>(type->align(), 1);
+    frame_ = (frame_ + align - 1) / align * align;
+    int32_t offset = frame_;
+    frame_ += type->size();
+    frame_size_ = std::max(frame_size_, frame_);
+    return offset;
+}
+
+uint32_t BytecodeCompiler::dataSlot(size_t size, size_t align) {
+    align = std::max<size_t>(align, 1);
+    p_.data.resize((p_.data.size() + align - 1) / align * align);
+    uint32_t offset = p_.data.size();
+    p_.data.resize(offset + size);
+    return offset;
+}
+
+//! =================================================
+//! ================= Declarations ==================
+//! =================================================
+
+void BytecodeCompiler::unit(TranslationUnit* unit, TranslationUnit* prelude) {
+    auto exts = externalDeclarations(unit, prelude);
+    // Functions first, so that calls can refer to later definitions
+    for (auto ext : exts) {
+        auto specDecl = ext->specifierDeclarator();
+        if (specDecl == nullptr || !isFunction(specDecl)) continue;
+        BcFunction fn;
+        fn.name = specDecl->name();
+        fn.num_params = parameters(specDecl).size();
+        fn.ret = repr(returnType(specDecl));
+        if (ext->functionBody() != nullptr) {
+            functions_[specDecl] = p_.functions.size();
+            p_.function_index[fn.name] = p_.functions.size();
+            p_.functions.push_back(fn);
+        } else {
+            externs_[specDecl] = p_.externs.size();
+            p_.externs.push_back({fn.name, fn.num_params, fn.ret});
+        }
+    }
+
+    for (auto ext : exts) {
+        auto specDecl = ext->specifierDeclarator();
+        if (specDecl == nullptr) continue;
+        if (ext->functionBody() != nullptr) function(ext);
+        else if (!isFunction(specDecl)) global(specDecl);
+    }
+}
+
+void BytecodeCompiler::global(SpecifierDeclarator* specDecl) {
+    if (specDecl->isTypedef() || specDecl->name().empty()) return;
+    Type* type = specDecl->type();
+    globals_[specDecl] = {Storage::Kind::Data, int32_t(dataSlot(type->size(), type->align()))};
+}
+
+void BytecodeCompiler::function(ExternalDeclaration* ext) {
+    auto specDecl = ext->specifierDeclarator();
+    auto& fn = p_.functions[functions_[specDecl]];
+    fn.entry = here();
+    ret_ = fn.ret;
+    if (ret_ == Repr::Struct) error(specDecl, "Functions returning structs are not supported!");
+
+    locals_.clear();
+    labels_.clear();
+    gotos_.clear();
+    addressTaken_ = addressTaken(ext->functionBody());
+    auto params = parameters(specDecl);
+    next_ = num_regs_ = params.size();
+    frame_ = frame_size_ = 0;
+
+    for (size_t i = 0; i != params.size(); ++i) {
+        auto param = params[i];
+        Repr r = repr(param->type());
+        if (r == Repr::Struct) error(param, "Struct parameters are not supported!");
+        if (addressTaken_.count(param)) {
+            int32_t offset = frameSlot(param->type());
+            locals_[param] = {Storage::Kind::Frame, offset};
+            int32_t addr = temp();
+            emit(Op::FrameAddr, addr, 0, offset);
+            store({false, addr, 0, param->type()}, i);
+            next_ = params.size();
+        } else {
+            locals_[param] = {Storage::Kind::Reg, int32_t(i)};
+            if (r == Repr::Char) emit(Op::SExt8, i, i);
+        }
+    }
+
+    stmt(ext->functionBody());
+    emit(Op::RetVoid);
+
+    for (auto [at, label] : gotos_) p_.code[at].c = labels_[label];
+    fn.num_regs = num_regs_;
+    fn.frame_size = (frame_size_ + 15) / 16 * 16;
+}
+
+void BytecodeCompiler::local(SpecifierDeclarator* specDecl) {
+    if (specDecl->isTypedef() || specDecl->name().empty()) return;
+    if (isFunction(specDecl)) return error(specDecl, "Block scope function declarations are not supported!");
+    Type* type = specDecl->type();
+    if (repr(type) == Repr::Struct || addressTaken_.count(specDecl)) locals_[specDecl] = {Storage::Kind::Frame, frameSlot(type)};
+    else locals_[specDecl] = {Storage::Kind::Reg, temp()};
+}
+
+const BytecodeCompiler::Storage* BytecodeCompiler::storage(SpecifierDeclarator* specDecl) const {
+    auto local = locals_.find(specDecl);
+    if (local != locals_.end()) return &local->second;
+    auto global = globals_.find(specDecl);
+    if (global != globals_.end()) return &global->second;
+    return nullptr;
+}
+
+
+//! =================================================
+//! ================== Statements ===================
+//! =================================================
+
+void BytecodeCompiler::stmt(Stmt* s) {
+    int32_t mark = next_;
+
+    if (auto compound = dynamic_cast<CompoundStmt*>(s)) {
+        int32_t frame = frame_;
+        for (size_t i = 0; i < compound->num_blockItems(); i++) stmt(compound->blockItem(i));
+        frame_ = frame;                                                 // Locals of the block are dead
+        next_ = mark;
+    } else if (auto decl = dynamic_cast<Declaration*>(s)) {
+        local(decl->specifierDeclarator());
+    } else if (auto expStmt = dynamic_cast<ExpressionStmt*>(s)) {
+        value(expStmt->exp(), -1);
+        next_ = mark;
+    } else if (auto ret = dynamic_cast<ReturnStmt*>(s)) {
+        if (ret_ == Repr::Void) {
+            value(ret->exp(), -1);
+            emit(Op::RetVoid);
+        } else {
+            emit(Op::Ret, 0, value(ret->exp(), -1));
+        }
+        next_ = mark;
+    } else if (dynamic_cast<EmptyReturnStmt*>(s)) {
+        emit(Op::RetVoid);
+    } else if (auto loop = dynamic_cast<WhileStmt*>(s)) {
+        // Rotated: the condition is tested at the bottom, one jump per iteration
+        Fixups enter = {emit(Op::Jmp)};
+        uint32_t body = here();
+        loops_.emplace_back();
+        stmt(loop->loop());
+        patch(loops_.back().continues);
+        patch(enter);
+        Fixups again;
+        branch(loop->condition(), true, again);
+        for (auto at : again) p_.code[at].c = body;
+        patch(loops_.back().breaks);
+        loops_.pop_back();
+        next_ = mark;
+    } else if (auto ifElse = dynamic_cast<IfElseStmt*>(s)) {
+        Fixups otherwise;
+        branch(ifElse->condition(), false, otherwise);
+        next_ = mark;
+        stmt(ifElse->consequence());
+        Fixups end = {emit(Op::Jmp)};
+        patch(otherwise);
+        stmt(ifElse->alternative());
+        patch(end);
+    } else if (auto ifStmt = dynamic_cast<IfStmt*>(s)) {
+        Fixups otherwise;
+        branch(ifStmt->condition(), false, otherwise);
+        next_ = mark;
+        stmt(ifStmt->consequence());
+        patch(otherwise);
+    } else if (auto labeled = dynamic_cast<LabeledStmt*>(s)) {
+        labels_[labeled] = here();
+        stmt(labeled->statement());
+    } else if (auto gotoStmt = dynamic_cast<GoToStmt*>(s)) {
+        gotos_.emplace_back(emit(Op::Jmp), gotoStmt->target());
+    } else if (dynamic_cast<BreakStmt*>(s)) {
+        loops_.back().breaks.push_back(emit(Op::Jmp));
+    } else if (dynamic_cast<ContinueStmt*>(s)) {
+        loops_.back().continues.push_back(emit(Op::Jmp));
+    } else if (!dynamic_cast<NullStmt*>(s)) {
+        error(s, "Statement is not supported by the bytecode compiler!");
+    }
+}
+
+
+//! =================================================
+//! ================== Expressions ==================
+//! =================================================
+
+namespace {
+    bool isComparison(Tok::Tag tag) {
+        return tag == Tok::Tag::P_Equal || tag == Tok::Tag::P_Unequal || tag == Tok::Tag::P_Less
+            || tag == Tok::Tag::P_Less_Equal || tag == Tok::Tag::P_Greater || tag == Tok::Tag::P_Greater_Equal;
+    }
+
+    /// Compare-and-branch for @p tag, or for its negation.
+    Op jump(Tok::Tag tag, bool negate) {
+        switch (tag) {
+            case Tok::Tag::P_Equal:         return negate ? Op::JNe : Op::JEq;
+            case Tok::Tag::P_Unequal:       return negate ? Op::JEq : Op::JNe;
+            case Tok::Tag::P_Less:          return negate ? Op::JGe : Op::JLt;
+            case Tok::Tag::P_Less_Equal:    return negate ? Op::JGt : Op::JLe;
+            case Tok::Tag::P_Greater:       return negate ? Op::JLe : Op::JGt;
+            default:                        return negate ? Op::JLt : Op::JGe;
+        }
+    }
+
+    Op arithmetic(Tok::Tag tag) {
+        switch (tag) {
+            case Tok::Tag::P_Addition:          return Op::Add;
+            case Tok::Tag::P_Substraction:      return Op::Sub;
+            case Tok::Tag::P_Multiplication:    return Op::Mul;
+            case Tok::Tag::P_Division:          return Op::Div;
+            case Tok::Tag::P_Modulo:            return Op::Mod;
+            case Tok::Tag::P_Bitwise_Shift_L:   return Op::Shl;
+            case Tok::Tag::P_Bitwise_Shift_R:   return Op::Shr;
+            case Tok::Tag::P_Bitwise_And:       return Op::And;
+            case Tok::Tag::P_Bitwise_Or:        return Op::Or;
+            case Tok::Tag::P_Bitwise_Xor:       return Op::Xor;
+            case Tok::Tag::P_Equal:             return Op::Eq;
+            case Tok::Tag::P_Unequal:           return Op::Ne;
+            case Tok::Tag::P_Less:              return Op::Lt;
+            case Tok::Tag::P_Less_Equal:        return Op::Le;
+            case Tok::Tag::P_Greater:           return Op::Gt;
+            default:                            return Op::Ge;
+        }
+    }
+}
+
+int32_t BytecodeCompiler::value(Exp* exp, int32_t dst) {
+    if (exp->isConstant()) {
+        int32_t r = into(dst);
+        emit(Op::Const, r, 0, exp->constant());
+        return r;
+    }
+
+    if (auto id = dynamic_cast<Identifier*>(exp)) {
+        auto where = storage(id->specifierDeclarator());
+        if (where == nullptr) {
+            noStorage(id);
+            return into(dst);
+        }
+        return load(place(exp), dst);
+    }
+    if (auto literal = dynamic_cast<Literal*>(exp)) {
+        auto bytes = decodeLiteral(literal->value());
+        auto [it, added] = strings_.emplace(bytes, 0);
+        if (added) {
+            it->second = dataSlot(bytes.size() + 1, 1);
+            std::copy(bytes.begin(), bytes.end(), p_.data.begin() + it->second);
+        }
+        int32_t r = into(dst);
+        emit(Op::DataAddr, r, 0, it->second);
+        return r;
+    }
+    if (auto infix = dynamic_cast<InfixExp*>(exp)) {
+        auto tag = infix->operation().tag();
+        if (tag == Tok::Tag::P_Assign) return assign(infix, dst);
+        if (tag == Tok::Tag::P_Logical_And || tag == Tok::Tag::P_Logical_Or) {
+            int32_t r = into(dst);
+            Fixups otherwise;
+            branch(exp, false, otherwise);
+            emit(Op::Const, r, 0, 1);
+            Fixups end = {emit(Op::Jmp)};
+            patch(otherwise);
+            emit(Op::Const, r, 0, 0);
+            patch(end);
+            return r;
+        }
+        return binary(infix, dst);
+    }
+    if (auto ternary = dynamic_cast<TernaryExp*>(exp)) {
+        int32_t r = into(dst);
+        int32_t mark = next_;
+        Fixups otherwise;
+        branch(ternary->condition(), false, otherwise);
+        next_ = mark;
+        value(ternary->consequence(), r);
+        Fixups end = {emit(Op::Jmp)};
+        patch(otherwise);
+        next_ = mark;
+        value(ternary->alternative(), r);
+        patch(end);
+        next_ = mark;
+        return r;
+    }
+    if (auto prefix = dynamic_cast<PrefixExp*>(exp)) {
+        switch (prefix->prefix().tag()) {
+            case Tok::Tag::P_Multiplication:
+                return load(place(exp), dst);
+            case Tok::Tag::P_Bitwise_And: {
+                Place p = place(prefix->operand());
+                if (p.reg) {
+                    error(exp, "Cannot take the address of a register value!");
+                    return into(dst);
+                }
+                if (p.off == 0 && dst < 0) return p.r;
+                int32_t r = into(dst);
+                emit(Op::AddPI, r, p.r, p.off);
+                return r;
+            }
+            case Tok::Tag::P_Increment:
+            case Tok::Tag::P_Decrement:
+                return incDec(prefix->operand(), prefix->prefix().isa(Tok::Tag::P_Increment), false, dst);
+            case Tok::Tag::P_Addition:
+                return value(prefix->operand(), dst);
+            default: {
+                int32_t operand = value(prefix->operand(), -1);
+                int32_t r = into(dst);
+                auto tag = prefix->prefix().tag();
+                emit(tag == Tok::Tag::P_Substraction ? Op::Neg : tag == Tok::Tag::P_Logical_Not ? Op::Not : Op::BitNot, r, operand);
+                return r;
+            }
+        }
+    }
+    if (auto postfix = dynamic_cast<PostfixExp*>(exp))
+        return incDec(postfix->operand(), postfix->postfix().isa(Tok::Tag::P_Increment), true, dst);
+    if (dynamic_cast<MemberAccessExp*>(exp) || dynamic_cast<ArrayExp*>(exp))
+        return load(place(exp), dst);
+    if (auto funcCall = dynamic_cast<FuncCallExp*>(exp))
+        return call(funcCall, dst);
+
+    error(exp, "Expression is not supported by the bytecode compiler!");
+    return into(dst);
+}
+
+void BytecodeCompiler::branch(Exp* exp, bool when, Fixups& fixups) {
+    if (exp->isConstant()) {
+        if ((exp->constant() != 0) == when) fixups.push_back(emit(Op::Jmp));
+        return;
+    }
+
+    if (auto infix = dynamic_cast<InfixExp*>(exp)) {
+        auto tag = infix->operation().tag();
+        if (tag == Tok::Tag::P_Logical_And || tag == Tok::Tag::P_Logical_Or) {
+            bool isAnd = tag == Tok::Tag::P_Logical_And;
+            if (when != isAnd) {                                        // Either operand decides
+                branch(infix->lhs(), when, fixups);
+                branch(infix->rhs(), when, fixups);
+            } else {                                                    // Both operands are needed
+                Fixups skip;
+                branch(infix->lhs(), !when, skip);
+                branch(infix->rhs(), when, fixups);
+                patch(skip);
+            }
+            return;
+        }
+        if (isComparison(tag)) {
+            int32_t lhs = value(infix->lhs(), -1);
+            int32_t rhs = value(infix->rhs(), -1);
+            fixups.push_back(emit(jump(tag, !when), lhs, rhs));
+            return;
+        }
+    }
+    if (auto prefix = dynamic_cast<PrefixExp*>(exp)) {
+        if (prefix->prefix().isa(Tok::Tag::P_Logical_Not)) return branch(prefix->operand(), !when, fixups);
+    }
+
+    int32_t r = value(exp, -1);
+    fixups.push_back(emit(when ? Op::Jnz : Op::Jz, 0, r));
+}
+
+BytecodeCompiler::Place BytecodeCompiler::place(Exp* exp) {
+    Type* type = exp->type();
+
+    if (auto id = dynamic_cast<Identifier*>(exp)) {
+        auto where = storage(id->specifierDeclarator());
+        if (where == nullptr) {
+            noStorage(id);
+            return {true, 0, 0, type};
+        }
+        if (where->kind == Storage::Kind::Reg) return {true, where->index, 0, type};
+        int32_t r = temp();
+        emit(where->kind == Storage::Kind::Frame ? Op::FrameAddr : Op::DataAddr, r, 0, where->index);
+        return {false, r, 0, type};
+    }
+    if (auto prefix = dynamic_cast<PrefixExp*>(exp)) {
+        if (prefix->prefix().isa(Tok::Tag::P_Multiplication)) return {false, value(prefix->operand(), -1), 0, type};
+    }
+    if (auto array = dynamic_cast<ArrayExp*>(exp)) {
+        int32_t base = value(array->object(), -1);
+        int32_t size = sizeOf(type);
+        if (array->index()->isConstant()) return {false, base, int32_t(array->index()->constant() * size), type};
+        int32_t index = value(array->index(), -1);
+        int32_t r = temp();
+        if (size != 1) {
+            emit(Op::MulI, r, index, size);
+            index = r;
+        }
+        emit(Op::AddP, r, base, index);
+        return {false, r, 0, type};
+    }
+    if (auto access = dynamic_cast<MemberAccessExp*>(exp)) {
+        bool arrow = access->operation() == Tok::Tag::P_Arrow_R;
+        Type* objectType = access->object()->type();
+        Member m;
+        if (!member(arrow ? pointee(objectType) : objectType, access->member_name(), m)) {
+            error(exp, "Unknown struct member!");
+            return {true, 0, 0, type};
+        }
+        if (arrow) return {false, value(access->object(), -1), int32_t(m.offset), m.type};
+        Place object = place(access->object());
+        return {false, object.r, object.off + int32_t(m.offset), m.type};
+    }
+
+    error(exp, "Expression is not an lvalue!");
+    return {true, 0, 0, type};
+}
+
+int32_t BytecodeCompiler::load(const Place& place, int32_t dst) {
+    if (place.reg) {
+        if (dst < 0 || dst == place.r) return place.r;
+        emit(Op::Mov, dst, place.r);
+        return dst;
+    }
+    int32_t r = into(dst);
+    switch (repr(place.type)) {
+        case Repr::Char:    emit(Op::Ld8, r, place.r, place.off); break;
+        case Repr::Int:     emit(Op::Ld32, r, place.r, place.off); break;
+        case Repr::Ptr:     emit(Op::Ld64, r, place.r, place.off); break;
+        case Repr::Struct:  emit(Op::AddPI, r, place.r, place.off); break;    // Structs are handled by address
+        default:            break;
+    }
+    return r;
+}
+
+void BytecodeCompiler::store(const Place& place, int32_t value) {
+    if (place.reg) {
+        if (value != place.r) emit(Op::Mov, place.r, value);
+        if (repr(place.type) == Repr::Char) emit(Op::SExt8, place.r, place.r);
+        return;
+    }
+    switch (repr(place.type)) {
+        case Repr::Char:    emit(Op::St8, place.r, value, place.off); break;
+        case Repr::Int:     emit(Op::St32, place.r, value, place.off); break;
+        case Repr::Ptr:     emit(Op::St64, place.r, value, place.off); break;
+        case Repr::Struct: {
+            int32_t addr = place.r;
+            if (place.off != 0) emit(Op::AddPI, addr = temp(), place.r, place.off);
+            emit(Op::Copy, addr, value, place.type->size());
+            break;
+        }
+        default: break;
+    }
+}
+
+int32_t BytecodeCompiler::assign(InfixExp* exp, int32_t dst) {
+    Place p = place(exp->lhs());
+    if (p.reg) {
+        value(exp->rhs(), p.r);
+        if (repr(p.type) == Repr::Char) emit(Op::SExt8, p.r, p.r);
+        return load(p, dst);
+    }
+    int32_t r = value(exp->rhs(), dst);
+    store(p, r);
+    return r;
+}
+
+int32_t BytecodeCompiler::binary(InfixExp* exp, int32_t dst) {
+    auto tag = exp->operation().tag();
+    Repr lhsRepr = repr(exp->lhs()->type());
+    Repr rhsRepr = repr(exp->rhs()->type());
+
+    // Pointer arithmetic
+    if ((tag == Tok::Tag::P_Addition || tag == Tok::Tag::P_Substraction) && (lhsRepr == Repr::Ptr || rhsRepr == Repr::Ptr)) {
+        if (lhsRepr == Repr::Ptr && rhsRepr == Repr::Ptr) {                     // Difference in elements
+            int32_t lhs = value(exp->lhs(), -1);
+            int32_t rhs = value(exp->rhs(), -1);
+            int32_t r = into(dst);
+            emit(Op::SubP, r, lhs, rhs);
+            int32_t size = sizeOf(pointee(exp->lhs()->type()));
+            if (size != 1) {
+                int32_t divisor = temp();
+                emit(Op::Const, divisor, 0, size);
+                emit(Op::Div, r, r, divisor);
+            } else {
+                emit(Op::SExt32, r, r);
+            }
+            return r;
+        }
+        Exp* pointer = lhsRepr == Repr::Ptr ? exp->lhs() : exp->rhs();
+        Exp* offset = lhsRepr == Repr::Ptr ? exp->rhs() : exp->lhs();
+        int32_t size = sizeOf(pointee(pointer->type()));
+        if (tag == Tok::Tag::P_Substraction) size = -size;
+        int32_t base = value(pointer, -1);
+        int32_t r = into(dst);
+        if (offset->isConstant()) {
+            emit(Op::AddPI, r, base, int32_t(offset->constant() * size));
+            return r;
+        }
+        int32_t index = value(offset, -1);
+        if (size != 1) {
+            int32_t scaled = temp();
+            emit(Op::MulI, scaled, index, size);
+            index = scaled;
+        }
+        emit(Op::AddP, r, base, index);
+        return r;
+    }
+
+    int32_t lhs = value(exp->lhs(), -1);
+    if ((tag == Tok::Tag::P_Addition || tag == Tok::Tag::P_Substraction || tag == Tok::Tag::P_Multiplication) && exp->rhs()->isConstant()) {
+        int64_t imm = exp->rhs()->constant();
+        int32_t r = into(dst);
+        if (tag == Tok::Tag::P_Multiplication) emit(Op::MulI, r, lhs, imm);
+        else emit(Op::AddI, r, lhs, tag == Tok::Tag::P_Addition ? imm : -imm);
+        return r;
+    }
+    int32_t rhs = value(exp->rhs(), -1);
+    int32_t r = into(dst);
+    emit(arithmetic(tag), r, lhs, rhs);
+    return r;
+}
+
+int32_t BytecodeCompiler::incDec(Exp* operand, bool inc, bool post, int32_t dst) {
+    Place p = place(operand);
+    Repr r = repr(p.type);
+    int32_t step = r == Repr::Ptr ? sizeOf(pointee(p.type)) : 1;
+    if (!inc) step = -step;
+    Op add = r == Repr::Ptr ? Op::AddPI : Op::AddI;
+
+    int32_t current = load(p, -1);
+    int32_t old = current;
+    if (post) {
+        old = into(dst);
+        if (old != current) emit(Op::Mov, old, current);
+    }
+    int32_t updated = p.reg ? p.r : temp();
+    emit(add, updated, current, step);
+    if (r == Repr::Char) emit(Op::SExt8, updated, updated);
+    if (!p.reg) store(p, updated);
+    if (post) return old;
+    if (dst >= 0 && dst != updated) emit(Op::Mov, dst, updated);
+    return dst >= 0 ? dst : updated;
+}
+
+int32_t BytecodeCompiler::call(FuncCallExp* exp, int32_t dst) {
+    auto id = dynamic_cast<Identifier*>(exp->func());
+    auto callee = id ? id->specifierDeclarator() : nullptr;
+    auto function = functions_.find(callee);
+    auto external = externs_.find(callee);
+    if (function == functions_.end() && external == externs_.end()) {
+        error(exp, "Only named functions can be called!");
+        return into(dst);
+    }
+
+    int32_t base = next_;
+    next_ += exp->num_parameters();
+    num_regs_ = std::max(num_regs_, next_);
+    for (size_t i = 0; i < exp->num_parameters(); i++) {
+        auto arg = exp->parameters()[i].get();
+        if (repr(arg->type()) == Repr::Struct) error(arg, "Struct arguments are not supported!");
+        value(arg, base + i);
+    }
+    int32_t r = dst >= 0 ? dst : base;                                  // The arguments are dead after the call
+    if (function != functions_.end()) emit(Op::Call, r, function->second, base);
+    else emit(Op::CallExt, r, external->second, base);
+    next_ = std::max(base, r) + 1;
+    num_regs_ = std::max(num_regs_, next_);
+    return r;
+}
+
+}
+
+Program compileBytecode(TranslationUnit* unit, TranslationUnit* prelude) {
+    Program program;
+    BytecodeCompiler(program).unit(unit, prelude);
+    return program;
+}
+
+}
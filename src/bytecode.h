@@ -0,0 +1,147 @@
+#ifndef PROG_BYTECODE_H
+#define PROG_BYTECODE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.h"
+#include "lower.h"
+
+namespace H {
+
+namespace ir { struct Module; }
+
+//! =================================================
+//! ================== Instructions =================
+//! =================================================
+//
+// Register machine: every function has a window of 64 bit registers; its parameters arrive in the first ones. Values
+// of type 'int' are kept sign-extended from 32 bits, 'char' from 8 bits. Objects whose address is needed (structs and
+// locals used with '&') live in the frame memory of the function, globals and string literals in the data segment.
+//
+// Operands: a is the destination (or the address of a store), b and c are sources; #c is an immediate and @c a jump
+// target, an instruction index.
+
+#define H_BYTECODE(m)                                                                           \
+    m(Const,     "const")       /* a = #c                                                   */  \
+    m(Mov,       "mov")         /* a = b                                                    */  \
+    m(Add,       "add")         /* a = int(b + c)                                           */  \
+    m(Sub,       "sub")         /* a = int(b - c)                                           */  \
+    m(Mul,       "mul")         /* a = int(b * c)                                           */  \
+    m(Div,       "div")         /* a = int(b / c)                                           */  \
+    m(Mod,       "mod")         /* a = int(b % c)                                           */  \
+    m(Shl,       "shl")         /* a = int(b << c)                                          */  \
+    m(Shr,       "shr")         /* a = int(b >> c)                                          */  \
+    m(And,       "and")         /* a = b & c                                                */  \
+    m(Or,        "or")          /* a = b | c                                                */  \
+    m(Xor,       "xor")         /* a = b ^ c                                                */  \
+    m(AddI,      "addi")        /* a = int(b + #c)                                          */  \
+    m(MulI,      "muli")        /* a = int(b * #c)                                          */  \
+    m(AddP,      "addp")        /* a = b + c, 64 bit                                        */  \
+    m(AddPI,     "addpi")       /* a = b + #c, 64 bit                                       */  \
+    m(SubP,      "subp")        /* a = b - c, 64 bit                                        */  \
+    m(Neg,       "neg")         /* a = int(-b)                                              */  \
+    m(Not,       "not")         /* a = !b                                                   */  \
+    m(BitNot,    "bitnot")      /* a = ~b                                                   */  \
+    m(SExt8,     "sext8")       /* a = char(b)                                              */  \
+    m(SExt32,    "sext32")      /* a = int(b)                                               */  \
+    m(Eq,        "eq")          /* a = b == c                                               */  \
+    m(Ne,        "ne")          /* a = b != c                                               */  \
+    m(Lt,        "lt")          /* a = b < c                                                */  \
+    m(Le,        "le")          /* a = b <= c                                               */  \
+    m(Gt,        "gt")          /* a = b > c                                                */  \
+    m(Ge,        "ge")          /* a = b >= c                                               */  \
+    m(Ld8,       "ld8")         /* a = char at b + #c                                       */  \
+    m(Ld32,      "ld32")        /* a = int at b + #c                                        */  \
+    m(Ld64,      "ld64")        /* a = pointer at b + #c                                    */  \
+    m(St8,       "st8")         /* char at a + #c = b                                       */  \
+    m(St32,      "st32")        /* int at a + #c = b                                        */  \
+    m(St64,      "st64")        /* pointer at a + #c = b                                    */  \
+    m(Copy,      "copy")        /* #c bytes at a = bytes at b                               */  \
+    m(FrameAddr, "frameaddr")   /* a = frame memory + #c                                    */  \
+    m(DataAddr,  "dataaddr")    /* a = data segment + #c                                    */  \
+    m(Jmp,       "jmp")         /* goto @c                                                  */  \
+    m(Jz,        "jz")          /* if (!b) goto @c                                          */  \
+    m(Jnz,       "jnz")         /* if (b) goto @c                                           */  \
+    m(JEq,       "jeq")         /* if (a == b) goto @c                                      */  \
+    m(JNe,       "jne")         /* if (a != b) goto @c                                      */  \
+    m(JLt,       "jlt")         /* if (a < b) goto @c                                       */  \
+    m(JLe,       "jle")         /* if (a <= b) goto @c                                      */  \
+    m(JGt,       "jgt")         /* if (a > b) goto @c                                       */  \
+    m(JGe,       "jge")         /* if (a >= b) goto @c                                      */  \
+    m(Call,      "call")        /* a = function #b with the arguments in c, c+1, ...        */  \
+    m(CallExt,   "callext")     /* a = external function #b with the arguments in c, ...    */  \
+    m(Ret,       "ret")         /* return b                                                 */  \
+    m(RetVoid,   "retvoid")     /* return                                                   */
+
+enum class Op : uint8_t {
+#define CODE(op, str) op,
+    H_BYTECODE(CODE)
+#undef CODE
+};
+
+const char* op2str(Op op);
+
+struct Insn {
+    Op op;
+    int32_t a = 0;
+    int32_t b = 0;
+    int32_t c = 0;
+};
+
+
+//! =================================================
+//! ==================== Program ====================
+//! =================================================
+
+struct BcFunction {
+    std::string name;
+    uint32_t entry = 0;                                                 // Index of the first instruction
+    uint32_t num_params = 0;
+    uint32_t num_regs = 0;                                              // Size of the register window
+    uint32_t frame_size = 0;                                            // Bytes of frame memory
+    Repr ret = Repr::Void;
+};
+
+/// Function declared without a body; resolved in the running process by name.
+struct BcExtern {
+    std::string name;
+    uint32_t num_params = 0;
+    Repr ret = Repr::Void;
+};
+
+/// Bytecode of a checked translation unit.
+struct Program {
+    std::vector<Insn> code;
+    std::vector<BcFunction> functions;
+    std::vector<BcExtern> externs;
+    std::string data;                                                   // Initial data segment: globals (zero) and string literals
+    std::unordered_map<std::string, uint32_t> function_index;
+
+    /// Index of the function @p name or -1.
+    int64_t function(const std::string& name) const {
+        auto it = function_index.find(name);
+        return it != function_index.end() ? int64_t(it->second) : -1;
+    }
+
+    void dump(std::ostream& o) const;
+};
+
+
+//! =================================================
+//! =============== Bytecode Compiler ===============
+//! =================================================
+
+/// Lowers a checked translation unit, after the declarations of its @p prelude if any, to bytecode; unsupported
+/// constructs are reported as errors.
+Program compileBytecode(TranslationUnit* unit, TranslationUnit* prelude = nullptr);
+
+/// Lowers the SSA IR of a checked translation unit, after whatever passes ran on it.
+Program compileBytecode(ir::Module& module);
+
+}
+
+#endif
@@ -0,0 +1,541 @@
+#include "incremental.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+#include "parser.h"
+
+namespace H {
+
+namespace {
+    /// Redirects diagnostics into a string; @p num_errors is left untouched.
+    class Capture : public std::streambuf {
+        public:
+            Capture()
+                : old_(std::cerr.rdbuf(this))
+                , num_errors_(num_errors)
+            {}
+            ~Capture() {
+                std::cerr.rdbuf(old_);
+                num_errors = num_errors_;
+            }
+
+            /// Diagnostics since the last call; their number of errors is added to @p errors.
+            std::string take(int& errors) {
+                errors += num_errors - num_errors_;
+                num_errors = num_errors_;
+                std::string result;
+                result.swap(text_);
+                return result;
+            }
+
+        protected:
+            int_type overflow(int_type c) override {
+                if (c != traits_type::eof()) text_ += traits_type::to_char_type(c);
+                return c;
+            }
+            std::streamsize xsputn(const char* s, std::streamsize n) override {
+                text_.append(s, n);
+                return n;
+            }
+
+        private:
+            std::string text_;
+            std::streambuf* old_;
+            int num_errors_;
+    };
+
+    Ptr<TranslationUnit> replay(const char* file, const AstRecord& record) {
+        return AstCache::replay(file, record.nodes.data(), record.nodes.size(), record.toks.data(), record.toks.size(), record.strings.data(), record.strings.size());
+    }
+
+    struct Span {
+        size_t begin, end, body;                                        // Byte offsets; @p body is the function body brace or @p end
+        Pos start;
+    };
+
+    /// Cuts @p source after each top-level ';' and after each function body, starting at the chunk boundary @p from.
+    /// Leading whitespace and comments belong to the following chunk, trailing ones to the last chunk.
+    /// Stops early at the first boundary @p sync accepts; returns whether it did.
+    template<class Sync>
+    bool split(const std::string& source, size_t from, Pos from_pos, std::vector<Span>& spans, Sync sync) {
+        size_t begin = from, body = std::string::npos;
+        Pos start = from_pos, pos = from_pos;
+        int depth = 0;
+        bool significant = false;                                       // Chunk holds more than stray semicolons
+        char last = 0;                                                  // Last character outside of comments and whitespace
+
+        size_t i = from, size = source.size();
+        auto advance = [&]() {
+            if (source[i++] == '\n') {
+                ++pos.row;
+                pos.col = 1;
+            } else {
+                ++pos.col;
+            }
+        };
+
+        while (i < size) {
+            char c = source[i];
+            if (c == '/' && i + 1 < size && source[i+1] == '/') {
+                while (i < size && source[i] != '\n') advance();
+                continue;
+            }
+            if (c == '/' && i + 1 < size && source[i+1] == '*') {
+                advance(); advance();
+                while (i < size && !(source[i] == '*' && i + 1 < size && source[i+1] == '/')) advance();
+                if (i < size) { advance(); advance(); }
+                continue;
+            }
+            if (std::isspace((unsigned char) c)) {
+                advance();
+                continue;
+            }
+            if (c == '"' || c == '\'') {
+                significant = true;
+                last = c;
+                advance();
+                while (i < size && source[i] != c && source[i] != '\n') {
+                    if (source[i] == '\\' && i + 1 < size) advance();
+                    advance();
+                }
+                if (i < size && source[i] == c) advance();
+                continue;
+            }
+
+            if (c == '{' && depth == 0 && last == ')') body = i;
+            if (c == '{' || c == '(' || c == '[') ++depth;
+            if ((c == '}' || c == ')' || c == ']') && depth > 0) --depth;
+            if (c != ';') significant = true;
+            last = c;
+            advance();
+
+            if (depth == 0 && ((c == ';' && significant) || (c == '}' && body != std::string::npos))) {
+                spans.push_back({begin, i, body == std::string::npos ? i : body, start});
+                if (i < size && sync(i, pos)) return true;
+                begin = i;
+                start = pos;
+                body = std::string::npos;
+                significant = false;
+            }
+        }
+
+        if (begin < size || spans.empty()) {
+            if (significant || spans.empty()) {
+                spans.push_back({begin, size, body == std::string::npos ? size : body, start});
+            } else {
+                spans.back().end = size;
+                if (spans.back().body == begin) spans.back().body = size;
+            }
+        }
+        return false;
+    }
+
+    /// Does a line of @p source start with '#'?
+    bool has_directives(const std::string& source) {
+        bool bol = true;
+        for (char c : source) {
+            if (bol && c == '#') return true;
+            if (c == '\n') bol = true;
+            else if (c != ' ' && c != '\t') bol = false;
+        }
+        return false;
+    }
+}
+
+IncrementalSession::IncrementalSession(std::string file)
+    : file_(std::move(file))
+{}
+
+std::vector<ExternalDeclaration*> IncrementalSession::declarations() const {
+    std::vector<ExternalDeclaration*> result;
+    for (auto& chunk : chunks_) {
+        if (!chunk->parsed) continue;
+        for (auto& decl : chunk->ast->external_declarations()) result.push_back(decl.get());
+    }
+    return result;
+}
+
+
+//! =================================================
+//! ================ Chunk Upkeep ===================
+//! =================================================
+
+/// Parses @p text as @p chunk; @p types are the typedef names declared before it.
+void IncrementalSession::parse(Chunk& chunk, const std::string& text, const std::vector<std::string>& types) {
+    Capture capture;
+    chunk.record = AstRecord();
+    std::istringstream stream(text);
+    Parser<RecordingBuilder> parser(file_.c_str(), stream, RecordingBuilder(chunk.record), NoTrace(), chunk.start);
+    for (auto& name : types) parser.type_names().declare(name, true);
+    parser.parse_prg();
+
+    chunk.parse_errors = 0;
+    chunk.parse_diags = capture.take(chunk.parse_errors);
+    chunk.base_row = chunk.start.row;
+    chunk.parsed = chunk.parse_errors == 0;
+    chunk.ast = chunk.parsed ? replay(file_.c_str(), chunk.record) : nullptr;
+    chunk.parsed = chunk.ast != nullptr;
+    if (!chunk.parsed) chunk.record = AstRecord();
+    chunk.fresh = true;
+    index(chunk);
+}
+
+/// Moves the record and the stored diagnostics of @p chunk to its current row.
+void IncrementalSession::relocate(Chunk& chunk) {
+    int delta = chunk.start.row - chunk.base_row;
+    if (delta == 0) return;
+    for (auto& node : chunk.record.nodes) {
+        node.loc.begin.row += delta;
+        node.loc.finish.row += delta;
+    }
+    for (auto& tok : chunk.record.toks) {
+        tok.loc.begin.row += delta;
+        tok.loc.finish.row += delta;
+    }
+    chunk.parse_diags = shift(chunk.parse_diags, delta);
+    for (auto& diags : chunk.body_diags) diags = shift(diags, delta);
+    chunk.base_row = chunk.start.row;
+}
+
+/// Replaces the (already checked) AST of @p chunk by an unchecked one at the current position.
+void IncrementalSession::rebuild(Chunk& chunk) {
+    relocate(chunk);
+    chunk.ast = replay(file_.c_str(), chunk.record);
+    chunk.fresh = true;
+}
+
+void IncrementalSession::index(Chunk& chunk) {
+    chunk.declared.clear();
+    chunk.types.clear();
+    chunk.referenced.clear();
+    if (!chunk.parsed) return;
+
+    for (auto& tok : chunk.record.toks) {
+        if (Tok::Tag(tok.tag) == Tok::Tag::M_Id) chunk.referenced.emplace(chunk.record.string(tok.str));
+    }
+    for (auto& decl : chunk.ast->external_declarations()) {
+        auto specDecl = decl->specifierDeclarator();
+        if (specDecl == nullptr) continue;
+        if (!specDecl->name().empty()) chunk.declared.emplace_back(specDecl->name());
+        if (!specDecl->name().empty() && specDecl->isTypedef()) chunk.types.push_back(specDecl->name());
+        auto structSpecif = dynamic_cast<StructSpecifier*>(specDecl->specifier());
+        if (structSpecif != nullptr && structSpecif->declarationListSet() && !structSpecif->structIdentifierString().empty())
+            chunk.declared.emplace_back(structSpecif->structIdentifierString());
+    }
+}
+
+/// Adds @p delta to the row of every "<file>:<row>:" in @p diags.
+std::string IncrementalSession::shift(const std::string& diags, int delta) const {
+    if (delta == 0 || diags.empty()) return diags;
+    std::string prefix = file_ + ":";
+    std::string result;
+    size_t pos = 0;
+    for (size_t hit; (hit = diags.find(prefix, pos)) != std::string::npos; ) {
+        size_t digits = hit + prefix.size(), end = digits;
+        while (end < diags.size() && std::isdigit((unsigned char) diags[end])) ++end;
+        result.append(diags, pos, digits - pos);
+        if (end != digits) result += std::to_string(std::stoi(diags.substr(digits, end - digits)) + delta);
+        pos = end;
+    }
+    result.append(diags, pos, std::string::npos);
+    return result;
+}
+
+
+//! =================================================
+//! =================== Update ======================
+//! =================================================
+
+int IncrementalSession::update(const std::string& source, std::ostream& diag) {
+    stats_ = Stats();
+
+    if (has_directives(source)) {
+        auto chunk = std::make_unique<Chunk>();
+        chunk->end = source.size();
+        chunk->signature = AstCache::hash(source);
+        chunk->start = Pos(1, 1);
+        parse(*chunk, source, {});
+        chunks_.clear();
+        chunks_.push_back(std::move(chunk));
+        source_ = source;
+        ++stats_.reparsed;
+        return check(diag);
+    }
+
+    // Bytes the old and the new source share at the front and at the back
+    size_t limit = std::min(source_.size(), source.size());
+    size_t head = std::mismatch(source.begin(), source.begin() + limit, source_.begin()).first - source.begin();
+    size_t tail = std::mismatch(source.rbegin(), source.rbegin() + (limit - head), source_.rbegin()).first - source.rbegin();
+    bool unchanged = head == source.size() && head == source_.size();
+
+    // Chunks before the first changed byte are kept (the last one may absorb new trailing whitespace)
+    size_t old_size = chunks_.size();
+    size_t prefix = 0;
+    while (prefix < old_size && chunks_[prefix]->end <= head && (prefix + 1 < old_size || unchanged)) ++prefix;
+
+    // Split the rest until a boundary in the shared tail meets the start of an old chunk at the same column
+    std::vector<Span> spans;
+    size_t resume = old_size, resume_row = 0;
+    auto sync = [&](size_t offset, Pos pos) {
+        if (offset <= source.size() - tail) return false;
+        size_t old_offset = offset - source.size() + source_.size();
+        auto it = std::lower_bound(chunks_.begin() + prefix, chunks_.end(), old_offset, [](const Ptr<Chunk>& chunk, size_t o) { return chunk->begin < o; });
+        if (it == chunks_.end() || (*it)->begin != old_offset || (*it)->start.col != pos.col) return false;
+        resume = it - chunks_.begin();
+        resume_row = pos.row;
+        return true;
+    };
+    auto resplit = [&]() {
+        spans.clear();
+        size_t from = prefix ? chunks_[prefix-1]->end : 0;
+        Pos from_pos = prefix < old_size ? chunks_[prefix]->start : Pos(1, 1);
+        return split(source, from, from_pos, spans, sync);
+    };
+    if (!unchanged && !resplit() && prefix > 0) {
+        --prefix;                                                       // Trailing whitespace may have to join the previous chunk
+        resplit();
+    }
+
+    // Parse the new middle
+    std::vector<std::string> types;                                     // Typedef names declared so far
+    for (size_t i = 0; i != prefix; ++i) types.insert(types.end(), chunks_[i]->types.begin(), chunks_[i]->types.end());
+    std::vector<Ptr<Chunk>> middle;
+    for (auto& span : spans) {
+        auto chunk = std::make_unique<Chunk>();
+        chunk->begin = span.begin;
+        chunk->end = span.end;
+        chunk->signature = AstCache::hash(source.data() + span.begin, span.body - span.begin);
+        chunk->start = span.start;
+        parse(*chunk, source.substr(span.begin, span.end - span.begin), types);
+        types.insert(types.end(), chunk->types.begin(), chunk->types.end());
+        middle.push_back(std::move(chunk));
+        ++stats_.reparsed;
+    }
+
+    // A global changed if the signatures of its declarations in the replaced range differ
+    std::unordered_map<Sym, std::vector<uint64_t>> old_sigs, new_sigs;
+    for (size_t i = prefix; i != resume; ++i)
+        for (auto name : chunks_[i]->declared) old_sigs[name].push_back(chunks_[i]->signature);
+    for (auto& chunk : middle)
+        for (auto name : chunk->declared) new_sigs[name].push_back(chunk->signature);
+    std::vector<Sym> changed;
+    for (auto& [name, sigs] : old_sigs) if (new_sigs[name] != sigs) changed.push_back(name);
+    for (auto& [name, sigs] : new_sigs) if (!old_sigs.count(name) && !sigs.empty()) changed.push_back(name);
+
+    // Names that were declared as types a different number of times change how later chunks parse
+    std::unordered_map<std::string, int> type_delta;
+    for (size_t i = prefix; i != resume; ++i) for (auto& name : chunks_[i]->types) --type_delta[name];
+    for (auto& chunk : middle) for (auto& name : chunk->types) ++type_delta[name];
+    std::unordered_set<Sym> retyped;
+    for (auto& [name, delta] : type_delta) if (delta != 0) retyped.emplace(name);
+
+    // Move the kept back by the size and row difference of the edit, then splice in the new middle
+    if (resume != old_size) {
+        int rows = int(resume_row) - chunks_[resume]->start.row;
+        for (size_t i = resume; i != old_size; ++i) {
+            auto& chunk = *chunks_[i];
+            chunk.begin = chunk.begin + source.size() - source_.size();
+            chunk.end = chunk.end + source.size() - source_.size();
+            chunk.start.row += rows;
+        }
+    }
+    chunks_.erase(chunks_.begin() + prefix, chunks_.begin() + resume);
+    chunks_.insert(chunks_.begin() + prefix, std::make_move_iterator(middle.begin()), std::make_move_iterator(middle.end()));
+    source_ = source;
+
+    // Parse the chunks after the edit again that may now read differently (those with syntax errors may mention anything)
+    for (size_t i = prefix + middle.size(); !retyped.empty() && i != chunks_.size(); ++i) {
+        auto& chunk = *chunks_[i];
+        bool affected = !chunk.parsed;
+        for (auto& name : chunk.referenced) affected = affected || retyped.count(name);
+        if (affected) {
+            auto old_types = chunk.types;
+            changed.insert(changed.end(), chunk.declared.begin(), chunk.declared.end());
+            parse(chunk, source.substr(chunk.begin, chunk.end - chunk.begin), types);
+            changed.insert(changed.end(), chunk.declared.begin(), chunk.declared.end());
+            if (old_types != chunk.types) {
+                for (auto& name : old_types) retyped.emplace(name);
+                for (auto& name : chunk.types) retyped.emplace(name);
+            }
+            ++stats_.reparsed;
+        }
+        types.insert(types.end(), chunk.types.begin(), chunk.types.end());
+    }
+
+    // A rebuilt chunk changes what it declares in turn (a typedef of an edited struct): follow until nothing is added
+    std::unordered_set<Sym> seen(changed.begin(), changed.end());
+    while (!changed.empty()) {
+        std::vector<Sym> next;
+        for (auto& chunk : chunks_) {
+            if (chunk->fresh || !chunk->parsed) continue;
+            for (auto name : changed) {
+                if (chunk->referenced.count(name)) {
+                    rebuild(*chunk);
+                    for (auto declared : chunk->declared) if (seen.insert(declared).second) next.push_back(declared);
+                    break;
+                }
+            }
+        }
+        changed = std::move(next);
+    }
+
+    return check(diag);
+}
+
+/// Enters the declarations of all chunks into a new @p Sema, checks the bodies of the fresh ones and writes the
+/// diagnostics of the whole file to @p diag.
+int IncrementalSession::check(std::ostream& diag) {
+    // Global declarations are cheap and order dependent: enter all of them again
+    int errors = 0;
+    std::string out;
+    {
+        Capture capture;
+        Sema sema;
+        for (auto& ptr : chunks_) {
+            auto& chunk = *ptr;
+            int delta = chunk.start.row - chunk.base_row;
+            out += shift(chunk.parse_diags, delta);
+            errors += chunk.parse_errors;
+            if (!chunk.parsed) continue;
+            if (chunk.fresh) {
+                chunk.body_diags.assign(chunk.ast->num_ext_declarations(), std::string());
+                chunk.body_errors = 0;
+                ++stats_.rechecked;
+            }
+
+            for (size_t i = 0; i != chunk.ast->num_ext_declarations(); ++i) {
+                auto decl = chunk.ast->external_declaration(i);
+                bool declared = decl->declare(sema);
+                out += shift(capture.take(errors), delta);
+                if (!declared) continue;
+
+                if (chunk.fresh) {
+                    decl->checkBody(sema);
+                    chunk.body_diags[i] = capture.take(chunk.body_errors);
+                }
+                out += shift(chunk.body_diags[i], delta);
+            }
+            errors += chunk.body_errors;
+            chunk.fresh = false;
+        }
+    }
+    diag << out;
+
+    stats_.chunks = chunks_.size();
+    num_errors = errors;
+    return errors;
+}
+
+
+//! =================================================
+//! ================= State File ====================
+//! =================================================
+
+namespace {
+    constexpr char state_magic[4] = {'H', 'I', 'N', 'C'};
+    constexpr uint32_t state_version = 4;
+
+    template<class T>
+    void write(std::ostream& o, const T& value) { o.write(reinterpret_cast<const char*>(&value), sizeof(T)); }
+
+    template<class T>
+    void write(std::ostream& o, const std::vector<T>& values) {
+        write(o, uint64_t(values.size()));
+        o.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    void write(std::ostream& o, const std::string& str) {
+        write(o, uint64_t(str.size()));
+        o.write(str.data(), str.size());
+    }
+
+    template<class T>
+    bool read(std::istream& i, T& value) { return bool(i.read(reinterpret_cast<char*>(&value), sizeof(T))); }
+
+    template<class T>
+    bool read(std::istream& i, std::vector<T>& values) {
+        uint64_t size;
+        if (!read(i, size) || size > (1ull << 32)) return false;
+        values.resize(size);
+        return bool(i.read(reinterpret_cast<char*>(values.data()), size * sizeof(T)));
+    }
+
+    bool read(std::istream& i, std::string& str) {
+        uint64_t size;
+        if (!read(i, size) || size > (1ull << 32)) return false;
+        str.resize(size);
+        return bool(i.read(str.data(), size));
+    }
+}
+
+void IncrementalSession::save(const std::string& path) const {
+    std::ofstream o(path, std::ios::binary | std::ios::trunc);
+    o.write(state_magic, sizeof(state_magic));
+    write(o, state_version);
+    write(o, file_);
+    write(o, source_);
+    write(o, uint64_t(chunks_.size()));
+    for (auto& ptr : chunks_) {
+        auto& chunk = *ptr;
+        write(o, uint64_t(chunk.begin));
+        write(o, uint64_t(chunk.end));
+        write(o, chunk.signature);
+        write(o, chunk.start.row);
+        write(o, chunk.start.col);
+        write(o, chunk.base_row);
+        write(o, uint8_t(chunk.parsed));
+        write(o, chunk.parse_diags);
+        write(o, chunk.parse_errors);
+        write(o, uint64_t(chunk.body_diags.size()));
+        for (auto& diags : chunk.body_diags) write(o, diags);
+        write(o, chunk.body_errors);
+        write(o, chunk.record.nodes);
+        write(o, chunk.record.toks);
+        write(o, chunk.record.strings);
+    }
+}
+
+bool IncrementalSession::load(const std::string& path) {
+    std::ifstream i(path, std::ios::binary);
+    char magic[4];
+    uint32_t version;
+    std::string file, source;
+    uint64_t size;
+    if (!i.read(magic, sizeof(magic)) || std::string(magic, 4) != std::string(state_magic, 4)) return false;
+    if (!read(i, version) || version != state_version || !read(i, file) || file != file_ || !read(i, source) || !read(i, size)) return false;
+
+    std::vector<Ptr<Chunk>> chunks;
+    for (uint64_t n = 0; n != size; ++n) {
+        chunks.push_back(std::make_unique<Chunk>());
+        auto& chunk = *chunks.back();
+        uint8_t parsed;
+        uint64_t num_bodies;
+        uint64_t begin, end;
+        bool ok = read(i, begin) && read(i, end) && read(i, chunk.signature) && read(i, chunk.start.row) && read(i, chunk.start.col)
+            && read(i, chunk.base_row) && read(i, parsed) && read(i, chunk.parse_diags) && read(i, chunk.parse_errors)
+            && read(i, num_bodies) && num_bodies < (1ull << 32);
+        if (!ok) return false;
+        chunk.body_diags.resize(num_bodies);
+        for (auto& diags : chunk.body_diags) if (!read(i, diags)) return false;
+        if (!read(i, chunk.body_errors) || !read(i, chunk.record.nodes) || !read(i, chunk.record.toks) || !read(i, chunk.record.strings)) return false;
+
+        chunk.begin = begin;
+        chunk.end = end;
+        chunk.parsed = parsed;
+        if (chunk.parsed) {
+            chunk.ast = replay(file_.c_str(), chunk.record);
+            if (chunk.ast == nullptr || chunk.ast->num_ext_declarations() != chunk.body_diags.size()) return false;
+        }
+        index(chunk);
+    }
+    chunks_ = std::move(chunks);
+    source_ = std::move(source);
+    return true;
+}
+
+}
@@ -0,0 +1,85 @@
+#ifndef PROG_INCREMENTAL_H
+#define PROG_INCREMENTAL_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "ast_cache.h"
+
+namespace H {
+
+/// Keeps the parsed and checked state of one file between edits (@c --incremental).
+///
+/// The source is split into chunks, one per external declaration. On @p update() only chunks whose text changed
+/// are parsed again. Function bodies are checked again only if they were reparsed or if they mention a global
+/// whose declaration changed. Everything else keeps its AST (as an @p AstRecord) and its diagnostics.
+///
+/// Unlike whole-file checking, declarations that parse are still checked when other chunks have syntax errors.
+/// Each chunk is parsed knowing the typedef names declared before it, and a chunk is parsed again when one of the names
+/// it mentions changes between typedef name and ordinary identifier. A file with preprocessing directives is a single
+/// chunk that every update parses and checks again: a directive affects everything after it, and included headers may
+/// change between updates.
+class IncrementalSession {
+    public:
+        struct Stats {
+            size_t chunks = 0;
+            size_t reparsed = 0;
+            size_t rechecked = 0;
+        };
+
+        IncrementalSession(std::string file);
+
+        /// Brings the session up to date with @p source and writes all diagnostics of the file to @p diag.
+        /// Returns the number of errors (also stored in @p num_errors).
+        int update(const std::string& source, std::ostream& diag);
+
+        /// Restores a session written by @p save(); @c false if @p path is missing, stale or for another file.
+        bool load(const std::string& path);
+        void save(const std::string& path) const;
+
+        const Stats& stats() const { return stats_; }
+
+        /// External declarations of the current source in order (those of chunks with syntax errors are missing).
+        std::vector<ExternalDeclaration*> declarations() const;
+
+    private:
+        struct Chunk {
+            size_t begin = 0, end = 0;                                  // Byte range in the current source
+            uint64_t signature = 0;                                     // Hash of the text before the function body
+            Pos start;                                                  // Position of the chunk in the current source
+            int base_row = 0;                                           // Row of @p start when @p record and the diagnostics were made
+
+            bool parsed = false;                                        // No syntax errors: @p record and @p ast are valid
+            AstRecord record;
+            Ptr<TranslationUnit> ast;
+            bool fresh = false;                                         // @p ast has not been checked yet
+
+            std::string parse_diags;
+            int parse_errors = 0;
+            std::vector<std::string> body_diags;                        // One entry per external declaration
+            int body_errors = 0;
+
+            std::vector<Sym> declared;                                  // Globals and structs this chunk declares
+            std::vector<std::string> types;                             // Typedef names among them
+            std::unordered_set<Sym> referenced;                         // Identifiers this chunk mentions
+        };
+
+        void parse(Chunk& chunk, const std::string& text, const std::vector<std::string>& types);
+        int check(std::ostream& diag);
+        void relocate(Chunk& chunk);
+        void rebuild(Chunk& chunk);
+        void index(Chunk& chunk);
+        std::string shift(const std::string& diags, int delta) const;
+
+        std::string file_;
+        std::string source_;
+        std::vector<Ptr<Chunk>> chunks_;                                // Owned separately so that splicing an edit moves pointers only
+        Stats stats_;
+};
+
+}
+
+#endif
@@ -0,0 +1,428 @@
+#include "ir.h"
+
+#include <unordered_set>
+
+#include "lower.h"
+
+namespace H::ir {
+
+const char* op2str(Op op) {
+    switch (op) {
+#define CODE(op, str) case Op::op: return str;
+        H_IR(CODE)
+#undef CODE
+        default: return "<unknown>";
+    }
+}
+
+const char* ty2str(Ty ty) {
+    switch (ty) {
+        case Ty::I8:    return "i8";
+        case Ty::I32:   return "i32";
+        case Ty::Ptr:   return "ptr";
+        default:        return "void";
+    }
+}
+
+Ty tyOf(const Type* type) {
+    switch (repr(type)) {
+        case Repr::Char:    return Ty::I8;
+        case Repr::Int:     return Ty::I32;
+        case Repr::Ptr:     return Ty::Ptr;
+        default:            return Ty::Void;
+    }
+}
+
+
+//! =================================================
+//! ============== Values and Instructions ==========
+//! =================================================
+
+void Value::replaceAllUsesWith(Value* other) {
+    while (!users_.empty()) {
+        Instruction* user = users_.back();
+        for (size_t i = 0; i < user->num_operands(); i++)
+            if (user->operand(i) == this) user->setOperand(i, other);
+    }
+}
+
+void Instruction::addOperand(Value* value) {
+    operands_.push_back(value);
+    value->users_.push_back(this);
+}
+
+void Instruction::setOperand(size_t i, Value* value) {
+    auto& users = operands_[i]->users_;
+    users.erase(std::find(users.begin(), users.end(), this));
+    operands_[i] = value;
+    value->users_.push_back(this);
+}
+
+void Instruction::removeOperand(size_t i) {
+    auto& users = operands_[i]->users_;
+    users.erase(std::find(users.begin(), users.end(), this));
+    operands_.erase(operands_.begin() + i);
+}
+
+void Instruction::dropOperands() {
+    for (auto operand : operands_) {
+        auto& users = operand->users_;
+        users.erase(std::find(users.begin(), users.end(), this));
+    }
+    operands_.clear();
+}
+
+bool Instruction::hasSideEffects() const {
+    switch (op_) {
+        case Op::Store: case Op::Copy: case Op::Call: case Op::Br: case Op::CondBr: case Op::Ret:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+//! =================================================
+//! ============== Blocks and Functions =============
+//! =================================================
+
+Instruction* Block::terminator() const {
+    if (instructions_.empty() || !instructions_.back()->isTerminator()) return nullptr;
+    return instructions_.back().get();
+}
+
+Instruction* Block::append(std::unique_ptr<Instruction> insn) {
+    return insert(std::move(insn), instructions_.size());
+}
+
+Instruction* Block::insert(std::unique_ptr<Instruction> insn, size_t before) {
+    insn->block_ = this;
+    return instructions_.insert(instructions_.begin() + before, std::move(insn))->get();
+}
+
+std::unique_ptr<Instruction> Block::remove(Instruction* insn) {
+    auto it = std::find_if(instructions_.begin(), instructions_.end(), [&](auto& i) { return i.get() == insn; });
+    auto result = std::move(*it);
+    instructions_.erase(it);
+    result->block_ = nullptr;
+    return result;
+}
+
+void Block::moveAllTo(Block* other) {
+    for (auto& insn : instructions_) {
+        insn->block_ = other;
+        other->instructions_.push_back(std::move(insn));
+    }
+    instructions_.clear();
+}
+
+std::vector<Block*> Block::successors() const {
+    auto term = terminator();
+    return term ? term->blocks() : std::vector<Block*>();
+}
+
+Function::~Function() {
+    // Operands may refer to instructions of blocks destroyed earlier
+    for (auto& block : blocks_)
+        for (auto& insn : block->instructions()) insn->dropOperands();
+}
+
+Argument* Function::addArg(Ty ty, std::string name) {
+    args_.push_back(std::make_unique<Argument>(ty, args_.size(), std::move(name)));
+    return args_.back().get();
+}
+
+Block* Function::addBlock(std::string name) {
+    size_t id = blockIds_++;
+    blocks_.push_back(std::make_unique<Block>(this, id == 0 ? name : name + std::to_string(id)));
+    return blocks_.back().get();
+}
+
+void Function::eraseBlock(Block* block) {
+    for (auto& insn : block->instructions()) insn->dropOperands();
+    blocks_.erase(std::find_if(blocks_.begin(), blocks_.end(), [&](auto& b) { return b.get() == block; }));
+}
+
+Constant* Function::constant(Ty ty, int64_t value) {
+    switch (ty) {
+        case Ty::I8:    value = int8_t(value); break;
+        case Ty::I32:   value = int32_t(value); break;
+        default:        break;
+    }
+    auto& slot = constants_[size_t(ty)][value];
+    if (!slot) slot = std::make_unique<Constant>(ty, value);
+    return slot.get();
+}
+
+Function* Module::function(const std::string& name) const {
+    for (auto& fn : functions) if (fn->name() == name) return fn.get();
+    return nullptr;
+}
+
+void removeEdge(Block* from, Block* to) {
+    auto& preds = to->preds;
+    preds.erase(std::find(preds.begin(), preds.end(), from));
+    for (auto& insn : to->instructions()) {
+        if (insn->op() != Op::Phi) break;
+        for (size_t i = 0; i < insn->num_operands(); i++) {
+            if (insn->block(i) != from) continue;
+            insn->removeOperand(i);
+            insn->removeBlock(i);
+            break;
+        }
+    }
+}
+
+void foldBranch(Block* block, bool taken) {
+    auto term = block->terminator();
+    Block* target = term->block(taken ? 0 : 1);
+    Block* dropped = term->block(taken ? 1 : 0);
+    removeEdge(block, dropped);                                         // Only one of the two if both are the same
+    block->erase(term);
+    auto br = std::make_unique<Instruction>(Op::Br, Ty::Void);
+    br->addBlock(target);
+    block->append(std::move(br));
+}
+
+bool removeUnreachableBlocks(Function& function) {
+    std::unordered_set<Block*> reachable;
+    std::vector<Block*> work = {function.entry()};
+    while (!work.empty()) {
+        Block* block = work.back();
+        work.pop_back();
+        if (!reachable.insert(block).second) continue;
+        for (auto succ : block->successors()) work.push_back(succ);
+    }
+    if (reachable.size() == function.blocks().size()) return false;
+
+    std::vector<Block*> dead;
+    for (auto& block : function.blocks()) if (!reachable.count(block.get())) dead.push_back(block.get());
+    for (auto block : dead) {
+        for (auto succ : block->successors()) {
+            if (!reachable.count(succ)) continue;
+            auto& preds = succ->preds;
+            preds.erase(std::remove(preds.begin(), preds.end(), block), preds.end());
+            for (auto& insn : succ->instructions()) {
+                if (insn->op() != Op::Phi) break;
+                for (size_t i = insn->num_operands(); i-- != 0;) {
+                    if (insn->block(i) != block) continue;
+                    insn->removeOperand(i);
+                    insn->removeBlock(i);
+                }
+            }
+        }
+    }
+    for (auto block : dead)                                             // Dead blocks may use each other's values
+        for (auto& insn : block->instructions()) insn->dropOperands();
+    for (auto block : dead) function.eraseBlock(block);
+    return true;
+}
+
+
+//! =================================================
+//! ==================== Printing ===================
+//! =================================================
+
+namespace {
+    class Printer {
+        public:
+            Printer(const Function& function, std::ostream& o)
+                : o_(o)
+            {
+                size_t next = 0;
+                for (auto& block : function.blocks())
+                    for (auto& insn : block->instructions()) if (insn->ty() != Ty::Void) ids_[insn.get()] = next++;
+            }
+
+            void value(const Value* v) {
+                switch (v->kind()) {
+                    case Value::Kind::Constant: {
+                        auto c = static_cast<const Constant*>(v);
+                        if (v->ty() == Ty::Ptr && c->value() == 0) o_ << "null";
+                        else o_ << c->value();
+                        break;
+                    }
+                    case Value::Kind::Argument:
+                        o_ << '%' << static_cast<const Argument*>(v)->name();
+                        break;
+                    default:
+                        auto id = ids_.find(v);
+                        if (id != ids_.end()) o_ << '%' << id->second;
+                        else o_ << "<dangling>";
+                        break;
+                }
+            }
+
+            void insn(const Instruction* insn, const Module* module) {
+                o_ << "  ";
+                if (insn->ty() != Ty::Void) {
+                    value(insn);
+                    o_ << " = ";
+                }
+                o_ << op2str(insn->op());
+                if (insn->ty() != Ty::Void || insn->op() == Op::Call) o_ << ' ' << ty2str(insn->ty());
+                switch (insn->op()) {
+                    case Op::Phi:
+                        for (size_t i = 0; i < insn->num_operands(); i++) {
+                            o_ << (i ? ", [" : " [");
+                            value(insn->operand(i));
+                            o_ << ", " << insn->block(i)->name() << ']';
+                        }
+                        break;
+                    case Op::Call:
+                        o_ << " @" << insn->callee()->name() << '(';
+                        for (size_t i = 0; i < insn->num_operands(); i++) {
+                            if (i) o_ << ", ";
+                            value(insn->operand(i));
+                        }
+                        o_ << ')';
+                        break;
+                    case Op::Global:
+                        o_ << " @" << (module ? module->globals[insn->imm()].name : std::to_string(insn->imm()));
+                        break;
+                    case Op::String:
+                        o_ << " @.str" << insn->imm();
+                        break;
+                    default:
+                        for (size_t i = 0; i < insn->num_operands(); i++) {
+                            o_ << (i ? ", " : " ");
+                            value(insn->operand(i));
+                        }
+                        for (size_t i = 0; i < insn->blocks().size(); i++) o_ << (i || insn->num_operands() ? ", " : " ") << insn->block(i)->name();
+                        if (insn->op() == Op::PtrAdd || insn->op() == Op::PtrDiff || insn->op() == Op::Alloca || insn->op() == Op::Copy)
+                            o_ << (insn->num_operands() ? ", " : " ") << insn->imm();
+                        break;
+                }
+                o_ << '\n';
+            }
+
+        private:
+            std::ostream& o_;
+            std::unordered_map<const Value*, size_t> ids_;
+    };
+
+    void print(const Function& function, const Module* module, std::ostream& o) {
+        o << (function.isExternal() ? "declare " : "define ") << (function.isInline() ? "inline " : "") << ty2str(function.ret()) << " @" << function.name() << '(';
+        for (auto& arg : function.args()) o << (arg->index() ? ", " : "") << ty2str(arg->ty()) << " %" << arg->name();
+        o << ')';
+        if (function.isExternal()) {
+            o << '\n';
+            return;
+        }
+        o << " {\n";
+        Printer printer(function, o);
+        for (auto& block : function.blocks()) {
+            o << block->name() << ':';
+            if (!block->preds.empty()) {
+                o << std::string(block->name().size() < 30 ? 30 - block->name().size() : 1, ' ') << "; preds =";
+                for (auto pred : block->preds) o << ' ' << pred->name();
+            }
+            o << '\n';
+            for (auto& insn : block->instructions()) printer.insn(insn.get(), module);
+        }
+        o << "}\n";
+    }
+}
+
+void dump(const Function& function, std::ostream& o) {
+    print(function, nullptr, o);
+}
+
+void Module::dump(std::ostream& o) const {
+    for (auto& global : globals) o << '@' << global.name << " = global " << global.size << ", align " << global.align << '\n';
+    for (size_t i = 0; i < strings.size(); i++) {
+        o << "@.str" << i << " = string \"";
+        for (unsigned char c : strings[i]) {
+            if (c >= ' ' && c < 127 && c != '"' && c != '\\') o << c;
+            else o << '\\' << "0123456789ABCDEF"[c >> 4] << "0123456789ABCDEF"[c & 15];
+        }
+        o << "\"\n";
+    }
+    for (auto& function : functions) {
+        o << '\n';
+        print(*function, this, o);
+    }
+}
+
+
+//! =================================================
+//! ================== Verification =================
+//! =================================================
+
+std::string verify(const Function& function) {
+    if (function.isExternal()) return "";
+    std::unordered_set<const Block*> blocks;
+    for (auto& block : function.blocks()) blocks.insert(block.get());
+    auto where = [&](const Block* block) { return "in " + function.name() + ", block " + block->name() + ": "; };
+
+    if (!function.entry()->preds.empty()) return where(function.entry()) + "the entry block has predecessors";
+    for (auto& block : function.blocks()) {
+        if (block->terminator() == nullptr) return where(block.get()) + "missing terminator";
+        for (auto succ : block->successors()) {
+            if (!blocks.count(succ)) return where(block.get()) + "branch to a deleted block";
+            if (std::count(succ->preds.begin(), succ->preds.end(), block.get()) == 0) return where(succ) + "missing predecessor " + block->name();
+        }
+        for (auto pred : block->preds) {
+            auto succs = pred->successors();
+            if (!blocks.count(pred) || std::find(succs.begin(), succs.end(), block.get()) == succs.end())
+                return where(block.get()) + "stale predecessor " + pred->name();
+        }
+
+        bool phis = true;
+        for (auto& insn : block->instructions()) {
+            if (insn->parent() != block.get()) return where(block.get()) + "instruction with the wrong parent";
+            if (insn->isTerminator() && insn.get() != block->instructions().back().get()) return where(block.get()) + "terminator in the middle";
+            if (insn->op() != Op::Phi) phis = false;
+            else if (!phis) return where(block.get()) + "phi after other instructions";
+
+            for (auto operand : insn->operands()) {
+                if (operand->kind() != Value::Kind::Instruction) continue;
+                auto def = static_cast<Instruction*>(operand);
+                if (!blocks.count(def->parent())) return where(block.get()) + "use of a deleted instruction";
+            }
+
+            auto operandTy = [&](size_t i) { return insn->operand(i)->ty(); };
+            switch (insn->op()) {
+                case Op::Add: case Op::Sub: case Op::Mul: case Op::SDiv: case Op::SRem:
+                case Op::Shl: case Op::AShr: case Op::And: case Op::Or: case Op::Xor:
+                    if (insn->num_operands() != 2 || operandTy(0) != insn->ty() || operandTy(1) != insn->ty())
+                        return where(block.get()) + op2str(insn->op()) + " with mismatched operands";
+                    break;
+                case Op::Eq: case Op::Ne: case Op::Lt: case Op::Le: case Op::Gt: case Op::Ge:
+                    if (insn->num_operands() != 2 || operandTy(0) != operandTy(1) || insn->ty() != Ty::I32)
+                        return where(block.get()) + op2str(insn->op()) + " with mismatched operands";
+                    break;
+                case Op::PtrAdd:
+                    if (operandTy(0) != Ty::Ptr || operandTy(1) != Ty::I32) return where(block.get()) + "ptradd with mismatched operands";
+                    break;
+                case Op::Load:
+                case Op::Store:
+                case Op::Copy:
+                    if (operandTy(0) != Ty::Ptr) return where(block.get()) + op2str(insn->op()) + " from a non-pointer";
+                    break;
+                case Op::Phi:
+                    if (insn->num_operands() != block->preds.size()) return where(block.get()) + "phi does not match the predecessors";
+                    for (size_t i = 0; i < insn->num_operands(); i++) {
+                        if (operandTy(i) != insn->ty()) return where(block.get()) + "phi with mismatched operands";
+                        if (std::find(block->preds.begin(), block->preds.end(), insn->block(i)) == block->preds.end())
+                            return where(block.get()) + "phi operand from a non-predecessor";
+                    }
+                    break;
+                case Op::Call:
+                    if (insn->num_operands() != insn->callee()->args().size()) return where(block.get()) + "call with the wrong number of arguments";
+                    for (size_t i = 0; i < insn->num_operands(); i++)
+                        if (operandTy(i) != insn->callee()->args()[i]->ty()) return where(block.get()) + "call with mismatched arguments";
+                    break;
+                case Op::Ret:
+                    if ((function.ret() == Ty::Void) != (insn->num_operands() == 0) || (insn->num_operands() && operandTy(0) != function.ret()))
+                        return where(block.get()) + "return of the wrong type";
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    return "";
+}
+
+}
@@ -0,0 +1,313 @@
+#ifndef PROG_IR_H
+#define PROG_IR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.h"
+
+namespace H::ir {
+
+//! =================================================
+//! ================== Instructions =================
+//! =================================================
+//
+// SSA form: every instruction defines at most one value, used directly as an operand by other instructions. Values
+// are typed; 'int' arithmetic is done on i32, 'char' values are i8 and extended before arithmetic, pointers are ptr.
+// Scalar locals whose address is never taken become SSA values; everything else (structs, '&' locals) lives in an
+// alloca slot of the frame. Block operands (branch targets, phi predecessors) are kept next to the value operands.
+
+#define H_IR(m)                                                                                 \
+    m(Add,       "add")         /* a + b                                                    */  \
+    m(Sub,       "sub")         /* a - b                                                    */  \
+    m(Mul,       "mul")         /* a * b                                                    */  \
+    m(SDiv,      "sdiv")        /* a / b                                                    */  \
+    m(SRem,      "srem")        /* a % b                                                    */  \
+    m(Shl,       "shl")         /* a << (b & 31)                                            */  \
+    m(AShr,      "ashr")        /* a >> (b & 31)                                            */  \
+    m(And,       "and")         /* a & b                                                    */  \
+    m(Or,        "or")          /* a | b                                                    */  \
+    m(Xor,       "xor")         /* a ^ b                                                    */  \
+    m(Eq,        "eq")          /* a == b, i32 0 or 1; also on pointers                     */  \
+    m(Ne,        "ne")          /* a != b                                                   */  \
+    m(Lt,        "lt")          /* a < b                                                    */  \
+    m(Le,        "le")          /* a <= b                                                   */  \
+    m(Gt,        "gt")          /* a > b                                                    */  \
+    m(Ge,        "ge")          /* a >= b                                                   */  \
+    m(SExt,      "sext")        /* i8 a as i32                                              */  \
+    m(Trunc,     "trunc")       /* i32 a as i8                                              */  \
+    m(PtrAdd,    "ptradd")      /* pointer a + i32 b * #imm                                 */  \
+    m(PtrDiff,   "ptrdiff")     /* (pointer a - pointer b) / #imm, i32                      */  \
+    m(Alloca,    "alloca")      /* address of #imm bytes in the frame                       */  \
+    m(Global,    "global")      /* address of global #imm of the module                     */  \
+    m(String,    "string")      /* address of string literal #imm of the module             */  \
+    m(Load,      "load")        /* value at a                                               */  \
+    m(Store,     "store")       /* value at a = b                                           */  \
+    m(Copy,      "copy")        /* #imm bytes at a = bytes at b                             */  \
+    m(Call,      "call")        /* callee(operands...)                                      */  \
+    m(Phi,       "phi")         /* operand i if control came from block i                   */  \
+    m(Br,        "br")          /* goto block 0                                             */  \
+    m(CondBr,    "condbr")      /* if (a) goto block 0 else block 1                         */  \
+    m(Ret,       "ret")         /* return a, or nothing                                     */
+
+enum class Op : uint8_t {
+#define CODE(op, str) op,
+    H_IR(CODE)
+#undef CODE
+};
+
+const char* op2str(Op op);
+
+enum class Ty : uint8_t { Void, I8, I32, Ptr };
+
+const char* ty2str(Ty ty);
+
+/// Type of the values of the H type @p type; structs are handled by address and have none.
+Ty tyOf(const Type* type);
+
+class Block;
+class Function;
+class Instruction;
+
+class Value {
+    public:
+        enum class Kind : uint8_t { Constant, Argument, Instruction };
+
+        Value(Kind kind, Ty ty)
+            : kind_(kind)
+            , ty_(ty)
+        {}
+        virtual ~Value() {}
+
+        Kind kind() const { return kind_; }
+        Ty ty() const { return ty_; }
+
+        /// Instructions using this value, once per operand.
+        const std::vector<Instruction*>& users() const { return users_; }
+        void replaceAllUsesWith(Value* other);
+
+    private:
+        Kind kind_;
+        Ty ty_;
+        std::vector<Instruction*> users_;
+
+        friend class Instruction;
+};
+
+class Constant : public Value {
+    public:
+        Constant(Ty ty, int64_t value)
+            : Value(Kind::Constant, ty)
+            , value_(value)
+        {}
+
+        int64_t value() const { return value_; }
+
+    private:
+        int64_t value_;
+};
+
+class Argument : public Value {
+    public:
+        Argument(Ty ty, size_t index, std::string name)
+            : Value(Kind::Argument, ty)
+            , index_(index)
+            , name_(std::move(name))
+        {}
+
+        size_t index() const { return index_; }
+        const std::string& name() const { return name_; }
+
+    private:
+        size_t index_;
+        std::string name_;
+};
+
+class Instruction : public Value {
+    public:
+        Instruction(Op op, Ty ty)
+            : Value(Kind::Instruction, ty)
+            , op_(op)
+        {}
+        ~Instruction() { dropOperands(); }
+
+        Op op() const { return op_; }
+        Block* parent() const { return block_; }
+
+        size_t num_operands() const { return operands_.size(); }
+        Value* operand(size_t i) const { return operands_[i]; }
+        const std::vector<Value*>& operands() const { return operands_; }
+        void addOperand(Value* value);
+        void setOperand(size_t i, Value* value);
+        void removeOperand(size_t i);
+        void dropOperands();
+
+        /// Branch targets, or the predecessor of each phi operand.
+        const std::vector<Block*>& blocks() const { return blocks_; }
+        Block* block(size_t i) const { return blocks_[i]; }
+        void addBlock(Block* block) { blocks_.push_back(block); }
+        void setBlock(size_t i, Block* block) { blocks_[i] = block; }
+        void removeBlock(size_t i) { blocks_.erase(blocks_.begin() + i); }
+
+        int64_t imm() const { return imm_; }
+        void setImm(int64_t imm) { imm_ = imm; }
+        Function* callee() const { return callee_; }
+        void setCallee(Function* callee) { callee_ = callee; }
+
+        bool isTerminator() const { return op_ == Op::Br || op_ == Op::CondBr || op_ == Op::Ret; }
+        /// Has an effect besides defining its value (memory, control flow, calls).
+        bool hasSideEffects() const;
+
+    private:
+        Op op_;
+        Block* block_ = nullptr;
+        std::vector<Value*> operands_;
+        std::vector<Block*> blocks_;
+        int64_t imm_ = 0;
+        Function* callee_ = nullptr;
+
+        friend class Block;
+};
+
+
+//! =================================================
+//! ============== Blocks and Functions =============
+//! =================================================
+
+class Block {
+    public:
+        Block(Function* function, std::string name)
+            : function_(function)
+            , name_(std::move(name))
+        {}
+
+        Function* function() const { return function_; }
+        const std::string& name() const { return name_; }
+
+        const std::vector<std::unique_ptr<Instruction>>& instructions() const { return instructions_; }
+        bool empty() const { return instructions_.empty(); }
+        Instruction* terminator() const;
+
+        /// Appends @p insn, or inserts it before @p before.
+        Instruction* append(std::unique_ptr<Instruction> insn);
+        Instruction* insert(std::unique_ptr<Instruction> insn, size_t before);
+        /// Deletes @p insn, which must have no users.
+        void erase(Instruction* insn) { remove(insn); }
+        /// Takes @p insn out of the block, keeping its operands.
+        std::unique_ptr<Instruction> remove(Instruction* insn);
+        /// Moves all instructions to the end of @p other.
+        void moveAllTo(Block* other);
+        /// Deletes all instructions for which @p dead holds in one sweep; they must not use each other.
+        template<class Pred>
+        void eraseIf(Pred dead);
+
+        /// Kept up to date by whoever changes a terminator.
+        std::vector<Block*> preds;
+        std::vector<Block*> successors() const;
+
+    private:
+        Function* function_;
+        std::string name_;
+        std::vector<std::unique_ptr<Instruction>> instructions_;
+};
+
+template<class Pred>
+void Block::eraseIf(Pred dead) {
+    std::vector<bool> erased;
+    for (auto& insn : instructions_) erased.push_back(dead(insn.get()));
+    size_t kept = 0;
+    for (size_t i = 0; i < instructions_.size(); i++) {
+        if (erased[i]) instructions_[i]->dropOperands();
+        else instructions_[kept++] = std::move(instructions_[i]);
+    }
+    instructions_.resize(kept);
+}
+
+class Function {
+    public:
+        Function(std::string name, Ty ret)
+            : name_(std::move(name))
+            , ret_(ret)
+        {}
+        ~Function();
+
+        const std::string& name() const { return name_; }
+        Ty ret() const { return ret_; }
+        /// Declared without a body: resolved by the linker or in the running process.
+        bool isExternal() const { return blocks_.empty(); }
+        /// Declared 'inline': the inliner ignores its size.
+        bool isInline() const { return inline_; }
+        void setInline(bool isInline) { inline_ = isInline; }
+
+        const std::vector<std::unique_ptr<Argument>>& args() const { return args_; }
+        Argument* addArg(Ty ty, std::string name);
+
+        const std::vector<std::unique_ptr<Block>>& blocks() const { return blocks_; }
+        Block* entry() const { return blocks_.front().get(); }
+        Block* addBlock(std::string name);
+        /// Deletes @p block; nothing may branch to it any more and its values must be unused.
+        void eraseBlock(Block* block);
+
+        /// Uniqued per function.
+        Constant* constant(Ty ty, int64_t value);
+
+    private:
+        std::string name_;
+        Ty ret_;
+        std::vector<std::unique_ptr<Argument>> args_;
+        std::vector<std::unique_ptr<Block>> blocks_;
+        size_t blockIds_ = 0;                                               // Makes block names unique
+        bool inline_ = false;
+        std::unordered_map<int64_t, std::unique_ptr<Constant>> constants_[4];
+};
+
+struct GlobalVar {
+    std::string name;
+    size_t size = 0;
+    size_t align = 1;
+};
+
+/// IR of a checked translation unit.
+struct Module {
+    std::vector<std::unique_ptr<Function>> functions;                   // Definitions and external declarations
+    std::vector<GlobalVar> globals;                                     // Zero initialised
+    std::vector<std::string> strings;                                   // Literal bytes without the terminating zero
+
+    /// Function named @p name or @c nullptr.
+    Function* function(const std::string& name) const;
+
+    void dump(std::ostream& o) const;
+};
+
+void dump(const Function& function, std::ostream& o);
+
+/// Removes the edge from @p from to @p to from the predecessors and phis of @p to; the terminator is left alone.
+void removeEdge(Block* from, Block* to);
+
+/// Replaces the conditional branch ending @p block by a jump to its first target if @p taken, else to its second.
+void foldBranch(Block* block, bool taken);
+
+/// Deletes the blocks not reachable from the entry and the phi operands coming from them; true if any were deleted.
+bool removeUnreachableBlocks(Function& function);
+
+/// Checks the structural invariants (terminators, operand types, phis matching predecessors, dominance is left to
+/// the dominator tree); returns the first violation or an empty string.
+std::string verify(const Function& function);
+
+
+//! =================================================
+//! ================== IR Generator =================
+//! =================================================
+
+/// Builds SSA form for a checked translation unit directly from the AST (phis are placed on the fly while blocks are
+/// sealed), after the declarations of its @p prelude if any; unsupported constructs are reported as errors.
+std::unique_ptr<Module> buildIr(TranslationUnit* unit, TranslationUnit* prelude = nullptr);
+
+}
+
+#endif
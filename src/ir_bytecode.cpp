@@ -0,0 +1,550 @@
+#include "bytecode.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+#include "ir_pass.h"
+
+namespace H {
+
+namespace {
+
+Repr reprOf(ir::Ty ty) {
+    switch (ty) {
+        case ir::Ty::I8:    return Repr::Char;
+        case ir::Ty::I32:   return Repr::Int;
+        case ir::Ty::Ptr:   return Repr::Ptr;
+        default:            return Repr::Void;
+    }
+}
+
+Op binaryOp(ir::Op op) {
+    switch (op) {
+        case ir::Op::Add:   return Op::Add;
+        case ir::Op::Sub:   return Op::Sub;
+        case ir::Op::Mul:   return Op::Mul;
+        case ir::Op::SDiv:  return Op::Div;
+        case ir::Op::SRem:  return Op::Mod;
+        case ir::Op::Shl:   return Op::Shl;
+        case ir::Op::AShr:  return Op::Shr;
+        case ir::Op::And:   return Op::And;
+        case ir::Op::Or:    return Op::Or;
+        case ir::Op::Xor:   return Op::Xor;
+        case ir::Op::Eq:    return Op::Eq;
+        case ir::Op::Ne:    return Op::Ne;
+        case ir::Op::Lt:    return Op::Lt;
+        case ir::Op::Le:    return Op::Le;
+        case ir::Op::Gt:    return Op::Gt;
+        default:            return Op::Ge;
+    }
+}
+
+/// Compare-and-branch for the comparison @p op, or for its negation.
+Op jump(ir::Op op, bool negate) {
+    switch (op) {
+        case ir::Op::Eq:    return negate ? Op::JNe : Op::JEq;
+        case ir::Op::Ne:    return negate ? Op::JEq : Op::JNe;
+        case ir::Op::Lt:    return negate ? Op::JGe : Op::JLt;
+        case ir::Op::Le:    return negate ? Op::JGt : Op::JLe;
+        case ir::Op::Gt:    return negate ? Op::JLe : Op::JGt;
+        default:            return negate ? Op::JLt : Op::JGe;
+    }
+}
+
+bool isComparison(ir::Op op) {
+    return op >= ir::Op::Eq && op <= ir::Op::Ge;
+}
+
+const ir::Constant* asConstant(const ir::Value* value) {
+    return value->kind() == ir::Value::Kind::Constant ? static_cast<const ir::Constant*>(value) : nullptr;
+}
+
+/// Lowering of the SSA IR of a module. Values get a register per congruence class: a phi shares it with those of its
+/// operands whose live ranges do not overlap its own, an extension with its operand. Constants that are not
+/// immediates get one per distinct value, loaded on entry; phis become parallel copies on the incoming edges.
+class IrLowering {
+    public:
+        IrLowering(Program& program, ir::Module& module)
+            : p_(program)
+            , module_(module)
+        {}
+
+        void unit();
+
+    private:
+        void function(ir::Function& fn, BcFunction& bc);
+        void coalesce(ir::Function& fn);
+        const ir::Value* find(const ir::Value* value);
+        bool liveAt(const ir::Value* value, const ir::Value* def, const ir::Liveness& live);
+        void block(ir::Block* block, ir::Block* next);
+        void instruction(ir::Instruction* insn);
+        void terminator(ir::Instruction* term, ir::Block* next);
+
+        // Registers; the ones above the values are only known at the end and written as placeholders until then
+        static constexpr int32_t scratch = -1;                          // Breaks cycles of phi copies
+        static constexpr int32_t discard = -2;                          // Result of a void call
+        static int32_t argument(size_t i) { return -3 - int32_t(i); }   // Of calls; the callee's window starts there
+        int32_t reg(const ir::Value* value);
+        int32_t constant(int64_t value);
+        /// Address of a load or store: the base register and a byte offset.
+        std::pair<int32_t, int32_t> address(const ir::Value* value);
+        bool foldsIntoAddress(const ir::Instruction* insn) const;
+
+        // Emission
+        uint32_t emit(Op op, int32_t a = 0, int32_t b = 0, int32_t c = 0) { code_.push_back({op, a, b, c}); return code_.size() - 1; }
+        void jumpTo(uint32_t at, ir::Block* target) { fixups_.emplace_back(at, target); }
+        bool needsCopies(ir::Block* from, ir::Block* to);
+        void edge(ir::Block* from, ir::Block* to, ir::Block* next);
+        void branch(ir::Instruction* term, bool when, ir::Block* target);
+        uint32_t branch(ir::Instruction* term, bool when);
+
+        Program& p_;
+        ir::Module& module_;
+        std::vector<uint32_t> globals_;                                 // Data offset of each global
+        std::vector<uint32_t> strings_;
+        std::unordered_map<const ir::Function*, uint32_t> functions_;
+        std::unordered_map<const ir::Function*, uint32_t> externs_;
+
+        // Per function
+        std::vector<Insn> code_;                                        // Body; jump targets are indices in it
+        std::vector<std::pair<uint32_t, ir::Block*>> fixups_;
+        std::unordered_map<const ir::Block*, uint32_t> starts_;
+        std::unordered_map<const ir::Value*, int32_t> regs_;
+        std::unordered_map<int64_t, int32_t> constants_;                // Value to register
+        std::unordered_set<const ir::Instruction*> fused_;              // Emitted as part of their user
+        std::unordered_map<const ir::Value*, const ir::Value*> classes_;    // Union-find parent
+        std::unordered_map<const ir::Value*, std::vector<const ir::Value*>> members_;
+        std::unordered_map<const ir::Value*, size_t> positions_;        // Index in the block
+        std::unordered_map<const ir::Value*, size_t> arguments_;        // Computed right into argument i of a call
+        int32_t next_ = 0;
+        int32_t frame_ = 0;
+        uint32_t maxArgs_ = 0;
+        bool calls_ = false;
+};
+
+void IrLowering::unit() {
+    for (auto& global : module_.globals) {
+        size_t align = std::max<size_t>(global.align, 1);
+        p_.data.resize((p_.data.size() + align - 1) / align * align);
+        globals_.push_back(p_.data.size());
+        p_.data.resize(p_.data.size() + global.size);
+    }
+    for (auto& string : module_.strings) {
+        strings_.push_back(p_.data.size());
+        p_.data += string;
+        p_.data += '\0';
+    }
+
+    for (auto& fn : module_.functions) {
+        if (fn->isExternal()) {
+            externs_[fn.get()] = p_.externs.size();
+            p_.externs.push_back({fn->name(), uint32_t(fn->args().size()), reprOf(fn->ret())});
+        } else {
+            functions_[fn.get()] = p_.functions.size();
+            p_.function_index[fn->name()] = p_.functions.size();
+            BcFunction bc;
+            bc.name = fn->name();
+            bc.num_params = fn->args().size();
+            bc.ret = reprOf(fn->ret());
+            p_.functions.push_back(bc);
+        }
+    }
+    for (auto& fn : module_.functions) if (!fn->isExternal()) function(*fn, p_.functions[functions_[fn.get()]]);
+}
+
+bool IrLowering::foldsIntoAddress(const ir::Instruction* insn) const {
+    if (insn->op() != ir::Op::PtrAdd) return false;
+    auto index = asConstant(insn->operand(1));
+    if (index == nullptr || index->value() * insn->imm() != int32_t(index->value() * insn->imm())) return false;
+    for (auto user : insn->users()) {
+        if (user->op() != ir::Op::Load && user->op() != ir::Op::Store) return false;
+        if (user->op() == ir::Op::Store && user->operand(1) == insn) return false;                  // Stored, not an address
+    }
+    return true;
+}
+
+int32_t IrLowering::constant(int64_t value) {
+    auto [it, added] = constants_.emplace(value, 0);
+    if (added) it->second = next_++;
+    return it->second;
+}
+
+const ir::Value* IrLowering::find(const ir::Value* value) {
+    auto it = classes_.find(value);
+    if (it == classes_.end() || it->second == value) return value;
+    return it->second = find(it->second);
+}
+
+/// Is @p value live right after @p def defines its value? Phis and arguments are defined at the start of their
+/// block, all at once.
+bool IrLowering::liveAt(const ir::Value* value, const ir::Value* def, const ir::Liveness& live) {
+    if (def->kind() == ir::Value::Kind::Argument) return value->kind() == ir::Value::Kind::Argument;
+    auto insn = static_cast<const ir::Instruction*>(def);
+    ir::Block* block = insn->parent();
+    if (insn->op() == ir::Op::Phi) {
+        if (value->kind() == ir::Value::Kind::Instruction && static_cast<const ir::Instruction*>(value)->parent() == block
+            && static_cast<const ir::Instruction*>(value)->op() == ir::Op::Phi) return true;
+        return live.liveIn(block).count(value) != 0;
+    }
+    size_t at = positions_[insn];
+    if (value->kind() == ir::Value::Kind::Instruction && static_cast<const ir::Instruction*>(value)->parent() == block
+        && positions_[value] > at) return false;                        // Not defined yet
+    if (live.liveOut(block).count(value)) return true;
+    for (auto user : value->users())
+        if (user->parent() == block && user->op() != ir::Op::Phi && positions_[user] > at) return true;
+    return false;
+}
+
+void IrLowering::coalesce(ir::Function& fn) {
+    classes_.clear();
+    members_.clear();
+    positions_.clear();
+    for (auto& block : fn.blocks())
+        for (size_t i = 0; i < block->instructions().size(); i++) positions_[block->instructions()[i].get()] = i;
+
+    auto unite = [&](const ir::Value* a, const ir::Value* b) {
+        a = find(a), b = find(b);
+        if (a == b) return;
+        if (b->kind() == ir::Value::Kind::Argument) std::swap(a, b);   // Arguments stay where they arrive
+        auto& into = members_[a];
+        if (into.empty()) into.push_back(a);
+        auto& from = members_[b];
+        if (from.empty()) from.push_back(b);
+        into.insert(into.end(), from.begin(), from.end());
+        members_.erase(b);
+        classes_[b] = a;
+        classes_[a] = a;
+    };
+    auto members = [&](const ir::Value* root) {
+        auto it = members_.find(root);
+        return it != members_.end() ? it->second : std::vector<const ir::Value*>{root};
+    };
+
+    for (auto& block : fn.blocks())                                     // Same bits in the same register
+        for (auto& insn : block->instructions())
+            if (insn->op() == ir::Op::SExt && !asConstant(insn->operand(0))) unite(insn->operand(0), insn.get());
+
+    ir::AnalysisManager am;
+    auto& live = am.get<ir::Liveness>(fn);
+    for (auto& block : fn.blocks()) {
+        for (auto& insn : block->instructions()) {
+            if (insn->op() != ir::Op::Phi) break;
+            for (auto operand : insn->operands()) {
+                if (asConstant(operand) || find(operand) == find(insn.get())) continue;
+                auto a = members(find(insn.get())), b = members(find(operand));
+                if (a.size() * b.size() > 4096) continue;
+                if (find(insn.get())->kind() == ir::Value::Kind::Argument && find(operand)->kind() == ir::Value::Kind::Argument) continue;
+                bool interfere = false;
+                for (auto x : a) {
+                    for (auto y : b) interfere = interfere || liveAt(x, y, live) || liveAt(y, x, live);
+                }
+                if (!interfere) unite(insn.get(), operand);
+            }
+        }
+    }
+}
+
+int32_t IrLowering::reg(const ir::Value* value) {
+    if (auto c = asConstant(value)) return constant(c->value());
+    auto argument = arguments_.find(value);
+    if (argument != arguments_.end()) return IrLowering::argument(argument->second);
+    value = find(value);
+    if (value->kind() == ir::Value::Kind::Argument) return static_cast<const ir::Argument*>(value)->index();
+    auto [it, added] = regs_.emplace(value, 0);
+    if (added) it->second = next_++;
+    return it->second;
+}
+
+std::pair<int32_t, int32_t> IrLowering::address(const ir::Value* value) {
+    if (value->kind() == ir::Value::Kind::Instruction && fused_.count(static_cast<const ir::Instruction*>(value))) {
+        auto ptrAdd = static_cast<const ir::Instruction*>(value);
+        return {reg(ptrAdd->operand(0)), int32_t(asConstant(ptrAdd->operand(1))->value() * ptrAdd->imm())};
+    }
+    return {reg(value), 0};
+}
+
+void IrLowering::function(ir::Function& fn, BcFunction& bc) {
+    code_.clear();
+    fixups_.clear();
+    starts_.clear();
+    regs_.clear();
+    constants_.clear();
+    fused_.clear();
+    next_ = fn.args().size();
+    frame_ = 0;
+    maxArgs_ = 0;
+    calls_ = false;
+
+    // Comparisons only deciding the branch after them, and constant offsets only used as addresses
+    for (auto& block : fn.blocks()) {
+        for (auto& insn : block->instructions()) {
+            if (foldsIntoAddress(insn.get())) fused_.insert(insn.get());
+            if (isComparison(insn->op()) && insn->users().size() == 1 && insn->users()[0] == block->terminator()
+                && block->terminator()->op() == ir::Op::CondBr)
+                fused_.insert(insn.get());
+        }
+    }
+    coalesce(fn);
+
+    // Values only passed to the next call go straight to their argument register
+    arguments_.clear();
+    for (auto& block : fn.blocks()) {
+        const ir::Instruction* lastCall = nullptr;
+        for (auto& insn : block->instructions()) {
+            if (insn->op() != ir::Op::Call) continue;
+            for (size_t i = 0; i < insn->num_operands(); i++) {
+                auto value = insn->operand(i);
+                if (value->kind() != ir::Value::Kind::Instruction || value->users().size() != 1) continue;
+                auto def = static_cast<const ir::Instruction*>(value);
+                if (def->parent() != block.get() || def->op() == ir::Op::Phi || def->op() == ir::Op::SExt || fused_.count(def)) continue;
+                if (lastCall != nullptr && positions_[def] < positions_[lastCall]) continue;
+                arguments_[def] = i;
+            }
+            lastCall = insn.get();
+        }
+    }
+    ir::AnalysisManager am;
+    auto order = ir::blockLayout(fn, am);
+    for (size_t i = 0; i < order.size(); i++) block(order[i], i + 1 < order.size() ? order[i + 1] : nullptr);
+
+    // All values have registers now: the scratch and arguments go above them, constants are loaded on entry
+    std::vector<Insn> prologue;
+    for (auto& arg : fn.args()) if (arg->ty() == ir::Ty::I8) prologue.push_back({Op::SExt8, int32_t(arg->index()), int32_t(arg->index()), 0});
+    for (auto [value, r] : constants_) prologue.push_back({Op::Const, r, 0, int32_t(value)});
+    int32_t args = next_ + 1;
+    auto resolve = [&](int32_t& r) {
+        if (r == scratch) r = next_;
+        else if (r == discard) r = args;
+        else if (r < 0) r = args + (-3 - r);
+    };
+    uint32_t base = p_.code.size() + prologue.size();
+    for (auto [at, block] : fixups_) code_[at].c = starts_[block];
+    for (auto& insn : code_) {
+        resolve(insn.a);
+        resolve(insn.b);
+        if (insn.op == Op::Call || insn.op == Op::CallExt) insn.c = args;
+        if (insn.op >= Op::Jmp && insn.op <= Op::JGe) insn.c += base;
+    }
+
+    bc.entry = p_.code.size();
+    p_.code.insert(p_.code.end(), prologue.begin(), prologue.end());
+    p_.code.insert(p_.code.end(), code_.begin(), code_.end());
+    bc.num_regs = args + (calls_ ? std::max<uint32_t>(maxArgs_, 1) : 0);
+    bc.frame_size = (frame_ + 15) / 16 * 16;
+}
+
+void IrLowering::block(ir::Block* block, ir::Block* next) {
+    starts_[block] = code_.size();
+    for (auto& insn : block->instructions()) {
+        if (insn->isTerminator()) terminator(insn.get(), next);
+        else if (!fused_.count(insn.get())) instruction(insn.get());
+    }
+}
+
+void IrLowering::instruction(ir::Instruction* insn) {
+    auto operand = [&](size_t i) { return reg(insn->operand(i)); };
+    switch (insn->op()) {
+        case ir::Op::Add: case ir::Op::Sub: case ir::Op::Mul: {
+            auto lhs = asConstant(insn->operand(0)), rhs = asConstant(insn->operand(1));
+            if (insn->op() == ir::Op::Sub && lhs != nullptr && lhs->value() == 0) {
+                emit(Op::Neg, reg(insn), operand(1));
+            } else if (rhs != nullptr || (lhs != nullptr && insn->op() != ir::Op::Sub)) {
+                auto imm = rhs != nullptr ? rhs : lhs;
+                int32_t value = reg(insn->operand(rhs != nullptr ? 0 : 1));
+                if (insn->op() == ir::Op::Mul) emit(Op::MulI, reg(insn), value, imm->value());
+                else emit(Op::AddI, reg(insn), value, insn->op() == ir::Op::Sub ? -imm->value() : imm->value());
+            } else {
+                emit(binaryOp(insn->op()), reg(insn), operand(0), operand(1));
+            }
+            break;
+        }
+        case ir::Op::Xor: {
+            auto rhs = asConstant(insn->operand(1));
+            if (rhs != nullptr && rhs->value() == -1) emit(Op::BitNot, reg(insn), operand(0));
+            else emit(Op::Xor, reg(insn), operand(0), operand(1));
+            break;
+        }
+        case ir::Op::Eq: {
+            auto rhs = asConstant(insn->operand(1));
+            if (rhs != nullptr && rhs->value() == 0) emit(Op::Not, reg(insn), operand(0));
+            else emit(Op::Eq, reg(insn), operand(0), operand(1));
+            break;
+        }
+        case ir::Op::SDiv: case ir::Op::SRem: case ir::Op::Shl: case ir::Op::AShr: case ir::Op::And: case ir::Op::Or:
+        case ir::Op::Ne: case ir::Op::Lt: case ir::Op::Le: case ir::Op::Gt: case ir::Op::Ge:
+            emit(binaryOp(insn->op()), reg(insn), operand(0), operand(1));
+            break;
+        case ir::Op::SExt:
+            if (reg(insn) != operand(0)) emit(Op::Mov, reg(insn), operand(0));
+            break;
+        case ir::Op::Trunc:
+            emit(Op::SExt8, reg(insn), operand(0));
+            break;
+        case ir::Op::PtrAdd: {
+            if (auto index = asConstant(insn->operand(1))) {
+                emit(Op::AddPI, reg(insn), operand(0), index->value() * insn->imm());
+            } else if (insn->imm() == 1) {
+                emit(Op::AddP, reg(insn), operand(0), operand(1));
+            } else {
+                emit(Op::MulI, reg(insn), operand(1), insn->imm());
+                emit(Op::AddP, reg(insn), operand(0), reg(insn));
+            }
+            break;
+        }
+        case ir::Op::PtrDiff:
+            emit(Op::SubP, reg(insn), operand(0), operand(1));
+            if (insn->imm() != 1) {
+                emit(Op::Div, reg(insn), reg(insn), constant(insn->imm()));
+            } else {
+                emit(Op::SExt32, reg(insn), reg(insn));
+            }
+            break;
+        case ir::Op::Alloca: {
+            int32_t size = insn->imm();
+            int32_t align = size >= 8 ? 8 : size >= 4 ? 4 : size >= 2 ? 2 : 1;
+            frame_ = (frame_ + align - 1) / align * align;
+            emit(Op::FrameAddr, reg(insn), 0, frame_);
+            frame_ += size;
+            break;
+        }
+        case ir::Op::Global:
+            emit(Op::DataAddr, reg(insn), 0, globals_[insn->imm()]);
+            break;
+        case ir::Op::String:
+            emit(Op::DataAddr, reg(insn), 0, strings_[insn->imm()]);
+            break;
+        case ir::Op::Load: {
+            auto [base, offset] = address(insn->operand(0));
+            Op load = insn->ty() == ir::Ty::I8 ? Op::Ld8 : insn->ty() == ir::Ty::I32 ? Op::Ld32 : Op::Ld64;
+            emit(load, reg(insn), base, offset);
+            break;
+        }
+        case ir::Op::Store: {
+            auto [base, offset] = address(insn->operand(0));
+            auto ty = insn->operand(1)->ty();
+            Op store = ty == ir::Ty::I8 ? Op::St8 : ty == ir::Ty::I32 ? Op::St32 : Op::St64;
+            emit(store, base, operand(1), offset);
+            break;
+        }
+        case ir::Op::Copy:
+            emit(Op::Copy, operand(0), operand(1), insn->imm());
+            break;
+        case ir::Op::Call: {
+            calls_ = true;
+            maxArgs_ = std::max<uint32_t>(maxArgs_, insn->num_operands());
+            for (size_t i = 0; i < insn->num_operands(); i++) {
+                if (auto c = asConstant(insn->operand(i))) emit(Op::Const, argument(i), 0, c->value());
+                else if (operand(i) != argument(i)) emit(Op::Mov, argument(i), operand(i));
+            }
+            int32_t result = insn->ty() != ir::Ty::Void ? reg(insn) : discard;
+            auto callee = insn->callee();
+            if (callee->isExternal()) emit(Op::CallExt, result, externs_[callee], 0);
+            else emit(Op::Call, result, functions_[callee], 0);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void IrLowering::terminator(ir::Instruction* term, ir::Block* next) {
+    ir::Block* block = term->parent();
+    switch (term->op()) {
+        case ir::Op::Ret:
+            if (term->num_operands() == 0) emit(Op::RetVoid);
+            else emit(Op::Ret, 0, reg(term->operand(0)));
+            break;
+        case ir::Op::Br:
+            edge(block, term->block(0), next);
+            break;
+        case ir::Op::CondBr: {
+            ir::Block* then = term->block(0);
+            ir::Block* otherwise = term->block(1);
+            if (auto cond = asConstant(term->operand(0))) {
+                edge(block, cond->value() != 0 ? then : otherwise, next);
+                break;
+            }
+            bool thenCopies = needsCopies(block, then), otherwiseCopies = needsCopies(block, otherwise);
+            if (!thenCopies && !otherwiseCopies && then == next) {
+                branch(term, false, otherwise);
+            } else if (!thenCopies && then != next) {
+                branch(term, true, then);
+                edge(block, otherwise, next);
+            } else if (!otherwiseCopies && otherwise != next) {
+                branch(term, false, otherwise);
+                edge(block, then, next);
+            } else {                                                    // Skip the copies of one edge for the other
+                bool thenLast = then == next;
+                uint32_t skip = branch(term, thenLast);
+                edge(block, thenLast ? otherwise : then, nullptr);
+                code_[skip].c = code_.size();
+                edge(block, thenLast ? then : otherwise, next);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+uint32_t IrLowering::branch(ir::Instruction* term, bool when) {
+    auto cond = term->operand(0);
+    if (cond->kind() == ir::Value::Kind::Instruction && fused_.count(static_cast<ir::Instruction*>(cond))) {
+        auto compare = static_cast<ir::Instruction*>(cond);
+        return emit(jump(compare->op(), !when), reg(compare->operand(0)), reg(compare->operand(1)));
+    }
+    return emit(when ? Op::Jnz : Op::Jz, 0, reg(cond));
+}
+
+void IrLowering::branch(ir::Instruction* term, bool when, ir::Block* target) {
+    jumpTo(branch(term, when), target);
+}
+
+bool IrLowering::needsCopies(ir::Block* from, ir::Block* to) {
+    for (auto& insn : to->instructions()) {
+        if (insn->op() != ir::Op::Phi) break;
+        for (size_t i = 0; i < insn->num_operands(); i++)
+            if (insn->block(i) == from && (asConstant(insn->operand(i)) || reg(insn->operand(i)) != reg(insn.get()))) return true;
+    }
+    return false;
+}
+
+/// Copies for the phis of @p to, as if done all at once, then a jump unless @p to comes @p next.
+void IrLowering::edge(ir::Block* from, ir::Block* to, ir::Block* next) {
+    std::vector<std::pair<int32_t, int32_t>> moves;                     // Destination, source
+    std::vector<std::pair<int32_t, int64_t>> constants;
+    for (auto& insn : to->instructions()) {
+        if (insn->op() != ir::Op::Phi) break;
+        for (size_t i = 0; i < insn->num_operands(); i++) {
+            if (insn->block(i) != from) continue;
+            if (auto c = asConstant(insn->operand(i))) constants.emplace_back(reg(insn.get()), c->value());
+            else if (reg(insn->operand(i)) != reg(insn.get())) moves.emplace_back(reg(insn.get()), reg(insn->operand(i)));
+            break;
+        }
+    }
+    while (!moves.empty()) {
+        auto ready = std::find_if(moves.begin(), moves.end(), [&](auto& move) {
+            return std::none_of(moves.begin(), moves.end(), [&](auto& other) { return other.second == move.first; });
+        });
+        if (ready == moves.end()) {                                     // A cycle: save one destination first
+            int32_t saved = moves.front().first;
+            emit(Op::Mov, scratch, saved);
+            for (auto& move : moves) if (move.second == saved) move.second = scratch;
+            continue;
+        }
+        emit(Op::Mov, ready->first, ready->second);
+        moves.erase(ready);
+    }
+    for (auto [r, value] : constants) emit(Op::Const, r, 0, value);
+    if (to != next) jumpTo(emit(Op::Jmp), to);
+}
+
+}
+
+Program compileBytecode(ir::Module& module) {
+    Program program;
+    IrLowering(program, module).unit();
+    return program;
+}
+
+}
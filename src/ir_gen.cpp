@@ -0,0 +1,660 @@
+#include "ir.h"
+
+#include <unordered_set>
+
+#include "lower.h"
+
+namespace H::ir {
+
+namespace {
+    Op comparison(Tok::Tag tag) {
+        switch (tag) {
+            case Tok::Tag::P_Equal:         return Op::Eq;
+            case Tok::Tag::P_Unequal:       return Op::Ne;
+            case Tok::Tag::P_Less:          return Op::Lt;
+            case Tok::Tag::P_Less_Equal:    return Op::Le;
+            case Tok::Tag::P_Greater:       return Op::Gt;
+            case Tok::Tag::P_Greater_Equal: return Op::Ge;
+            default:                        return Op::Ret;             // Not a comparison
+        }
+    }
+
+    Op arithmetic(Tok::Tag tag) {
+        switch (tag) {
+            case Tok::Tag::P_Addition:          return Op::Add;
+            case Tok::Tag::P_Substraction:      return Op::Sub;
+            case Tok::Tag::P_Multiplication:    return Op::Mul;
+            case Tok::Tag::P_Division:          return Op::SDiv;
+            case Tok::Tag::P_Modulo:            return Op::SRem;
+            case Tok::Tag::P_Bitwise_Shift_L:   return Op::Shl;
+            case Tok::Tag::P_Bitwise_Shift_R:   return Op::AShr;
+            case Tok::Tag::P_Bitwise_And:       return Op::And;
+            case Tok::Tag::P_Bitwise_Or:        return Op::Or;
+            default:                            return Op::Xor;
+        }
+    }
+
+    /// SSA construction after Braun et al., "Simple and Efficient Construction of Static Single Assignment Form":
+    /// each block remembers the current definition of every variable; reading one that is not defined locally asks the
+    /// predecessors, with a phi when there are several. Blocks whose predecessors are not all known yet (loop headers,
+    /// labels) are unsealed; their phis are completed when they are sealed.
+    class IrGenerator {
+        public:
+            IrGenerator(Module& module)
+                : m_(module)
+            {}
+
+            void unit(TranslationUnit* unit, TranslationUnit* prelude);
+
+        private:
+            using Var = const SpecifierDeclarator*;
+
+            void error(ASTNode* node, const char* what) { node->loc().err() << what << node->loc().endErr(); }
+
+            // Emission
+            Instruction* emit(Op op, Ty ty, std::initializer_list<Value*> operands = {}, int64_t imm = 0);
+            Constant* constant(Ty ty, int64_t value) { return fn_->constant(ty, value); }
+            Block* newBlock(const char* name) { return fn_->addBlock(name); }
+            bool terminated() const { return cur_->terminator() != nullptr; }
+            void enter(Block* block) { cur_ = block; }
+            void br(Block* target);
+            void condBr(Value* cond, Block* then, Block* otherwise);
+
+            // SSA variables
+            void write(Var var, Block* block, Value* value) { defs_[block][var] = value; }
+            Value* read(Var var, Block* block);
+            Value* readRecursive(Var var, Block* block);
+            Value* addPhiOperands(Var var, Instruction* phi);
+            Value* removeTrivialPhi(Instruction* phi);
+            Value* resolve(Value* value);
+            void seal(Block* block);
+
+            // Declarations
+            void function(ExternalDeclaration* ext);
+            void allocate(ASTNode* node, const std::unordered_set<const SpecifierDeclarator*>& escaping);
+
+            // Statements
+            void stmt(Stmt* stmt);
+
+            // Expressions
+            Value* expr(Exp* exp);
+            Value* addr(Exp* exp);
+            void branch(Exp* exp, Block* then, Block* otherwise);
+            Value* convert(Value* value, Ty to);
+            Value* binary(InfixExp* exp);
+            Value* assign(Exp* lhs, Value* value);
+            Value* incDec(Exp* operand, bool inc, bool post);
+            Value* call(FuncCallExp* exp);
+            Var variable(Exp* exp) const;
+
+            Module& m_;
+            std::unordered_map<Var, size_t> globals_;
+            std::unordered_map<std::string, size_t> strings_;
+
+            // Per function
+            Function* fn_ = nullptr;
+            Block* cur_ = nullptr;
+            std::unordered_map<Var, Ty> vars_;                                  // SSA variables
+            std::unordered_map<Var, Instruction*> slots_;                       // Allocas of the other locals
+            std::unordered_map<Block*, std::unordered_map<Var, Value*>> defs_;
+            std::unordered_map<Block*, std::vector<std::pair<Var, Instruction*>>> incomplete_;
+            std::unordered_set<Block*> sealed_;
+            std::unordered_map<Value*, Value*> replaced_;                       // Removed trivial phis
+            std::vector<std::unique_ptr<Instruction>> removed_;
+            std::unordered_set<Instruction*> building_;                         // Phis whose operands are being added
+            std::unordered_map<const LabeledStmt*, Block*> labels_;
+            std::vector<std::pair<Block*, Block*>> loops_;                      // Break and continue targets
+    };
+
+
+    //! =================================================
+    //! ==================== Emission ===================
+    //! =================================================
+
+    Instruction* IrGenerator::emit(Op op, Ty ty, std::initializer_list<Value*> operands, int64_t imm) {
+        auto insn = std::make_unique<Instruction>(op, ty);
+        for (auto operand : operands) insn->addOperand(operand);
+        insn->setImm(imm);
+        return cur_->append(std::move(insn));
+    }
+
+    void IrGenerator::br(Block* target) {
+        if (terminated()) return;
+        emit(Op::Br, Ty::Void)->addBlock(target);
+        target->preds.push_back(cur_);
+    }
+
+    void IrGenerator::condBr(Value* cond, Block* then, Block* otherwise) {
+        if (then == otherwise) return br(then);
+        auto insn = emit(Op::CondBr, Ty::Void, {cond});
+        insn->addBlock(then);
+        insn->addBlock(otherwise);
+        then->preds.push_back(cur_);
+        otherwise->preds.push_back(cur_);
+    }
+
+
+    //! =================================================
+    //! ================= SSA Variables =================
+    //! =================================================
+
+    Value* IrGenerator::resolve(Value* value) {
+        for (auto it = replaced_.find(value); it != replaced_.end(); it = replaced_.find(value)) value = it->second;
+        return value;
+    }
+
+    Value* IrGenerator::read(Var var, Block* block) {
+        auto& defs = defs_[block];
+        auto def = defs.find(var);
+        if (def != defs.end()) return def->second = resolve(def->second);
+        return readRecursive(var, block);
+    }
+
+    Value* IrGenerator::readRecursive(Var var, Block* block) {
+        Value* value;
+        if (!sealed_.count(block)) {
+            auto phi = block->insert(std::make_unique<Instruction>(Op::Phi, vars_[var]), 0);
+            incomplete_[block].emplace_back(var, phi);
+            value = phi;
+        } else if (block->preds.size() == 1) {
+            value = read(var, block->preds[0]);
+        } else if (block->preds.empty()) {
+            value = constant(vars_[var], 0);                            // Read before any assignment
+        } else {
+            auto phi = block->insert(std::make_unique<Instruction>(Op::Phi, vars_[var]), 0);
+            write(var, block, phi);                                     // Breaks cycles through loops
+            value = addPhiOperands(var, phi);
+        }
+        write(var, block, value);
+        return value;
+    }
+
+    Value* IrGenerator::addPhiOperands(Var var, Instruction* phi) {
+        building_.insert(phi);
+        for (auto pred : phi->parent()->preds) {
+            phi->addOperand(read(var, pred));
+            phi->addBlock(pred);
+        }
+        building_.erase(phi);
+        return removeTrivialPhi(phi);
+    }
+
+    /// Replaces a phi whose operands are all the same value (or itself) by that value.
+    Value* IrGenerator::removeTrivialPhi(Instruction* phi) {
+        Value* same = nullptr;
+        for (auto operand : phi->operands()) {
+            if (operand == same || operand == phi) continue;
+            if (same != nullptr) return phi;
+            same = operand;
+        }
+        if (same == nullptr) same = constant(phi->ty(), 0);             // Unreachable or read before assignment
+
+        std::vector<Instruction*> users;
+        for (auto user : phi->users()) if (user != phi && user->op() == Op::Phi) users.push_back(user);
+        phi->replaceAllUsesWith(same);
+        replaced_[phi] = same;
+        phi->dropOperands();
+        removed_.push_back(phi->parent()->remove(phi));                 // Kept so that its address is not reused
+
+        for (auto user : users) {
+            if (user->parent() != nullptr && !building_.count(user)) removeTrivialPhi(user);  // May have gone already
+        }
+        return resolve(same);
+    }
+
+    void IrGenerator::seal(Block* block) {
+        if (!sealed_.insert(block).second) return;
+        auto incomplete = std::move(incomplete_[block]);
+        incomplete_.erase(block);
+        for (auto [var, phi] : incomplete) addPhiOperands(var, phi);
+    }
+
+
+    //! =================================================
+    //! ================= Declarations ==================
+    //! =================================================
+
+    void IrGenerator::unit(TranslationUnit* unit, TranslationUnit* prelude) {
+        auto exts = externalDeclarations(unit, prelude);
+        for (auto ext : exts) {
+            auto specDecl = ext->specifierDeclarator();
+            if (specDecl == nullptr || specDecl->isTypedef() || specDecl->name().empty()) continue;
+            if (isFunction(specDecl)) {
+                if (auto declared = m_.function(specDecl->name())) {
+                    if (specDecl->isInline()) declared->setInline(true);
+                    continue;
+                }
+                auto fn = std::make_unique<Function>(specDecl->name(), tyOf(returnType(specDecl)));
+                fn->setInline(specDecl->isInline());
+                if (repr(returnType(specDecl)) == Repr::Struct) error(specDecl, "Functions returning structs are not supported!");
+                for (auto param : parameters(specDecl)) {
+                    if (repr(param->type()) == Repr::Struct) error(param, "Struct parameters are not supported!");
+                    fn->addArg(tyOf(param->type()), param->name().empty() ? "arg" + std::to_string(fn->args().size()) : param->name());
+                }
+                m_.functions.push_back(std::move(fn));
+                continue;
+            }
+            Type* type = specDecl->type();
+            auto found = std::find_if(m_.globals.begin(), m_.globals.end(), [&](auto& g) { return g.name == specDecl->name(); });
+            if (found == m_.globals.end()) {
+                m_.globals.push_back({specDecl->name(), std::max<size_t>(type->size(), 1), std::max<size_t>(type->align(), 1)});
+                found = m_.globals.end() - 1;
+            }
+            globals_[specDecl] = found - m_.globals.begin();
+        }
+
+        for (auto ext : exts)
+            if (ext->specifierDeclarator() != nullptr && ext->functionBody() != nullptr) function(ext);
+    }
+
+    void IrGenerator::function(ExternalDeclaration* ext) {
+        auto specDecl = ext->specifierDeclarator();
+        fn_ = m_.function(specDecl->name());
+        if (!fn_->isExternal()) return error(specDecl, "Function defined twice!");
+        vars_.clear();
+        slots_.clear();
+        defs_.clear();
+        incomplete_.clear();
+        sealed_.clear();
+        replaced_.clear();
+        removed_.clear();
+        labels_.clear();
+
+        cur_ = newBlock("entry");
+        seal(cur_);
+        auto escaping = addressTaken(ext->functionBody());
+        auto params = parameters(specDecl);
+        for (size_t i = 0; i < params.size(); i++) {
+            Argument* arg = fn_->args()[i].get();
+            if (escaping.count(params[i])) {
+                slots_[params[i]] = emit(Op::Alloca, Ty::Ptr, {}, params[i]->type()->size());
+                emit(Op::Store, Ty::Void, {slots_[params[i]], arg});
+            } else {
+                vars_[params[i]] = arg->ty();
+                write(params[i], cur_, arg);
+            }
+        }
+        allocate(ext->functionBody(), escaping);
+
+        stmt(ext->functionBody());
+        if (!terminated()) {                                            // Falling off the end returns 0, as main must
+            if (fn_->ret() == Ty::Void) emit(Op::Ret, Ty::Void);
+            else emit(Op::Ret, Ty::Void, {constant(fn_->ret(), 0)});
+        }
+        for (auto [label, block] : labels_) seal(block);
+        removeUnreachableBlocks(*fn_);
+    }
+
+    /// Makes the scalar locals in @p node SSA variables and gives the others an alloca.
+    void IrGenerator::allocate(ASTNode* node, const std::unordered_set<const SpecifierDeclarator*>& escaping) {
+        if (auto decl = dynamic_cast<Declaration*>(node)) {
+            auto specDecl = decl->specifierDeclarator();
+            if (specDecl->isTypedef() || specDecl->name().empty()) return;
+            if (isFunction(specDecl)) return error(specDecl, "Block scope function declarations are not supported!");
+            Ty ty = tyOf(specDecl->type());
+            if (ty != Ty::Void && !escaping.count(specDecl)) vars_[specDecl] = ty;
+            else slots_[specDecl] = emit(Op::Alloca, Ty::Ptr, {}, std::max<size_t>(specDecl->type()->size(), 1));
+            return;
+        }
+        forEachChild(node, [&](ASTNode* child) { if (dynamic_cast<Stmt*>(child)) allocate(child, escaping); });
+    }
+
+
+    //! =================================================
+    //! ================== Statements ===================
+    //! =================================================
+
+    void IrGenerator::stmt(Stmt* s) {
+        // Code after a jump is unreachable but still needs a block; it is deleted at the end
+        if (terminated() && !dynamic_cast<LabeledStmt*>(s)) {
+            enter(newBlock("dead"));
+            seal(cur_);
+        }
+
+        if (auto compound = dynamic_cast<CompoundStmt*>(s)) {
+            for (size_t i = 0; i < compound->num_blockItems(); i++) stmt(compound->blockItem(i));
+        } else if (auto expStmt = dynamic_cast<ExpressionStmt*>(s)) {
+            expr(expStmt->exp());
+        } else if (auto ret = dynamic_cast<ReturnStmt*>(s)) {
+            Value* value = expr(ret->exp());
+            if (fn_->ret() == Ty::Void) emit(Op::Ret, Ty::Void);
+            else emit(Op::Ret, Ty::Void, {convert(value, fn_->ret())});
+        } else if (dynamic_cast<EmptyReturnStmt*>(s)) {
+            if (fn_->ret() == Ty::Void) emit(Op::Ret, Ty::Void);
+            else emit(Op::Ret, Ty::Void, {constant(fn_->ret(), 0)});
+        } else if (auto loop = dynamic_cast<WhileStmt*>(s)) {
+            Block* cond = newBlock("while.cond");
+            Block* body = newBlock("while.body");
+            Block* end = newBlock("while.end");
+            br(cond);
+            enter(cond);
+            branch(loop->condition(), body, end);
+            seal(body);
+            enter(body);
+            loops_.emplace_back(end, cond);
+            stmt(loop->loop());
+            loops_.pop_back();
+            br(cond);
+            seal(cond);
+            seal(end);
+            enter(end);
+        } else if (auto ifElse = dynamic_cast<IfElseStmt*>(s)) {
+            Block* then = newBlock("if.then");
+            Block* otherwise = newBlock("if.else");
+            Block* end = newBlock("if.end");
+            branch(ifElse->condition(), then, otherwise);
+            seal(then);
+            seal(otherwise);
+            enter(then);
+            stmt(ifElse->consequence());
+            br(end);
+            enter(otherwise);
+            stmt(ifElse->alternative());
+            br(end);
+            seal(end);
+            enter(end);
+        } else if (auto ifStmt = dynamic_cast<IfStmt*>(s)) {
+            Block* then = newBlock("if.then");
+            Block* end = newBlock("if.end");
+            branch(ifStmt->condition(), then, end);
+            seal(then);
+            enter(then);
+            stmt(ifStmt->consequence());
+            br(end);
+            seal(end);
+            enter(end);
+        } else if (auto labeled = dynamic_cast<LabeledStmt*>(s)) {
+            auto& target = labels_[labeled];
+            if (target == nullptr) target = newBlock("label");
+            br(target);
+            enter(target);
+            stmt(labeled->statement());
+        } else if (auto gotoStmt = dynamic_cast<GoToStmt*>(s)) {
+            auto& target = labels_[gotoStmt->target()];
+            if (target == nullptr) target = newBlock("label");
+            br(target);
+        } else if (dynamic_cast<BreakStmt*>(s)) {
+            br(loops_.back().first);
+        } else if (dynamic_cast<ContinueStmt*>(s)) {
+            br(loops_.back().second);
+        } else if (!dynamic_cast<NullStmt*>(s) && !dynamic_cast<Declaration*>(s)) {
+            error(s, "Statement is not supported by the IR generator!");
+        }
+    }
+
+
+    //! =================================================
+    //! ================== Expressions ==================
+    //! =================================================
+
+    /// @p value as @p to: integers are sign extended or truncated; only constants change between integer and pointer.
+    Value* IrGenerator::convert(Value* value, Ty to) {
+        Ty from = value->ty();
+        if (from == to || to == Ty::Void || from == Ty::Void) return value;
+        if (value->kind() == Value::Kind::Constant) return constant(to, static_cast<Constant*>(value)->value());
+        if (from == Ty::I8 && to == Ty::I32) return emit(Op::SExt, Ty::I32, {value});
+        if (from == Ty::I32 && to == Ty::I8) return emit(Op::Trunc, Ty::I8, {value});
+        return value;
+    }
+
+    /// The SSA variable designated by @p exp, if it is one.
+    IrGenerator::Var IrGenerator::variable(Exp* exp) const {
+        auto id = dynamic_cast<Identifier*>(exp);
+        if (id == nullptr || !vars_.count(id->specifierDeclarator())) return nullptr;
+        return id->specifierDeclarator();
+    }
+
+    Value* IrGenerator::expr(Exp* exp) {
+        if (exp->isConstant()) {
+            Ty ty = tyOf(exp->type());
+            return constant(ty == Ty::Void ? Ty::I32 : ty, exp->constant());
+        }
+
+        if (auto var = variable(exp)) return read(var, cur_);
+        if (auto id = dynamic_cast<Identifier*>(exp)) {
+            auto specDecl = id->specifierDeclarator();
+            if (!slots_.count(specDecl) && !globals_.count(specDecl)) {
+                noStorage(id);
+                return constant(Ty::I32, 0);
+            }
+            Value* address = addr(exp);
+            if (repr(exp->type()) == Repr::Struct) return address;
+            return emit(Op::Load, tyOf(exp->type()), {address});
+        }
+        if (auto lit = dynamic_cast<Literal*>(exp)) {
+            auto bytes = decodeLiteral(lit->value());
+            auto [it, added] = strings_.emplace(bytes, m_.strings.size());
+            if (added) m_.strings.push_back(bytes);
+            return emit(Op::String, Ty::Ptr, {}, it->second);
+        }
+        if (auto infix = dynamic_cast<InfixExp*>(exp)) {
+            auto tag = infix->operation().tag();
+            if (tag == Tok::Tag::P_Assign) return assign(infix->lhs(), expr(infix->rhs()));
+            if (tag == Tok::Tag::P_Logical_And || tag == Tok::Tag::P_Logical_Or) {
+                Block* then = newBlock("bool.true");
+                Block* otherwise = newBlock("bool.false");
+                Block* end = newBlock("bool.end");
+                branch(exp, then, otherwise);
+                seal(then);
+                seal(otherwise);
+                enter(then);
+                br(end);
+                enter(otherwise);
+                br(end);
+                seal(end);
+                enter(end);
+                auto phi = emit(Op::Phi, Ty::I32);
+                phi->addOperand(constant(Ty::I32, 1));
+                phi->addBlock(then);
+                phi->addOperand(constant(Ty::I32, 0));
+                phi->addBlock(otherwise);
+                return phi;
+            }
+            return binary(infix);
+        }
+        if (auto ternary = dynamic_cast<TernaryExp*>(exp)) {
+            Block* then = newBlock("cond.true");
+            Block* otherwise = newBlock("cond.false");
+            Block* end = newBlock("cond.end");
+            Ty ty = repr(exp->type()) == Repr::Struct ? Ty::Ptr : tyOf(exp->type());
+            branch(ternary->condition(), then, otherwise);
+            seal(then);
+            seal(otherwise);
+            enter(then);
+            Value* consequence = convert(expr(ternary->consequence()), ty);
+            Block* thenEnd = cur_;
+            br(end);
+            enter(otherwise);
+            Value* alternative = convert(expr(ternary->alternative()), ty);
+            Block* otherwiseEnd = cur_;
+            br(end);
+            seal(end);
+            enter(end);
+            if (ty == Ty::Void) return constant(Ty::I32, 0);
+            auto phi = emit(Op::Phi, ty);
+            phi->addOperand(consequence);
+            phi->addBlock(thenEnd);
+            phi->addOperand(alternative);
+            phi->addBlock(otherwiseEnd);
+            return phi;
+        }
+        if (auto prefix = dynamic_cast<PrefixExp*>(exp)) {
+            Ty ty = tyOf(exp->type());
+            switch (prefix->prefix().tag()) {
+                case Tok::Tag::P_Multiplication:
+                    if (repr(exp->type()) == Repr::Struct) return addr(exp);
+                    return emit(Op::Load, ty, {addr(exp)});
+                case Tok::Tag::P_Bitwise_And:
+                    return addr(prefix->operand());
+                case Tok::Tag::P_Increment:
+                case Tok::Tag::P_Decrement:
+                    return incDec(prefix->operand(), prefix->prefix().isa(Tok::Tag::P_Increment), false);
+                case Tok::Tag::P_Addition:
+                    return expr(prefix->operand());
+                case Tok::Tag::P_Substraction:
+                    return convert(emit(Op::Sub, Ty::I32, {constant(Ty::I32, 0), convert(expr(prefix->operand()), Ty::I32)}), ty);
+                case Tok::Tag::P_Logical_Not: {
+                    Value* operand = expr(prefix->operand());
+                    return emit(Op::Eq, Ty::I32, {operand, constant(operand->ty(), 0)});
+                }
+                default:
+                    return convert(emit(Op::Xor, Ty::I32, {convert(expr(prefix->operand()), Ty::I32), constant(Ty::I32, -1)}), ty);
+            }
+        }
+        if (auto postfix = dynamic_cast<PostfixExp*>(exp))
+            return incDec(postfix->operand(), postfix->postfix().isa(Tok::Tag::P_Increment), true);
+        if (dynamic_cast<MemberAccessExp*>(exp) || dynamic_cast<ArrayExp*>(exp)) {
+            Value* address = addr(exp);
+            if (repr(exp->type()) == Repr::Struct) return address;
+            return emit(Op::Load, tyOf(exp->type()), {address});
+        }
+        if (auto funcCall = dynamic_cast<FuncCallExp*>(exp))
+            return call(funcCall);
+
+        error(exp, "Expression is not supported by the IR generator!");
+        return constant(Ty::I32, 0);
+    }
+
+    Value* IrGenerator::addr(Exp* exp) {
+        if (auto id = dynamic_cast<Identifier*>(exp)) {
+            auto specDecl = id->specifierDeclarator();
+            auto slot = slots_.find(specDecl);
+            if (slot != slots_.end()) return slot->second;
+            auto global = globals_.find(specDecl);
+            if (global != globals_.end()) return emit(Op::Global, Ty::Ptr, {}, global->second);
+        } else if (auto prefix = dynamic_cast<PrefixExp*>(exp)) {
+            if (prefix->prefix().isa(Tok::Tag::P_Multiplication)) return expr(prefix->operand());
+        } else if (auto array = dynamic_cast<ArrayExp*>(exp)) {
+            Value* base = expr(array->object());
+            Value* index = convert(expr(array->index()), Ty::I32);
+            return emit(Op::PtrAdd, Ty::Ptr, {base, index}, sizeOf(exp->type()));
+        } else if (auto access = dynamic_cast<MemberAccessExp*>(exp)) {
+            bool arrow = access->operation() == Tok::Tag::P_Arrow_R;
+            Type* structType = arrow ? pointee(access->object()->type()) : access->object()->type();
+            Member m;
+            if (!member(structType, access->member_name(), m)) {
+                error(exp, "Unknown struct member!");
+                return constant(Ty::Ptr, 0);
+            }
+            Value* object = arrow ? expr(access->object()) : addr(access->object());
+            if (m.offset == 0) return object;
+            return emit(Op::PtrAdd, Ty::Ptr, {object, constant(Ty::I32, m.offset)}, 1);
+        }
+        if (repr(exp->type()) == Repr::Struct) return expr(exp);           // Struct values are addresses already
+        error(exp, "Expression is not an lvalue!");
+        return constant(Ty::Ptr, 0);
+    }
+
+    /// Jumps to @p then if @p exp is non-zero, to @p otherwise if not; the callers seal both.
+    void IrGenerator::branch(Exp* exp, Block* then, Block* otherwise) {
+        if (exp->isConstant()) return br(exp->constant() != 0 ? then : otherwise);
+        if (auto infix = dynamic_cast<InfixExp*>(exp)) {
+            auto tag = infix->operation().tag();
+            if (tag == Tok::Tag::P_Logical_And || tag == Tok::Tag::P_Logical_Or) {
+                Block* rhs = newBlock(tag == Tok::Tag::P_Logical_And ? "and.rhs" : "or.rhs");
+                if (tag == Tok::Tag::P_Logical_And) branch(infix->lhs(), rhs, otherwise);
+                else branch(infix->lhs(), then, rhs);
+                seal(rhs);
+                enter(rhs);
+                return branch(infix->rhs(), then, otherwise);
+            }
+        }
+        if (auto prefix = dynamic_cast<PrefixExp*>(exp)) {
+            if (prefix->prefix().isa(Tok::Tag::P_Logical_Not)) return branch(prefix->operand(), otherwise, then);
+        }
+        condBr(expr(exp), then, otherwise);
+    }
+
+    Value* IrGenerator::assign(Exp* lhs, Value* value) {
+        Type* type = lhs->type();
+        if (auto var = variable(lhs)) {
+            value = convert(value, vars_[var]);
+            write(var, cur_, value);
+            return value;
+        }
+        Value* to = addr(lhs);
+        if (repr(type) == Repr::Struct) {
+            emit(Op::Copy, Ty::Void, {to, value}, type->size());
+            return to;
+        }
+        value = convert(value, tyOf(type));
+        emit(Op::Store, Ty::Void, {to, value});
+        return value;
+    }
+
+    Value* IrGenerator::binary(InfixExp* exp) {
+        auto tag = exp->operation().tag();
+        Ty ty = tyOf(exp->type());
+        Value* lhs = expr(exp->lhs());
+        Value* rhs = expr(exp->rhs());
+
+        // Pointer arithmetic
+        if ((tag == Tok::Tag::P_Addition || tag == Tok::Tag::P_Substraction) && (lhs->ty() == Ty::Ptr || rhs->ty() == Ty::Ptr)) {
+            if (lhs->ty() == Ty::Ptr && rhs->ty() == Ty::Ptr)
+                return emit(Op::PtrDiff, Ty::I32, {lhs, rhs}, sizeOf(pointee(exp->lhs()->type())));
+            Type* pointer = lhs->ty() == Ty::Ptr ? exp->lhs()->type() : exp->rhs()->type();
+            if (rhs->ty() == Ty::Ptr) std::swap(lhs, rhs);
+            rhs = convert(rhs, Ty::I32);
+            if (tag == Tok::Tag::P_Substraction) rhs = emit(Op::Sub, Ty::I32, {constant(Ty::I32, 0), rhs});
+            return emit(Op::PtrAdd, Ty::Ptr, {lhs, rhs}, sizeOf(pointee(pointer)));
+        }
+
+        Op compare = comparison(tag);
+        if (compare != Op::Ret) {
+            if (lhs->ty() == Ty::Ptr || rhs->ty() == Ty::Ptr) return emit(compare, Ty::I32, {convert(lhs, Ty::Ptr), convert(rhs, Ty::Ptr)});
+            return emit(compare, Ty::I32, {convert(lhs, Ty::I32), convert(rhs, Ty::I32)});
+        }
+
+        // Integer arithmetic is done in 32 bits
+        Value* result = emit(arithmetic(tag), Ty::I32, {convert(lhs, Ty::I32), convert(rhs, Ty::I32)});
+        return convert(result, ty == Ty::Void ? Ty::I32 : ty);
+    }
+
+    Value* IrGenerator::incDec(Exp* operand, bool inc, bool post) {
+        Type* type = operand->type();
+        Ty ty = tyOf(type);
+        Var var = variable(operand);
+        Value* address = var ? nullptr : addr(operand);
+        Value* old = var ? read(var, cur_) : emit(Op::Load, ty, {address});
+        Value* updated;
+        if (ty == Ty::Ptr) updated = emit(Op::PtrAdd, Ty::Ptr, {old, constant(Ty::I32, inc ? 1 : -1)}, sizeOf(pointee(type)));
+        else updated = convert(emit(inc ? Op::Add : Op::Sub, Ty::I32, {convert(old, Ty::I32), constant(Ty::I32, 1)}), ty);
+        if (var) write(var, cur_, updated);
+        else emit(Op::Store, Ty::Void, {address, updated});
+        return post ? old : updated;
+    }
+
+    Value* IrGenerator::call(FuncCallExp* exp) {
+        auto id = dynamic_cast<Identifier*>(exp->func());
+        auto callee = id ? id->specifierDeclarator() : nullptr;
+        Function* function = callee && isFunction(callee) ? m_.function(callee->name()) : nullptr;
+        if (function == nullptr) {
+            error(exp, "Only named functions can be called!");
+            return constant(Ty::I32, 0);
+        }
+        if (function->args().size() != exp->num_parameters()) {
+            error(exp, "Wrong number of arguments!");
+            return constant(Ty::I32, 0);
+        }
+
+        std::vector<Value*> args;
+        for (size_t i = 0; i < exp->num_parameters(); i++) {
+            auto arg = exp->parameters()[i].get();
+            if (repr(arg->type()) == Repr::Struct) error(arg, "Struct arguments are not supported!");
+            args.push_back(convert(expr(arg), function->args()[i]->ty()));
+        }
+        auto insn = emit(Op::Call, function->ret(), {});
+        for (auto arg : args) insn->addOperand(arg);
+        insn->setCallee(function);
+        return insn;
+    }
+}
+
+std::unique_ptr<Module> buildIr(TranslationUnit* unit, TranslationUnit* prelude) {
+    auto module = std::make_unique<Module>();
+    IrGenerator generator(*module);
+    generator.unit(unit, prelude);
+    return module;
+}
+
+}
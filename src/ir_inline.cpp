@@ -0,0 +1,192 @@
+#include "ir_pass.h"
+
+#include <algorithm>
+
+namespace H::ir {
+
+namespace {
+
+//! =================================================
+//! ==================== Inlining ===================
+//! =================================================
+
+/// Callers stop growing at this many instructions, whatever their callees are.
+constexpr size_t callerLimit = 4096;
+
+/// Size of @p function as the inliner sees it: the instructions left after phis and jumps are gone.
+size_t cost(const Function& function) {
+    size_t n = 0;
+    for (auto& block : function.blocks())
+        for (auto& insn : block->instructions()) if (insn->op() != Op::Phi && insn->op() != Op::Br) n++;
+    return n;
+}
+
+class InlinePass : public Pass {
+    public:
+        InlinePass(const PassOptions& options)
+            : threshold_(options.inlineThreshold)
+            , report_(options.inlineReport)
+        {}
+
+        const char* name() const override { return "inline"; }
+        PreservedAnalyses run(Function& function, AnalysisManager& am) override;
+
+    private:
+        /// Why the call of @p callee in @p caller of @p size instructions is kept, or @c nullptr to inline it.
+        const char* reject(Function& caller, size_t size, Function* callee);
+        /// Is @p function part of a cycle of the call graph?
+        bool recursive(Function* function);
+        void inlineCall(Function& caller, Instruction* call);
+
+        size_t threshold_;
+        std::ostream* report_;
+        std::unordered_map<const Function*, bool> recursive_;          // Calls only ever disappear, so a cycle once
+                                                                        // absent stays absent
+};
+
+bool InlinePass::recursive(Function* function) {
+    auto found = recursive_.find(function);
+    if (found != recursive_.end()) return found->second;
+
+    std::unordered_set<Function*> visited;
+    std::vector<Function*> work = {function};
+    bool cycle = false;
+    while (!work.empty() && !cycle) {
+        Function* f = work.back();
+        work.pop_back();
+        for (auto& block : f->blocks()) {
+            for (auto& insn : block->instructions()) {
+                if (insn->op() != Op::Call) continue;
+                if (insn->callee() == function) cycle = true;
+                else if (visited.insert(insn->callee()).second) work.push_back(insn->callee());
+            }
+        }
+    }
+    return recursive_[function] = cycle;
+}
+
+const char* InlinePass::reject(Function& caller, size_t size, Function* callee) {
+    if (callee->isExternal()) return "no body";
+    if (callee == &caller || recursive(callee)) return "recursive";
+    if (!callee->entry()->preds.empty()) return "entry block is a loop header";
+    if (!callee->isInline() && cost(*callee) > threshold_) return "too big";
+    if (size + cost(*callee) > callerLimit) return "caller too big";
+    return nullptr;
+}
+
+PreservedAnalyses InlinePass::run(Function& function, AnalysisManager&) {
+    std::vector<Instruction*> calls;
+    for (auto& block : function.blocks())
+        for (auto& insn : block->instructions()) if (insn->op() == Op::Call) calls.push_back(insn.get());
+
+    size_t size = cost(function), inlined = 0;
+    for (auto call : calls) {
+        Function* callee = call->callee();
+        const char* reason = reject(function, size, callee);
+        if (report_ != nullptr && !callee->isExternal()) {
+            *report_ << "inline: " << callee->name() << " into " << function.name() << ": ";
+            if (reason != nullptr) *report_ << "kept, " << reason;
+            else *report_ << "inlined";
+            *report_ << " (size " << cost(*callee) << (callee->isInline() ? ", declared inline" : "") << ", threshold "
+                     << threshold_ << ")\n";
+        }
+        if (reason != nullptr) continue;
+        size += cost(*callee);
+        statistics_["instructions inlined"] += cost(*callee);
+        inlineCall(function, call);
+        inlined++;
+    }
+    if (inlined == 0) return PreservedAnalyses::all();
+    statistics_["calls inlined"] += inlined;
+    return PreservedAnalyses::none();
+}
+
+/// Splits the block of @p call after it, copies the callee's blocks in between with the arguments in place of the
+/// parameters and the allocas moved to the caller's entry, and turns the returns into jumps to the second half, which
+/// takes the returned value from a phi.
+void InlinePass::inlineCall(Function& caller, Instruction* call) {
+    Function* callee = call->callee();
+    Block* block = call->parent();
+    Block* after = caller.addBlock(callee->name() + ".exit");
+
+    auto& insns = block->instructions();
+    size_t at = std::find_if(insns.begin(), insns.end(), [&](auto& i) { return i.get() == call; }) - insns.begin();
+    std::vector<Instruction*> rest;
+    for (size_t i = at + 1; i < insns.size(); i++) rest.push_back(insns[i].get());
+    for (auto insn : rest) after->append(block->remove(insn));
+    for (auto succ : after->successors()) {
+        std::replace(succ->preds.begin(), succ->preds.end(), block, after);
+        for (auto& insn : succ->instructions()) {
+            if (insn->op() != Op::Phi) break;
+            for (size_t k = 0; k < insn->blocks().size(); k++) if (insn->block(k) == block) insn->setBlock(k, after);
+        }
+    }
+
+    // The copies first, then their operands: phis may use values defined further down
+    std::unordered_map<const Block*, Block*> blocks;
+    std::unordered_map<const Value*, Value*> values;
+    for (auto& arg : callee->args()) values[arg.get()] = call->operand(arg->index());
+    for (auto& b : callee->blocks()) blocks[b.get()] = caller.addBlock(callee->name() + "." + b->name());
+    size_t hoisted = 0;
+    std::vector<std::pair<Value*, Block*>> returns;
+    for (auto& b : callee->blocks()) {
+        Block* copy = blocks[b.get()];
+        for (auto pred : b->preds) copy->preds.push_back(blocks[pred]);
+        for (auto& insn : b->instructions()) {
+            if (insn->op() == Op::Ret) {
+                returns.emplace_back(insn->num_operands() ? insn->operand(0) : nullptr, copy);
+                auto br = std::make_unique<Instruction>(Op::Br, Ty::Void);
+                br->addBlock(after);
+                copy->append(std::move(br));
+                after->preds.push_back(copy);
+                continue;
+            }
+            auto clone = std::make_unique<Instruction>(insn->op(), insn->ty());
+            clone->setImm(insn->imm());
+            clone->setCallee(insn->callee());
+            values[insn.get()] = insn->op() == Op::Alloca ? caller.entry()->insert(std::move(clone), hoisted++)
+                                                          : copy->append(std::move(clone));
+        }
+    }
+    auto map = [&](Value* value) -> Value* {
+        if (value->kind() == Value::Kind::Constant) return caller.constant(value->ty(), static_cast<Constant*>(value)->value());
+        return values.at(value);
+    };
+    for (auto& b : callee->blocks()) {
+        for (auto& insn : b->instructions()) {
+            if (insn->op() == Op::Ret) continue;
+            auto clone = static_cast<Instruction*>(values.at(insn.get()));
+            for (auto operand : insn->operands()) clone->addOperand(map(operand));
+            for (auto target : insn->blocks()) clone->addBlock(blocks.at(target));
+        }
+    }
+
+    if (!call->users().empty()) {
+        Value* result;
+        if (returns.size() == 1) {
+            result = map(returns[0].first);
+        } else {
+            auto phi = std::make_unique<Instruction>(Op::Phi, call->ty());
+            for (auto [value, from] : returns) {
+                phi->addOperand(map(value));
+                phi->addBlock(from);
+            }
+            result = after->insert(std::move(phi), 0);
+        }
+        call->replaceAllUsesWith(result);
+    }
+    block->erase(call);
+    Block* entry = blocks.at(callee->entry());
+    auto br = std::make_unique<Instruction>(Op::Br, Ty::Void);
+    br->addBlock(entry);
+    block->append(std::move(br));
+    entry->preds.push_back(block);
+}
+
+}
+
+std::unique_ptr<Pass> createInlinePass(const PassOptions& options) {
+    return std::make_unique<InlinePass>(options);
+}
+
+}
@@ -0,0 +1,496 @@
+#include "ir_pass.h"
+
+#include <algorithm>
+#include <tuple>
+
+namespace H::ir {
+
+namespace {
+
+//! =================================================
+//! ====================== SCCP =====================
+//! =================================================
+
+/// What is known about a value: nothing yet (Top), that it is always @p value, or that it varies (Bottom).
+struct Lattice {
+    enum class State : uint8_t { Top, Constant, Bottom } state = State::Top;
+    int64_t value = 0;
+
+    bool operator==(const Lattice& other) const { return state == other.state && value == other.value; }
+};
+
+Lattice meet(Lattice a, Lattice b) {
+    if (a.state == Lattice::State::Top) return b;
+    if (b.state == Lattice::State::Top) return a;
+    if (a == b) return a;
+    return {Lattice::State::Bottom};
+}
+
+int64_t normalize(Ty ty, int64_t value) {
+    switch (ty) {
+        case Ty::I8:    return int8_t(value);
+        case Ty::I32:   return int32_t(value);
+        default:        return value;
+    }
+}
+
+/// Evaluates @p op as the interpreters do; false if it traps (division by zero) or is not foldable.
+bool fold(Op op, int64_t a, int64_t b, int64_t& result) {
+    switch (op) {
+        case Op::Add:   result = uint64_t(a) + uint64_t(b); return true;
+        case Op::Sub:   result = uint64_t(a) - uint64_t(b); return true;
+        case Op::Mul:   result = uint64_t(a) * uint64_t(b); return true;
+        case Op::SDiv:  if (b == 0) return false; result = a / b; return true;
+        case Op::SRem:  if (b == 0) return false; result = a % b; return true;
+        case Op::Shl:   result = uint64_t(a) << (b & 31); return true;
+        case Op::AShr:  result = int32_t(a) >> (b & 31); return true;
+        case Op::And:   result = a & b; return true;
+        case Op::Or:    result = a | b; return true;
+        case Op::Xor:   result = a ^ b; return true;
+        case Op::Eq:    result = a == b; return true;
+        case Op::Ne:    result = a != b; return true;
+        case Op::Lt:    result = a < b; return true;
+        case Op::Le:    result = a <= b; return true;
+        case Op::Gt:    result = a > b; return true;
+        case Op::Ge:    result = a >= b; return true;
+        case Op::SExt:  result = a; return true;
+        case Op::Trunc: result = int8_t(a); return true;
+        default:        return false;
+    }
+}
+
+bool isFoldable(Op op) {
+    return (op >= Op::Add && op <= Op::Trunc);
+}
+
+class SccpPass : public Pass {
+    public:
+        const char* name() const override { return "sccp"; }
+        PreservedAnalyses run(Function& function, AnalysisManager& am) override;
+
+    private:
+        void solve();
+        Lattice get(Value* value) const;
+        void set(Instruction* insn, Lattice lattice);
+        void markEdge(Block* from, Block* to);
+        void visit(Instruction* insn);
+
+        std::unordered_map<const Value*, Lattice> values_;
+        std::set<std::pair<Block*, Block*>> edges_;                     // Executable edges
+        std::unordered_set<Block*> executable_;
+        std::vector<Block*> blockWork_;                                 // Newly executable
+        std::vector<Instruction*> work_;                                // Operands changed
+};
+
+Lattice SccpPass::get(Value* value) const {
+    switch (value->kind()) {
+        case Value::Kind::Constant: return {Lattice::State::Constant, static_cast<Constant*>(value)->value()};
+        case Value::Kind::Argument: return {Lattice::State::Bottom};
+        default: {
+            auto it = values_.find(value);
+            return it != values_.end() ? it->second : Lattice();
+        }
+    }
+}
+
+void SccpPass::set(Instruction* insn, Lattice lattice) {
+    auto& current = values_[insn];
+    if (current == lattice) return;
+    current = lattice;
+    for (auto user : insn->users()) work_.push_back(user);
+}
+
+void SccpPass::markEdge(Block* from, Block* to) {
+    if (!edges_.insert({from, to}).second) return;
+    if (executable_.insert(to).second) {
+        blockWork_.push_back(to);
+        return;
+    }
+    for (auto& insn : to->instructions()) {                             // Another operand of its phis counts now
+        if (insn->op() != Op::Phi) break;
+        work_.push_back(insn.get());
+    }
+}
+
+void SccpPass::visit(Instruction* insn) {
+    Block* block = insn->parent();
+    switch (insn->op()) {
+        case Op::Phi: {
+            Lattice result;
+            for (size_t i = 0; i < insn->num_operands(); i++)
+                if (edges_.count({insn->block(i), block})) result = meet(result, get(insn->operand(i)));
+            set(insn, result);
+            return;
+        }
+        case Op::Br:
+            markEdge(block, insn->block(0));
+            return;
+        case Op::CondBr: {
+            Lattice cond = get(insn->operand(0));
+            if (cond.state == Lattice::State::Constant) {
+                markEdge(block, insn->block(cond.value != 0 ? 0 : 1));
+            } else if (cond.state == Lattice::State::Bottom) {
+                markEdge(block, insn->block(0));
+                markEdge(block, insn->block(1));
+            }
+            return;
+        }
+        default:
+            break;
+    }
+    if (insn->ty() == Ty::Void) return;
+    if (!isFoldable(insn->op())) return set(insn, {Lattice::State::Bottom});
+
+    Lattice a = get(insn->operand(0));
+    Lattice b = insn->num_operands() > 1 ? get(insn->operand(1)) : a;
+    if (a.state == Lattice::State::Bottom || b.state == Lattice::State::Bottom) return set(insn, {Lattice::State::Bottom});
+    if (a.state == Lattice::State::Top || b.state == Lattice::State::Top) return;
+    int64_t result;
+    if (fold(insn->op(), a.value, b.value, result)) set(insn, {Lattice::State::Constant, normalize(insn->ty(), result)});
+    else set(insn, {Lattice::State::Bottom});
+}
+
+void SccpPass::solve() {
+    while (!work_.empty() || !blockWork_.empty()) {
+        while (!work_.empty()) {
+            Instruction* insn = work_.back();
+            work_.pop_back();
+            if (executable_.count(insn->parent())) visit(insn);
+        }
+        if (!blockWork_.empty()) {
+            Block* block = blockWork_.back();
+            blockWork_.pop_back();
+            for (auto& insn : block->instructions()) visit(insn.get());
+        }
+    }
+}
+
+PreservedAnalyses SccpPass::run(Function& function, AnalysisManager&) {
+    values_.clear();
+    edges_.clear();
+    executable_ = {function.entry()};
+    blockWork_ = {function.entry()};
+    solve();
+
+    // A branch on a value never found (only read on paths never executed) could go either way
+    for (bool again = true; again;) {
+        again = false;
+        for (auto block : std::vector<Block*>(executable_.begin(), executable_.end())) {
+            auto term = block->terminator();
+            if (term->op() != Op::CondBr || get(term->operand(0)).state != Lattice::State::Top) continue;
+            values_[term->operand(0)] = {Lattice::State::Bottom};
+            work_.push_back(term);
+            again = true;
+        }
+        solve();
+    }
+
+    bool changed = false, cfgChanged = false;
+    for (auto& block : function.blocks()) {
+        if (!executable_.count(block.get())) continue;
+        std::vector<Instruction*> folded;
+        for (auto& insn : block->instructions()) {
+            Lattice value = get(insn.get());
+            if (insn->ty() != Ty::Void && !insn->hasSideEffects() && value.state == Lattice::State::Constant) folded.push_back(insn.get());
+        }
+        for (auto insn : folded) {
+            insn->replaceAllUsesWith(function.constant(insn->ty(), get(insn).value));
+            block->erase(insn);
+            changed = true;
+        }
+        if (!folded.empty()) statistics_["values folded"] += folded.size();
+        auto term = block->terminator();
+        if (term->op() == Op::CondBr && term->operand(0)->kind() == Value::Kind::Constant) {
+            foldBranch(block.get(), static_cast<Constant*>(term->operand(0))->value() != 0);
+            statistics_["branches folded"]++;
+            cfgChanged = true;
+        }
+    }
+    cfgChanged |= removeUnreachableBlocks(function);
+
+    if (cfgChanged) return PreservedAnalyses::none();
+    return changed ? PreservedAnalyses::cfg() : PreservedAnalyses::all();
+}
+
+
+//! =================================================
+//! ====================== ADCE =====================
+//! =================================================
+
+class AdcePass : public Pass {
+    public:
+        const char* name() const override { return "adce"; }
+        PreservedAnalyses run(Function& function, AnalysisManager& am) override;
+};
+
+PreservedAnalyses AdcePass::run(Function& function, AnalysisManager& am) {
+    bool cfgChanged = removeUnreachableBlocks(function);
+    if (cfgChanged) am.invalidate(function, PreservedAnalyses::none());
+    auto& dom = am.get<DominatorTree>(function);
+    auto& pdom = am.get<PostDominatorTree>(function);
+
+    // Block x is control dependent on the branch ending b if it post dominates a successor of b but not b itself
+    std::unordered_map<Block*, std::vector<Block*>> controllers;
+    for (auto block : dom.rpo()) {
+        if (block->terminator()->op() != Op::CondBr) continue;
+        Block* stop = pdom.ipdom(block);
+        for (auto succ : block->successors())
+            for (Block* x = succ; x != nullptr && x != stop; x = pdom.ipdom(x)) controllers[x].push_back(block);
+    }
+
+    std::unordered_set<Instruction*> live;
+    std::unordered_set<Block*> liveBlocks;
+    std::vector<Instruction*> work;
+    auto mark = [&](Instruction* insn) { if (live.insert(insn).second) work.push_back(insn); };
+
+    for (auto block : dom.rpo()) {
+        for (auto& insn : block->instructions()) {
+            if (insn->op() == Op::Store || insn->op() == Op::Copy || insn->op() == Op::Call || insn->op() == Op::Ret) mark(insn.get());
+        }
+        auto term = block->terminator();
+        if (term->op() == Op::CondBr && pdom.ipdom(block) == nullptr) mark(term);                  // Nowhere to jump instead
+        for (auto succ : block->successors()) if (dom.dominates(succ, block)) mark(term);           // Keep loops
+    }
+    while (!work.empty()) {
+        Instruction* insn = work.back();
+        work.pop_back();
+        for (auto operand : insn->operands())
+            if (operand->kind() == Value::Kind::Instruction) mark(static_cast<Instruction*>(operand));
+        if (liveBlocks.insert(insn->parent()).second)
+            for (auto controller : controllers[insn->parent()]) mark(controller->terminator());
+        if (insn->op() == Op::Phi)
+            for (auto pred : insn->blocks()) mark(pred->terminator());
+    }
+
+    // Dead branches jump to their post dominator: whatever ran in between is dead, and so are its phis there
+    for (auto block : dom.rpo()) {
+        auto term = block->terminator();
+        if (term->op() != Op::CondBr || live.count(term)) continue;
+        Block* target = pdom.ipdom(block);
+        auto succs = block->successors();
+        for (size_t i = 0; i < succs.size(); i++) if (std::find(succs.begin(), succs.begin() + i, succs[i]) == succs.begin() + i) removeEdge(block, succs[i]);
+        block->erase(term);
+        auto br = std::make_unique<Instruction>(Op::Br, Ty::Void);
+        br->addBlock(target);
+        block->append(std::move(br));
+        target->preds.push_back(block);
+        statistics_["branches removed"]++;
+        cfgChanged = true;
+    }
+
+    bool changed = false;
+    auto dead = [&](Instruction* insn) { return !insn->isTerminator() && !live.count(insn); };
+    for (auto block : dom.rpo()) {                                      // Dead values may use each other
+        for (auto& insn : block->instructions()) {
+            if (!dead(insn.get())) continue;
+            insn->dropOperands();
+            statistics_["instructions removed"]++;
+            changed = true;
+        }
+    }
+    for (auto block : dom.rpo()) block->eraseIf(dead);
+    cfgChanged |= removeUnreachableBlocks(function);
+
+    if (cfgChanged) return PreservedAnalyses::none();
+    return changed ? PreservedAnalyses::cfg() : PreservedAnalyses::all();
+}
+
+
+//! =================================================
+//! ====================== GVN ======================
+//! =================================================
+
+/// Where an address points: a constant byte offset into a frame slot or a global, or somewhere unknown.
+struct Location {
+    enum class Object : uint8_t { Unknown, Frame, Global } object = Object::Unknown;
+    uintptr_t id = 0;                                                   // The alloca, or the index of the global
+    int64_t offset = 0;
+    bool exact = true;                                                  // Offset known
+};
+
+size_t sizeOf(Ty ty) {
+    switch (ty) {
+        case Ty::I8:    return 1;
+        case Ty::I32:   return 4;
+        default:        return 8;
+    }
+}
+
+bool isCommutative(Op op) {
+    return op == Op::Add || op == Op::Mul || op == Op::And || op == Op::Or || op == Op::Xor || op == Op::Eq || op == Op::Ne;
+}
+
+/// A pure computation; equal expressions compute equal values.
+struct Expression {
+    Op op;
+    Ty ty;
+    int64_t imm;
+    std::vector<Value*> operands;
+
+    bool operator<(const Expression& other) const {
+        return std::tie(op, ty, imm, operands) < std::tie(other.op, other.ty, other.imm, other.operands);
+    }
+};
+
+class GvnPass : public Pass {
+    public:
+        const char* name() const override { return "gvn"; }
+        PreservedAnalyses run(Function& function, AnalysisManager& am) override;
+
+    private:
+        /// Loaded or stored value known to be in memory at @p address.
+        struct Available {
+            Value* address;
+            Ty ty;
+            Value* value;
+        };
+
+        void visit(Block* block, std::vector<Available> loads, const DominatorTree& dom);
+        Location locate(Value* address) const;
+        bool escaped(const Location& loc) const { return escaped_.count(reinterpret_cast<const Instruction*>(loc.id)) != 0; }
+        bool mayAlias(Value* a, size_t aSize, Value* b, size_t bSize) const;
+        void clobber(std::vector<Available>& loads, Value* address, size_t size) const;
+
+        std::map<Expression, Value*> expressions_;
+        std::unordered_set<const Instruction*> escaped_;               // Allocas whose address leaves the function's view
+};
+
+Location GvnPass::locate(Value* address) const {
+    Location loc;
+    while (address->kind() == Value::Kind::Instruction) {
+        auto insn = static_cast<Instruction*>(address);
+        if (insn->op() == Op::PtrAdd) {
+            if (insn->operand(1)->kind() == Value::Kind::Constant) loc.offset += static_cast<Constant*>(insn->operand(1))->value() * insn->imm();
+            else loc.exact = false;
+            address = insn->operand(0);
+            continue;
+        }
+        if (insn->op() == Op::Alloca) {
+            loc.object = Location::Object::Frame;
+            loc.id = reinterpret_cast<uintptr_t>(insn);
+        } else if (insn->op() == Op::Global) {
+            loc.object = Location::Object::Global;
+            loc.id = insn->imm();
+        }
+        break;
+    }
+    return loc;
+}
+
+/// May @p aSize bytes at @p a overlap @p bSize bytes at @p b? A size of 0 means any number.
+bool GvnPass::mayAlias(Value* a, size_t aSize, Value* b, size_t bSize) const {
+    Location x = locate(a), y = locate(b);
+    if (x.object == Location::Object::Unknown || y.object == Location::Object::Unknown) {
+        // Pointers of unknown origin only reach frame slots whose address escaped
+        Location& known = x.object == Location::Object::Unknown ? y : x;
+        return known.object != Location::Object::Frame || escaped(known);
+    }
+    if (x.object != y.object || x.id != y.id) return false;
+    if (!x.exact || !y.exact || aSize == 0 || bSize == 0) return true;
+    return x.offset < y.offset + int64_t(bSize) && y.offset < x.offset + int64_t(aSize);
+}
+
+/// Forgets the loads that writing @p size bytes at @p address may change. Calls (@p address null) may write
+/// anything but the frame slots that never escaped.
+void GvnPass::clobber(std::vector<Available>& loads, Value* address, size_t size) const {
+    loads.erase(std::remove_if(loads.begin(), loads.end(), [&](const Available& load) {
+        if (address != nullptr) return mayAlias(load.address, sizeOf(load.ty), address, size);
+        Location loc = locate(load.address);
+        return loc.object != Location::Object::Frame || escaped(loc);
+    }), loads.end());
+}
+
+PreservedAnalyses GvnPass::run(Function& function, AnalysisManager& am) {
+    // An alloca escapes when a pointer into it is stored, passed, returned or merged by a phi
+    escaped_.clear();
+    for (auto& block : function.blocks()) {
+        for (auto& insn : block->instructions()) {
+            if (insn->op() != Op::Alloca) continue;
+            std::vector<Instruction*> work = {insn.get()};
+            while (!work.empty() && !escaped_.count(insn.get())) {
+                Instruction* pointer = work.back();
+                work.pop_back();
+                for (auto user : pointer->users()) {
+                    if (user->op() == Op::PtrAdd && user->operand(0) == pointer) work.push_back(user);
+                    else if (user->op() == Op::Store && user->operand(1) == pointer) escaped_.insert(insn.get());
+                    else if (user->op() != Op::Load && user->op() != Op::Store && user->op() != Op::Copy && user->op() != Op::PtrDiff
+                             && !(user->op() >= Op::Eq && user->op() <= Op::Ge)) escaped_.insert(insn.get());
+                }
+            }
+        }
+    }
+
+    size_t before = 0, after = 0;
+    for (auto& block : function.blocks()) before += block->instructions().size();
+    expressions_.clear();
+    visit(function.entry(), {}, am.get<DominatorTree>(function));
+    for (auto& block : function.blocks()) after += block->instructions().size();
+
+    if (before == after) return PreservedAnalyses::all();
+    statistics_["instructions removed"] += before - after;
+    return PreservedAnalyses::cfg();
+}
+
+/// Walks the dominator tree: the expressions of the blocks above are available, and so are the loads of the parent
+/// when it is the only predecessor.
+void GvnPass::visit(Block* block, std::vector<Available> loads, const DominatorTree& dom) {
+    std::vector<Expression> scope;
+    std::vector<Instruction*> redundant;
+    for (auto& ptr : block->instructions()) {
+        Instruction* insn = ptr.get();
+        Op op = insn->op();
+        if ((op >= Op::Add && op <= Op::PtrDiff) || op == Op::Global || op == Op::String) {
+            Expression e{op, insn->ty(), insn->imm(), insn->operands()};
+            if (isCommutative(op) && e.operands[1] < e.operands[0]) std::swap(e.operands[0], e.operands[1]);
+            if (op == Op::Gt || op == Op::Ge) {                         // a > b is b < a
+                e.op = op == Op::Gt ? Op::Lt : Op::Le;
+                std::swap(e.operands[0], e.operands[1]);
+            }
+            auto [it, added] = expressions_.emplace(e, insn);
+            if (added) {
+                scope.push_back(std::move(e));
+            } else {
+                insn->replaceAllUsesWith(it->second);
+                redundant.push_back(insn);
+            }
+        } else if (op == Op::Load) {
+            auto known = std::find_if(loads.begin(), loads.end(), [&](const Available& load) {
+                return load.address == insn->operand(0) && load.ty == insn->ty();
+            });
+            if (known != loads.end()) {
+                insn->replaceAllUsesWith(known->value);
+                redundant.push_back(insn);
+            } else {
+                loads.push_back({insn->operand(0), insn->ty(), insn});
+            }
+        } else if (op == Op::Store) {
+            clobber(loads, insn->operand(0), sizeOf(insn->operand(1)->ty()));
+            loads.push_back({insn->operand(0), insn->operand(1)->ty(), insn->operand(1)});
+        } else if (op == Op::Copy) {
+            clobber(loads, insn->operand(0), insn->imm());
+        } else if (op == Op::Call) {
+            clobber(loads, nullptr, 0);
+        }
+    }
+    std::unordered_set<Instruction*> erased(redundant.begin(), redundant.end());
+    block->eraseIf([&](Instruction* insn) { return erased.count(insn) != 0; });
+
+    for (auto child : dom.children(block)) visit(child, child->preds.size() == 1 ? loads : std::vector<Available>(), dom);
+    for (auto& e : scope) expressions_.erase(e);
+}
+
+}
+
+std::unique_ptr<Pass> createSccpPass() {
+    return std::make_unique<SccpPass>();
+}
+
+std::unique_ptr<Pass> createAdcePass() {
+    return std::make_unique<AdcePass>();
+}
+
+std::unique_ptr<Pass> createGvnPass() {
+    return std::make_unique<GvnPass>();
+}
+
+}
@@ -0,0 +1,530 @@
+#include "ir_pass.h"
+
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <stdexcept>
+
+namespace H::ir {
+
+//! =================================================
+//! ==================== Analyses ===================
+//! =================================================
+
+DominatorTree::DominatorTree(Function& function, AnalysisManager&) {
+    // Reverse post order by an iterative depth first search
+    std::unordered_set<Block*> visited;
+    std::vector<std::pair<Block*, size_t>> stack = {{function.entry(), 0}};
+    visited.insert(function.entry());
+    while (!stack.empty()) {
+        auto& [block, next] = stack.back();
+        auto succs = block->successors();
+        if (next < succs.size()) {
+            Block* succ = succs[next++];
+            if (visited.insert(succ).second) stack.emplace_back(succ, 0);
+            continue;
+        }
+        rpo_.push_back(block);
+        stack.pop_back();
+    }
+    std::reverse(rpo_.begin(), rpo_.end());
+    for (size_t i = 0; i < rpo_.size(); i++) order_[rpo_[i]] = i;
+
+    constexpr size_t none = SIZE_MAX;
+    idom_.assign(rpo_.size(), none);
+    idom_[0] = 0;
+    auto intersect = [&](size_t a, size_t b) {
+        while (a != b) {
+            while (a > b) a = idom_[a];
+            while (b > a) b = idom_[b];
+        }
+        return a;
+    };
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t i = 1; i < rpo_.size(); i++) {
+            size_t idom = none;
+            for (auto pred : rpo_[i]->preds) {
+                auto p = order_.find(pred);
+                if (p == order_.end() || idom_[p->second] == none) continue;
+                idom = idom == none ? p->second : intersect(p->second, idom);
+            }
+            if (idom != idom_[i]) {
+                idom_[i] = idom;
+                changed = true;
+            }
+        }
+    }
+
+    children_.resize(rpo_.size());
+    for (size_t i = 1; i < rpo_.size(); i++) children_[idom_[i]].push_back(rpo_[i]);
+}
+
+Block* DominatorTree::idom(Block* block) const {
+    auto it = order_.find(block);
+    if (it == order_.end() || it->second == 0) return nullptr;
+    return rpo_[idom_[it->second]];
+}
+
+const std::vector<Block*>& DominatorTree::children(Block* block) const {
+    static const std::vector<Block*> none;
+    auto it = order_.find(block);
+    return it != order_.end() ? children_[it->second] : none;
+}
+
+bool DominatorTree::dominates(Block* a, Block* b) const {
+    auto ia = order_.find(a), ib = order_.find(b);
+    if (ia == order_.end() || ib == order_.end()) return false;
+    // Dominators come earlier in reverse post order, so walking up from b can stop below a
+    for (size_t i = ib->second; ; i = idom_[i]) {
+        if (i == ia->second) return true;
+        if (i < ia->second || i == 0) return false;
+    }
+}
+
+bool DominatorTree::dominates(const Instruction* def, const Instruction* user, Block* pred) const {
+    if (pred != nullptr) return dominates(def->parent(), pred);
+    if (def->parent() != user->parent()) return dominates(def->parent(), user->parent());
+    for (auto& insn : def->parent()->instructions()) {
+        if (insn.get() == def) return true;
+        if (insn.get() == user) return false;
+    }
+    return false;
+}
+
+PostDominatorTree::PostDominatorTree(Function& function, AnalysisManager&) {
+    // Reverse post order of the reversed graph, from the virtual exit (index 0) over the predecessors
+    std::vector<Block*> exits;
+    for (auto& block : function.blocks()) if (block->terminator()->op() == Op::Ret) exits.push_back(block.get());
+    std::unordered_set<Block*> visited;
+    std::vector<std::pair<Block*, size_t>> stack;
+    std::vector<Block*> postorder;
+    for (auto exit : exits) {
+        if (!visited.insert(exit).second) continue;
+        stack.emplace_back(exit, 0);
+        while (!stack.empty()) {
+            auto& [block, next] = stack.back();
+            if (next < block->preds.size()) {
+                Block* pred = block->preds[next++];
+                if (visited.insert(pred).second) stack.emplace_back(pred, 0);
+                continue;
+            }
+            postorder.push_back(block);
+            stack.pop_back();
+        }
+    }
+    rpo_.push_back(nullptr);
+    rpo_.insert(rpo_.end(), postorder.rbegin(), postorder.rend());
+    for (size_t i = 1; i < rpo_.size(); i++) order_[rpo_[i]] = i;
+
+    constexpr size_t none = SIZE_MAX;
+    ipdom_.assign(rpo_.size(), none);
+    ipdom_[0] = 0;
+    auto intersect = [&](size_t a, size_t b) {
+        while (a != b) {
+            while (a > b) a = ipdom_[a];
+            while (b > a) b = ipdom_[b];
+        }
+        return a;
+    };
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t i = 1; i < rpo_.size(); i++) {
+            Block* block = rpo_[i];
+            size_t ipdom = block->terminator()->op() == Op::Ret ? 0 : none;
+            for (auto succ : block->successors()) {
+                auto s = order_.find(succ);
+                if (s == order_.end() || ipdom_[s->second] == none) continue;
+                ipdom = ipdom == none ? s->second : intersect(s->second, ipdom);
+            }
+            if (ipdom != ipdom_[i]) {
+                ipdom_[i] = ipdom;
+                changed = true;
+            }
+        }
+    }
+}
+
+Block* PostDominatorTree::ipdom(Block* block) const {
+    auto it = order_.find(block);
+    return it != order_.end() ? rpo_[ipdom_[it->second]] : nullptr;
+}
+
+bool PostDominatorTree::postDominates(Block* a, Block* b) const {
+    auto ia = order_.find(a), ib = order_.find(b);
+    if (ia == order_.end() || ib == order_.end()) return false;
+    for (size_t i = ib->second; ; i = ipdom_[i]) {
+        if (i == ia->second) return true;
+        if (i < ia->second || i == 0) return false;
+    }
+}
+
+LoopInfo::LoopInfo(Function& function, AnalysisManager& am) {
+    auto& dom = am.get<DominatorTree>(function);
+
+    // A back edge goes to a block dominating its source; the loop is everything reaching it without the header
+    std::unordered_map<Block*, std::vector<Block*>> latches;
+    std::vector<Block*> headers;
+    for (auto block : dom.rpo()) {
+        for (auto succ : block->successors()) {
+            if (!dom.dominates(succ, block)) continue;
+            if (latches[succ].empty()) headers.push_back(succ);
+            latches[succ].push_back(block);
+        }
+    }
+    for (auto header : headers) {
+        auto loop = std::make_unique<Loop>();
+        loop->header = header;
+        loop->blocks.insert(header);
+        std::vector<Block*> work = latches[header];
+        while (!work.empty()) {
+            Block* block = work.back();
+            work.pop_back();
+            if (!loop->blocks.insert(block).second) continue;
+            for (auto pred : block->preds) work.push_back(pred);
+        }
+        loops_.push_back(std::move(loop));
+    }
+
+    std::stable_sort(loops_.begin(), loops_.end(), [](auto& a, auto& b) { return a->blocks.size() > b->blocks.size(); });
+    for (size_t i = 0; i < loops_.size(); i++) {
+        Loop* loop = loops_[i].get();
+        for (size_t j = i; j-- != 0;) {                                 // Smallest enclosing loop
+            if (loops_[j]->blocks.count(loop->header)) {
+                loop->parent = loops_[j].get();
+                loop->depth = loop->parent->depth + 1;
+                break;
+            }
+        }
+        for (auto block : loop->blocks) innermost_[block] = loop;
+    }
+}
+
+LoopInfo::Loop* LoopInfo::loopFor(Block* block) const {
+    auto it = innermost_.find(block);
+    return it != innermost_.end() ? it->second : nullptr;
+}
+
+Liveness::Liveness(Function& function, AnalysisManager& am) {
+    auto& dom = am.get<DominatorTree>(function);
+    auto isVariable = [](const Value* v) { return v->kind() != Value::Kind::Constant; };
+
+    std::unordered_map<Block*, Set> uses, defs;
+    for (auto& block : function.blocks()) {
+        auto& blockUses = uses[block.get()];
+        auto& blockDefs = defs[block.get()];
+        for (auto& insn : block->instructions()) {
+            if (insn->op() != Op::Phi)
+                for (auto operand : insn->operands()) if (isVariable(operand) && !blockDefs.count(operand)) blockUses.insert(operand);
+            blockDefs.insert(insn.get());
+        }
+        in_[block.get()];
+        out_[block.get()];
+    }
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto it = dom.rpo().rbegin(); it != dom.rpo().rend(); ++it) {
+            Block* block = *it;
+            Set out;
+            for (auto succ : block->successors()) {
+                out.insert(in_[succ].begin(), in_[succ].end());
+                for (auto& insn : succ->instructions()) {
+                    if (insn->op() != Op::Phi) break;
+                    for (size_t i = 0; i < insn->num_operands(); i++)
+                        if (insn->block(i) == block && isVariable(insn->operand(i))) out.insert(insn->operand(i));
+                }
+            }
+            Set in = uses[block];
+            for (auto value : out) if (!defs[block].count(value)) in.insert(value);
+            if (in.size() != in_[block].size() || out.size() != out_[block].size()) changed = true;
+            in_[block] = std::move(in);
+            out_[block] = std::move(out);
+        }
+    }
+}
+
+
+/// Reverse post order visiting the last successor first, so that the body of a loop follows its header and the
+/// exit comes after the whole loop; then the header of every loop with a conditional exit is moved to its bottom,
+/// where the back edge falls through into it and the test branches back once per iteration.
+std::vector<Block*> blockLayout(Function& function, AnalysisManager& am) {
+    std::vector<Block*> order;
+    std::unordered_set<Block*> visited = {function.entry()};
+    std::vector<std::pair<Block*, size_t>> stack = {{function.entry(), 0}};
+    while (!stack.empty()) {
+        auto& [block, next] = stack.back();
+        auto succs = block->successors();
+        if (next < succs.size()) {
+            Block* succ = succs[succs.size() - 1 - next++];
+            if (visited.insert(succ).second) stack.emplace_back(succ, 0);
+            continue;
+        }
+        order.push_back(block);
+        stack.pop_back();
+    }
+    std::reverse(order.begin(), order.end());
+
+    auto& loops = am.get<LoopInfo>(function);
+    for (auto it = loops.loops().rbegin(); it != loops.loops().rend(); ++it) {      // Inner loops first
+        auto& loop = **it;
+        auto exits = loop.header->successors();
+        if (loop.header == function.entry() || loop.header->terminator()->op() != Op::CondBr
+            || (loop.blocks.count(exits[0]) != 0) == (loop.blocks.count(exits[1]) != 0)) continue;
+        auto start = std::find(order.begin(), order.end(), loop.header);
+        if (size_t(order.end() - start) < loop.blocks.size()) continue;
+        auto end = start + loop.blocks.size();
+        if (!std::all_of(start, end, [&](Block* block) { return loop.blocks.count(block) != 0; })) continue;
+        std::rotate(start, start + 1, end);
+    }
+    return order;
+}
+
+
+//! =================================================
+//! ================== Pass Manager =================
+//! =================================================
+
+void AnalysisManager::invalidate(Function& function, const PreservedAnalyses& preserved) {
+    auto it = results_.find(&function);
+    if (it == results_.end()) return;
+    for (auto entry = it->second.begin(); entry != it->second.end();) {
+        if (preserved.preserved(entry->first, entry->second.cfgOnly)) ++entry;
+        else entry = it->second.erase(entry);
+    }
+}
+
+namespace {
+    /// verify() plus the SSA property: every definition dominates its uses.
+    std::string verifySsa(Function& function, AnalysisManager& am) {
+        std::string error = verify(function);
+        if (!error.empty()) return error;
+        auto& dom = am.get<DominatorTree>(function);
+        for (auto block : dom.rpo()) {
+            for (auto& insn : block->instructions()) {
+                for (size_t i = 0; i < insn->num_operands(); i++) {
+                    if (insn->operand(i)->kind() != Value::Kind::Instruction) continue;
+                    auto def = static_cast<Instruction*>(insn->operand(i));
+                    if (!dom.dominates(def, insn.get(), insn->op() == Op::Phi ? insn->block(i) : nullptr))
+                        return "in " + function.name() + ", block " + block->name() + ": " + op2str(insn->op()) + " uses a value not dominating it";
+                }
+            }
+        }
+        return "";
+    }
+
+    class VerifyPass : public Pass {
+        public:
+            const char* name() const override { return "verify"; }
+            PreservedAnalyses run(Function& function, AnalysisManager& am) override {
+                std::string error = verifySsa(function, am);
+                if (!error.empty()) throw std::logic_error("invalid IR " + error);
+                return PreservedAnalyses::all();
+            }
+    };
+
+    /// Folds constant branches, deletes unreachable blocks and single operand phis, merges a block into its only
+    /// predecessor when that has no other successor, and bypasses blocks that only jump on (unless the target has
+    /// phis or only jumps on as well).
+    class SimplifyCfgPass : public Pass {
+        public:
+            const char* name() const override { return "simplifycfg"; }
+            PreservedAnalyses run(Function& function, AnalysisManager& am) override;
+
+        private:
+            bool foldConstantBranches(Function& function);
+            bool removeSinglePhis(Function& function);
+            bool mergeBlocks(Function& function);
+            bool bypassForwarders(Function& function);
+    };
+
+    PreservedAnalyses SimplifyCfgPass::run(Function& function, AnalysisManager&) {
+        bool changed = false;
+        for (bool again = true; again;) {
+            again = foldConstantBranches(function);
+            again |= removeUnreachableBlocks(function);
+            again |= removeSinglePhis(function);
+            again |= mergeBlocks(function);
+            again |= bypassForwarders(function);
+            changed |= again;
+        }
+        return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+    }
+
+    bool SimplifyCfgPass::foldConstantBranches(Function& function) {
+        bool changed = false;
+        for (auto& block : function.blocks()) {
+            auto term = block->terminator();
+            if (term->op() != Op::CondBr || term->operand(0)->kind() != Value::Kind::Constant) continue;
+            foldBranch(block.get(), static_cast<Constant*>(term->operand(0))->value() != 0);
+            changed = true;
+        }
+        return changed;
+    }
+
+    bool SimplifyCfgPass::removeSinglePhis(Function& function) {
+        bool changed = false;
+        for (auto& block : function.blocks()) {
+            if (block->preds.size() != 1) continue;
+            while (!block->empty() && block->instructions().front()->op() == Op::Phi) {
+                Instruction* phi = block->instructions().front().get();
+                phi->replaceAllUsesWith(phi->operand(0));
+                block->erase(phi);
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    bool SimplifyCfgPass::mergeBlocks(Function& function) {
+        bool changed = false;
+        for (size_t i = 0; i < function.blocks().size(); i++) {
+            Block* block = function.blocks()[i].get();
+            if (block == function.entry() || block->preds.size() != 1) continue;
+            Block* pred = block->preds[0];
+            if (pred == block || pred->terminator()->op() != Op::Br) continue;
+            if (!block->empty() && block->instructions().front()->op() == Op::Phi) continue;
+
+            pred->erase(pred->terminator());
+            block->moveAllTo(pred);
+            for (auto succ : pred->successors()) {
+                std::replace(succ->preds.begin(), succ->preds.end(), block, pred);
+                for (auto& insn : succ->instructions()) {
+                    if (insn->op() != Op::Phi) break;
+                    for (size_t k = 0; k < insn->blocks().size(); k++) if (insn->block(k) == block) insn->setBlock(k, pred);
+                }
+            }
+            block->preds.clear();
+            function.eraseBlock(block);
+            i--;
+            changed = true;
+        }
+        return changed;
+    }
+
+    bool SimplifyCfgPass::bypassForwarders(Function& function) {
+        bool changed = false;
+        for (auto& block : function.blocks()) {
+            if (block.get() == function.entry() || block->instructions().size() != 1 || block->terminator()->op() != Op::Br) continue;
+            Block* target = block->terminator()->block(0);
+            if (target == block.get() || target->instructions().front()->op() == Op::Phi) continue;
+            if (target->instructions().size() == 1 && target->terminator()->op() == Op::Br) continue;    // Chains go one at a time, cycles stay
+            for (auto pred : std::vector<Block*>(block->preds)) {
+                auto term = pred->terminator();
+                for (size_t k = 0; k < term->blocks().size(); k++) {
+                    if (term->block(k) != block.get()) continue;
+                    term->setBlock(k, target);
+                    target->preds.push_back(pred);
+                }
+            }
+            block->preds.clear();                                       // Unreachable now; deleted in the next round
+            changed = true;
+        }
+        return changed;
+    }
+
+    using Factory = std::function<std::unique_ptr<Pass>(const PassOptions&)>;
+
+    const std::vector<std::pair<std::string, Factory>>& registry() {
+        static const std::vector<std::pair<std::string, Factory>> passes = {
+            {"adce",        [](const PassOptions&) { return createAdcePass(); }},
+            {"gvn",         [](const PassOptions&) { return createGvnPass(); }},
+            {"inline",      createInlinePass},
+            {"sccp",        [](const PassOptions&) { return createSccpPass(); }},
+            {"simplifycfg", [](const PassOptions&) { return std::make_unique<SimplifyCfgPass>(); }},
+            {"verify",      [](const PassOptions&) { return std::make_unique<VerifyPass>(); }},
+        };
+        return passes;
+    }
+
+    /// Functions with a body in post order of the call graph, starting from each function in module order.
+    std::vector<Function*> bottomUp(Module& module) {
+        std::vector<Function*> order;
+        std::unordered_set<Function*> visited;
+        std::function<void(Function*)> visit = [&](Function* function) {
+            if (function->isExternal() || !visited.insert(function).second) return;
+            for (auto& block : function->blocks())
+                for (auto& insn : block->instructions()) if (insn->op() == Op::Call) visit(insn->callee());
+            order.push_back(function);
+        };
+        for (auto& function : module.functions) visit(function.get());
+        return order;
+    }
+}
+
+std::unique_ptr<Pass> createPass(const std::string& name, const PassOptions& options) {
+    for (auto& [passName, factory] : registry()) if (passName == name) return factory(options);
+    return nullptr;
+}
+
+std::vector<std::string> passNames() {
+    std::vector<std::string> names;
+    for (auto& entry : registry()) names.push_back(entry.first);
+    return names;
+}
+
+const char* defaultPipeline(unsigned) {
+    return "inline,sccp,simplifycfg,gvn,adce,simplifycfg";
+}
+
+void PassManager::parse(const std::string& pipeline, const PassOptions& options) {
+    size_t start = 0;
+    while (start <= pipeline.size()) {
+        size_t end = pipeline.find(',', start);
+        if (end == std::string::npos) end = pipeline.size();
+        std::string name = pipeline.substr(start, end - start);
+        if (!name.empty()) {
+            auto pass = createPass(name, options);
+            if (!pass) {
+                std::string known;
+                for (auto& n : passNames()) known += (known.empty() ? "" : ", ") + n;
+                throw std::logic_error("unknown pass '" + name + "' (known: " + known + ")");
+            }
+            add(std::move(pass));
+        }
+        start = end + 1;
+    }
+}
+
+void PassManager::run(Module& module) {
+    for (auto function : bottomUp(module)) {
+        for (auto& pass : passes_) {
+            auto start = std::chrono::steady_clock::now();
+            PreservedAnalyses preserved = pass->run(*function, am_);
+            std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+            auto& timing = timings_[pass->name()];
+            timing.seconds += seconds.count();
+            timing.runs++;
+
+            am_.invalidate(*function, preserved);
+            if (verify_) {
+                std::string error = verifySsa(*function, am_);
+                if (!error.empty()) throw std::logic_error(std::string("invalid IR after ") + pass->name() + " " + error);
+            }
+        }
+    }
+    am_.clear();
+}
+
+void PassManager::printTimings(std::ostream& o) const {
+    std::vector<std::pair<std::string, Timing>> rows(timings_.begin(), timings_.end());
+    for (auto& [name, timing] : am_.timings()) rows.emplace_back(name + " (analysis)", timing);
+    std::stable_sort(rows.begin(), rows.end(), [](auto& a, auto& b) { return a.second.seconds > b.second.seconds; });
+    double total = 0;
+    for (auto& row : rows) total += row.second.seconds;
+
+    o << "pass timings (total " << std::fixed << std::setprecision(6) << total << " s)\n";
+    o << "     seconds   share    runs  name\n";
+    for (auto& [name, timing] : rows) {
+        o << std::setw(12) << timing.seconds << std::setw(7) << std::setprecision(1) << (total > 0 ? 100 * timing.seconds / total : 0.0) << '%'
+          << std::setw(8) << timing.runs << "  " << name << '\n' << std::setprecision(6);
+    }
+    o << std::defaultfloat;
+}
+
+void PassManager::printStatistics(std::ostream& o) const {
+    for (auto& pass : passes_)
+        for (auto& [what, count] : pass->statistics()) o << pass->name() << ": " << count << ' ' << what << '\n';
+}
+
+}
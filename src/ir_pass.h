@@ -0,0 +1,272 @@
+#ifndef PROG_IR_PASS_H
+#define PROG_IR_PASS_H
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ir.h"
+
+namespace H::ir {
+
+class AnalysisManager;
+
+//! =================================================
+//! ==================== Analyses ===================
+//! =================================================
+//
+// An analysis is computed on demand by the AnalysisManager and cached per function until a pass reports that it did
+// not preserve it. Every analysis class has a static id() and name(), a constant cfgOnly (its result only depends on
+// the control flow graph, so passes that keep the CFG keep it) and a constructor taking the function and the manager
+// (to ask for the analyses it builds on).
+
+using AnalysisId = const void*;
+
+class AnalysisResult {
+    public:
+        virtual ~AnalysisResult() {}
+};
+
+/// Immediate dominators (Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm") of the reachable blocks.
+class DominatorTree : public AnalysisResult {
+    public:
+        static AnalysisId id() { static char id; return &id; }
+        static const char* name() { return "dominators"; }
+        static constexpr bool cfgOnly = true;
+
+        DominatorTree(Function& function, AnalysisManager& am);
+
+        /// Reachable blocks in reverse post order; the entry comes first.
+        const std::vector<Block*>& rpo() const { return rpo_; }
+        /// @c nullptr for the entry and unreachable blocks.
+        Block* idom(Block* block) const;
+        const std::vector<Block*>& children(Block* block) const;
+        bool dominates(Block* a, Block* b) const;
+        /// Does the definition @p def dominate the use by @p user (in its block, or at the end of phi predecessor
+        /// @p pred)?
+        bool dominates(const Instruction* def, const Instruction* user, Block* pred = nullptr) const;
+
+    private:
+        std::vector<Block*> rpo_;
+        std::unordered_map<Block*, size_t> order_;                      // Index in rpo_
+        std::vector<size_t> idom_;
+        std::vector<std::vector<Block*>> children_;
+};
+
+/// Immediate post dominators, the dominators of the reversed control flow graph below a virtual exit that succeeds
+/// every return. Blocks that never reach a return (endless loops) have none.
+class PostDominatorTree : public AnalysisResult {
+    public:
+        static AnalysisId id() { static char id; return &id; }
+        static const char* name() { return "postdominators"; }
+        static constexpr bool cfgOnly = true;
+
+        PostDominatorTree(Function& function, AnalysisManager& am);
+
+        bool reachesExit(Block* block) const { return order_.count(block) != 0; }
+        /// @c nullptr when it is the virtual exit or @p block does not reach it.
+        Block* ipdom(Block* block) const;
+        bool postDominates(Block* a, Block* b) const;
+
+    private:
+        std::vector<Block*> rpo_;                                       // Of the reversed graph; the exit is nullptr
+        std::unordered_map<Block*, size_t> order_;
+        std::vector<size_t> ipdom_;
+};
+
+/// Natural loops, found from the back edges of the dominator tree.
+class LoopInfo : public AnalysisResult {
+    public:
+        static AnalysisId id() { static char id; return &id; }
+        static const char* name() { return "loops"; }
+        static constexpr bool cfgOnly = true;
+
+        struct Loop {
+            Block* header;
+            std::unordered_set<Block*> blocks;
+            Loop* parent = nullptr;
+            size_t depth = 1;
+        };
+
+        LoopInfo(Function& function, AnalysisManager& am);
+
+        const std::vector<std::unique_ptr<Loop>>& loops() const { return loops_; }
+        /// Innermost loop containing @p block or @c nullptr.
+        Loop* loopFor(Block* block) const;
+        size_t depth(Block* block) const { auto loop = loopFor(block); return loop ? loop->depth : 0; }
+
+    private:
+        std::vector<std::unique_ptr<Loop>> loops_;                      // Outer loops first
+        std::unordered_map<Block*, Loop*> innermost_;
+};
+
+/// Values live on entry and exit of every block; a phi operand is live at the end of its predecessor only.
+class Liveness : public AnalysisResult {
+    public:
+        static AnalysisId id() { static char id; return &id; }
+        static const char* name() { return "liveness"; }
+        static constexpr bool cfgOnly = false;
+
+        using Set = std::unordered_set<const Value*>;
+
+        Liveness(Function& function, AnalysisManager& am);
+
+        const Set& liveIn(Block* block) const { return in_.at(block); }
+        const Set& liveOut(Block* block) const { return out_.at(block); }
+
+    private:
+        std::unordered_map<Block*, Set> in_;
+        std::unordered_map<Block*, Set> out_;
+};
+
+/// Order in which backends emit the blocks of @p function: reverse post order visiting the last successor first, with
+/// the header of every loop that has a conditional exit moved to the bottom of the loop.
+std::vector<Block*> blockLayout(Function& function, AnalysisManager& am);
+
+
+//! =================================================
+//! ================== Pass Manager =================
+//! =================================================
+
+/// Analyses still valid after a pass.
+class PreservedAnalyses {
+    public:
+        static PreservedAnalyses all() { PreservedAnalyses pa; pa.all_ = true; return pa; }
+        static PreservedAnalyses none() { return PreservedAnalyses(); }
+        /// Only instructions changed: the analyses of the control flow graph stay valid.
+        static PreservedAnalyses cfg() { PreservedAnalyses pa; pa.cfg_ = true; return pa; }
+
+        template<class A>
+        PreservedAnalyses& preserve() { ids_.insert(A::id()); return *this; }
+        bool preserved(AnalysisId id, bool cfgOnly) const { return all_ || (cfgOnly && cfg_) || ids_.count(id); }
+
+    private:
+        bool all_ = false;
+        bool cfg_ = false;
+        std::set<AnalysisId> ids_;
+};
+
+struct Timing {
+    double seconds = 0;
+    size_t runs = 0;
+};
+
+class AnalysisManager {
+    public:
+        template<class A>
+        A& get(Function& function);
+
+        /// Drops the results for @p function that @p preserved does not keep.
+        void invalidate(Function& function, const PreservedAnalyses& preserved);
+        void clear() { results_.clear(); }
+
+        /// Time spent computing each analysis.
+        const std::map<std::string, Timing>& timings() const { return timings_; }
+
+    private:
+        struct Entry {
+            std::unique_ptr<AnalysisResult> result;
+            bool cfgOnly;
+        };
+
+        std::unordered_map<const Function*, std::unordered_map<AnalysisId, Entry>> results_;
+        std::map<std::string, Timing> timings_;
+};
+
+template<class A>
+A& AnalysisManager::get(Function& function) {
+    auto& cached = results_[&function][A::id()];
+    if (!cached.result) {
+        auto start = std::chrono::steady_clock::now();
+        auto result = std::make_unique<A>(function, *this);
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+        auto& timing = timings_[A::name()];
+        timing.seconds += seconds.count();
+        timing.runs++;
+        auto& entry = results_[&function][A::id()];                     // The analyses it used may have rehashed the map
+        entry.result = std::move(result);
+        entry.cfgOnly = A::cfgOnly;
+        return static_cast<A&>(*entry.result);
+    }
+    return static_cast<A&>(*cached.result);
+}
+
+/// Transformation of one function at a time.
+class Pass {
+    public:
+        virtual ~Pass() {}
+        virtual const char* name() const = 0;
+        virtual PreservedAnalyses run(Function& function, AnalysisManager& am) = 0;
+
+        /// What the pass changed, summed over all functions it ran on.
+        const std::map<std::string, size_t>& statistics() const { return statistics_; }
+
+    protected:
+        std::map<std::string, size_t> statistics_;
+};
+
+/// Settings of the passes that have any.
+struct PassOptions {
+    size_t inlineThreshold = 40;                                        // Largest callee inlined unless declared 'inline'
+    std::ostream* inlineReport = nullptr;                               // Gets a line for every call considered
+};
+
+/// Sparse conditional constant propagation (Wegman and Zadeck): values and branches that are constant on every
+/// executable path are folded, blocks found never executed are deleted.
+std::unique_ptr<Pass> createSccpPass();
+
+/// Aggressive dead code elimination: everything is dead unless it has an effect, feeds something live or decides
+/// whether something live runs. Dead branches jump straight to their post dominator; loops are kept.
+std::unique_ptr<Pass> createAdcePass();
+
+/// Global value numbering: a pure computation, or a load not preceded by a store that may alias it, that repeats
+/// one dominating it is replaced by the earlier value; a load right after a store to its address takes the value
+/// stored.
+std::unique_ptr<Pass> createGvnPass();
+
+/// Inlining: a call of a function that is declared 'inline' or has at most @c inlineThreshold instructions, and is not
+/// on a cycle of the call graph, is replaced by a copy of the callee's body with the arguments for its parameters.
+std::unique_ptr<Pass> createInlinePass(const PassOptions& options);
+
+/// Pass registered under @p name or @c nullptr.
+std::unique_ptr<Pass> createPass(const std::string& name, const PassOptions& options = {});
+
+/// Names of all registered passes.
+std::vector<std::string> passNames();
+
+/// Pipeline run on the IR of executed programs at -O@p level (1 to 3).
+const char* defaultPipeline(unsigned level);
+
+class PassManager {
+    public:
+        void add(std::unique_ptr<Pass> pass) { passes_.push_back(std::move(pass)); }
+        /// Adds the comma separated passes of @p pipeline; throws std::logic_error for unknown ones.
+        void parse(const std::string& pipeline, const PassOptions& options = {});
+        /// Check every function after every pass; violations throw std::logic_error naming the pass.
+        void verifyEach(bool enable) { verify_ = enable; }
+
+        /// Runs the passes in order on every function with a body, on callees before their callers where the call graph
+        /// has no cycle, so the inliner sees them optimised.
+        void run(Module& module);
+
+        /// Time per pass and per analysis, most expensive first.
+        void printTimings(std::ostream& o) const;
+        /// Statistics of every pass in pipeline order.
+        void printStatistics(std::ostream& o) const;
+
+    private:
+        std::vector<std::unique_ptr<Pass>> passes_;
+        AnalysisManager am_;
+        std::map<std::string, Timing> timings_;
+        bool verify_ = false;
+};
+
+}
+
+#endif
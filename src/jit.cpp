@@ -0,0 +1,418 @@
+#include "jit.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "vm.h"
+#include "x86.h"
+
+namespace H {
+
+using namespace x86;
+
+namespace {
+    /// Callee-saved host registers that hold the most used bytecode registers.
+    constexpr Reg host_regs[] = {RBX, R12, R13, R14, R15};
+    constexpr int num_host_regs = sizeof(host_regs) / sizeof(host_regs[0]);
+
+    Cond condition(Op op) {
+        switch (op) {
+            case Op::Eq: case Op::JEq: return E;
+            case Op::Ne: case Op::JNe: return NE;
+            case Op::Lt: case Op::JLt: return L;
+            case Op::Le: case Op::JLe: return LE;
+            case Op::Gt: case Op::JGt: return G;
+            default:                   return GE;
+        }
+    }
+
+    /// Expands the bytecode of one function; calls are left for @p Jit to resolve once all entries are known.
+    class FunctionCompiler {
+        public:
+            FunctionCompiler(Assembler& as, const Program& program, const BcFunction& fn, char* data, const std::vector<void*>& externs)
+                : as_(as)
+                , program_(program)
+                , fn_(fn)
+                , data_(data)
+                , externs_(externs)
+            {}
+
+            void compile(std::vector<std::pair<size_t, uint32_t>>& calls);
+
+        private:
+            void allocate(uint32_t begin, uint32_t end);
+            void insn(const Insn& insn, std::vector<std::pair<size_t, uint32_t>>& calls);
+            void epilogue();
+
+            Operand loc(int32_t r) const {
+                if (host_[r] != RSP) return Operand::r(host_[r]);
+                return Operand::m(RBP, -saved_bytes_ - 8 * (r + 1));
+            }
+            /// Register holding bytecode register @p r, loading it into @p scratch if it lives on the stack.
+            Reg read(int32_t r, Reg scratch) {
+                if (host_[r] != RSP) return host_[r];
+                as_.mov(scratch, loc(r));
+                return scratch;
+            }
+            void write(int32_t r, Reg value) {
+                if (host_[r] != RSP) as_.mov(host_[r], value);
+                else as_.mov(loc(r), value);
+            }
+            /// Writes the 32 bit result in @p value sign-extended.
+            void writeInt(int32_t r, Reg value) {
+                if (host_[r] != RSP) {
+                    as_.movsxd(host_[r], value);
+                } else {
+                    as_.movsxd(value, value);
+                    as_.mov(loc(r), value);
+                }
+            }
+
+            Assembler& as_;
+            const Program& program_;
+            const BcFunction& fn_;
+            char* data_;
+            const std::vector<void*>& externs_;
+            std::vector<Reg> host_;                                     // RSP: kept in a stack slot
+            int num_saved_ = 0;                                         // Host registers in use, saved below RBP
+            int32_t saved_bytes_ = 0;
+            int32_t frame_base_ = 0;                                    // Frame memory relative to RBP
+            int32_t total_ = 0;                                         // Bytes below RBP
+            std::vector<size_t> offsets_;                               // Native offset of every instruction
+            std::vector<std::pair<size_t, uint32_t>> jumps_;            // rel32 field, target instruction
+            uint32_t begin_ = 0;
+    };
+
+    void FunctionCompiler::allocate(uint32_t begin, uint32_t end) {
+        // Uses inside loops (spans of backward jumps) count eight times per level of nesting
+        std::vector<uint32_t> weight(end - begin, 1);
+        for (uint32_t i = begin; i != end; ++i) {
+            auto& insn = program_.code[i];
+            if (insn.op >= Op::Jmp && insn.op <= Op::JGe && uint32_t(insn.c) <= i && uint32_t(insn.c) >= begin)
+                for (uint32_t k = insn.c; k <= i; ++k) weight[k - begin] = std::min<uint32_t>(weight[k - begin] * 8, 1 << 24);
+        }
+
+        std::vector<uint32_t> uses(fn_.num_regs);
+        uint32_t w = 1;
+        auto use = [&](int32_t r) { uses[r] += w; };
+        for (uint32_t i = begin; i != end; ++i) {
+            auto& insn = program_.code[i];
+            w = weight[i - begin];
+            switch (insn.op) {
+                case Op::Const: case Op::FrameAddr: case Op::DataAddr:
+                    use(insn.a); break;
+                case Op::Jmp: case Op::RetVoid:
+                    break;
+                case Op::Jz: case Op::Jnz: case Op::Ret:
+                    use(insn.b); break;
+                case Op::Mov: case Op::AddI: case Op::MulI: case Op::AddPI: case Op::Neg: case Op::Not: case Op::BitNot:
+                case Op::SExt8: case Op::SExt32: case Op::Ld8: case Op::Ld32: case Op::Ld64: case Op::St8: case Op::St32:
+                case Op::St64: case Op::Copy: case Op::JEq: case Op::JNe: case Op::JLt: case Op::JLe: case Op::JGt: case Op::JGe:
+                    use(insn.a); use(insn.b); break;
+                case Op::Call: case Op::CallExt: {
+                    use(insn.a);
+                    uint32_t n = insn.op == Op::Call ? program_.functions[insn.b].num_params : program_.externs[insn.b].num_params;
+                    for (uint32_t k = 0; k != n; ++k) use(insn.c + k);
+                    break;
+                }
+                default:
+                    use(insn.a); use(insn.b); use(insn.c); break;
+            }
+        }
+
+        std::vector<int32_t> order(fn_.num_regs);
+        for (size_t r = 0; r != order.size(); ++r) order[r] = r;
+        std::stable_sort(order.begin(), order.end(), [&](int32_t x, int32_t y) { return uses[x] > uses[y]; });
+        host_.assign(fn_.num_regs, RSP);
+        num_saved_ = 0;
+        while (num_saved_ != num_host_regs && num_saved_ != int(order.size()) && uses[order[num_saved_]] != 0) {
+            host_[order[num_saved_]] = host_regs[num_saved_];
+            num_saved_++;
+        }
+        saved_bytes_ = 8 * num_saved_;
+    }
+
+    void FunctionCompiler::compile(std::vector<std::pair<size_t, uint32_t>>& calls) {
+        begin_ = fn_.entry;
+        uint32_t end = &fn_ == &program_.functions.back() ? program_.code.size() : (&fn_ + 1)->entry;
+        allocate(begin_, end);
+
+        // Frame: saved registers, register slots, frame memory; RSP stays 16 byte aligned at calls
+        int32_t total = (saved_bytes_ + 8 * fn_.num_regs + fn_.frame_size + 15) / 16 * 16;
+        frame_base_ = -total;
+        total_ = total;
+        as_.push(RBP);
+        as_.mov(RBP, RSP);
+        for (int k = 0; k != num_saved_; ++k) as_.push(host_regs[k]);
+        if (total != saved_bytes_) as_.alu(SUB, Operand::r(RSP), total - saved_bytes_);
+
+        for (uint32_t i = 0; i != fn_.num_params; ++i) {
+            if (i < 6) {
+                write(i, arg_regs[i]);
+            } else {
+                as_.mov(RAX, Operand::m(RBP, 16 + 8 * (i - 6)));
+                write(i, RAX);
+            }
+        }
+
+        for (uint32_t i = begin_; i != end; ++i) {
+            offsets_.push_back(as_.size());
+            insn(program_.code[i], calls);
+        }
+        for (auto [at, target] : jumps_) as_.patch(at, offsets_[target - begin_]);
+    }
+
+    void FunctionCompiler::epilogue() {
+        if (total_ != saved_bytes_) as_.lea(RSP, Operand::m(RBP, -saved_bytes_));
+        for (int k = num_saved_; k-- != 0;) as_.pop(host_regs[k]);
+        as_.pop(RBP);
+        as_.ret();
+    }
+
+    void FunctionCompiler::insn(const Insn& insn, std::vector<std::pair<size_t, uint32_t>>& calls) {
+        int32_t a = insn.a, b = insn.b, c = insn.c;
+        switch (insn.op) {
+            case Op::Const:
+                if (host_[a] != RSP) as_.mov(host_[a], int64_t(c));
+                else as_.mov(loc(a), c);
+                break;
+            case Op::Mov:
+                write(a, read(b, RAX));
+                break;
+            case Op::Add:
+            case Op::Sub:
+                as_.mov(RAX, loc(b), W32);
+                as_.alu(insn.op == Op::Add ? ADD : SUB, RAX, loc(c), W32);
+                writeInt(a, RAX);
+                break;
+            case Op::Mul:
+                as_.mov(RAX, loc(b), W32);
+                as_.imul(RAX, loc(c), W32);
+                writeInt(a, RAX);
+                break;
+            case Op::Div:
+            case Op::Mod:
+                as_.mov(RAX, loc(b), W32);
+                as_.cdq();
+                as_.idiv(loc(c), W32);
+                writeInt(a, insn.op == Op::Div ? RAX : RDX);
+                break;
+            case Op::Shl:
+            case Op::Shr:
+                as_.mov(RCX, loc(c), W32);
+                as_.mov(RAX, loc(b), W32);
+                as_.shift(insn.op == Op::Shl ? SHL : SAR, Operand::r(RAX), W32);
+                writeInt(a, RAX);
+                break;
+            case Op::And:
+            case Op::Or:
+            case Op::Xor:
+            case Op::AddP:
+            case Op::SubP: {
+                Alu kind = insn.op == Op::And ? AND : insn.op == Op::Or ? OR : insn.op == Op::Xor ? XOR : insn.op == Op::AddP ? ADD : SUB;
+                as_.mov(RAX, loc(b));
+                as_.alu(kind, RAX, loc(c));
+                write(a, RAX);
+                break;
+            }
+            case Op::AddI:
+                as_.mov(RAX, loc(b), W32);
+                as_.alu(ADD, Operand::r(RAX), c, W32);
+                writeInt(a, RAX);
+                break;
+            case Op::MulI:
+                as_.imul(RAX, loc(b), c, W32);
+                writeInt(a, RAX);
+                break;
+            case Op::AddPI: {
+                Reg base = read(b, RAX);
+                if (host_[a] != RSP) {
+                    as_.lea(host_[a], Operand::m(base, c));
+                } else {
+                    as_.lea(RAX, Operand::m(base, c));
+                    write(a, RAX);
+                }
+                break;
+            }
+            case Op::Neg:
+                as_.mov(RAX, loc(b), W32);
+                as_.neg(Operand::r(RAX), W32);
+                writeInt(a, RAX);
+                break;
+            case Op::Not: {
+                Reg x = read(b, RAX);
+                as_.test(x, Operand::r(x));
+                as_.setcc(E, RAX);
+                as_.movzx8(RAX, Operand::r(RAX));
+                write(a, RAX);
+                break;
+            }
+            case Op::BitNot:
+                as_.mov(RAX, loc(b));
+                as_.not_(Operand::r(RAX));
+                write(a, RAX);
+                break;
+            case Op::SExt8:
+                as_.movsx8(RAX, loc(b));
+                write(a, RAX);
+                break;
+            case Op::SExt32:
+                as_.movsxd(RAX, loc(b));
+                write(a, RAX);
+                break;
+            case Op::Eq:
+            case Op::Ne:
+            case Op::Lt:
+            case Op::Le:
+            case Op::Gt:
+            case Op::Ge:
+                as_.alu(CMP, read(b, RAX), loc(c));
+                as_.setcc(condition(insn.op), RAX);
+                as_.movzx8(RAX, Operand::r(RAX));
+                write(a, RAX);
+                break;
+            case Op::Ld8:
+                as_.movsx8(RAX, Operand::m(read(b, RAX), c));
+                write(a, RAX);
+                break;
+            case Op::Ld32:
+                as_.movsxd(RAX, Operand::m(read(b, RAX), c));
+                write(a, RAX);
+                break;
+            case Op::Ld64:
+                as_.mov(RAX, Operand::m(read(b, RAX), c));
+                write(a, RAX);
+                break;
+            case Op::St8:
+            case Op::St32:
+            case Op::St64: {
+                Reg base = read(a, RAX);
+                Reg value = read(b, RCX);
+                as_.mov(Operand::m(base, c), value, insn.op == Op::St8 ? W8 : insn.op == Op::St32 ? W32 : W64);
+                break;
+            }
+            case Op::Copy:
+                if (c <= 64) {                                          // Unrolled for small structs
+                    Reg dst = read(a, RDI);
+                    Reg src = read(b, RSI);
+                    for (int32_t k = 0; k < c;) {
+                        Width w = c - k >= 8 ? W64 : c - k >= 4 ? W32 : W8;
+                        if (w == W8) as_.movzx8(RAX, Operand::m(src, k));
+                        else as_.mov(RAX, Operand::m(src, k), w);
+                        as_.mov(Operand::m(dst, k), RAX, w);
+                        k += w / 8;
+                    }
+                } else {
+                    as_.mov(RDI, loc(a));
+                    as_.mov(RSI, loc(b));
+                    as_.mov(RCX, int64_t(c));
+                    as_.rep_movsb();
+                }
+                break;
+            case Op::FrameAddr:
+                as_.lea(RAX, Operand::m(RBP, frame_base_ + c));
+                write(a, RAX);
+                break;
+            case Op::DataAddr:
+                as_.mov(RAX, int64_t(data_ + c));
+                write(a, RAX);
+                break;
+            case Op::Jmp:
+                jumps_.emplace_back(as_.jmp(), c);
+                break;
+            case Op::Jz:
+            case Op::Jnz: {
+                Reg x = read(b, RAX);
+                as_.test(x, Operand::r(x));
+                jumps_.emplace_back(as_.jcc(insn.op == Op::Jz ? E : NE), c);
+                break;
+            }
+            case Op::JEq:
+            case Op::JNe:
+            case Op::JLt:
+            case Op::JLe:
+            case Op::JGt:
+            case Op::JGe:
+                as_.alu(CMP, read(a, RAX), loc(b));
+                jumps_.emplace_back(as_.jcc(condition(insn.op)), c);
+                break;
+            case Op::Call:
+            case Op::CallExt: {
+                bool external = insn.op == Op::CallExt;
+                uint32_t n = external ? program_.externs[b].num_params : program_.functions[b].num_params;
+                int32_t stacked = n > 6 ? n - 6 : 0;
+                int32_t pad = stacked % 2 ? 8 : 0;
+                if (pad) as_.alu(SUB, Operand::r(RSP), pad);
+                for (int32_t k = n; k-- > 6;) as_.push(loc(c + k));
+                for (uint32_t k = 0; k != n && k != 6; ++k) as_.mov(arg_regs[k], loc(c + k));
+                if (external) {
+                    as_.mov(R11, int64_t(externs_[b]));
+                    as_.alu(XOR, RAX, Operand::r(RAX), W32);            // No vector arguments for variadic callees
+                    as_.call(Operand::r(R11));
+                    Repr ret = program_.externs[b].ret;
+                    if (ret == Repr::Char) as_.movsx8(RAX, Operand::r(RAX));
+                    if (ret == Repr::Int) as_.movsxd(RAX, RAX);
+                } else {
+                    calls.emplace_back(as_.call(), b);
+                }
+                if (stacked + pad / 8) as_.alu(ADD, Operand::r(RSP), 8 * stacked + pad);
+                write(a, RAX);
+                break;
+            }
+            case Op::Ret:
+                as_.mov(RAX, read(b, RAX));
+                epilogue();
+                break;
+            case Op::RetVoid:
+                as_.alu(XOR, RAX, Operand::r(RAX), W32);
+                epilogue();
+                break;
+        }
+    }
+}
+
+Jit::Jit(const Program& program)
+    : program_(program)
+    , data_(new char[program.data.size() + 1])
+{
+    std::memcpy(data_.get(), program.data.data(), program.data.size());
+    auto externs = resolveExterns(program);
+
+    Assembler as;
+    std::vector<std::pair<size_t, uint32_t>> calls;
+    for (auto& fn : program.functions) {
+        entries_.push_back(as.size());
+        FunctionCompiler(as, program, fn, data_.get(), externs).compile(calls);
+    }
+    for (auto [at, callee] : calls) as.patch(at, entries_[callee]);
+
+    // Written while writable, then flipped to executable
+    code_size_ = as.size();
+    size_t page = sysconf(_SC_PAGESIZE);
+    mapped_ = std::max<size_t>((code_size_ + page - 1) / page * page, page);
+    void* memory = mmap(nullptr, mapped_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) throw std::runtime_error("cannot map memory for the JIT");
+    code_ = static_cast<uint8_t*>(memory);
+    std::memcpy(code_, as.code().data(), code_size_);
+    if (mprotect(code_, mapped_, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code_, mapped_);
+        throw std::runtime_error("cannot make the JIT code executable");
+    }
+}
+
+Jit::~Jit() {
+    if (code_ != nullptr) munmap(code_, mapped_);
+}
+
+int Jit::runMain(int argc, char** argv) {
+    int64_t index = program_.function("main");
+    if (index < 0) throw std::runtime_error("no function 'main'");
+    if (program_.functions[index].num_params == 2)
+        return int(reinterpret_cast<int64_t (*)(int64_t, char**)>(function(index))(argc, argv));
+    return int(reinterpret_cast<int64_t (*)()>(function(index))());
+}
+
+}
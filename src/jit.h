@@ -0,0 +1,48 @@
+#ifndef PROG_JIT_H
+#define PROG_JIT_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "bytecode.h"
+
+namespace H {
+
+//! =================================================
+//! ====================== JIT ======================
+//! =================================================
+//
+// Baseline compiler from bytecode to x86-64: every instruction is expanded from a fixed template. The most used
+// registers of a function are kept in the callee-saved host registers, the others in stack slots. Functions follow
+// the System V calling convention, so they call each other (and external functions) directly and main is entered
+// as a plain function pointer. The code is written to anonymous pages that are made executable, never both.
+
+class Jit {
+    public:
+        /// Compiles all functions of @p program; throws std::runtime_error if an external is missing.
+        Jit(const Program& program);
+        ~Jit();
+        Jit(const Jit&) = delete;
+        Jit& operator=(const Jit&) = delete;
+
+        /// Entry point of function @p index.
+        void* function(uint32_t index) const { return code_ + entries_[index]; }
+
+        /// Runs @c main, passing @c argc and @c argv if it takes them, and returns the exit status.
+        int runMain(int argc, char** argv);
+
+        size_t code_size() const { return code_size_; }
+
+    private:
+        const Program& program_;
+        std::unique_ptr<char[]> data_;
+        std::vector<size_t> entries_;
+        uint8_t* code_ = nullptr;
+        size_t code_size_ = 0;
+        size_t mapped_ = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef PROG_JSON_WRITER_H
+#define PROG_JSON_WRITER_H
+
+#include "output_buffer.h"
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+namespace H {
+
+/// Streaming JSON output: values are written into an @c OutputBuffer as they are produced. The writer only remembers whether the next value needs a separating comma, so its memory does not
+/// grow with the document; callers are responsible for balancing @p begin_object() / @p end_object() and the like.
+class JsonWriter {
+    public:
+        JsonWriter(std::ostream& sink)
+            : out_(sink)
+        {}
+
+        void begin_object() { separate(); out_.put('{'); comma_ = false; }
+        void end_object() { out_.put('}'); comma_ = true; full(); }
+        void begin_array() { separate(); out_.put('['); comma_ = false; }
+        void end_array() { out_.put(']'); comma_ = true; full(); }
+
+        /// Member name inside an object; the next call writes its value.
+        void key(const char* name) {
+            separate();
+            string(name, std::strlen(name));
+            out_.put(':');
+            comma_ = false;
+        }
+
+        void value(const std::string& s) { separate(); string(s.data(), s.size()); comma_ = true; full(); }
+        void value(const char* s) { separate(); string(s, std::strlen(s)); comma_ = true; full(); }
+        void value(bool b) { separate(); out_.put(b ? "true" : "false"); comma_ = true; }
+        void value(std::nullptr_t) { separate(); out_.put("null"); comma_ = true; }
+        void value(int64_t i) { separate(); out_.digits(i); comma_ = true; }
+        void value(uint64_t i) { separate(); out_.digits(i); comma_ = true; }
+        void value(int i) { value(int64_t(i)); }
+
+        template<class T>
+        void field(const char* name, T&& v) { key(name); value(std::forward<T>(v)); }
+
+        /// Ends a top-level value with a line break (NDJSON).
+        void end_line() { out_.put('\n'); comma_ = false; full(); }
+
+        void flush() { out_.flush(); }
+
+    private:
+        void separate() { if (comma_) out_.put(','); }
+
+        void full() { out_.full(); }
+
+        void string(const char* s, size_t size) {
+            static const char hex[] = "0123456789abcdef";
+            out_.put('"');
+            for (auto end = s + size; s != end; ++s) {
+                auto c = static_cast<unsigned char>(*s);
+                switch (c) {
+                    case '"':  out_.put("\\\""); break;
+                    case '\\': out_.put("\\\\"); break;
+                    case '\n': out_.put("\\n"); break;
+                    case '\t': out_.put("\\t"); break;
+                    case '\r': out_.put("\\r"); break;
+                    default:
+                        if (c < 0x20) {
+                            out_.put("\\u00");
+                            out_.put(hex[c >> 4]);
+                            out_.put(hex[c & 15]);
+                        } else {
+                            out_.put(c);
+                        }
+                }
+            }
+            out_.put('"');
+        }
+
+        OutputBuffer out_;
+        bool comma_ = false;                                            // A value precedes the next one at this level
+};
+
+}
+
+#endif
@@ -13,9 +13,10 @@ using namespace std;
 
 namespace H {
 
-Lexer::Lexer(const char* filename, std::istream& stream)
-    : loc_{filename, {1, 1}, {1, 1}}
-    , peek_pos_({1, 1})
+Lexer::Lexer(const char* filename, std::istream& stream, Pos start)
+    : loc_{filename, start, start}
+    , peek_pos_(start)
+    , bol_(start.col == 1)
     , stream_(stream)
 {
     if (!stream_) throw std::runtime_error("stream is bad");
@@ -28,6 +29,7 @@ int Lexer::next() {
     if (c == '\n') {
         ++peek_pos_.row;
         peek_pos_.col = 1;
+        bol_ = true;
     } else {
         ++peek_pos_.col;
     }
@@ -336,6 +338,33 @@ Tok Lexer::lex() {
     }
 }
 
+bool Lexer::at_line_end() {
+    while (true) {
+        while (blank(peek())) next();
+        if (peek() != '/') break;
+        next();
+        if (accept('*')) {
+            eat_comments();
+        } else if (peek() == '/') {
+            while (!eof() && peek() != '\n') next();
+        } else {
+            back();
+            --peek_pos_.col;
+            break;
+        }
+    }
+    return eof() || peek() == '\n';
+}
+
+void Lexer::skip_line() {
+    while (!eof() && next() != '\n') {}
+}
+
+bool Lexer::directive_follows() {
+    while (blank(peek())) next();
+    return peek() == '#';
+}
+
 void Lexer::eat_comments() {
     while (true) {
         while (!eof() && peek() != '*') next();
@@ -10,20 +10,26 @@ namespace H {
 
 class Lexer {
 public:
-    Lexer(const char*, std::istream&);
+    Lexer(const char*, std::istream&, Pos start = Pos(1, 1));      ///< @p start: position of the first byte of @p stream in its file.
 
     Loc loc() const { return loc_; }
     Tok lex();                                          ///< Get next @p Tok in stream.
 
+    // Line-oriented helpers for the preprocessor
+    bool at_line_end();                                 ///< Skips blanks and line comments; @c true at a newline or eof.
+    void skip_line();                                   ///< Consumes everything up to and including the next newline.
+    bool directive_follows();                           ///< Skips leading blanks; @c true if the line starts with '#'.
+    bool at_eof() const { return eof(); }
+
 private:
     Tok tok(Tok::Tag tag, std::string tag_value, std::string tag_type) {
-
-        if(tag == Tok::Tag::C_Integer) {
-            return {loc(), tag, tag_value, tag_type, std::stoull(tag_value)};
-        }
-
-        return {loc(), tag, tag_value, tag_type}; 
+        Tok result = tag == Tok::Tag::C_Integer ? Tok(loc(), tag, tag_value, tag_type, std::stoull(tag_value)) : Tok(loc(), tag, tag_value, tag_type);
+        result.set_bol(bol_);
+        bol_ = false;
+        return result;
     }        
+
+    static bool blank(int c) { return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v'; }
  
     bool eof() const { peek(); return stream_.eof(); }  
 
@@ -51,6 +57,7 @@ private:
 
     Loc loc_;       ///< @p Loc%ation of the @p Tok%en we are currently constructing within @p str_,
     Pos peek_pos_;  ///< @p Pos%ition of the current @p peek().
+    bool bol_;      ///< No token yet on the current line.
     std::istream& stream_;
     std::string str_;
 };
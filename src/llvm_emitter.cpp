@@ -0,0 +1,645 @@
+#include "llvm_emitter.h"
+
+#include <stdexcept>
+
+#ifdef H_LLVM
+
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+
+#include "lower.h"
+
+namespace H {
+
+namespace {
+    bool isComparison(Tok::Tag tag) {
+        return tag == Tok::Tag::P_Equal || tag == Tok::Tag::P_Unequal || tag == Tok::Tag::P_Less
+            || tag == Tok::Tag::P_Less_Equal || tag == Tok::Tag::P_Greater || tag == Tok::Tag::P_Greater_Equal;
+    }
+
+    llvm::CmpInst::Predicate predicate(Tok::Tag tag) {
+        switch (tag) {
+            case Tok::Tag::P_Equal:         return llvm::CmpInst::ICMP_EQ;
+            case Tok::Tag::P_Unequal:       return llvm::CmpInst::ICMP_NE;
+            case Tok::Tag::P_Less:          return llvm::CmpInst::ICMP_SLT;
+            case Tok::Tag::P_Less_Equal:    return llvm::CmpInst::ICMP_SLE;
+            case Tok::Tag::P_Greater:       return llvm::CmpInst::ICMP_SGT;
+            default:                        return llvm::CmpInst::ICMP_SGE;
+        }
+    }
+
+    /// IR of one translation unit. Scalar expressions yield values of their LLVM type; struct expressions yield the
+    /// address of the struct.
+    class IrGenerator {
+        public:
+            IrGenerator(llvm::LLVMContext& context, llvm::Module& module)
+                : context_(context)
+                , module_(module)
+                , builder_(context)
+            {}
+
+            void unit(TranslationUnit* unit, TranslationUnit* prelude);
+
+        private:
+            void error(ASTNode* node, const char* what) { node->loc().err() << what << node->loc().endErr(); }
+
+            // Types
+            llvm::Type* type(const Type* type);
+            llvm::StructType* structType(const StructSpecifier* definition);
+            unsigned memberIndex(const Type* type, const std::string& name);
+
+            // Declarations
+            llvm::Function* declare(SpecifierDeclarator* specDecl);
+            void function(ExternalDeclaration* ext);
+            void allocate(ASTNode* node);
+
+            // Statements
+            void stmt(Stmt* stmt);
+            llvm::BasicBlock* block(const char* name) { return llvm::BasicBlock::Create(context_, name, function_); }
+            void jump(llvm::BasicBlock* target);
+            void enter(llvm::BasicBlock* block) { builder_.SetInsertPoint(block); }
+
+            // Expressions
+            llvm::Value* expr(Exp* exp);
+            llvm::Value* addr(Exp* exp);
+            llvm::Value* condition(Exp* exp);
+            llvm::Value* convert(llvm::Value* value, llvm::Type* to);
+            llvm::Value* binary(InfixExp* exp);
+            llvm::Value* incDec(Exp* operand, bool inc, bool post);
+            llvm::Value* call(FuncCallExp* exp);
+            void copy(llvm::Value* to, llvm::Value* from, const Type* type);
+
+            llvm::LLVMContext& context_;
+            llvm::Module& module_;
+            llvm::IRBuilder<> builder_;
+            std::unordered_map<const StructSpecifier*, llvm::StructType*> structs_;
+            std::unordered_map<const SpecifierDeclarator*, llvm::Value*> objects_;  // Allocas and globals
+            std::unordered_map<std::string, llvm::Constant*> strings_;
+
+            // Per function
+            llvm::Function* function_ = nullptr;
+            llvm::IRBuilder<> allocas_{context_};                                   // Entry block, before any code
+            std::unordered_map<const LabeledStmt*, llvm::BasicBlock*> labels_;
+            std::vector<std::pair<llvm::BasicBlock*, llvm::BasicBlock*>> loops_;    // Break and continue targets
+    };
+
+
+    //! =================================================
+    //! ===================== Types =====================
+    //! =================================================
+
+    llvm::Type* IrGenerator::type(const Type* t) {
+        switch (repr(t)) {
+            case Repr::Char:    return builder_.getInt8Ty();
+            case Repr::Int:     return builder_.getInt32Ty();
+            case Repr::Void:    return builder_.getVoidTy();
+            case Repr::Struct:  return structType(static_cast<const StructType*>(t)->definition());
+            case Repr::Ptr: {
+                Repr target = repr(pointee(t));
+                if (target == Repr::Void || target == Repr::Function || target == Repr::Error) return builder_.getInt8PtrTy();
+                if (target == Repr::Struct && static_cast<const StructType*>(pointee(t))->definition() == nullptr) return builder_.getInt8PtrTy();
+                return type(pointee(t))->getPointerTo();
+            }
+            default:            return builder_.getInt32Ty();
+        }
+    }
+
+    /// Named struct type of @p definition; the body is set after the name exists, so self references work.
+    llvm::StructType* IrGenerator::structType(const StructSpecifier* definition) {
+        auto [it, added] = structs_.emplace(definition, nullptr);
+        if (!added) return it->second;
+        std::string name = definition != nullptr && !definition->structIdentifierString().empty() ? definition->structIdentifierString() : "anon";
+        auto result = it->second = llvm::StructType::create(context_, "struct." + name);
+        if (definition == nullptr) return result;
+
+        std::vector<llvm::Type*> members;
+        for (size_t i = 0; i < definition->num_structDeclarations(); i++) members.push_back(type(definition->structDeclaration(i)->type()));
+        result->setBody(members);
+        return result;
+    }
+
+    unsigned IrGenerator::memberIndex(const Type* t, const std::string& name) {
+        auto definition = static_cast<const StructType*>(t)->definition();
+        for (size_t i = 0; i < definition->num_structDeclarations(); i++)
+            if (definition->structDeclaration(i)->name() == name) return i;
+        return 0;
+    }
+
+
+    //! =================================================
+    //! ================= Declarations ==================
+    //! =================================================
+
+    void IrGenerator::unit(TranslationUnit* unit, TranslationUnit* prelude) {
+        auto exts = externalDeclarations(unit, prelude);
+        for (auto ext : exts) {
+            auto specDecl = ext->specifierDeclarator();
+            if (specDecl == nullptr || specDecl->isTypedef() || specDecl->name().empty()) continue;
+            if (isFunction(specDecl)) {
+                declare(specDecl);
+                continue;
+            }
+            if (repr(specDecl->type()) == Repr::Error) continue;
+            auto global = module_.getGlobalVariable(specDecl->name());
+            if (global == nullptr) {
+                llvm::Type* t = type(specDecl->type());
+                global = new llvm::GlobalVariable(module_, t, false, llvm::GlobalValue::ExternalLinkage, llvm::Constant::getNullValue(t), specDecl->name());
+                global->setAlignment(llvm::Align(std::max<size_t>(specDecl->type()->align(), 1)));
+            }
+            objects_[specDecl] = global;
+        }
+
+        for (auto ext : exts)
+            if (ext->specifierDeclarator() != nullptr && ext->functionBody() != nullptr) function(ext);
+    }
+
+    llvm::Function* IrGenerator::declare(SpecifierDeclarator* specDecl) {
+        if (auto existing = module_.getFunction(specDecl->name())) {
+            if (specDecl->isInline()) existing->addFnAttr(llvm::Attribute::InlineHint);
+            return existing;
+        }
+        std::vector<llvm::Type*> params;
+        for (auto param : parameters(specDecl)) {
+            if (repr(param->type()) == Repr::Struct) error(param, "Struct parameters are not supported!");
+            params.push_back(type(param->type()));
+        }
+        if (repr(returnType(specDecl)) == Repr::Struct) error(specDecl, "Functions returning structs are not supported!");
+        auto functionType = llvm::FunctionType::get(type(returnType(specDecl)), params, false);
+        auto function = llvm::Function::Create(functionType, llvm::Function::ExternalLinkage, specDecl->name(), module_);
+        if (specDecl->isInline()) function->addFnAttr(llvm::Attribute::InlineHint);
+        return function;
+    }
+
+    void IrGenerator::function(ExternalDeclaration* ext) {
+        auto specDecl = ext->specifierDeclarator();
+        function_ = declare(specDecl);
+        labels_.clear();
+
+        auto entry = block("entry");
+        allocas_.SetInsertPoint(entry);
+        enter(entry);
+        auto params = parameters(specDecl);
+        for (size_t i = 0; i < params.size(); i++) {
+            auto arg = function_->getArg(i);
+            arg->setName(params[i]->name());
+            auto slot = allocas_.CreateAlloca(arg->getType(), nullptr, params[i]->name() + ".addr");
+            builder_.CreateStore(arg, slot);
+            objects_[params[i]] = slot;
+        }
+        allocate(ext->functionBody());
+
+        stmt(ext->functionBody());
+        if (builder_.GetInsertBlock()->getTerminator() == nullptr) {     // Falling off the end returns 0, as main must
+            llvm::Type* result = function_->getReturnType();
+            if (result->isVoidTy()) builder_.CreateRetVoid();
+            else builder_.CreateRet(llvm::Constant::getNullValue(result));
+        }
+    }
+
+    /// Gives every local declared in @p node its own alloca.
+    void IrGenerator::allocate(ASTNode* node) {
+        if (auto decl = dynamic_cast<Declaration*>(node)) {
+            auto specDecl = decl->specifierDeclarator();
+            if (specDecl->isTypedef() || specDecl->name().empty()) return;
+            if (isFunction(specDecl)) return error(specDecl, "Block scope function declarations are not supported!");
+            auto slot = allocas_.CreateAlloca(type(specDecl->type()), nullptr, specDecl->name());
+            slot->setAlignment(llvm::Align(std::max<size_t>(specDecl->type()->align(), 1)));
+            objects_[specDecl] = slot;
+            return;
+        }
+        forEachChild(node, [&](ASTNode* child) { if (dynamic_cast<Stmt*>(child)) allocate(child); });
+    }
+
+
+    //! =================================================
+    //! ================== Statements ===================
+    //! =================================================
+
+    /// Branches to @p target unless the current block already ended.
+    void IrGenerator::jump(llvm::BasicBlock* target) {
+        if (builder_.GetInsertBlock()->getTerminator() == nullptr) builder_.CreateBr(target);
+    }
+
+    void IrGenerator::stmt(Stmt* s) {
+        // Code after a jump is unreachable but still needs a block
+        if (builder_.GetInsertBlock()->getTerminator() != nullptr && !dynamic_cast<LabeledStmt*>(s)) enter(block("dead"));
+
+        if (auto compound = dynamic_cast<CompoundStmt*>(s)) {
+            for (size_t i = 0; i < compound->num_blockItems(); i++) stmt(compound->blockItem(i));
+        } else if (auto expStmt = dynamic_cast<ExpressionStmt*>(s)) {
+            expr(expStmt->exp());
+        } else if (auto ret = dynamic_cast<ReturnStmt*>(s)) {
+            llvm::Value* value = expr(ret->exp());
+            llvm::Type* result = function_->getReturnType();
+            if (result->isVoidTy()) builder_.CreateRetVoid();
+            else builder_.CreateRet(convert(value, result));
+        } else if (dynamic_cast<EmptyReturnStmt*>(s)) {
+            llvm::Type* result = function_->getReturnType();
+            if (result->isVoidTy()) builder_.CreateRetVoid();
+            else builder_.CreateRet(llvm::Constant::getNullValue(result));
+        } else if (auto loop = dynamic_cast<WhileStmt*>(s)) {
+            auto cond = block("while.cond"), body = block("while.body"), end = block("while.end");
+            jump(cond);
+            enter(cond);
+            builder_.CreateCondBr(condition(loop->condition()), body, end);
+            enter(body);
+            loops_.emplace_back(end, cond);
+            stmt(loop->loop());
+            loops_.pop_back();
+            jump(cond);
+            enter(end);
+        } else if (auto ifElse = dynamic_cast<IfElseStmt*>(s)) {
+            auto then = block("if.then"), otherwise = block("if.else"), end = block("if.end");
+            builder_.CreateCondBr(condition(ifElse->condition()), then, otherwise);
+            enter(then);
+            stmt(ifElse->consequence());
+            jump(end);
+            enter(otherwise);
+            stmt(ifElse->alternative());
+            jump(end);
+            enter(end);
+        } else if (auto ifStmt = dynamic_cast<IfStmt*>(s)) {
+            auto then = block("if.then"), end = block("if.end");
+            builder_.CreateCondBr(condition(ifStmt->condition()), then, end);
+            enter(then);
+            stmt(ifStmt->consequence());
+            jump(end);
+            enter(end);
+        } else if (auto labeled = dynamic_cast<LabeledStmt*>(s)) {
+            auto& target = labels_[labeled];
+            if (target == nullptr) target = block("label");
+            jump(target);
+            enter(target);
+            stmt(labeled->statement());
+        } else if (auto gotoStmt = dynamic_cast<GoToStmt*>(s)) {
+            auto& target = labels_[gotoStmt->target()];
+            if (target == nullptr) target = block("label");
+            builder_.CreateBr(target);
+        } else if (dynamic_cast<BreakStmt*>(s)) {
+            builder_.CreateBr(loops_.back().first);
+        } else if (dynamic_cast<ContinueStmt*>(s)) {
+            builder_.CreateBr(loops_.back().second);
+        } else if (!dynamic_cast<NullStmt*>(s) && !dynamic_cast<Declaration*>(s)) {
+            error(s, "Statement is not supported by the LLVM backend!");
+        }
+    }
+
+
+    //! =================================================
+    //! ================== Expressions ==================
+    //! =================================================
+
+    /// @p value as @p to; integers are sign extended or truncated, pointers are cast.
+    llvm::Value* IrGenerator::convert(llvm::Value* value, llvm::Type* to) {
+        llvm::Type* from = value->getType();
+        if (from == to || to->isVoidTy()) return value;
+        if (from->isIntegerTy() && to->isIntegerTy()) return builder_.CreateSExtOrTrunc(value, to);
+        if (from->isPointerTy() && to->isPointerTy()) return builder_.CreateBitCast(value, to);
+        if (from->isIntegerTy() && to->isPointerTy()) return builder_.CreateIntToPtr(value, to);
+        if (from->isPointerTy() && to->isIntegerTy()) return builder_.CreatePtrToInt(value, to);
+        return value;
+    }
+
+    void IrGenerator::copy(llvm::Value* to, llvm::Value* from, const Type* t) {
+        llvm::Align align(std::max<size_t>(t->align(), 1));
+        builder_.CreateMemCpy(to, align, from, align, t->size());
+    }
+
+    /// Value of @p exp as an @c i1 (non-zero).
+    llvm::Value* IrGenerator::condition(Exp* exp) {
+        if (auto infix = dynamic_cast<InfixExp*>(exp)) {
+            auto tag = infix->operation().tag();
+            if (tag == Tok::Tag::P_Logical_And || tag == Tok::Tag::P_Logical_Or) {
+                bool isAnd = tag == Tok::Tag::P_Logical_And;
+                llvm::Value* lhs = condition(infix->lhs());
+                auto lhsEnd = builder_.GetInsertBlock();
+                auto right = block(isAnd ? "and.rhs" : "or.rhs"), end = block(isAnd ? "and.end" : "or.end");
+                if (isAnd) builder_.CreateCondBr(lhs, right, end);
+                else builder_.CreateCondBr(lhs, end, right);
+                enter(right);
+                llvm::Value* rhs = condition(infix->rhs());
+                auto rhsEnd = builder_.GetInsertBlock();
+                builder_.CreateBr(end);
+                enter(end);
+                auto phi = builder_.CreatePHI(builder_.getInt1Ty(), 2);
+                phi->addIncoming(builder_.getInt1(!isAnd), lhsEnd);      // The left operand decided
+                phi->addIncoming(rhs, rhsEnd);
+                return phi;
+            }
+            if (isComparison(tag)) {
+                llvm::Value* lhs = expr(infix->lhs());
+                llvm::Value* rhs = expr(infix->rhs());
+                if (lhs->getType()->isPointerTy() || rhs->getType()->isPointerTy()) {
+                    llvm::Type* common = lhs->getType()->isPointerTy() ? lhs->getType() : rhs->getType();
+                    return builder_.CreateICmp(predicate(tag), convert(lhs, common), convert(rhs, common));
+                }
+                return builder_.CreateICmp(predicate(tag), convert(lhs, builder_.getInt32Ty()), convert(rhs, builder_.getInt32Ty()));
+            }
+        }
+        if (auto prefix = dynamic_cast<PrefixExp*>(exp)) {
+            if (prefix->prefix().isa(Tok::Tag::P_Logical_Not)) return builder_.CreateNot(condition(prefix->operand()));
+        }
+        llvm::Value* value = expr(exp);
+        return builder_.CreateICmpNE(value, llvm::Constant::getNullValue(value->getType()));
+    }
+
+    llvm::Value* IrGenerator::expr(Exp* exp) {
+        if (exp->isConstant()) {
+            llvm::Type* t = type(exp->type());
+            if (t->isPointerTy()) return builder_.CreateIntToPtr(builder_.getInt64(exp->constant()), t);
+            return llvm::ConstantInt::get(t->isIntegerTy() ? t : builder_.getInt32Ty(), exp->constant(), true);
+        }
+
+        if (auto id = dynamic_cast<Identifier*>(exp)) {
+            auto object = objects_.find(id->specifierDeclarator());
+            if (object == objects_.end()) {
+                noStorage(id);
+                return llvm::UndefValue::get(builder_.getInt32Ty());
+            }
+            if (repr(exp->type()) == Repr::Struct) return object->second;
+            return builder_.CreateLoad(type(exp->type()), object->second, id->specifierDeclarator()->name());
+        }
+        if (auto lit = dynamic_cast<Literal*>(exp)) {
+            auto bytes = decodeLiteral(lit->value());
+            auto& string = strings_[bytes];
+            if (string == nullptr) string = builder_.CreateGlobalStringPtr(bytes, ".str", 0, &module_);
+            return string;
+        }
+        if (auto infix = dynamic_cast<InfixExp*>(exp)) {
+            auto tag = infix->operation().tag();
+            if (tag == Tok::Tag::P_Assign) {
+                Type* t = infix->lhs()->type();
+                llvm::Value* to = addr(infix->lhs());
+                llvm::Value* value = expr(infix->rhs());
+                if (repr(t) == Repr::Struct) {
+                    copy(to, value, t);
+                    return to;
+                }
+                value = convert(value, type(t));
+                builder_.CreateStore(value, to);
+                return value;
+            }
+            if (tag == Tok::Tag::P_Logical_And || tag == Tok::Tag::P_Logical_Or || isComparison(tag))
+                return builder_.CreateZExt(condition(exp), type(exp->type()));
+            return binary(infix);
+        }
+        if (auto ternary = dynamic_cast<TernaryExp*>(exp)) {
+            auto then = block("cond.then"), otherwise = block("cond.else"), end = block("cond.end");
+            llvm::Type* t = repr(exp->type()) == Repr::Struct ? type(exp->type())->getPointerTo() : type(exp->type());
+            builder_.CreateCondBr(condition(ternary->condition()), then, otherwise);
+            enter(then);
+            llvm::Value* consequence = convert(expr(ternary->consequence()), t);
+            auto thenEnd = builder_.GetInsertBlock();
+            builder_.CreateBr(end);
+            enter(otherwise);
+            llvm::Value* alternative = convert(expr(ternary->alternative()), t);
+            auto otherwiseEnd = builder_.GetInsertBlock();
+            builder_.CreateBr(end);
+            enter(end);
+            if (t->isVoidTy()) return nullptr;
+            auto phi = builder_.CreatePHI(t, 2);
+            phi->addIncoming(consequence, thenEnd);
+            phi->addIncoming(alternative, otherwiseEnd);
+            return phi;
+        }
+        if (auto prefix = dynamic_cast<PrefixExp*>(exp)) {
+            switch (prefix->prefix().tag()) {
+                case Tok::Tag::P_Multiplication:
+                    if (repr(exp->type()) == Repr::Struct) return addr(exp);
+                    return builder_.CreateLoad(type(exp->type()), addr(exp));
+                case Tok::Tag::P_Bitwise_And:
+                    return addr(prefix->operand());
+                case Tok::Tag::P_Increment:
+                case Tok::Tag::P_Decrement:
+                    return incDec(prefix->operand(), prefix->prefix().isa(Tok::Tag::P_Increment), false);
+                case Tok::Tag::P_Addition:
+                    return expr(prefix->operand());
+                case Tok::Tag::P_Substraction:
+                    return convert(builder_.CreateNeg(convert(expr(prefix->operand()), builder_.getInt32Ty())), type(exp->type()));
+                case Tok::Tag::P_Logical_Not:
+                    return builder_.CreateZExt(condition(exp), type(exp->type()));
+                default:
+                    return convert(builder_.CreateNot(expr(prefix->operand())), type(exp->type()));
+            }
+        }
+        if (auto postfix = dynamic_cast<PostfixExp*>(exp))
+            return incDec(postfix->operand(), postfix->postfix().isa(Tok::Tag::P_Increment), true);
+        if (dynamic_cast<MemberAccessExp*>(exp) || dynamic_cast<ArrayExp*>(exp)) {
+            llvm::Value* address = addr(exp);
+            if (repr(exp->type()) == Repr::Struct) return address;
+            return builder_.CreateLoad(type(exp->type()), address);
+        }
+        if (auto funcCall = dynamic_cast<FuncCallExp*>(exp))
+            return call(funcCall);
+
+        error(exp, "Expression is not supported by the LLVM backend!");
+        return llvm::UndefValue::get(builder_.getInt32Ty());
+    }
+
+    llvm::Value* IrGenerator::addr(Exp* exp) {
+        if (auto id = dynamic_cast<Identifier*>(exp)) {
+            auto object = objects_.find(id->specifierDeclarator());
+            if (object != objects_.end()) return object->second;
+        } else if (auto prefix = dynamic_cast<PrefixExp*>(exp)) {
+            if (prefix->prefix().isa(Tok::Tag::P_Multiplication)) return convert(expr(prefix->operand()), type(exp->type())->getPointerTo());
+        } else if (auto array = dynamic_cast<ArrayExp*>(exp)) {
+            llvm::Value* base = convert(expr(array->object()), type(exp->type())->getPointerTo());
+            llvm::Value* index = builder_.CreateSExt(expr(array->index()), builder_.getInt64Ty());
+            return builder_.CreateGEP(type(exp->type()), base, index);
+        } else if (auto access = dynamic_cast<MemberAccessExp*>(exp)) {
+            bool arrow = access->operation() == Tok::Tag::P_Arrow_R;
+            Type* structType = arrow ? pointee(access->object()->type()) : access->object()->type();
+            Member m;
+            if (!member(structType, access->member_name(), m)) {
+                error(exp, "Unknown struct member!");
+                return llvm::UndefValue::get(builder_.getInt8PtrTy());
+            }
+            llvm::Value* object = convert(arrow ? expr(access->object()) : addr(access->object()), type(structType)->getPointerTo());
+            return builder_.CreateStructGEP(type(structType), object, memberIndex(structType, access->member_name()), access->member_name());
+        }
+        if (repr(exp->type()) == Repr::Struct) return expr(exp);           // Struct values are addresses already
+        error(exp, "Expression is not an lvalue!");
+        return llvm::UndefValue::get(builder_.getInt8PtrTy());
+    }
+
+    llvm::Value* IrGenerator::binary(InfixExp* exp) {
+        auto tag = exp->operation().tag();
+        Repr lhsRepr = repr(exp->lhs()->type());
+        Repr rhsRepr = repr(exp->rhs()->type());
+        llvm::Value* lhs = expr(exp->lhs());
+        llvm::Value* rhs = expr(exp->rhs());
+
+        // Pointer arithmetic; void* steps bytes because it is an i8*
+        if ((tag == Tok::Tag::P_Addition || tag == Tok::Tag::P_Substraction) && (lhsRepr == Repr::Ptr || rhsRepr == Repr::Ptr)) {
+            if (lhsRepr == Repr::Ptr && rhsRepr == Repr::Ptr) {
+                llvm::Type* element = type(exp->lhs()->type())->getPointerElementType();
+                auto difference = builder_.CreatePtrDiff(element, lhs, convert(rhs, lhs->getType()));
+                return convert(difference, type(exp->type()));
+            }
+            if (rhsRepr == Repr::Ptr) std::swap(lhs, rhs);
+            llvm::Value* offset = builder_.CreateSExt(rhs, builder_.getInt64Ty());
+            if (tag == Tok::Tag::P_Substraction) offset = builder_.CreateNeg(offset);
+            return builder_.CreateGEP(lhs->getType()->getPointerElementType(), lhs, offset);
+        }
+
+        // Integer arithmetic is done in 32 bits; shift counts are masked as on x86
+        lhs = convert(lhs, builder_.getInt32Ty());
+        rhs = convert(rhs, builder_.getInt32Ty());
+        llvm::Value* result;
+        switch (tag) {
+            case Tok::Tag::P_Addition:          result = builder_.CreateAdd(lhs, rhs); break;
+            case Tok::Tag::P_Substraction:      result = builder_.CreateSub(lhs, rhs); break;
+            case Tok::Tag::P_Multiplication:    result = builder_.CreateMul(lhs, rhs); break;
+            case Tok::Tag::P_Division:          result = builder_.CreateSDiv(lhs, rhs); break;
+            case Tok::Tag::P_Modulo:            result = builder_.CreateSRem(lhs, rhs); break;
+            case Tok::Tag::P_Bitwise_Shift_L:   result = builder_.CreateShl(lhs, builder_.CreateAnd(rhs, 31)); break;
+            case Tok::Tag::P_Bitwise_Shift_R:   result = builder_.CreateAShr(lhs, builder_.CreateAnd(rhs, 31)); break;
+            case Tok::Tag::P_Bitwise_And:       result = builder_.CreateAnd(lhs, rhs); break;
+            case Tok::Tag::P_Bitwise_Or:        result = builder_.CreateOr(lhs, rhs); break;
+            default:                            result = builder_.CreateXor(lhs, rhs); break;
+        }
+        return convert(result, type(exp->type()));
+    }
+
+    llvm::Value* IrGenerator::incDec(Exp* operand, bool inc, bool post) {
+        llvm::Type* t = type(operand->type());
+        llvm::Value* address = addr(operand);
+        llvm::Value* old = builder_.CreateLoad(t, address);
+        llvm::Value* updated;
+        if (t->isPointerTy()) updated = builder_.CreateGEP(t->getPointerElementType(), old, builder_.getInt64(inc ? 1 : -1));
+        else updated = builder_.CreateAdd(old, llvm::ConstantInt::get(t, inc ? 1 : -1, true));
+        builder_.CreateStore(updated, address);
+        return post ? old : updated;
+    }
+
+    llvm::Value* IrGenerator::call(FuncCallExp* exp) {
+        auto id = dynamic_cast<Identifier*>(exp->func());
+        auto callee = id ? id->specifierDeclarator() : nullptr;
+        if (callee == nullptr || !isFunction(callee)) {
+            error(exp, "Only named functions can be called!");
+            return llvm::UndefValue::get(builder_.getInt32Ty());
+        }
+        llvm::Function* function = declare(callee);
+        if (function->arg_size() != exp->num_parameters()) {
+            error(exp, "Wrong number of arguments!");
+            return llvm::UndefValue::get(builder_.getInt32Ty());
+        }
+
+        std::vector<llvm::Value*> args;
+        for (size_t i = 0; i < exp->num_parameters(); i++) {
+            auto arg = exp->parameters()[i].get();
+            if (repr(arg->type()) == Repr::Struct) error(arg, "Struct arguments are not supported!");
+            args.push_back(convert(expr(arg), function->getArg(i)->getType()));
+        }
+        return builder_.CreateCall(function, args);
+    }
+
+
+    //! =================================================
+    //! =================== Pipeline ====================
+    //! =================================================
+
+    llvm::OptimizationLevel level(unsigned optLevel) {
+        switch (optLevel) {
+            case 0:     return llvm::OptimizationLevel::O0;
+            case 1:     return llvm::OptimizationLevel::O1;
+            case 2:     return llvm::OptimizationLevel::O2;
+            default:    return llvm::OptimizationLevel::O3;
+        }
+    }
+
+    void optimize(llvm::Module& module, llvm::TargetMachine* machine, unsigned optLevel) {
+        llvm::LoopAnalysisManager loops;
+        llvm::FunctionAnalysisManager functions;
+        llvm::CGSCCAnalysisManager sccs;
+        llvm::ModuleAnalysisManager modules;
+        llvm::PassBuilder builder(machine);
+        builder.registerModuleAnalyses(modules);
+        builder.registerCGSCCAnalyses(sccs);
+        builder.registerFunctionAnalyses(functions);
+        builder.registerLoopAnalyses(loops);
+        builder.crossRegisterProxies(loops, functions, sccs, modules);
+
+        llvm::ModulePassManager passes = optLevel == 0
+            ? builder.buildO0DefaultPipeline(llvm::OptimizationLevel::O0)
+            : builder.buildPerModuleDefaultPipeline(level(optLevel));
+        passes.run(module, modules);
+    }
+}
+
+bool llvmAvailable() { return true; }
+
+void emitLlvm(TranslationUnit* unit, const std::string& name, LlvmFormat format, unsigned optLevel, const std::string& output, TranslationUnit* prelude) {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    llvm::LLVMContext context;
+    llvm::Module module(name, context);
+    IrGenerator generator(context, module);
+    generator.unit(unit, prelude);
+    if (num_errors != 0) return;
+
+    std::string message;
+    llvm::raw_string_ostream messages(message);
+    if (llvm::verifyModule(module, &messages)) throw std::runtime_error("invalid LLVM IR: " + messages.str());
+
+    std::string triple = llvm::sys::getDefaultTargetTriple();
+    auto target = llvm::TargetRegistry::lookupTarget(triple, message);
+    if (target == nullptr) throw std::runtime_error(message);
+    auto codeGenLevel = optLevel == 0 ? llvm::CodeGenOpt::None : optLevel == 1 ? llvm::CodeGenOpt::Less
+                      : optLevel == 2 ? llvm::CodeGenOpt::Default : llvm::CodeGenOpt::Aggressive;
+    std::unique_ptr<llvm::TargetMachine> machine(target->createTargetMachine(triple, "generic", "", llvm::TargetOptions(), llvm::Reloc::PIC_, llvm::None, codeGenLevel));
+    module.setTargetTriple(triple);
+    module.setDataLayout(machine->createDataLayout());
+
+    optimize(module, machine.get(), optLevel);
+
+    std::error_code error;
+    llvm::raw_fd_ostream out(output, error, format == LlvmFormat::Ll ? llvm::sys::fs::OF_Text : llvm::sys::fs::OF_None);
+    if (error) throw std::runtime_error("cannot write " + output + ": " + error.message());
+    switch (format) {
+        case LlvmFormat::Ll:
+            module.print(out, nullptr);
+            break;
+        case LlvmFormat::Bc:
+            llvm::WriteBitcodeToFile(module, out);
+            break;
+        default: {
+            llvm::legacy::PassManager codeGen;                          // Code generation has no new pass manager yet
+            if (machine->addPassesToEmitFile(codeGen, out, nullptr, llvm::CGFT_ObjectFile))
+                throw std::runtime_error("the target cannot emit object files");
+            codeGen.run(module);
+            break;
+        }
+    }
+    out.flush();
+    if (out.has_error()) throw std::runtime_error("cannot write " + output);
+}
+
+}
+
+#else
+
+namespace H {
+
+bool llvmAvailable() { return false; }
+
+void emitLlvm(TranslationUnit*, const std::string&, LlvmFormat, unsigned, const std::string&, TranslationUnit*) {
+    throw std::runtime_error("this build has no LLVM backend; rebuild with 'make LLVM=1'");
+}
+
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef PROG_LLVM_EMITTER_H
+#define PROG_LLVM_EMITTER_H
+
+#include <string>
+
+#include "ast.h"
+
+namespace H {
+
+//! =================================================
+//! ================= LLVM Backend ==================
+//! =================================================
+//
+// Generates LLVM IR for the checked AST: every local gets an alloca in the entry block (mem2reg turns them into SSA
+// values), structs become named LLVM struct types with the member order of their Sema definition, and the module is
+// optimised with the -O0..-O3 pipelines of LLVM's new pass manager. Only available in builds made with 'make LLVM=1';
+// otherwise emitLlvm throws.
+
+enum class LlvmFormat { None, Ll, Bc, Obj };
+
+/// Built with the LLVM backend?
+bool llvmAvailable();
+
+/// Writes @p unit, after the declarations of its @p prelude if any, as @p format to @p output after running the
+/// pipeline of @p optLevel (0 to 3); unsupported constructs are reported as errors, failures to write throw
+/// std::runtime_error.
+void emitLlvm(TranslationUnit* unit, const std::string& module, LlvmFormat format, unsigned optLevel, const std::string& output,
+              TranslationUnit* prelude = nullptr);
+
+}
+
+#endif
@@ -12,6 +12,11 @@ std::ostream& Loc::err(int offset) {
     return std::cerr << "\033[1;31m" << (*this) << ": error: ";
 }
 
+std::ostream& Loc::warn(int offset) {
+    this->begin = Pos(this->begin.row, this->begin.col + offset);
+    return std::cerr << "\033[1;35m" << (*this) << ": warning: ";
+}
+
 std::string Loc::endErr() const { //reset error encoding
     return "\033[0m\n";
 }
@@ -34,6 +34,7 @@ struct Loc {
     Pos finish;
 
     std::ostream& err(int offset=0);
+    std::ostream& warn(int offset=0);
     std::string endErr() const;
 };
 
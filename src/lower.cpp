@@ -0,0 +1,150 @@
+#include "lower.h"
+
+namespace H {
+
+Repr repr(const Type* type) {
+    if (type == nullptr) return Repr::Error;
+    if (dynamic_cast<const IntType*>(type)) return Repr::Int;
+    if (dynamic_cast<const CharType*>(type)) return Repr::Char;
+    if (dynamic_cast<const PointerType*>(type)) return Repr::Ptr;
+    if (dynamic_cast<const StructType*>(type)) return Repr::Struct;
+    if (dynamic_cast<const FunctionType*>(type)) return Repr::Function;
+    if (dynamic_cast<const VoidType*>(type)) return Repr::Void;
+    return Repr::Error;
+}
+
+size_t sizeOf(const Type* type) {
+    if (type == nullptr || dynamic_cast<const VoidType*>(type)) return 1;
+    return type->size();
+}
+
+Type* pointee(const Type* type) {
+    auto pointer = dynamic_cast<const PointerType*>(type);
+    return pointer ? pointer->pointee() : nullptr;
+}
+
+bool member(const Type* type, const std::string& name, Member& result) {
+    auto structType = dynamic_cast<const StructType*>(type);
+    if (structType == nullptr || structType->definition() == nullptr) return false;
+    auto definition = structType->definition();
+    size_t offset = 0;
+    for (size_t i = 0; i < definition->num_structDeclarations(); i++) {
+        auto decl = definition->structDeclaration(i);
+        Type* memberType = decl->type();
+        offset = (offset + memberType->align() - 1) / memberType->align() * memberType->align();
+        if (decl->name() == name) {
+            result.type = memberType;
+            result.offset = offset;
+            return true;
+        }
+        offset += memberType->size();
+    }
+    return false;
+}
+
+std::string decodeLiteral(const std::string& spelling) {
+    std::string bytes;
+    bool quoted = false;
+    for (size_t i = 0; i < spelling.size(); i++) {
+        char c = spelling[i];
+        if (c == '"') { quoted = !quoted; continue; }                   // Also joins adjacent literals
+        if (!quoted) continue;
+        if (c != '\\' || i + 1 == spelling.size()) { bytes += c; continue; }
+        switch (spelling[++i]) {
+            case 'a': bytes += '\a'; break;
+            case 'b': bytes += '\b'; break;
+            case 'f': bytes += '\f'; break;
+            case 'n': bytes += '\n'; break;
+            case 'r': bytes += '\r'; break;
+            case 't': bytes += '\t'; break;
+            case 'v': bytes += '\v'; break;
+            case '0': bytes += '\0'; break;
+            default:  bytes += spelling[i];                             // \' \" \? \\ stand for themselves
+        }
+    }
+    return bytes;
+}
+
+bool isFunction(SpecifierDeclarator* specDecl) {
+    return !specDecl->isTypedef() && specDecl->declarator() != nullptr && dynamic_cast<FunctionType*>(specDecl->type());
+}
+
+std::vector<ExternalDeclaration*> externalDeclarations(TranslationUnit* unit, TranslationUnit* prelude) {
+    std::vector<ExternalDeclaration*> result;
+    if (prelude != nullptr) {
+        std::unordered_map<const SpecifierDeclarator*, ASTNode*> bodies;
+        for (auto& ext : prelude->external_declarations())
+            if (ext->functionBody() != nullptr) bodies[ext->specifierDeclarator()] = ext->functionBody();
+        std::unordered_set<const SpecifierDeclarator*> used;
+        std::function<void(ASTNode*)> visit = [&](ASTNode* node) {
+            if (auto id = dynamic_cast<Identifier*>(node)) {
+                auto body = bodies.find(id->specifierDeclarator());
+                if (used.insert(id->specifierDeclarator()).second && body != bodies.end()) visit(body->second);
+            }
+            forEachChild(node, visit);
+        };
+        for (auto& ext : unit->external_declarations()) if (ext->functionBody() != nullptr) visit(ext->functionBody());
+        for (auto& ext : prelude->external_declarations()) {
+            auto specDecl = ext->specifierDeclarator();
+            if (specDecl == nullptr || !isFunction(specDecl) || used.count(specDecl)) result.push_back(ext.get());
+        }
+    }
+    for (auto& ext : unit->external_declarations()) result.push_back(ext.get());
+    return result;
+}
+
+void noStorage(Identifier* id) {
+    auto specDecl = id->specifierDeclarator();
+    if (specDecl != nullptr && isFunction(specDecl)) {
+        id->loc().err() << "Functions can only be called!" << id->loc().endErr();
+        return;
+    }
+    id->loc().err() << "No storage for '" << id->name() << "': it is not declared by this file or its prelude!" << id->loc().endErr();
+}
+
+std::vector<SpecifierDeclarator*> parameters(SpecifierDeclarator* specDecl) {
+    std::vector<SpecifierDeclarator*> params;
+    for (auto& param : specDecl->parameterList()) params.push_back(param.get());
+    if (params.size() == 1 && params[0]->declarator() == nullptr && repr(params[0]->type()) == Repr::Void) params.clear();
+    return params;
+}
+
+Type* returnType(SpecifierDeclarator* specDecl) {
+    auto function = dynamic_cast<FunctionType*>(specDecl->type());
+    return function ? function->returnType() : nullptr;
+}
+
+void forEachChild(ASTNode* node, const std::function<void(ASTNode*)>& visit) {
+    auto visitIf = [&](ASTNode* child) { if (child != nullptr) visit(child); };
+
+    if (auto n = dynamic_cast<CompoundStmt*>(node)) { for (auto& item : n->blockItems()) visitIf(item.get()); }
+    else if (auto n = dynamic_cast<ExpressionStmt*>(node)) visitIf(n->exp());
+    else if (auto n = dynamic_cast<ReturnStmt*>(node)) visitIf(n->exp());
+    else if (auto n = dynamic_cast<WhileStmt*>(node)) { visitIf(n->condition()); visitIf(n->loop()); }
+    else if (auto n = dynamic_cast<IfElseStmt*>(node)) { visitIf(n->condition()); visitIf(n->consequence()); visitIf(n->alternative()); }
+    else if (auto n = dynamic_cast<IfStmt*>(node)) { visitIf(n->condition()); visitIf(n->consequence()); }
+    else if (auto n = dynamic_cast<LabeledStmt*>(node)) visitIf(n->statement());
+    else if (auto n = dynamic_cast<InfixExp*>(node)) { visitIf(n->lhs()); visitIf(n->rhs()); }
+    else if (auto n = dynamic_cast<TernaryExp*>(node)) { visitIf(n->condition()); visitIf(n->consequence()); visitIf(n->alternative()); }
+    else if (auto n = dynamic_cast<PrefixExp*>(node)) visitIf(n->operand());
+    else if (auto n = dynamic_cast<PostfixExp*>(node)) visitIf(n->operand());
+    else if (auto n = dynamic_cast<MemberAccessExp*>(node)) visitIf(n->object());
+    else if (auto n = dynamic_cast<ArrayExp*>(node)) { visitIf(n->object()); visitIf(n->index()); }
+    else if (auto n = dynamic_cast<FuncCallExp*>(node)) { visitIf(n->func()); for (auto& arg : n->parameters()) visitIf(arg.get()); }
+    else if (auto n = dynamic_cast<SizeOfUnaryExp*>(node)) visitIf(n->exp());
+}
+
+std::unordered_set<const SpecifierDeclarator*> addressTaken(ASTNode* body) {
+    std::unordered_set<const SpecifierDeclarator*> result;
+    std::function<void(ASTNode*)> visit = [&](ASTNode* node) {
+        if (dynamic_cast<SizeOfUnaryExp*>(node)) return;                // Not evaluated
+        auto prefix = dynamic_cast<PrefixExp*>(node);
+        if (prefix != nullptr && prefix->prefix().isa(Tok::Tag::P_Bitwise_And))
+            if (auto id = dynamic_cast<Identifier*>(prefix->operand())) result.insert(id->specifierDeclarator());
+        forEachChild(node, visit);
+    };
+    visit(body);
+    return result;
+}
+
+}
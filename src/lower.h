@@ -0,0 +1,68 @@
+#ifndef PROG_LOWER_H
+#define PROG_LOWER_H
+
+#include <functional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "ast.h"
+
+namespace H {
+
+//! =================================================
+//! =============== Lowering Helpers ================
+//! =================================================
+//
+// Shared by the code generators: they all start from the checked AST and need the same view of types, struct layouts,
+// literals and declarations.
+
+/// How a value of a type is held by generated code.
+enum class Repr { Void, Char, Int, Ptr, Struct, Function, Error };
+
+Repr repr(const Type* type);
+
+/// Size of @p type in bytes; @c void counts as 1 so that pointer arithmetic on @c void* steps bytes.
+size_t sizeOf(const Type* type);
+
+/// Element type of a pointer (or @c nullptr).
+Type* pointee(const Type* type);
+
+struct Member {
+    Type* type = nullptr;
+    size_t offset = 0;
+};
+
+/// Looks up @p name in the struct type @p type; @c false if it has no such member.
+bool member(const Type* type, const std::string& name, Member& result);
+
+/// Bytes of the string literal spelled @p spelling (with quotes), without the terminating zero.
+std::string decodeLiteral(const std::string& spelling);
+
+/// Declares a function (as opposed to an object or a typedef)?
+bool isFunction(SpecifierDeclarator* specDecl);
+
+/// Parameters of the function declared by @p specDecl; empty for @c (void).
+std::vector<SpecifierDeclarator*> parameters(SpecifierDeclarator* specDecl);
+
+/// Return type of the function declared by @p specDecl.
+Type* returnType(SpecifierDeclarator* specDecl);
+
+/// External declarations in the order the code generators lower them: those of @p prelude, the precompiled prelude
+/// the file was checked against (or @c nullptr), then those of @p unit. The prelude's objects become globals of the
+/// program, and of its functions those @p unit calls, directly or through other prelude functions; the others are left
+/// out, as a linker would, so that running the program does not need them.
+std::vector<ExternalDeclaration*> externalDeclarations(TranslationUnit* unit, TranslationUnit* prelude);
+
+/// Reports @p id used as a value although the code generator has no storage for it.
+void noStorage(Identifier* id);
+
+/// Calls @p visit for every direct child of @p node.
+void forEachChild(ASTNode* node, const std::function<void(ASTNode*)>& visit);
+
+/// Declarations in @p body whose address is taken with a prefix @c &; they cannot be kept in registers.
+std::unordered_set<const SpecifierDeclarator*> addressTaken(ASTNode* body);
+
+}
+
+#endif
@@ -1,14 +1,29 @@
+#include <chrono>
 #include <cstring>
 #include <iostream>
 #include <fstream>
+#include <iterator>
+#include <sstream>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
+#include "ast_cache.h"
+#include "bytecode.h"
+#include "incremental.h"
+#include "ir_pass.h"
+#include "jit.h"
+#include "llvm_emitter.h"
 #include "lexer.h"
+#include "mir.h"
 #include "parser.h"
+#include "prelude.h"
+#include "vm.h"
 
 using namespace H;
 
 static const auto usage =
-"Usage: h [options] file\n"
+"Usage: h [options] file [program arguments]\n"
 "\n"
 "Options:\n"
 "\t-h,\t--help\t\tdisplay this help and exit\n"
@@ -17,20 +32,391 @@ static const auto usage =
 "\t-ep,\t--eval-parsing\tdisplay the parser run through the code\n"
 "\t-p,\t--parse\t\tdisplay syntactical errors while parsing if they exist\n"
 "\t-pp,\t--print-ast\tdisplay a pretty printed version of the source code\n"
-"\t-c,\t--compile\t compiles the given source code\n"
+"\t-fsyntax-only,\t--syntax-only\tonly check the syntax; builds no AST\n"
+"\t-pe,\t--parse-events\tdisplay the parsed nodes as a post-order event stream\n"
+"\t-c,\t--compile\tcompile to a native executable (a.out unless -o is given) with the system toolchain\n"
+"\t-S\t\t\tcompile to x86-64 assembly only (<file>.s unless -o is given)\n"
+"\t--emit-obj\t\tcompile to a relocatable ELF object file only (<file>.o unless -o is given)\n"
+"\t-o <file>\t\twrite the output of -c, -S, --emit-obj or --emit-llvm to <file>\n"
+"\t--emit-llvm[=<format>]\twrite LLVM IR as 'll' (default), bitcode as 'bc' or an object file as 'obj'\n"
+"\t-O<level>\t\toptimise with the -O0 (default) to -O3 pipeline: the SSA IR for -c and -S, and the LLVM output,\n"
+"\t\t\t\twhich -c links instead when available; with --run or --jit, run the optimised SSA IR instead of the AST\n"
+"\t--cache-dir <dir>\treuse the ASTs of unchanged files stored in <dir>\n"
+"\t--incremental <state>\tonly reparse and recheck declarations changed since the run that wrote <state>\n"
+"\t--emit-pch <pch>\tcheck the file and write its declarations, definitions and macros to <pch> as a\n"
+"\t\t\t\tprecompiled prelude\n"
+"\t--include-pch <pch>\tstart from the global declarations and macros of a precompiled prelude\n"
+"\t-I <dir>\t\tsearch <dir> for included files\n"
+"\t--dump-ast=<format>\twrite the checked AST as 'json' or as 'ndjson' (one external declaration per line)\n"
+"\t--run\t\t\tcompile to bytecode and run main; the arguments after the file are passed to it\n"
+"\t--jit\t\t\tlike --run, but compile the bytecode to x86-64 machine code first\n"
+"\t-run\t\t\tlike --run, but compile to native code as -c does and run it in memory\n"
+"\t--stats\t\t\treport how many expressions were typed and the checking time on stderr; with --run, --jit or\n"
+"\t\t\t\t-run, also executed instructions or code size, and time; with IR\n"
+"\t\t\t\tpasses, what each of them changed; with -c or -S, what the register allocator did\n"
+"\t--dump-bytecode\t\tdisplay the bytecode of the checked file\n"
+"\t--dump-ir\t\tdisplay the SSA IR of the checked file after the --passes\n"
+"\t--passes=<list>\t\trun the comma separated IR passes (e.g. sccp,adce,simplifycfg) on the SSA IR; --run and\n"
+"\t\t\t\t--jit then execute the result\n"
+"\t--time-passes\t\treport the time spent in each IR pass and analysis on stderr\n"
+"\t--inline-threshold=<n>\tlet the inline pass (part of -O) copy callees of up to <n> IR instructions (default 40);\n"
+"\t\t\t\tfunctions declared 'inline' are copied whatever their size\n"
+"\t--inline-report\t\treport on stderr which calls the inline pass copied or kept, and why\n"
 "\nHint: use '-' as file to read from stdin.\n"
 ;
 
 static const auto version = "H compiler 0.1\n";
 
+enum class AstFormat { None, Json, Ndjson };
+
+/// What to do with a checked translation unit besides printing it.
+struct Execution {
+    bool run = false;
+    bool jit = false;                                                   // Run as machine code instead of interpreting
+    bool native = false;                                                // Run the code of -c in memory instead
+    bool stats = false;
+    bool dumpBytecode = false;
+    bool dumpIr = false;
+    const char* passes = nullptr;                                       // IR pipeline
+    ir::PassOptions passOptions;
+    bool timePasses = false;
+    bool compile = false;                                               // Native code through the assembly backend
+    bool assemblyOnly = false;
+    bool objectOnly = false;
+    LlvmFormat llvm = LlvmFormat::None;                                 // Only in builds with the LLVM backend
+    unsigned optLevel = 0;
+    const char* output = nullptr;
+    int argc = 0;                                                       // Arguments of the H program, argv[0] is the file
+    char** argv = nullptr;
+    int status = EXIT_SUCCESS;                                          // Exit status of the H program
+};
+
+/// Makes the typedef names of @p prelude known to @p parser.
+template<class P>
+static void seed_type_names(P& parser, const Prelude* prelude) {
+    if (prelude == nullptr) return;
+    for (auto& name : prelude->type_names()) parser.type_names().declare(name, true);
+}
+
+/// Parses @p stream through the AST cache in @p cache_dir: a hit skips lexing and parsing entirely.
+static Ptr<TranslationUnit> parse_cached(const char* file, std::istream& stream, const char* cache_dir, const Prelude* prelude) {
+    std::string source((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    AstCache cache(cache_dir);
+    // The parse also depends on the prelude's type names and macros and on where #include looks: the directory of the
+    // file for quoted names and the include dirs. The entry checks the headers it found there
+    std::string context = source + '\0';
+    std::string dir = file;
+    dir = dir.rfind('/') == std::string::npos ? "." : dir.substr(0, dir.rfind('/') + 1);
+    if (char* canonical = realpath(dir.c_str(), nullptr)) {
+        dir = canonical;
+        std::free(canonical);
+    }
+    context += dir + '\0';
+    if (prelude != nullptr) context += std::to_string(prelude->hash());
+    for (auto& dir : FileCache::process().include_dirs) context += '\0' + dir;
+    uint64_t key = AstCache::hash(context);
+    if (auto translationUnit = cache.load(file, key)) return translationUnit;
+
+    AstRecord record;
+    std::istringstream iss(source);
+    Parser<RecordingBuilder> parser(file, iss, RecordingBuilder(record));
+    seed_type_names(parser, prelude);
+    parser.parse_prg();
+    if (num_errors != 0) return nullptr;
+
+    std::vector<AstCache::Dependency> headers;
+    for (auto header : parser.preprocessor().included()) headers.push_back({header->name, AstCache::hash(header->text)});
+    cache.store(key, record, headers);
+    return AstCache::replay(file, record.nodes.data(), record.nodes.size(), record.toks.data(), record.toks.size(), record.strings.data(), record.strings.size());
+}
+
+/// Checks @p stream with the @p IncrementalSession kept in @p state_file.
+static void check_incremental(const char* file, std::istream& stream, const char* state_file) {
+    std::string source((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    IncrementalSession session(file);
+    session.load(state_file);
+    session.update(source, std::cerr);
+    session.save(state_file);
+}
+
+/// Checks @p stream and writes its declarations and macros to @p pch_file if there are no errors.
+static void emit_prelude(const char* file, std::istream& stream, const char* pch_file) {
+    AstRecord record;
+    Parser<RecordingBuilder> parser(file, stream, RecordingBuilder(record));
+    parser.parse_prg();
+    if (num_errors != 0) return;
+    auto macros = parser.preprocessor().definitions();
+
+    auto translationUnit = AstCache::replay(file, record.nodes.data(), record.nodes.size(), record.toks.data(), record.toks.size(), record.strings.data(), record.strings.size());
+    Sema sema;
+    translationUnit->check(sema);
+    if (num_errors != 0) return;
+
+    if (!Prelude::emit(pch_file, file, record, macros)) throw std::runtime_error(std::string("cannot write ") + pch_file);
+}
+
+/// Compiles the checked @p translationUnit, after the declarations of @p prelude, to bytecode, from its optimised IR
+/// @p module if there is one, and runs it as requested by @p exec.
+static void execute(TranslationUnit* translationUnit, TranslationUnit* prelude, ir::Module* module, Execution& exec) {
+    Program program = module != nullptr ? compileBytecode(*module) : compileBytecode(translationUnit, prelude);
+    if (num_errors != 0) return;
+    if (exec.dumpBytecode) program.dump(std::cout);
+    if (!exec.run) return;
+
+    try {
+        auto start = std::chrono::steady_clock::now();
+        if (exec.jit) {
+            Jit jit(program);
+            std::chrono::duration<double> compiled = std::chrono::steady_clock::now() - start;
+            exec.status = jit.runMain(exec.argc, exec.argv);
+            std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+            std::cout.flush();
+            if (exec.stats) {
+                std::cerr << "machine code: " << jit.code_size() << " bytes\ncompile time: " << compiled.count() << " s\n"
+                          << "time: " << seconds.count() << " s\n";
+            }
+        } else {
+            VM vm(program);
+            vm.count(exec.stats);
+            exec.status = vm.runMain(exec.argc, exec.argv);
+            std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+            std::cout.flush();
+            if (exec.stats) {
+                auto& stats = vm.stats();
+                std::cerr << "instructions: " << stats.instructions << "\ncalls: " << stats.calls << "\ntime: " << seconds.count() << " s\n"
+                          << "speed: " << stats.instructions / seconds.count() / 1e6 << " M insn/s\n";
+            }
+        }
+    } catch (const std::runtime_error& e) {
+        std::cout.flush();
+        std::cerr << "runtime error: " << e.what() << std::endl;
+        exec.status = EXIT_FAILURE;
+    }
+}
+
+/// Builds the SSA IR of the checked @p translationUnit, after the declarations of @p prelude, and runs the --passes
+/// pipeline, or the one of -O, on it.
+static std::unique_ptr<ir::Module> optimize_ir(TranslationUnit* translationUnit, TranslationUnit* prelude, const Execution& exec) {
+    auto module = ir::buildIr(translationUnit, prelude);
+    if (num_errors != 0) return nullptr;
+
+    ir::PassManager passes;
+    if (exec.passes != nullptr) passes.parse(exec.passes, exec.passOptions);
+    else if (exec.optLevel != 0) passes.parse(ir::defaultPipeline(exec.optLevel), exec.passOptions);
+#ifndef NDEBUG
+    passes.verifyEach(true);
+#endif
+    passes.run(*module);
+    if (exec.dumpIr) module->dump(std::cout);
+    if (exec.timePasses) passes.printTimings(std::cerr);
+    if (exec.stats) passes.printStatistics(std::cerr);
+    return module;
+}
+
+/// -o if given, otherwise @p file in the working directory with its extension replaced by @p extension.
+static std::string output_name(const char* file, const Execution& exec, const char* extension) {
+    if (exec.output != nullptr) return exec.output;
+    std::string output = strcmp(file, "<stdin>") == 0 ? "a" : file;
+    output = output.substr(output.rfind('/') + 1);
+    return output.substr(0, output.rfind('.')) + extension;
+}
+
+/// Links the object file @p object into the executable named by -o with the system compiler driver.
+static void link_executable(const char* object, const Execution& exec) {
+    std::string cc = "cc", dashO = "-o", output = exec.output ? exec.output : "a.out", input = object;
+    char* args[] = {cc.data(), dashO.data(), output.data(), input.data(), nullptr};
+    pid_t pid;
+    int status = -1;
+    if (posix_spawnp(&pid, "cc", nullptr, nullptr, args, environ) == 0) waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) throw std::runtime_error("linking with cc failed");
+}
+
+/// Writes the checked @p translationUnit, after the declarations of @p prelude, in the --emit-llvm format.
+static void emit_llvm(const char* file, TranslationUnit* translationUnit, TranslationUnit* prelude, const Execution& exec) {
+    const char* extension = exec.llvm == LlvmFormat::Ll ? ".ll" : exec.llvm == LlvmFormat::Bc ? ".bc" : ".o";
+    emitLlvm(translationUnit, file, exec.llvm, exec.optLevel, output_name(file, exec, extension), prelude);
+}
+
+/// Selects instructions for the SSA IR @p module and allocates their registers.
+static mir::Module lower_native(ir::Module& module, const Execution& exec) {
+    auto machine = mir::select(module);
+    mir::AllocationStats stats;
+    for (auto& function : machine.functions) mir::allocateRegisters(function, stats);
+    if (exec.stats) {
+        std::cerr << "intervals: " << stats.intervals << "\nsplits: " << stats.splits << "\nspilled: " << stats.spilled
+                  << "\nstack slots: " << stats.slots << "\nresolution moves: " << stats.moves << "\n";
+    }
+    return machine;
+}
+
+/// Compiles the SSA IR @p module to native code as -c does, but maps it into this process and runs main (-run).
+static void run_native(ir::Module& module, Execution& exec) {
+    auto start = std::chrono::steady_clock::now();
+    auto machine = lower_native(module, exec);
+    auto code = mir::encode(machine);
+    try {
+        mir::Image image(machine, code);
+        std::chrono::duration<double> compiled = std::chrono::steady_clock::now() - start;
+        exec.status = image.runMain(exec.argc, exec.argv);
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+        std::cout.flush();
+        if (exec.stats) {
+            std::cerr << "machine code: " << code.text.size() << " bytes\ncompile time: " << compiled.count() << " s\n"
+                      << "time: " << seconds.count() << " s\n";
+        }
+    } catch (const std::runtime_error& e) {
+        std::cout.flush();
+        std::cerr << "runtime error: " << e.what() << std::endl;
+        exec.status = EXIT_FAILURE;
+    }
+}
+
+/// Whether -c links the object file of the LLVM backend: optimised builds (-O1 and up) when it is available.
+static bool links_llvm(const Execution& exec) {
+    return exec.optLevel != 0 && !exec.assemblyOnly && !exec.objectOnly && llvmAvailable();
+}
+
+/// Compiles the SSA IR @p module to machine code and writes it as assembly (-S) or as an ELF object file, which -c
+/// links with the system compiler driver; see links_llvm() for the exception.
+static void compile_native(const char* file, TranslationUnit* translationUnit, TranslationUnit* prelude, ir::Module* module, const Execution& exec) {
+    if (links_llvm(exec)) {
+        char path[] = "/tmp/h-XXXXXX.o";
+        int fd = mkstemps(path, 2);
+        if (fd < 0) throw std::runtime_error("cannot create a temporary file");
+        close(fd);
+        try {
+            emitLlvm(translationUnit, file, LlvmFormat::Obj, exec.optLevel, path, prelude);
+            if (num_errors == 0) link_executable(path, exec);
+        } catch (...) {
+            unlink(path);
+            throw;
+        }
+        unlink(path);
+        return;
+    }
+
+    auto machine = lower_native(*module, exec);
+    if (exec.assemblyOnly) {
+        std::string output = output_name(file, exec, ".s");
+        std::ofstream ofs(output);
+        mir::printAssembly(machine, ofs);
+        if (!ofs) throw std::runtime_error("cannot write " + output);
+        return;
+    }
+
+    auto code = mir::encode(machine);
+    if (exec.objectOnly) {
+        std::string output = output_name(file, exec, ".o");
+        std::ofstream ofs(output, std::ios::binary);
+        mir::writeObject(machine, code, ofs);
+        if (!ofs) throw std::runtime_error("cannot write " + output);
+        return;
+    }
+
+    char path[] = "/tmp/h-XXXXXX.o";
+    int fd = mkstemps(path, 2);
+    if (fd < 0) throw std::runtime_error("cannot create a temporary file");
+    std::ostringstream object;
+    mir::writeObject(machine, code, object);
+    std::string bytes = object.str();
+    bool written = write(fd, bytes.data(), bytes.size()) == ssize_t(bytes.size());
+    close(fd);
+    try {
+        if (!written) throw std::runtime_error("cannot write the object file");
+        link_executable(path, exec);
+    } catch (...) {
+        unlink(path);
+        throw;
+    }
+    unlink(path);
+}
+
+static void parse_file(const char* file, std::istream& stream, bool eval_parsing, bool prettyPrint, bool syntaxOnly, bool parseEvents, AstFormat dumpAst, Execution& exec, const char* cache_dir, const char* state_file, const char* pch_file, const Prelude* prelude) {
+    if (state_file != nullptr) {
+        check_incremental(file, stream, state_file);
+        return;
+    }
+    if (pch_file != nullptr) {
+        emit_prelude(file, stream, pch_file);
+        return;
+    }
+    if (syntaxOnly) {
+        Parser<NullBuilder> parser(file, stream);
+        seed_type_names(parser, prelude);
+        parser.parse_prg();
+        return;
+    }
+    if (parseEvents) {
+        EventBuilder::TextSink sink(std::cout);
+        Parser<EventBuilder> parser(file, stream, EventBuilder(sink));
+        seed_type_names(parser, prelude);
+        parser.parse_prg();
+        return;
+    }
+
+    Ptr<TranslationUnit> translationUnit;
+    if (cache_dir != nullptr && !eval_parsing) {
+        translationUnit = parse_cached(file, stream, cache_dir, prelude);
+    } else if (eval_parsing) {
+        Tracer::TextSink sink(std::cout);
+        Parser<AstBuilder, Tracer> parser(file, stream, AstBuilder(), Tracer(sink));
+        seed_type_names(parser, prelude);
+        translationUnit = parser.parse_prg();
+    } else {
+        Parser<AstBuilder> parser(file, stream);
+        seed_type_names(parser, prelude);
+        translationUnit = parser.parse_prg();
+    }
+    if (!translationUnit || num_errors != 0) return;
+
+    if (prettyPrint) translationUnit->dump();
+    Sema sema;
+    if (prelude != nullptr) prelude->seed(sema);
+    auto start = std::chrono::steady_clock::now();
+    translationUnit->check(sema);
+    if (exec.stats) {
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+        std::cerr << "typechecks: " << Exp::num_typechecks() << "\ncheck time: " << seconds.count() << " s\n";
+    }
+
+    if (dumpAst != AstFormat::None) {
+        JsonWriter writer(std::cout);
+        if (dumpAst == AstFormat::Json) {
+            translationUnit->json(writer);
+            writer.end_line();
+        } else {
+            translationUnit->jsonLines(writer);
+        }
+    }
+    bool executed = exec.run || exec.dumpBytecode;
+    std::unique_ptr<ir::Module> module;
+    bool native = (exec.compile && !links_llvm(exec)) || exec.native;
+    TranslationUnit* declarations = prelude != nullptr ? prelude->unit() : nullptr;
+    bool lowered = executed || native || exec.dumpIr || exec.passes != nullptr || exec.llvm != LlvmFormat::None || exec.compile;
+    if (num_errors == 0 && lowered && prelude != nullptr) prelude->checkBodies(sema);
+    if (num_errors == 0 && (exec.dumpIr || exec.passes != nullptr || (executed && exec.optLevel != 0) || native))
+        module = optimize_ir(translationUnit.get(), declarations, exec);
+    if (num_errors == 0 && executed) execute(translationUnit.get(), declarations, module.get(), exec);
+    if (num_errors == 0 && exec.llvm != LlvmFormat::None) emit_llvm(file, translationUnit.get(), declarations, exec);
+    if (num_errors == 0 && exec.compile) compile_native(file, translationUnit.get(), declarations, module.get(), exec);
+    if (num_errors == 0 && exec.native) run_native(*module, exec);
+}
+
 int main(int argc, char** argv) {
     try {
         bool tokenize = false;
         bool eval_parsing = false;
         bool parse = false;
+        bool syntaxOnly = false;
+        bool parseEvents = false;
+        AstFormat dumpAst = AstFormat::None;
+        Execution exec;
+        const char* cache_dir = nullptr;
+        const char* state_file = nullptr;
+        const char* pch_file = nullptr;
+        const char* prelude_file = nullptr;
         const char* file = nullptr;
         bool prettyPrint = false;
-        bool compile = false;
 
 
         
@@ -50,10 +436,80 @@ int main(int argc, char** argv) {
                 prettyPrint = true;
             } else if (strcmp("-p", argv[i]) == 0 || strcmp("--parse", argv[i]) == 0) {
                 parse = true;
+            } else if (strcmp("-fsyntax-only", argv[i]) == 0 || strcmp("--syntax-only", argv[i]) == 0) {
+                syntaxOnly = true;
+            } else if (strcmp("-pe", argv[i]) == 0 || strcmp("--parse-events", argv[i]) == 0) {
+                parseEvents = true;
+            } else if (strncmp("--dump-ast=", argv[i], 11) == 0) {
+                const char* format = argv[i] + 11;
+                if (strcmp("json", format) == 0) dumpAst = AstFormat::Json;
+                else if (strcmp("ndjson", format) == 0) dumpAst = AstFormat::Ndjson;
+                else throw std::logic_error(std::string("unknown AST format ") + format);
+            } else if (strcmp("--run", argv[i]) == 0) {
+                exec.run = true;
+            } else if (strcmp("--jit", argv[i]) == 0) {
+                exec.run = exec.jit = true;
+            } else if (strcmp("-run", argv[i]) == 0) {
+                exec.native = true;
+            } else if (strcmp("--stats", argv[i]) == 0) {
+                exec.stats = true;
+            } else if (strcmp("--dump-bytecode", argv[i]) == 0) {
+                exec.dumpBytecode = true;
+            } else if (strcmp("--dump-ir", argv[i]) == 0) {
+                exec.dumpIr = true;
+            } else if (strncmp("--passes=", argv[i], 9) == 0) {
+                exec.passes = argv[i] + 9;
+            } else if (strcmp("--time-passes", argv[i]) == 0) {
+                exec.timePasses = true;
+            } else if (strncmp("--inline-threshold=", argv[i], 19) == 0) {
+                char* end;
+                exec.passOptions.inlineThreshold = strtoul(argv[i] + 19, &end, 10);
+                if (*end != '\0' || argv[i][19] < '0' || argv[i][19] > '9') throw std::logic_error(std::string("invalid inline threshold ") + (argv[i] + 19));
+            } else if (strcmp("--inline-report", argv[i]) == 0) {
+                exec.passOptions.inlineReport = &std::cerr;
             } else if (strcmp("-c", argv[i]) == 0 || strcmp("--compile", argv[i]) == 0) {
-                compile = true;
+                exec.compile = true;
+            } else if (strcmp("-S", argv[i]) == 0) {
+                exec.compile = exec.assemblyOnly = true;
+            } else if (strcmp("--emit-obj", argv[i]) == 0) {
+                exec.compile = exec.objectOnly = true;
+            } else if (strncmp("--emit-llvm", argv[i], 11) == 0) {
+                const char* format = argv[i] + 11;
+                if (*format == '\0' || strcmp("=ll", format) == 0) exec.llvm = LlvmFormat::Ll;
+                else if (strcmp("=bc", format) == 0) exec.llvm = LlvmFormat::Bc;
+                else if (strcmp("=obj", format) == 0) exec.llvm = LlvmFormat::Obj;
+                else throw std::logic_error(std::string("unknown LLVM output format ") + format);
+            } else if (argv[i][0] == '-' && argv[i][1] == 'O' && argv[i][2] >= '0' && argv[i][2] <= '3' && argv[i][3] == '\0') {
+                exec.optLevel = argv[i][2] - '0';
+            } else if (strcmp("-o", argv[i]) == 0) {
+                if (++i == argc) throw std::logic_error("-o needs a file");
+                exec.output = argv[i];
+            } else if (strcmp("--cache-dir", argv[i]) == 0) {
+                if (++i == argc) throw std::logic_error("--cache-dir needs a directory");
+                cache_dir = argv[i];
+            } else if (strcmp("--incremental", argv[i]) == 0) {
+                if (++i == argc) throw std::logic_error("--incremental needs a state file");
+                state_file = argv[i];
+            } else if (strncmp("-I", argv[i], 2) == 0) {
+                const char* dir = argv[i] + 2;
+                if (*dir == '\0') {
+                    if (++i == argc) throw std::logic_error("-I needs a directory");
+                    dir = argv[i];
+                }
+                FileCache::process().include_dirs.push_back(dir);
+            } else if (strcmp("--emit-pch", argv[i]) == 0) {
+                if (++i == argc) throw std::logic_error("--emit-pch needs an output file");
+                pch_file = argv[i];
+            } else if (strcmp("--include-pch", argv[i]) == 0) {
+                if (++i == argc) throw std::logic_error("--include-pch needs a precompiled prelude");
+                prelude_file = argv[i];
             } else if (file == nullptr) {
                 file = argv[i];
+                if (exec.run || exec.native) {                          // The rest belongs to the program
+                    exec.argc = argc - i;
+                    exec.argv = argv + i;
+                    break;
+                }
             } else {
                 throw std::logic_error("multiple input files given");
             }
@@ -61,6 +517,13 @@ int main(int argc, char** argv) {
         //
         if (file == nullptr)
             throw std::logic_error("no input file given");
+        if (prelude_file != nullptr && (pch_file != nullptr || state_file != nullptr))
+            throw std::logic_error("--include-pch cannot be combined with --emit-pch or --incremental");
+
+        Prelude prelude;
+        if (prelude_file != nullptr && !prelude.load(prelude_file))
+            throw std::runtime_error(std::string("cannot read precompiled prelude ") + prelude_file);
+        FileCache::process().predefined = prelude.macros();
 
 
         if(tokenize) {
@@ -91,14 +554,12 @@ int main(int argc, char** argv) {
             }
 
         }
-        else if ((parse||eval_parsing||prettyPrint) && !compile) {
+        else if (parse||eval_parsing||prettyPrint||syntaxOnly||parseEvents||dumpAst!=AstFormat::None||exec.run||exec.native||exec.dumpBytecode||exec.dumpIr||exec.passes||exec.compile||exec.llvm!=LlvmFormat::None||state_file||pch_file||prelude_file) {
             if (strcmp("-", file) == 0) {
-                Parser parser("<stdin>", std::cin, eval_parsing, prettyPrint);
-                parser.parse_prg();
+                parse_file("<stdin>", std::cin, eval_parsing, prettyPrint, syntaxOnly, parseEvents, dumpAst, exec, cache_dir, state_file, pch_file, prelude_file ? &prelude : nullptr);
             } else {
                 std::ifstream ifs(file);
-                Parser parser(file, ifs, eval_parsing, prettyPrint);
-                parser.parse_prg();
+                parse_file(file, ifs, eval_parsing, prettyPrint, syntaxOnly, parseEvents, dumpAst, exec, cache_dir, state_file, pch_file, prelude_file ? &prelude : nullptr);
             }
 
 
@@ -106,12 +567,10 @@ int main(int argc, char** argv) {
                 std::cerr << "\033[1;31m" << "ALARM: " << num_errors << " error(s) encountered" << "\033[0m" << std::endl;
                 return EXIT_FAILURE;
             }
+            if (exec.run || exec.native) return exec.status;
 
 
         }
-        else {
-            // compile
-        }
     } catch (const std::exception& e) {
         std::cerr << "error: " << e.what() << std::endl;
         std::cerr << usage;
@@ -0,0 +1,250 @@
+#ifndef PROG_MIR_H
+#define PROG_MIR_H
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "x86.h"
+
+namespace H {
+
+namespace ir { struct Module; }
+
+namespace mir {
+
+//! =================================================
+//! ================== Instructions =================
+//! =================================================
+//
+// Machine IR for x86-64: one instruction per machine instruction, in two-address form where x86 has it (a is then
+// both the destination and the first source). Registers 0 to 15 are the physical ones in x86::Reg order, higher
+// numbers are virtual until the register allocator replaces them. 32 bit values live in the low half of a register;
+// 'char' values are kept sign-extended to 32 bits. Phis have become copies on the incoming edges.
+
+#define H_MIR(m)                                                                                \
+    m(Mov,       "mov")         /* a = b                                                    */  \
+    m(MovSX8,    "movsb")       /* a = sign extended byte b                                 */  \
+    m(MovSXD,    "movsxd")      /* a = sign extended 32 bit b, 64 bit                       */  \
+    m(Lea,       "lea")         /* a = address of memory b                                  */  \
+    m(Add,       "add")         /* a += b                                                   */  \
+    m(Sub,       "sub")         /* a -= b                                                   */  \
+    m(And,       "and")         /* a &= b                                                   */  \
+    m(Or,        "or")          /* a |= b                                                   */  \
+    m(Xor,       "xor")         /* a ^= b                                                   */  \
+    m(Imul,      "imul")        /* a *= b                                                   */  \
+    m(Imul3,     "imul3")       /* a = b * #imm                                             */  \
+    m(Neg,       "neg")         /* a = -a                                                   */  \
+    m(Not,       "not")         /* a = ~a                                                   */  \
+    m(Shl,       "shl")         /* a <<= b, an immediate or rcx                             */  \
+    m(Sar,       "sar")         /* a >>= b, arithmetic                                      */  \
+    m(Cmp,       "cmp")         /* flags of a - b                                           */  \
+    m(Test,      "test")        /* flags of a & b                                           */  \
+    m(Set,       "set")         /* a = #cond holds ? 1 : 0                                  */  \
+    m(Cdq,       "cdq")         /* rdx = sign of rax                                        */  \
+    m(Idiv,      "idiv")        /* rax, rdx = rdx:rax / a, rdx:rax % a                      */  \
+    m(Movs,      "movs")        /* copy rcx bytes from rsi to rdi                           */  \
+    m(Jmp,       "jmp")         /* goto block #target                                       */  \
+    m(Jcc,       "jcc")         /* if #cond holds goto block #target                        */  \
+    m(Call,      "call")        /* call symbol #target reading the registers in #uses       */  \
+    m(Ret,       "ret")         /* return, reading the registers in #uses                   */
+
+enum class Opc : uint8_t {
+#define CODE(op, str) op,
+    H_MIR(CODE)
+#undef CODE
+};
+
+const char* opc2str(Opc opc);
+
+/// Physical registers are numbered as x86::Reg, virtual ones from here on.
+constexpr uint32_t firstVirtual = 16;
+constexpr uint32_t noReg = UINT32_MAX;
+
+inline bool isVirtual(uint32_t reg) { return reg != noReg && reg >= firstVirtual; }
+
+/// Bit of physical register @p reg in a register mask.
+inline uint32_t bit(x86::Reg reg) { return 1u << reg; }
+
+/// Registers a call may change under the System V ABI.
+constexpr uint32_t callerSaved = 1u << x86::RAX | 1u << x86::RCX | 1u << x86::RDX | 1u << x86::RSI | 1u << x86::RDI
+                               | 1u << x86::R8 | 1u << x86::R9 | 1u << x86::R10 | 1u << x86::R11;
+
+/// base + index * scale + disp. Without a base the address is relative to the instruction pointer and @c symbol;
+/// in the frame, @c disp counts from the end of the saved registers, which is only known after register allocation.
+struct Mem {
+    uint32_t base = noReg;
+    uint32_t index = noReg;
+    uint8_t scale = 1;
+    bool frame = false;                                                 // base is rbp
+    int32_t symbol = -1;
+    int32_t disp = 0;
+};
+
+struct Operand {
+    enum class Kind : uint8_t { None, Reg, Imm, Mem };
+
+    Kind kind = Kind::None;
+    uint32_t reg = noReg;
+    int64_t imm = 0;
+    Mem mem;
+
+    static Operand r(uint32_t reg) { Operand o; o.kind = Kind::Reg; o.reg = reg; return o; }
+    static Operand i(int64_t imm) { Operand o; o.kind = Kind::Imm; o.imm = imm; return o; }
+    static Operand m(Mem mem) { Operand o; o.kind = Kind::Mem; o.mem = mem; return o; }
+
+    bool isReg() const { return kind == Kind::Reg; }
+    bool isImm() const { return kind == Kind::Imm; }
+    bool isMem() const { return kind == Kind::Mem; }
+};
+
+struct Inst {
+    Opc opc;
+    x86::Width w = x86::W32;
+    x86::Cond cond = x86::E;
+    Operand a;
+    Operand b;
+    int64_t imm = 0;
+    uint32_t target = 0;                                                // Block of a jump, symbol of a call
+    uint32_t uses = 0;                                                  // Register mask read by a call or return
+};
+
+
+//! =================================================
+//! ============ Functions and the Module ===========
+//! =================================================
+
+struct Block {
+    std::vector<Inst> insts;                                            // Ends with jumps or a return
+    std::vector<uint32_t> preds;
+    std::vector<uint32_t> succs;
+};
+
+struct Function {
+    uint32_t symbol = 0;
+    std::vector<Block> blocks;                                          // In layout order, the entry first
+    uint32_t num_regs = firstVirtual;
+    int32_t locals = 0;                                                 // Bytes of allocas and spill slots
+    int32_t outgoing = 0;                                               // Bytes of stack arguments of calls
+    std::vector<x86::Reg> saved;                                        // Callee-saved registers to preserve
+
+    uint32_t newReg() { return num_regs++; }
+    /// Bytes the prologue reserves below the saved registers, keeping the stack 16 byte aligned at calls.
+    int32_t frameSize() const {
+        int32_t size = locals + outgoing, pushed = 8 * int32_t(saved.size());
+        return size + (16 - (pushed + size) % 16) % 16;
+    }
+    /// Offset from rbp of the frame displacement @p disp.
+    int32_t frameOffset(int32_t disp) const { return disp - 8 * int32_t(saved.size()); }
+    /// Recomputes the predecessors and successors of every block from its jumps.
+    void linkBlocks();
+};
+
+struct Symbol {
+    enum class Kind : uint8_t { Function, External, Global, String };
+
+    Kind kind;
+    std::string name;                                                   // Bytes of a string, without the zero
+    size_t size = 0;
+    size_t align = 1;
+};
+
+/// Machine code of a module before encoding.
+struct Module {
+    std::vector<Symbol> symbols;
+    std::vector<Function> functions;
+};
+
+/// Selects instructions for the functions of the SSA IR @p module, with virtual registers.
+Module select(ir::Module& module);
+
+
+//! =================================================
+//! ============== Register Allocation ==============
+//! =================================================
+//
+// Linear scan over live intervals with holes (Wimmer & Franz): intervals are split where their register is needed
+// by another one or clobbered by a call, and the parts without uses in between wait in a stack slot. Values that
+// live across calls end up in callee-saved registers, which are then saved on entry; stack slots are shared by
+// values whose lifetimes do not overlap.
+
+struct AllocationStats {
+    size_t intervals = 0;
+    size_t splits = 0;
+    size_t spilled = 0;                                                 // Values that spent some time in memory
+    size_t slots = 0;
+    size_t moves = 0;                                                   // Moves inserted between split parts
+};
+
+/// Replaces the virtual registers of @p function by physical ones and lays out its frame.
+void allocateRegisters(Function& function, AllocationStats& stats);
+
+
+//! =================================================
+//! ==================== Output =====================
+//! =================================================
+
+/// Writes GNU (AT&T) assembly for the allocated @p module.
+void printAssembly(const Module& module, std::ostream& o);
+
+/// A rel32 field in the code that refers to an external function (through its PLT entry when linked), a global or
+/// a string: S + @c addend - P, with P the address of the field.
+struct Fixup {
+    size_t at;
+    uint32_t symbol;
+    int64_t addend;
+};
+
+/// Machine code of an allocated module, with the references to data and external functions still open.
+struct Code {
+    std::vector<uint8_t> text;
+    std::vector<uint8_t> rodata;                                        // The strings, zero terminated
+    size_t bss = 0;                                                     // Bytes of the globals
+    std::vector<size_t> offsets;                                        // Per symbol, in text, rodata or bss
+    std::vector<size_t> sizes;                                          // Per symbol
+    std::vector<Fixup> fixups;
+};
+
+/// Encodes the allocated @p module; calls between its functions are resolved.
+Code encode(const Module& module);
+
+/// Writes @p code of @p module as a relocatable ELF64 object file for x86-64.
+void writeObject(const Module& module, const Code& code, std::ostream& o);
+
+
+//! =================================================
+//! ============== In-Memory Execution ==============
+//! =================================================
+
+/// Encoded code mapped into this process ready to run: the text, a jump through memory for every external function
+/// (resolved with dlsym), the strings and the zeroed globals, close enough together for the rel32 fixups.
+class Image {
+    public:
+        /// Maps and links @p code of @p module; throws std::runtime_error if an external is missing.
+        Image(const Module& module, const Code& code);
+        ~Image();
+        Image(const Image&) = delete;
+        Image& operator=(const Image&) = delete;
+
+        /// Address of symbol @p index of the module.
+        void* address(uint32_t index) const { return addresses_[index]; }
+
+        /// Runs @c main with @p argc and @p argv, which a main without parameters ignores, and returns its result.
+        int runMain(int argc, char** argv);
+
+        size_t size() const { return mapped_; }
+
+    private:
+        const Module& module_;
+        std::vector<void*> addresses_;
+        uint8_t* memory_ = nullptr;
+        size_t mapped_ = 0;
+};
+
+}
+
+}
+
+#endif
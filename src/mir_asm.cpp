@@ -0,0 +1,160 @@
+#include "mir.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace H::mir {
+
+namespace {
+
+const char* const names64[] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+                               "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"};
+const char* const names32[] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+                               "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"};
+const char* const names8[] = {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+                              "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"};
+const char* const conds[] = {"o", "no", "b", "ae", "e", "ne", "be", "a", "s", "ns", "p", "np", "l", "ge", "le", "g"};
+
+char suffix(x86::Width w) { return w == x86::W8 ? 'b' : w == x86::W32 ? 'l' : 'q'; }
+
+/// Writes the assembly of one function of the module, after register allocation.
+class Printer {
+    public:
+        Printer(const Module& module, std::ostream& o)
+            : m_(module)
+            , o_(o)
+        {}
+
+        void function(const Function& f, size_t index);
+
+    private:
+        std::string reg(uint32_t r, x86::Width w) const;
+        std::string operand(const Operand& op, x86::Width w) const;
+        std::string label(uint32_t block) const { return ".LBB" + std::to_string(index_) + "_" + std::to_string(block); }
+        void inst(const Inst& inst);
+        void line(const std::string& s) { o_ << '\t' << s << '\n'; }
+
+        const Module& m_;
+        std::ostream& o_;
+        const Function* f_ = nullptr;
+        size_t index_ = 0;
+};
+
+std::string Printer::reg(uint32_t r, x86::Width w) const {
+    assert(r < firstVirtual);
+    return std::string("%") + (w == x86::W8 ? names8[r] : w == x86::W32 ? names32[r] : names64[r]);
+}
+
+std::string Printer::operand(const Operand& op, x86::Width w) const {
+    if (op.isReg()) return reg(op.reg, w);
+    if (op.isImm()) return "$" + std::to_string(op.imm);
+    const Mem& mem = op.mem;
+    if (mem.symbol >= 0) {
+        const Symbol& symbol = m_.symbols[mem.symbol];
+        std::string name = symbol.kind == Symbol::Kind::String ? ".Lstr" + std::to_string(mem.symbol) : symbol.name;
+        return name + (mem.disp != 0 ? (mem.disp > 0 ? "+" : "") + std::to_string(mem.disp) : "") + "(%rip)";
+    }
+    int32_t disp = mem.frame ? f_->frameOffset(mem.disp) : mem.disp;
+    std::string s = disp != 0 ? std::to_string(disp) : "";
+    s += "(" + reg(mem.base, x86::W64);
+    if (mem.index != noReg) s += "," + reg(mem.index, x86::W64) + "," + std::to_string(mem.scale);
+    return s + ")";
+}
+
+void Printer::function(const Function& f, size_t index) {
+    f_ = &f;
+    index_ = index;
+    const std::string& name = m_.symbols[f.symbol].name;
+    o_ << "\n\t.globl " << name << "\n\t.type " << name << ", @function\n" << name << ":\n";
+
+    int32_t frame = f.frameSize();
+    line("pushq %rbp");
+    line("movq %rsp, %rbp");
+    for (auto r : f.saved) line("pushq " + reg(r, x86::W64));
+    if (frame != 0) line("subq $" + std::to_string(frame) + ", %rsp");
+
+    std::vector<bool> targets(f.blocks.size());
+    for (auto& block : f.blocks)
+        for (auto& i : block.insts) if (i.opc == Opc::Jmp || i.opc == Opc::Jcc) targets[i.target] = true;
+    for (uint32_t b = 0; b < f.blocks.size(); b++) {
+        if (targets[b]) o_ << label(b) << ":\n";
+        for (auto& i : f.blocks[b].insts) inst(i);
+    }
+    o_ << "\t.size " << name << ", .-" << name << "\n";
+}
+
+void Printer::inst(const Inst& inst) {
+    std::string op = opc2str(inst.opc);
+    auto binary = [&](const std::string& mnemonic, x86::Width wb, x86::Width wa) {
+        line(mnemonic + " " + operand(inst.b, wb) + ", " + operand(inst.a, wa));
+    };
+    switch (inst.opc) {
+        case Opc::Mov:
+            if (inst.b.isImm() && (inst.b.imm < INT32_MIN || inst.b.imm > INT32_MAX)) return binary("movabsq", x86::W64, x86::W64);
+            return binary(std::string("mov") + suffix(inst.w), inst.w, inst.w);
+        case Opc::MovSX8:
+            return binary(std::string("movsb") + suffix(inst.w), x86::W8, inst.w);
+        case Opc::MovSXD:
+            return binary("movslq", x86::W32, x86::W64);
+        case Opc::Lea: case Opc::Add: case Opc::Sub: case Opc::And: case Opc::Or: case Opc::Xor: case Opc::Imul: case Opc::Cmp: case Opc::Test:
+            return binary(op + suffix(inst.w), inst.w, inst.w);
+        case Opc::Imul3:
+            return line(std::string("imul") + suffix(inst.w) + " $" + std::to_string(inst.imm) + ", "
+                        + operand(inst.b, inst.w) + ", " + operand(inst.a, inst.w));
+        case Opc::Neg: case Opc::Not: case Opc::Idiv:
+            return line(op + suffix(inst.w) + " " + operand(inst.a, inst.w));
+        case Opc::Shl: case Opc::Sar:
+            return binary(op + suffix(inst.w), x86::W8, inst.w);
+        case Opc::Set:
+            line(std::string("set") + conds[inst.cond] + " " + operand(inst.a, x86::W8));
+            return line("movzbl " + operand(inst.a, x86::W8) + ", " + operand(inst.a, x86::W32));
+        case Opc::Cdq:
+            return line(inst.w == x86::W64 ? "cqto" : "cltd");
+        case Opc::Movs:
+            return line("rep movsb");
+        case Opc::Jmp:
+            return line("jmp " + label(inst.target));
+        case Opc::Jcc:
+            return line(std::string("j") + conds[inst.cond] + " " + label(inst.target));
+        case Opc::Call: {
+            const Symbol& callee = m_.symbols[inst.target];
+            return line("call " + callee.name + (callee.kind == Symbol::Kind::External ? "@PLT" : ""));
+        }
+        case Opc::Ret:
+            if (f_->saved.empty()) {
+                line("leave");
+            } else {
+                line("leaq -" + std::to_string(8 * f_->saved.size()) + "(%rbp), %rsp");
+                for (size_t i = f_->saved.size(); i-- > 0;) line("popq " + reg(f_->saved[i], x86::W64));
+                line("popq %rbp");
+            }
+            return line("ret");
+    }
+}
+
+}
+
+void printAssembly(const Module& module, std::ostream& o) {
+    o << "\t.text\n";
+    for (size_t i = 0; i < module.functions.size(); i++) Printer(module, o).function(module.functions[i], i);
+
+    bool bss = false, rodata = false;
+    for (auto& symbol : module.symbols) {
+        if (symbol.kind != Symbol::Kind::Global) continue;
+        if (!bss) o << "\n\t.bss\n";
+        bss = true;
+        o << "\t.globl " << symbol.name << "\n\t.align " << symbol.align << "\n" << symbol.name << ":\n\t.zero "
+          << std::max<size_t>(symbol.size, 1) << "\n";
+    }
+    for (size_t i = 0; i < module.symbols.size(); i++) {
+        if (module.symbols[i].kind != Symbol::Kind::String) continue;
+        if (!rodata) o << "\n\t.section .rodata\n";
+        rodata = true;
+        o << ".Lstr" << i << ":\n\t.byte ";
+        for (unsigned char c : module.symbols[i].name) o << unsigned(c) << ",";
+        o << "0\n";
+    }
+    o << "\t.section .note.GNU-stack,\"\",@progbits\n";
+}
+
+}
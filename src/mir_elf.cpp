@@ -0,0 +1,136 @@
+#include "mir.h"
+
+#include <cstring>
+#include <elf.h>
+
+namespace H::mir {
+
+namespace {
+
+/// Section header indices of the object file.
+enum Section : uint16_t { Null, Text, Rodata, Bss, Note, Symtab, Strtab, RelaText, Shstrtab, NumSections };
+
+/// A string table under construction; offset 0 is the empty string.
+class StringTable {
+    public:
+        uint32_t add(const std::string& s) {
+            uint32_t offset = data_.size();
+            data_ += s;
+            data_ += '\0';
+            return offset;
+        }
+        const std::string& data() const { return data_; }
+
+    private:
+        std::string data_ = std::string(1, '\0');
+};
+
+template<class T>
+void append(std::string& out, const T& value) { out.append(reinterpret_cast<const char*>(&value), sizeof(T)); }
+
+void align(std::string& out, size_t alignment) { out.resize((out.size() + alignment - 1) / alignment * alignment, '\0'); }
+
+}
+
+void writeObject(const Module& module, const Code& code, std::ostream& o) {
+    // Locals first: the null symbol and the sections that strings and globals are addressed through
+    StringTable names;
+    std::vector<Elf64_Sym> symbols(4);
+    symbols[0] = {};
+    for (uint16_t section : {Text, Rodata, Bss}) {
+        symbols[section] = {};
+        symbols[section].st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+        symbols[section].st_shndx = section;
+    }
+    uint32_t firstGlobal = symbols.size();
+    std::vector<uint32_t> index(module.symbols.size());                 // Of the ELF symbol or section symbol
+    for (size_t i = 0; i < module.symbols.size(); i++) {
+        const Symbol& symbol = module.symbols[i];
+        if (symbol.kind == Symbol::Kind::String) {
+            index[i] = Rodata;
+            continue;
+        }
+        Elf64_Sym sym = {};
+        sym.st_name = names.add(symbol.name);
+        switch (symbol.kind) {
+            case Symbol::Kind::Function:
+                sym.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+                sym.st_shndx = Text;
+                break;
+            case Symbol::Kind::Global:
+                sym.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_OBJECT);
+                sym.st_shndx = Bss;
+                break;
+            default:
+                sym.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE);
+                sym.st_shndx = SHN_UNDEF;
+                break;
+        }
+        sym.st_value = code.offsets[i];
+        sym.st_size = code.sizes[i];
+        index[i] = symbols.size();
+        symbols.push_back(sym);
+    }
+
+    std::vector<Elf64_Rela> relocations;
+    for (auto& fixup : code.fixups) {
+        const Symbol& symbol = module.symbols[fixup.symbol];
+        Elf64_Rela rela;
+        rela.r_offset = fixup.at;
+        rela.r_info = ELF64_R_INFO(index[fixup.symbol], symbol.kind == Symbol::Kind::External ? R_X86_64_PLT32 : R_X86_64_PC32);
+        rela.r_addend = fixup.addend + (symbol.kind == Symbol::Kind::String ? int64_t(code.offsets[fixup.symbol]) : 0);
+        relocations.push_back(rela);
+    }
+
+    // The file: header, section contents, section headers
+    StringTable sectionNames;
+    Elf64_Shdr headers[NumSections] = {};
+    std::string out(sizeof(Elf64_Ehdr), '\0');
+    auto section = [&](Section s, const char* name, uint32_t type, uint64_t flags, const void* data, size_t size, size_t alignment) {
+        align(out, alignment);
+        Elf64_Shdr& header = headers[s];
+        if (name != nullptr) header.sh_name = sectionNames.add(name);
+        header.sh_type = type;
+        header.sh_flags = flags;
+        header.sh_offset = out.size();
+        header.sh_size = size;
+        header.sh_addralign = alignment;
+        if (type != SHT_NOBITS && data != nullptr) out.append(static_cast<const char*>(data), size);
+    };
+    section(Text, ".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, code.text.data(), code.text.size(), 16);
+    section(Rodata, ".rodata", SHT_PROGBITS, SHF_ALLOC, code.rodata.data(), code.rodata.size(), 1);
+    section(Bss, ".bss", SHT_NOBITS, SHF_ALLOC | SHF_WRITE, nullptr, code.bss, 16);
+    section(Note, ".note.GNU-stack", SHT_PROGBITS, 0, nullptr, 0, 1);
+    section(Symtab, ".symtab", SHT_SYMTAB, 0, symbols.data(), symbols.size() * sizeof(Elf64_Sym), 8);
+    headers[Symtab].sh_link = Strtab;
+    headers[Symtab].sh_info = firstGlobal;
+    headers[Symtab].sh_entsize = sizeof(Elf64_Sym);
+    section(Strtab, ".strtab", SHT_STRTAB, 0, names.data().data(), names.data().size(), 1);
+    section(RelaText, ".rela.text", SHT_RELA, SHF_INFO_LINK, relocations.data(), relocations.size() * sizeof(Elf64_Rela), 8);
+    headers[RelaText].sh_link = Symtab;
+    headers[RelaText].sh_info = Text;
+    headers[RelaText].sh_entsize = sizeof(Elf64_Rela);
+    headers[Shstrtab].sh_name = sectionNames.add(".shstrtab");                   // Before the table is written
+    section(Shstrtab, nullptr, SHT_STRTAB, 0, sectionNames.data().data(), sectionNames.data().size(), 1);
+
+    align(out, 8);
+    Elf64_Ehdr header = {};
+    std::memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    header.e_type = ET_REL;
+    header.e_machine = EM_X86_64;
+    header.e_version = EV_CURRENT;
+    header.e_shoff = out.size();
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_shentsize = sizeof(Elf64_Shdr);
+    header.e_shnum = NumSections;
+    header.e_shstrndx = Shstrtab;
+    std::memcpy(out.data(), &header, sizeof(header));
+    for (auto& h : headers) append(out, h);
+    o.write(out.data(), out.size());
+}
+
+}
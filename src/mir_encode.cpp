@@ -0,0 +1,194 @@
+#include "mir.h"
+
+#include <algorithm>
+
+namespace H::mir {
+
+namespace {
+
+using x86::Reg;
+
+/// Encodes the functions of a module one after another into one text section.
+class Encoder {
+    public:
+        Encoder(const Module& module, Code& code)
+            : m_(module)
+            , code_(code)
+        {}
+
+        void function(const Function& f);
+        /// Points the calls to functions encoded after the caller at them.
+        void resolveCalls();
+
+    private:
+        x86::Operand operand(const Operand& op);
+        void inst(const Inst& inst);
+        void jump(const Inst& inst);
+        /// Records the fixup of the rip-relative operand of the instruction just encoded.
+        void fixup();
+
+        const Module& m_;
+        Code& code_;
+        x86::Assembler a_;
+        const Function* f_ = nullptr;
+        std::vector<size_t> blocks_;                                    // Offsets of the blocks emitted so far
+        std::vector<std::pair<size_t, uint32_t>> jumps_;                // Forward jumps to blocks
+        std::vector<std::pair<size_t, uint32_t>> calls_;                // Calls to functions not yet encoded
+        int32_t symbol_ = -1;                                           // Of the rip-relative operand, if any
+        int32_t disp_ = 0;
+};
+
+x86::Operand Encoder::operand(const Operand& op) {
+    if (op.isReg()) return x86::Operand::r(Reg(op.reg));
+    const Mem& mem = op.mem;
+    if (mem.symbol >= 0) {
+        symbol_ = mem.symbol;
+        disp_ = mem.disp;
+        return x86::Operand::ripRelative(0);
+    }
+    int32_t disp = mem.frame ? f_->frameOffset(mem.disp) : mem.disp;
+    if (mem.index != noReg) return x86::Operand::m(Reg(mem.base), Reg(mem.index), mem.scale, disp);
+    return x86::Operand::m(Reg(mem.base), disp);
+}
+
+void Encoder::fixup() {
+    if (symbol_ < 0) return;
+    size_t at = a_.ripField();
+    code_.fixups.push_back({at, uint32_t(symbol_), disp_ - int64_t(a_.size() - at)});
+    symbol_ = -1;
+}
+
+void Encoder::function(const Function& f) {
+    f_ = &f;
+    while (a_.size() % 16 != 0) a_.byte(0xCC);
+    code_.offsets[f.symbol] = a_.size();
+    blocks_.clear();
+    jumps_.clear();
+
+    a_.push(x86::RBP);
+    a_.mov(x86::RBP, x86::RSP);
+    for (auto r : f.saved) a_.push(r);
+    if (int32_t frame = f.frameSize()) a_.alu(x86::SUB, x86::Operand::r(x86::RSP), frame);
+
+    for (auto& block : f.blocks) {
+        blocks_.push_back(a_.size());
+        for (auto& i : block.insts) inst(i);
+    }
+    for (auto [at, block] : jumps_) a_.patch(at, blocks_[block]);
+    code_.sizes[f.symbol] = a_.size() - code_.offsets[f.symbol];
+}
+
+void Encoder::resolveCalls() {
+    for (auto [at, symbol] : calls_) a_.patch(at, code_.offsets[symbol]);
+    code_.text = std::move(a_.code());
+}
+
+void Encoder::jump(const Inst& inst) {
+    if (inst.target < blocks_.size()) {
+        if (inst.opc == Opc::Jmp) a_.jmp(blocks_[inst.target]);
+        else a_.jcc(inst.cond, blocks_[inst.target]);
+        return;
+    }
+    jumps_.push_back({inst.opc == Opc::Jmp ? a_.jmp() : a_.jcc(inst.cond), inst.target});
+}
+
+void Encoder::inst(const Inst& inst) {
+    Reg a = inst.a.isReg() ? Reg(inst.a.reg) : x86::RAX;
+    auto alu = [&](x86::Alu kind) {
+        if (inst.b.isImm()) a_.alu(kind, x86::Operand::r(a), int32_t(inst.b.imm), inst.w);
+        else a_.alu(kind, a, operand(inst.b), inst.w);
+    };
+    switch (inst.opc) {
+        case Opc::Mov:
+            if (inst.a.isMem()) {
+                x86::Operand to = operand(inst.a);
+                if (inst.b.isImm()) a_.mov(to, int32_t(inst.b.imm), inst.w);
+                else a_.mov(to, Reg(inst.b.reg), inst.w);
+            } else if (inst.b.isImm()) {
+                a_.mov(a, inst.w == x86::W64 ? inst.b.imm : int64_t(uint32_t(inst.b.imm)), true);
+            } else {
+                a_.mov(a, operand(inst.b), inst.w);
+            }
+            break;
+        case Opc::MovSX8:   a_.movsx8(a, operand(inst.b), inst.w); break;
+        case Opc::MovSXD:   a_.movsxd(a, operand(inst.b)); break;
+        case Opc::Lea:      a_.lea(a, operand(inst.b), inst.w); break;
+        case Opc::Add:      alu(x86::ADD); break;
+        case Opc::Sub:      alu(x86::SUB); break;
+        case Opc::And:      alu(x86::AND); break;
+        case Opc::Or:       alu(x86::OR); break;
+        case Opc::Xor:      alu(x86::XOR); break;
+        case Opc::Cmp:      alu(x86::CMP); break;
+        case Opc::Test:     a_.test(Reg(inst.b.reg), x86::Operand::r(a), inst.w); break;
+        case Opc::Imul:     a_.imul(a, operand(inst.b), inst.w); break;
+        case Opc::Imul3:    a_.imul(a, operand(inst.b), int32_t(inst.imm), inst.w); break;
+        case Opc::Neg:      a_.neg(x86::Operand::r(a), inst.w); break;
+        case Opc::Not:      a_.not_(x86::Operand::r(a), inst.w); break;
+        case Opc::Shl: case Opc::Sar: {
+            x86::Shift kind = inst.opc == Opc::Shl ? x86::SHL : x86::SAR;
+            if (inst.b.isImm()) a_.shift(kind, x86::Operand::r(a), uint8_t(inst.b.imm), inst.w);
+            else a_.shift(kind, x86::Operand::r(a), inst.w);
+            break;
+        }
+        case Opc::Set:
+            a_.setcc(inst.cond, a);
+            a_.movzx8(a, x86::Operand::r(a));
+            break;
+        case Opc::Cdq:
+            if (inst.w == x86::W64) a_.cqo();
+            else a_.cdq();
+            break;
+        case Opc::Idiv:     a_.idiv(x86::Operand::r(a), inst.w); break;
+        case Opc::Movs:     a_.rep_movsb(); break;
+        case Opc::Jmp: case Opc::Jcc:
+            return jump(inst);
+        case Opc::Call:
+            if (m_.symbols[inst.target].kind == Symbol::Kind::External) {
+                size_t at = a_.call();
+                code_.fixups.push_back({at, inst.target, -4});
+            } else if (m_.symbols[inst.target].kind == Symbol::Kind::Function) {
+                calls_.push_back({a_.call(), inst.target});
+            }
+            break;
+        case Opc::Ret:
+            if (f_->saved.empty()) {
+                a_.leave();
+            } else {
+                a_.lea(x86::RSP, x86::Operand::m(x86::RBP, -8 * int32_t(f_->saved.size())));
+                for (size_t i = f_->saved.size(); i-- > 0;) a_.pop(f_->saved[i]);
+                a_.pop(x86::RBP);
+            }
+            a_.ret();
+            break;
+    }
+    fixup();
+}
+
+}
+
+Code encode(const Module& module) {
+    Code code;
+    code.offsets.resize(module.symbols.size());
+    code.sizes.resize(module.symbols.size());
+    for (size_t i = 0; i < module.symbols.size(); i++) {
+        const Symbol& symbol = module.symbols[i];
+        if (symbol.kind == Symbol::Kind::String) {
+            code.offsets[i] = code.rodata.size();
+            code.rodata.insert(code.rodata.end(), symbol.name.begin(), symbol.name.end());
+            code.rodata.push_back(0);
+            code.sizes[i] = symbol.name.size() + 1;
+        } else if (symbol.kind == Symbol::Kind::Global) {
+            code.bss = (code.bss + symbol.align - 1) / symbol.align * symbol.align;
+            code.offsets[i] = code.bss;
+            code.sizes[i] = std::max<size_t>(symbol.size, 1);
+            code.bss += code.sizes[i];
+        }
+    }
+
+    Encoder encoder(module, code);
+    for (auto& function : module.functions) encoder.function(function);
+    encoder.resolveCalls();
+    return code;
+}
+
+}
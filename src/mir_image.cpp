@@ -0,0 +1,87 @@
+#include "mir.h"
+
+#include <algorithm>
+#include <cstring>
+#include <dlfcn.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace H::mir {
+
+namespace {
+
+/// jmp *0(%rip) followed by the 8 byte target, padded to 16 bytes.
+constexpr size_t stubSize = 16;
+
+size_t roundUp(size_t n, size_t to) { return (n + to - 1) / to * to; }
+
+}
+
+Image::Image(const Module& module, const Code& code)
+    : module_(module)
+    , addresses_(module.symbols.size())
+{
+    std::vector<void*> externals(module.symbols.size());
+    size_t numExternals = 0;
+    for (size_t i = 0; i < module.symbols.size(); i++) {
+        if (module.symbols[i].kind != Symbol::Kind::External) continue;
+        externals[i] = dlsym(RTLD_DEFAULT, module.symbols[i].name.c_str());
+        if (externals[i] == nullptr) throw std::runtime_error("undefined function '" + module.symbols[i].name + "'");
+        numExternals++;
+    }
+
+    // Text, stubs and strings are made executable together; the globals follow on their own pages
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t stubs = roundUp(code.text.size(), stubSize), rodata = stubs + numExternals * stubSize;
+    size_t executable = roundUp(std::max<size_t>(rodata + code.rodata.size(), 1), page);
+    mapped_ = executable + roundUp(code.bss, page);
+    void* memory = mmap(nullptr, mapped_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) throw std::runtime_error("cannot map memory for the program");
+    memory_ = static_cast<uint8_t*>(memory);
+    std::memcpy(memory_, code.text.data(), code.text.size());
+    std::memcpy(memory_ + rodata, code.rodata.data(), code.rodata.size());
+
+    uint8_t* stub = memory_ + stubs;
+    for (size_t i = 0; i < module.symbols.size(); i++) {
+        switch (module.symbols[i].kind) {
+            case Symbol::Kind::Function:    addresses_[i] = memory_ + code.offsets[i]; break;
+            case Symbol::Kind::String:      addresses_[i] = memory_ + rodata + code.offsets[i]; break;
+            case Symbol::Kind::Global:      addresses_[i] = memory_ + executable + code.offsets[i]; break;
+            case Symbol::Kind::External: {
+                const uint8_t jump[] = {0xFF, 0x25, 0, 0, 0, 0};
+                std::memcpy(stub, jump, sizeof(jump));
+                std::memcpy(stub + sizeof(jump), &externals[i], 8);
+                addresses_[i] = stub;
+                stub += stubSize;
+                break;
+            }
+        }
+    }
+    for (auto& fixup : code.fixups) {
+        uint8_t* at = memory_ + fixup.at;
+        int64_t rel = static_cast<uint8_t*>(addresses_[fixup.symbol]) + fixup.addend - at;
+        int32_t rel32 = int32_t(rel);
+        std::memcpy(at, &rel32, 4);
+    }
+
+    if (mprotect(memory_, executable, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory_, mapped_);
+        throw std::runtime_error("cannot make the program executable");
+    }
+}
+
+Image::~Image() {
+    if (memory_ != nullptr) munmap(memory_, mapped_);
+}
+
+int Image::runMain(int argc, char** argv) {
+    for (size_t i = 0; i < module_.symbols.size(); i++) {
+        const Symbol& symbol = module_.symbols[i];
+        if (symbol.kind == Symbol::Kind::Function && symbol.name == "main")
+            return reinterpret_cast<int (*)(int, char**)>(addresses_[i])(argc, argv);
+    }
+    throw std::runtime_error("no function 'main'");
+}
+
+}
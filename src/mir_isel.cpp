@@ -0,0 +1,573 @@
+#include "mir.h"
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ir_pass.h"
+
+namespace H::mir {
+
+const char* opc2str(Opc opc) {
+    switch (opc) {
+#define CODE(op, str) case Opc::op: return str;
+        H_MIR(CODE)
+#undef CODE
+        default: return "<unknown>";
+    }
+}
+
+void Function::linkBlocks() {
+    for (auto& block : blocks) block.preds.clear(), block.succs.clear();
+    for (uint32_t i = 0; i < blocks.size(); i++) {
+        for (auto& inst : blocks[i].insts) {
+            if (inst.opc != Opc::Jmp && inst.opc != Opc::Jcc) continue;
+            auto& succs = blocks[i].succs;
+            if (std::find(succs.begin(), succs.end(), inst.target) != succs.end()) continue;
+            succs.push_back(inst.target);
+            blocks[inst.target].preds.push_back(i);
+        }
+    }
+}
+
+namespace {
+
+using x86::Cond;
+using x86::Width;
+
+Width widthOf(ir::Ty ty) { return ty == ir::Ty::Ptr ? x86::W64 : x86::W32; }
+
+bool fitsImm(int64_t v) { return v >= INT32_MIN && v <= INT32_MAX; }
+
+const ir::Constant* asConstant(const ir::Value* value) {
+    return value->kind() == ir::Value::Kind::Constant ? static_cast<const ir::Constant*>(value) : nullptr;
+}
+
+const ir::Instruction* asInstruction(const ir::Value* value) {
+    return value->kind() == ir::Value::Kind::Instruction ? static_cast<const ir::Instruction*>(value) : nullptr;
+}
+
+bool isComparison(ir::Op op) { return op >= ir::Op::Eq && op <= ir::Op::Ge; }
+
+/// Condition of the comparison @p op; pointers compare unsigned.
+Cond condition(ir::Op op, bool pointers) {
+    switch (op) {
+        case ir::Op::Eq:    return x86::E;
+        case ir::Op::Ne:    return x86::NE;
+        case ir::Op::Lt:    return pointers ? x86::B : x86::L;
+        case ir::Op::Le:    return pointers ? x86::BE : x86::LE;
+        case ir::Op::Gt:    return pointers ? x86::A : x86::G;
+        default:            return pointers ? x86::AE : x86::GE;
+    }
+}
+
+/// Condition that holds for the swapped operands when @p cond holds for the original ones.
+Cond swapped(Cond cond) {
+    switch (cond) {
+        case x86::L:    return x86::G;
+        case x86::G:    return x86::L;
+        case x86::LE:   return x86::GE;
+        case x86::GE:   return x86::LE;
+        case x86::B:    return x86::A;
+        case x86::A:    return x86::B;
+        case x86::BE:   return x86::AE;
+        case x86::AE:   return x86::BE;
+        default:        return cond;
+    }
+}
+
+/// A move of a parallel copy.
+struct Copy {
+    uint32_t dst;
+    Operand src;
+    Width w;
+};
+
+/// Instruction selection for the SSA IR of a module. Every value gets a virtual register, except addresses that fold
+/// into the memory operands of their loads and stores (frame slots, globals, constant and scaled indices) and
+/// comparisons that only decide the branch right after them. Critical edges get a block of their own, so that the
+/// copies of phis and of the register allocator always have a place.
+class Selector {
+    public:
+        Selector(Module& module, ir::Module& source)
+            : m_(module)
+            , source_(source)
+        {}
+
+        void unit();
+
+    private:
+        void function(ir::Function& fn, Function& f);
+        void instruction(ir::Instruction* insn);
+        void binary(ir::Instruction* insn);
+        void divide(ir::Instruction* insn);
+        void shift(ir::Instruction* insn);
+        Cond compare(const ir::Instruction* insn);
+        void call(ir::Instruction* insn);
+        void copy(ir::Instruction* insn);
+        void branch(ir::Instruction* term);
+        void phis(ir::Block* from, ir::Block* to);
+        void copies(std::vector<Copy> moves);
+
+        void emit(Opc opc, Width w, Operand a = {}, Operand b = {}, int64_t imm = 0);
+        uint32_t reg(const ir::Value* value);
+        Operand use(const ir::Value* value);
+        Mem address(const ir::Value* pointer);
+        Mem element(const ir::Instruction* ptradd);
+        bool foldsIntoAddress(const ir::Instruction* insn) const;
+        uint32_t target(ir::Block* from, ir::Block* to) const;
+
+        Module& m_;
+        ir::Module& source_;
+        std::unordered_map<const ir::Function*, uint32_t> symbols_;
+        uint32_t globals_ = 0;                                                  // Symbol of the first global
+        uint32_t strings_ = 0;                                                  // Symbol of the first string
+
+        // Per function
+        Function* f_ = nullptr;
+        Block* b_ = nullptr;
+        ir::Block* block_ = nullptr;
+        std::unordered_map<const ir::Value*, uint32_t> regs_;
+        std::unordered_map<const ir::Instruction*, int32_t> slots_;            // Frame offsets of the allocas
+        std::unordered_map<const ir::Block*, uint32_t> blocks_;
+        std::map<std::pair<const ir::Block*, const ir::Block*>, uint32_t> edges_;  // Blocks of critical edges
+        std::unordered_set<const ir::Instruction*> fused_;                      // Compares emitted by their branch
+};
+
+void Selector::unit() {
+    for (auto& fn : source_.functions) {
+        symbols_[fn.get()] = m_.symbols.size();
+        m_.symbols.push_back({fn->isExternal() ? Symbol::Kind::External : Symbol::Kind::Function, fn->name()});
+    }
+    globals_ = m_.symbols.size();
+    for (auto& global : source_.globals) m_.symbols.push_back({Symbol::Kind::Global, global.name, global.size, global.align});
+    strings_ = m_.symbols.size();
+    for (auto& string : source_.strings) m_.symbols.push_back({Symbol::Kind::String, string, string.size() + 1, 1});
+
+    for (auto& fn : source_.functions) {
+        if (fn->isExternal()) continue;
+        Function f;
+        f.symbol = symbols_[fn.get()];
+        function(*fn, f);
+        m_.functions.push_back(std::move(f));
+    }
+}
+
+void Selector::function(ir::Function& fn, Function& f) {
+    f_ = &f;
+    regs_.clear();
+    slots_.clear();
+    blocks_.clear();
+    edges_.clear();
+    fused_.clear();
+
+    ir::AnalysisManager am;
+    auto order = ir::blockLayout(fn, am);
+    uint32_t n = 0;
+    for (auto block : order) {
+        blocks_[block] = n++;
+        auto succs = block->successors();
+        if (succs.size() < 2) continue;
+        for (auto succ : succs)
+            if (succ->preds.size() > 1 && !edges_.count({block, succ})) edges_[{block, succ}] = n++;
+    }
+    f.blocks.resize(n);
+
+    for (auto block : order) {
+        for (auto& insn : block->instructions()) {
+            if (insn->op() == ir::Op::Alloca) {
+                int32_t size = insn->imm();
+                int32_t align = size >= 8 ? 8 : size >= 4 ? 4 : size >= 2 ? 2 : 1;
+                f.locals = (f.locals + size + align - 1) / align * align;
+                slots_[insn.get()] = -f.locals;
+            }
+        }
+        auto term = block->terminator();
+        auto cond = term->op() == ir::Op::CondBr ? asInstruction(term->operand(0)) : nullptr;
+        if (cond && isComparison(cond->op()) && cond->parent() == block && cond->users().size() == 1) fused_.insert(cond);
+    }
+
+    for (auto block : order) {
+        block_ = block;
+        b_ = &f.blocks[blocks_[block]];
+        if (block == fn.entry()) {
+            for (auto& arg : fn.args()) {
+                if (arg->users().empty()) continue;
+                size_t i = arg->index();
+                Operand from = i < 6 ? Operand::r(x86::arg_regs[i]) : Operand::m({x86::RBP, noReg, 1, false, -1, int32_t(16 + 8 * (i - 6))});
+                if (arg->ty() == ir::Ty::I8) emit(Opc::MovSX8, x86::W32, Operand::r(reg(arg.get())), from);
+                else emit(Opc::Mov, widthOf(arg->ty()), Operand::r(reg(arg.get())), from);
+            }
+        }
+        if (block->preds.size() == 1) phis(block->preds[0], block);
+        for (auto& insn : block->instructions()) instruction(insn.get());
+    }
+    f.linkBlocks();
+}
+
+uint32_t Selector::target(ir::Block* from, ir::Block* to) const {
+    auto edge = edges_.find({from, to});
+    return edge != edges_.end() ? edge->second : blocks_.at(to);
+}
+
+void Selector::emit(Opc opc, Width w, Operand a, Operand b, int64_t imm) {
+    Inst inst;
+    inst.opc = opc;
+    inst.w = w;
+    inst.a = a;
+    inst.b = b;
+    inst.imm = imm;
+    b_->insts.push_back(inst);
+}
+
+/// Register holding @p value; constants and addresses are materialised where they are needed.
+uint32_t Selector::reg(const ir::Value* value) {
+    if (auto constant = asConstant(value)) {
+        uint32_t r = f_->newReg();
+        emit(Opc::Mov, fitsImm(constant->value()) ? widthOf(value->ty()) : x86::W64, Operand::r(r), Operand::i(constant->value()));
+        return r;
+    }
+    if (auto insn = asInstruction(value)) {
+        auto op = insn->op();
+        if (op == ir::Op::Alloca || op == ir::Op::Global || op == ir::Op::String || (op == ir::Op::PtrAdd && foldsIntoAddress(insn))) {
+            uint32_t r = f_->newReg();
+            emit(Opc::Lea, x86::W64, Operand::r(r), Operand::m(address(value)));
+            return r;
+        }
+    }
+    auto [it, added] = regs_.emplace(value, 0);
+    if (added) it->second = f_->newReg();
+    return it->second;
+}
+
+/// @p value as an immediate if it is a small enough constant, else in a register.
+Operand Selector::use(const ir::Value* value) {
+    auto constant = asConstant(value);
+    if (constant && fitsImm(constant->value())) return Operand::i(constant->value());
+    return Operand::r(reg(value));
+}
+
+/// Memory operand for the object @p pointer points to.
+Mem Selector::address(const ir::Value* pointer) {
+    if (auto insn = asInstruction(pointer)) {
+        switch (insn->op()) {
+            case ir::Op::Alloca:    return {x86::RBP, noReg, 1, true, -1, slots_.at(insn)};
+            case ir::Op::Global:    return {noReg, noReg, 1, false, int32_t(globals_ + insn->imm()), 0};
+            case ir::Op::String:    return {noReg, noReg, 1, false, int32_t(strings_ + insn->imm()), 0};
+            case ir::Op::PtrAdd:    if (foldsIntoAddress(insn)) return element(insn); break;
+            default:                break;
+        }
+    }
+    Mem mem;
+    mem.base = reg(pointer);
+    return mem;
+}
+
+/// Address computed by @p ptradd: a constant index goes into the displacement, a variable one into the index
+/// register, sign-extended and scaled.
+Mem Selector::element(const ir::Instruction* ptradd) {
+    Mem mem = address(ptradd->operand(0));
+    int64_t scale = ptradd->imm();
+    auto index = asConstant(ptradd->operand(1));
+    if (index != nullptr && fitsImm(mem.disp + index->value() * scale)) {
+        mem.disp += index->value() * scale;
+        return mem;
+    }
+    if (mem.index != noReg || mem.base == noReg) {                      // Rip-relative addresses take no index
+        uint32_t base = f_->newReg();
+        emit(Opc::Lea, x86::W64, Operand::r(base), Operand::m(mem));
+        mem = Mem();
+        mem.base = base;
+    }
+    uint32_t r = f_->newReg();
+    emit(Opc::MovSXD, x86::W64, Operand::r(r), Operand::r(reg(ptradd->operand(1))));
+    if (scale == 1 || scale == 2 || scale == 4 || scale == 8) {
+        mem.scale = scale;
+    } else {
+        emit(Opc::Imul3, x86::W64, Operand::r(r), Operand::r(r), scale);
+    }
+    mem.index = r;
+    return mem;
+}
+
+/// Is @p insn a pointer addition used only as the address of loads, stores and copies?
+bool Selector::foldsIntoAddress(const ir::Instruction* insn) const {
+    if (insn->op() != ir::Op::PtrAdd) return false;
+    for (auto user : insn->users()) {
+        if (user->op() != ir::Op::Load && user->op() != ir::Op::Store && user->op() != ir::Op::Copy) return false;
+        if (user->op() == ir::Op::Store && user->operand(1) == insn) return false;                  // Stored, not an address
+    }
+    return true;
+}
+
+
+//! =================================================
+//! ================== Instructions =================
+//! =================================================
+
+void Selector::instruction(ir::Instruction* insn) {
+    if (!insn->hasSideEffects() && insn->users().empty()) return;
+    switch (insn->op()) {
+        case ir::Op::Add: case ir::Op::Sub: case ir::Op::Mul: case ir::Op::And: case ir::Op::Or: case ir::Op::Xor:
+            return binary(insn);
+        case ir::Op::SDiv: case ir::Op::SRem:
+            return divide(insn);
+        case ir::Op::Shl: case ir::Op::AShr:
+            return shift(insn);
+        case ir::Op::Eq: case ir::Op::Ne: case ir::Op::Lt: case ir::Op::Le: case ir::Op::Gt: case ir::Op::Ge: {
+            if (fused_.count(insn)) return;
+            Cond cond = compare(insn);
+            emit(Opc::Set, x86::W32, Operand::r(reg(insn)));
+            b_->insts.back().cond = cond;
+            return;
+        }
+        case ir::Op::SExt:                                              // Chars are kept sign-extended
+            return emit(Opc::Mov, x86::W32, Operand::r(reg(insn)), Operand::r(reg(insn->operand(0))));
+        case ir::Op::Trunc:
+            return emit(Opc::MovSX8, x86::W32, Operand::r(reg(insn)), Operand::r(reg(insn->operand(0))));
+        case ir::Op::PtrAdd:
+            if (!foldsIntoAddress(insn)) emit(Opc::Lea, x86::W64, Operand::r(reg(insn)), Operand::m(element(insn)));
+            return;
+        case ir::Op::PtrDiff: {
+            uint32_t d = reg(insn);
+            emit(Opc::Mov, x86::W64, Operand::r(d), Operand::r(reg(insn->operand(0))));
+            emit(Opc::Sub, x86::W64, Operand::r(d), use(insn->operand(1)));
+            int64_t size = insn->imm();
+            if (size > 1 && (size & (size - 1)) == 0) {
+                int shift = 0;
+                while ((int64_t(1) << shift) != size) shift++;
+                emit(Opc::Sar, x86::W64, Operand::r(d), Operand::i(shift));
+            } else if (size > 1) {
+                uint32_t divisor = f_->newReg();
+                emit(Opc::Mov, x86::W64, Operand::r(divisor), Operand::i(size));
+                emit(Opc::Mov, x86::W64, Operand::r(x86::RAX), Operand::r(d));
+                emit(Opc::Cdq, x86::W64);
+                emit(Opc::Idiv, x86::W64, Operand::r(divisor));
+                emit(Opc::Mov, x86::W64, Operand::r(d), Operand::r(x86::RAX));
+            }
+            return;
+        }
+        case ir::Op::Alloca: case ir::Op::Global: case ir::Op::String: case ir::Op::Phi:
+            return;                                                     // Folded into their users, or copies
+        case ir::Op::Load: {
+            Operand from = Operand::m(address(insn->operand(0)));
+            if (insn->ty() == ir::Ty::I8) emit(Opc::MovSX8, x86::W32, Operand::r(reg(insn)), from);
+            else emit(Opc::Mov, widthOf(insn->ty()), Operand::r(reg(insn)), from);
+            return;
+        }
+        case ir::Op::Store: {
+            Mem to = address(insn->operand(0));
+            auto value = insn->operand(1);
+            return emit(Opc::Mov, value->ty() == ir::Ty::I8 ? x86::W8 : widthOf(value->ty()), Operand::m(to), use(value));
+        }
+        case ir::Op::Copy:
+            return copy(insn);
+        case ir::Op::Call:
+            return call(insn);
+        case ir::Op::Br: case ir::Op::CondBr:
+            return branch(insn);
+        case ir::Op::Ret:
+            if (insn->num_operands() == 0) return emit(Opc::Ret, x86::W64);
+            emit(Opc::Mov, widthOf(insn->operand(0)->ty()), Operand::r(x86::RAX), use(insn->operand(0)));
+            emit(Opc::Ret, x86::W64);
+            b_->insts.back().uses = bit(x86::RAX);
+            return;
+    }
+}
+
+void Selector::binary(ir::Instruction* insn) {
+    auto a = insn->operand(0), b = insn->operand(1);
+    auto op = insn->op();
+    if (op != ir::Op::Sub && asConstant(a) && !asConstant(b)) std::swap(a, b);
+    Width w = widthOf(insn->ty());
+    Operand d = Operand::r(reg(insn));
+    auto constant = asConstant(b);
+    if (op == ir::Op::Mul && constant && fitsImm(constant->value()))
+        return emit(Opc::Imul3, w, d, Operand::r(reg(a)), constant->value());
+    if (op == ir::Op::Sub && asConstant(a) && asConstant(a)->value() == 0) {
+        emit(Opc::Mov, w, d, use(b));
+        return emit(Opc::Neg, w, d);
+    }
+    if (op == ir::Op::Xor && constant && constant->value() == -1) {
+        emit(Opc::Mov, w, d, use(a));
+        return emit(Opc::Not, w, d);
+    }
+    Opc opc;
+    switch (op) {
+        case ir::Op::Add:   opc = Opc::Add; break;
+        case ir::Op::Sub:   opc = Opc::Sub; break;
+        case ir::Op::Mul:   opc = Opc::Imul; break;
+        case ir::Op::And:   opc = Opc::And; break;
+        case ir::Op::Or:    opc = Opc::Or; break;
+        default:            opc = Opc::Xor; break;
+    }
+    emit(Opc::Mov, w, d, use(a));
+    emit(opc, w, d, opc == Opc::Imul ? Operand::r(reg(b)) : use(b));
+}
+
+void Selector::divide(ir::Instruction* insn) {
+    emit(Opc::Mov, x86::W32, Operand::r(x86::RAX), use(insn->operand(0)));
+    emit(Opc::Cdq, x86::W32);
+    emit(Opc::Idiv, x86::W32, Operand::r(reg(insn->operand(1))));
+    emit(Opc::Mov, x86::W32, Operand::r(reg(insn)), Operand::r(insn->op() == ir::Op::SDiv ? x86::RAX : x86::RDX));
+}
+
+void Selector::shift(ir::Instruction* insn) {
+    Opc opc = insn->op() == ir::Op::Shl ? Opc::Shl : Opc::Sar;
+    Operand d = Operand::r(reg(insn));
+    emit(Opc::Mov, x86::W32, d, use(insn->operand(0)));
+    if (auto count = asConstant(insn->operand(1))) return emit(opc, x86::W32, d, Operand::i(count->value() & 31));
+    emit(Opc::Mov, x86::W32, Operand::r(x86::RCX), use(insn->operand(1)));
+    emit(opc, x86::W32, d, Operand::r(x86::RCX));
+}
+
+/// Sets the flags for the comparison @p insn and returns the condition under which it holds.
+Cond Selector::compare(const ir::Instruction* insn) {
+    auto a = insn->operand(0), b = insn->operand(1);
+    Cond cond = condition(insn->op(), a->ty() == ir::Ty::Ptr);
+    if (asConstant(a) && !asConstant(b)) {
+        std::swap(a, b);
+        cond = swapped(cond);
+    }
+    Width w = widthOf(a->ty());
+    Operand lhs = Operand::r(reg(a)), rhs = use(b);
+    if (rhs.isImm() && rhs.imm == 0 && cond != x86::B && cond != x86::BE && cond != x86::A && cond != x86::AE) emit(Opc::Test, w, lhs, lhs);
+    else emit(Opc::Cmp, w, lhs, rhs);
+    return cond;
+}
+
+void Selector::call(ir::Instruction* insn) {
+    size_t n = insn->num_operands();
+    std::vector<Copy> regs;
+    for (size_t i = 0; i < n; i++) {
+        auto arg = insn->operand(i);
+        if (i < 6) regs.push_back({x86::arg_regs[i], use(arg), widthOf(arg->ty())});
+        else emit(Opc::Mov, widthOf(arg->ty()), Operand::m({x86::RSP, noReg, 1, false, -1, int32_t(8 * (i - 6))}), use(arg));
+    }
+    if (n > 6) f_->outgoing = std::max<int32_t>(f_->outgoing, 8 * (n - 6));
+
+    uint32_t uses = 0;
+    for (auto& copy : regs) {
+        emit(Opc::Mov, copy.w, Operand::r(copy.dst), copy.src);
+        uses |= bit(x86::Reg(copy.dst));
+    }
+    if (insn->callee()->isExternal()) {                                 // No vector registers for variadic ones
+        emit(Opc::Mov, x86::W32, Operand::r(x86::RAX), Operand::i(0));
+        uses |= bit(x86::RAX);
+    }
+    emit(Opc::Call, x86::W64);
+    b_->insts.back().target = symbols_.at(insn->callee());
+    b_->insts.back().uses = uses;
+
+    if (insn->users().empty()) return;
+    if (insn->ty() == ir::Ty::I8) emit(Opc::MovSX8, x86::W32, Operand::r(reg(insn)), Operand::r(x86::RAX));
+    else emit(Opc::Mov, widthOf(insn->ty()), Operand::r(reg(insn)), Operand::r(x86::RAX));
+}
+
+/// Struct assignment: small ones move through a register, larger ones use rep movsb.
+void Selector::copy(ir::Instruction* insn) {
+    Mem to = address(insn->operand(0)), from = address(insn->operand(1));
+    int32_t size = insn->imm();
+    if (size > 64) {
+        emit(Opc::Lea, x86::W64, Operand::r(x86::RDI), Operand::m(to));
+        emit(Opc::Lea, x86::W64, Operand::r(x86::RSI), Operand::m(from));
+        emit(Opc::Mov, x86::W64, Operand::r(x86::RCX), Operand::i(size));
+        return emit(Opc::Movs, x86::W64);
+    }
+    for (int32_t offset = 0; offset < size;) {
+        int32_t chunk = size - offset >= 8 ? 8 : size - offset >= 4 ? 4 : 1;
+        Mem src = from, dst = to;
+        src.disp += offset;
+        dst.disp += offset;
+        uint32_t r = f_->newReg();
+        if (chunk == 1) emit(Opc::MovSX8, x86::W32, Operand::r(r), Operand::m(src));
+        else emit(Opc::Mov, chunk == 8 ? x86::W64 : x86::W32, Operand::r(r), Operand::m(src));
+        emit(Opc::Mov, chunk == 8 ? x86::W64 : chunk == 4 ? x86::W32 : x86::W8, Operand::m(dst), Operand::r(r));
+        offset += chunk;
+    }
+}
+
+void Selector::branch(ir::Instruction* term) {
+    if (term->op() == ir::Op::Br) {
+        ir::Block* to = term->block(0);
+        if (to->preds.size() > 1) phis(block_, to);
+        emit(Opc::Jmp, x86::W64);
+        b_->insts.back().target = target(block_, to);
+        return;
+    }
+
+    Cond cond = x86::NE;
+    auto value = term->operand(0);
+    if (fused_.count(asInstruction(value))) {
+        cond = compare(asInstruction(value));
+    } else {
+        Operand r = Operand::r(reg(value));
+        emit(Opc::Test, widthOf(value->ty()), r, r);
+    }
+    emit(Opc::Jcc, x86::W64);
+    b_->insts.back().cond = cond;
+    b_->insts.back().target = target(block_, term->block(0));
+    emit(Opc::Jmp, x86::W64);
+    b_->insts.back().target = target(block_, term->block(1));
+
+    // The blocks of critical edges hold the copies of the phis
+    Block* current = b_;
+    for (size_t i = 0; i < 2; i++) {
+        ir::Block* to = term->block(i);
+        auto edge = edges_.find({block_, to});
+        if (edge == edges_.end() || (i == 1 && to == term->block(0))) continue;
+        b_ = &f_->blocks[edge->second];
+        phis(block_, to);
+        emit(Opc::Jmp, x86::W64);
+        b_->insts.back().target = blocks_.at(to);
+    }
+    b_ = current;
+}
+
+/// Copies the operands of the phis of @p to that come from @p from into the registers of the phis.
+void Selector::phis(ir::Block* from, ir::Block* to) {
+    std::vector<Copy> moves;
+    for (auto& insn : to->instructions()) {
+        if (insn->op() != ir::Op::Phi) break;
+        if (insn->users().empty()) continue;
+        for (size_t i = 0; i < insn->num_operands(); i++) {
+            if (insn->block(i) != from) continue;
+            moves.push_back({reg(insn.get()), use(insn->operand(i)), widthOf(insn->ty())});
+            break;
+        }
+    }
+    copies(std::move(moves));
+}
+
+/// Sequentialises the parallel copy @p moves: a move waits until no other one reads its destination, and a cycle
+/// is broken by saving one destination in a new register.
+void Selector::copies(std::vector<Copy> moves) {
+    auto read = [&](uint32_t r, size_t except) {
+        for (size_t i = 0; i < moves.size(); i++)
+            if (i != except && moves[i].src.isReg() && moves[i].src.reg == r) return true;
+        return false;
+    };
+    while (!moves.empty()) {
+        size_t i = 0;
+        while (i < moves.size() && read(moves[i].dst, i)) i++;
+        if (i == moves.size()) {
+            uint32_t saved = f_->newReg();
+            emit(Opc::Mov, x86::W64, Operand::r(saved), Operand::r(moves[0].dst));
+            for (auto& move : moves) if (move.src.isReg() && move.src.reg == moves[0].dst) move.src.reg = saved;
+            i = 0;
+        }
+        emit(Opc::Mov, moves[i].w, Operand::r(moves[i].dst), moves[i].src);
+        moves.erase(moves.begin() + i);
+    }
+}
+
+}
+
+Module select(ir::Module& module) {
+    Module m;
+    Selector(m, module).unit();
+    return m;
+}
+
+}
@@ -0,0 +1,680 @@
+#include "mir.h"
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <map>
+
+namespace H::mir {
+
+namespace {
+
+using x86::Reg;
+
+constexpr uint32_t never = UINT32_MAX;
+
+/// Registers handed out, caller-saved ones first; rsp and rbp hold the frame, and r11 is kept free for the moves
+/// that connect the parts of split intervals.
+constexpr Reg allocatable[] = {x86::RAX, x86::RCX, x86::RDX, x86::RSI, x86::RDI, x86::R8, x86::R9, x86::R10,
+                               x86::RBX, x86::R12, x86::R13, x86::R14, x86::R15};
+constexpr Reg scratch = x86::R11;
+
+bool isAllocatable(uint32_t reg) { return reg < firstVirtual && reg != x86::RSP && reg != x86::RBP && reg != scratch; }
+bool isTracked(uint32_t reg) { return isVirtual(reg) || isAllocatable(reg); }
+bool isCalleeSaved(uint32_t reg) { return (callerSaved & (1u << reg)) == 0; }
+
+enum class Role : uint8_t { Use, Def, UseDef };
+
+/// Calls @p f(reg, role) for the registers @p inst reads and writes, explicitly or implied by the instruction.
+template<class F>
+void forEachReg(Inst& inst, F f) {
+    auto operand = [&](Operand& o, Role role) {
+        if (o.isReg()) {
+            f(o.reg, role);
+        } else if (o.isMem()) {
+            if (o.mem.base != noReg) f(o.mem.base, Role::Use);
+            if (o.mem.index != noReg) f(o.mem.index, Role::Use);
+        }
+    };
+    auto implicit = [&](Reg r, Role role) { uint32_t reg = r; f(reg, role); };
+    auto mask = [&](uint32_t regs, Role role) { for (uint32_t r = 0; r < firstVirtual; r++) if (regs & (1u << r)) implicit(Reg(r), role); };
+    switch (inst.opc) {
+        case Opc::Mov: case Opc::MovSX8: case Opc::MovSXD: case Opc::Lea: case Opc::Imul3: case Opc::Set:
+            operand(inst.b, Role::Use);
+            operand(inst.a, Role::Def);
+            break;
+        case Opc::Add: case Opc::Sub: case Opc::And: case Opc::Or: case Opc::Xor: case Opc::Imul: case Opc::Shl: case Opc::Sar:
+            operand(inst.b, Role::Use);
+            operand(inst.a, Role::UseDef);
+            break;
+        case Opc::Neg: case Opc::Not:
+            operand(inst.a, Role::UseDef);
+            break;
+        case Opc::Cmp: case Opc::Test:
+            operand(inst.a, Role::Use);
+            operand(inst.b, Role::Use);
+            break;
+        case Opc::Cdq:
+            implicit(x86::RAX, Role::Use);
+            implicit(x86::RDX, Role::Def);
+            break;
+        case Opc::Idiv:
+            operand(inst.a, Role::Use);
+            implicit(x86::RAX, Role::UseDef);
+            implicit(x86::RDX, Role::UseDef);
+            break;
+        case Opc::Movs:
+            mask(bit(x86::RDI) | bit(x86::RSI) | bit(x86::RCX), Role::UseDef);
+            break;
+        case Opc::Call:
+            mask(inst.uses, Role::Use);
+            mask(callerSaved, Role::Def);
+            break;
+        case Opc::Ret:
+            mask(inst.uses, Role::Use);
+            break;
+        case Opc::Jmp: case Opc::Jcc:
+            break;
+    }
+}
+
+//! =================================================
+//! ================ Live Intervals =================
+//! =================================================
+//
+// Instruction k of the function (counting through the blocks in layout order) is at position 2k: it reads its
+// operands at 2k and writes its results at 2k + 1, so a result may take the register of an operand that dies.
+// Intervals are only split at even positions, where the moves between their parts go before the instruction.
+
+struct Range {
+    uint32_t from;
+    uint32_t to;                                                        // Exclusive
+};
+
+struct Interval {
+    uint32_t reg = noReg;                                               // Virtual register, or the physical one of a fixed interval
+    std::vector<Range> ranges;                                          // Sorted and disjoint
+    std::vector<uint32_t> uses;                                         // Sorted positions that need a register
+    uint32_t assigned = noReg;                                          // Physical register, none while in the stack slot
+    uint32_t hint = noReg;                                              // Register it is moved from or to
+    Interval* parent = nullptr;                                         // Interval it was split from
+    std::vector<Interval*> parts;                                       // Of the parent: itself and its split children by start
+    bool spilled = false;                                               // Of the parent: some part lives in the stack slot
+    int32_t slot = -1;                                                  // Of the parent: frame offset of the stack slot
+
+    uint32_t start() const { return ranges.front().from; }
+    uint32_t end() const { return ranges.back().to; }
+
+    bool covers(uint32_t pos) const {
+        auto it = std::upper_bound(ranges.begin(), ranges.end(), pos, [](uint32_t p, const Range& r) { return p < r.to; });
+        return it != ranges.end() && it->from <= pos;
+    }
+    uint32_t nextUse(uint32_t pos) const {
+        auto it = std::lower_bound(uses.begin(), uses.end(), pos);
+        return it != uses.end() ? *it : never;
+    }
+    /// Adds [@p from, @p to) while the ranges are built backwards (latest first).
+    void addRange(uint32_t from, uint32_t to) {
+        if (!ranges.empty() && ranges.back().from <= to) {
+            ranges.back().from = std::min(ranges.back().from, from);
+            ranges.back().to = std::max(ranges.back().to, to);
+        } else {
+            ranges.push_back({from, to});
+        }
+    }
+};
+
+/// First position covered by both @p a and @p b, from the start of @p b on.
+uint32_t intersect(const Interval& a, const Interval& b) {
+    if (a.ranges.empty()) return never;
+    auto i = std::upper_bound(a.ranges.begin(), a.ranges.end(), b.start(), [](uint32_t p, const Range& r) { return p < r.to; });
+    auto j = b.ranges.begin();
+    while (i != a.ranges.end() && j != b.ranges.end()) {
+        if (i->to <= j->from) ++i;
+        else if (j->to <= i->from) ++j;
+        else return std::max(i->from, j->from);
+    }
+    return never;
+}
+
+/// A move between the places of a value, in physical registers and stack slots.
+struct Move {
+    Operand dst;
+    Operand src;
+};
+
+bool sameLocation(const Operand& a, const Operand& b) {
+    if (a.kind != b.kind) return false;
+    return a.isReg() ? a.reg == b.reg : a.mem.disp == b.mem.disp;
+}
+
+class LinearScan {
+    public:
+        LinearScan(Function& function, AllocationStats& stats)
+            : f_(function)
+            , stats_(stats)
+        {}
+
+        void run();
+
+    private:
+        void liveness();
+        void buildIntervals();
+        void allocate();
+        bool tryAllocateFree(Interval* current);
+        void allocateBlocked(Interval* current);
+        Interval* split(Interval* it, uint32_t pos);
+        void splitAndSpill(Interval* it, uint32_t pos);
+        void spill(Interval* it);
+        void schedule(Interval* it);
+        uint32_t hintFor(const Interval* it) const;
+        void assignSlots();
+        Interval* partAt(uint32_t reg, uint32_t pos) const;
+        Operand location(const Interval* part) const;
+        void rewrite();
+        void sequentialize(std::vector<Move> moves, std::vector<Inst>& out);
+
+        bool live(const std::vector<uint64_t>& set, uint32_t reg) const { return set[reg / 64] >> (reg % 64) & 1; }
+
+        Function& f_;
+        AllocationStats& stats_;
+        std::vector<uint32_t> blockFrom_;                                       // Position of the first instruction
+        std::vector<uint32_t> blockTo_;                                         // After the last one
+        std::vector<std::vector<uint64_t>> liveIn_;
+        std::vector<std::vector<uint64_t>> liveOut_;
+        std::deque<Interval> storage_;
+        std::vector<Interval*> intervals_;                                      // Whole interval of every register
+        std::vector<Interval*> unhandled_;                                      // By decreasing start
+        std::vector<Interval*> active_;
+        std::vector<Interval*> inactive_;
+        uint32_t position_ = 0;
+        uint32_t usedCalleeSaved_ = 0;
+};
+
+void LinearScan::run() {
+    uint32_t pos = 0;
+    for (auto& block : f_.blocks) {
+        blockFrom_.push_back(pos);
+        pos += 2 * block.insts.size();
+        blockTo_.push_back(pos);
+    }
+    liveness();
+    buildIntervals();
+    allocate();
+    assignSlots();
+    rewrite();
+    for (Reg r : allocatable) if (usedCalleeSaved_ & (1u << r)) f_.saved.push_back(r);
+}
+
+void LinearScan::liveness() {
+    size_t n = f_.blocks.size(), words = (f_.num_regs + 63) / 64;
+    std::vector<std::vector<uint64_t>> gen(n, std::vector<uint64_t>(words)), kill(n, std::vector<uint64_t>(words));
+    for (size_t b = 0; b < n; b++) {
+        for (auto& inst : f_.blocks[b].insts) {
+            std::vector<uint32_t> defs;
+            forEachReg(inst, [&](uint32_t& r, Role role) {
+                if (!isTracked(r)) return;
+                if (role != Role::Def && !(kill[b][r / 64] >> (r % 64) & 1)) gen[b][r / 64] |= uint64_t(1) << (r % 64);
+                if (role != Role::Use) defs.push_back(r);
+            });
+            for (uint32_t r : defs) kill[b][r / 64] |= uint64_t(1) << (r % 64);
+        }
+    }
+
+    liveIn_.assign(n, std::vector<uint64_t>(words));
+    liveOut_.assign(n, std::vector<uint64_t>(words));
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t b = n; b-- > 0;) {
+            std::vector<uint64_t> out(words);
+            for (uint32_t succ : f_.blocks[b].succs) for (size_t w = 0; w < words; w++) out[w] |= liveIn_[succ][w];
+            for (size_t w = 0; w < words; w++) {
+                uint64_t in = gen[b][w] | (out[w] & ~kill[b][w]);
+                if (in != liveIn_[b][w]) changed = true;
+                liveIn_[b][w] = in;
+            }
+            liveOut_[b] = std::move(out);
+        }
+    }
+}
+
+void LinearScan::buildIntervals() {
+    intervals_.assign(f_.num_regs, nullptr);
+    for (uint32_t r = 0; r < f_.num_regs; r++) {
+        if (!isTracked(r)) continue;
+        storage_.emplace_back();
+        intervals_[r] = &storage_.back();
+        intervals_[r]->reg = r;
+    }
+
+    for (size_t b = f_.blocks.size(); b-- > 0;) {
+        uint32_t from = blockFrom_[b], to = blockTo_[b];
+        std::vector<uint64_t> liveNow = liveOut_[b];
+        for (uint32_t r = 0; r < f_.num_regs; r++) if (live(liveNow, r)) intervals_[r]->addRange(from, to);
+
+        auto& insts = f_.blocks[b].insts;
+        for (size_t i = insts.size(); i-- > 0;) {
+            uint32_t pos = from + 2 * i;
+            std::vector<uint32_t> defs, uses;
+            forEachReg(insts[i], [&](uint32_t& r, Role role) {
+                if (!isTracked(r)) return;
+                if (role != Role::Use) defs.push_back(r);
+                if (role != Role::Def) uses.push_back(r);
+            });
+            for (uint32_t r : defs) {
+                Interval* it = intervals_[r];
+                if (live(liveNow, r)) it->ranges.back().from = pos + 1;
+                else it->addRange(pos + 1, pos + 2);
+                if (isVirtual(r)) it->uses.push_back(pos + 1);
+                liveNow[r / 64] &= ~(uint64_t(1) << (r % 64));
+            }
+            for (uint32_t r : uses) {
+                intervals_[r]->addRange(from, pos + 1);
+                if (isVirtual(r)) intervals_[r]->uses.push_back(pos);
+                liveNow[r / 64] |= uint64_t(1) << (r % 64);
+            }
+        }
+    }
+
+    for (auto& it : storage_) {
+        std::reverse(it.ranges.begin(), it.ranges.end());
+        std::reverse(it.uses.begin(), it.uses.end());
+        it.uses.erase(std::unique(it.uses.begin(), it.uses.end()), it.uses.end());
+        it.parts.push_back(&it);
+    }
+
+    // A register moved from or to another one prefers it
+    for (auto& block : f_.blocks) {
+        for (auto& inst : block.insts) {
+            if (inst.opc != Opc::Mov || !inst.a.isReg() || !inst.b.isReg()) continue;
+            uint32_t a = inst.a.reg, b = inst.b.reg;
+            if (isVirtual(a) && intervals_[a]->hint == noReg) intervals_[a]->hint = b;
+            if (isVirtual(b) && !isVirtual(a) && intervals_[b]->hint == noReg) intervals_[b]->hint = a;
+        }
+    }
+}
+
+
+//! =================================================
+//! ================== Allocation ===================
+//! =================================================
+
+void LinearScan::allocate() {
+    for (uint32_t r = firstVirtual; r < f_.num_regs; r++)
+        if (!intervals_[r]->ranges.empty()) unhandled_.push_back(intervals_[r]);
+    std::sort(unhandled_.begin(), unhandled_.end(), [](Interval* a, Interval* b) { return a->start() > b->start(); });
+    stats_.intervals += unhandled_.size();
+
+    while (!unhandled_.empty()) {
+        Interval* current = unhandled_.back();
+        unhandled_.pop_back();
+        position_ = current->start();
+
+        for (size_t i = 0; i < active_.size();) {
+            Interval* it = active_[i];
+            if (it->end() <= position_ || !it->covers(position_)) {
+                active_.erase(active_.begin() + i);
+                if (it->end() > position_) inactive_.push_back(it);
+            } else {
+                i++;
+            }
+        }
+        for (size_t i = 0; i < inactive_.size();) {
+            Interval* it = inactive_[i];
+            if (it->end() <= position_ || it->covers(position_)) {
+                inactive_.erase(inactive_.begin() + i);
+                if (it->end() > position_) active_.push_back(it);
+            } else {
+                i++;
+            }
+        }
+
+        if (!tryAllocateFree(current)) allocateBlocked(current);
+        if (current->assigned != noReg) {
+            active_.push_back(current);
+            if (isCalleeSaved(current->assigned)) usedCalleeSaved_ |= 1u << current->assigned;
+        }
+    }
+}
+
+/// Register @p it would like: the one of the interval it is moved from or to, else the one of its previous part.
+uint32_t LinearScan::hintFor(const Interval* it) const {
+    uint32_t hint = it->hint;
+    if (hint == noReg && it->parent != nullptr) {
+        auto& parts = it->parent->parts;
+        auto self = std::find(parts.begin(), parts.end(), it);
+        if (self != parts.begin()) return (*(self - 1))->assigned;
+    }
+    if (!isVirtual(hint)) return hint;
+    Interval* part = partAt(hint, it->start() - 1);
+    return part != nullptr ? part->assigned : noReg;
+}
+
+/// Gives @p current a register that is free at its start: for its whole lifetime if possible, preferring its hint,
+/// then the caller-saved registers and callee-saved ones that are saved anyway; else for as long as possible, and
+/// the rest is split off.
+bool LinearScan::tryAllocateFree(Interval* current) {
+    uint32_t freeUntil[firstVirtual] = {};
+    for (Reg r : allocatable) freeUntil[r] = never;
+    for (Interval* it : active_) freeUntil[it->assigned] = 0;
+    for (Interval* it : inactive_) freeUntil[it->assigned] = std::min(freeUntil[it->assigned], intersect(*it, *current));
+    for (Reg r : allocatable) freeUntil[r] = std::min(freeUntil[r], intersect(*intervals_[r], *current));
+
+    uint32_t end = current->end(), hint = hintFor(current), reg = noReg;
+    if (hint != noReg && isAllocatable(hint) && freeUntil[hint] >= end) reg = hint;
+    for (int pass = 0; pass < 2 && reg == noReg; pass++) {
+        for (Reg r : allocatable) {
+            bool cheap = !isCalleeSaved(r) || (usedCalleeSaved_ & (1u << r));
+            if (freeUntil[r] >= end && (cheap || pass == 1)) {
+                reg = r;
+                break;
+            }
+        }
+    }
+    if (reg == noReg) {
+        reg = allocatable[0];
+        for (Reg r : allocatable) if (freeUntil[r] > freeUntil[reg]) reg = r;
+        if (hint != noReg && isAllocatable(hint) && freeUntil[hint] == freeUntil[reg]) reg = hint;
+        uint32_t pos = freeUntil[reg] & ~1u;
+        if (pos <= current->start()) return false;
+        schedule(split(current, pos));
+    }
+    current->assigned = reg;
+    return true;
+}
+
+/// No register is free at the start of @p current: the one whose next use is furthest away is taken from the
+/// intervals holding it, unless @p current itself is used even later, in which case it waits in its stack slot.
+void LinearScan::allocateBlocked(Interval* current) {
+    uint32_t start = current->start() & ~1u;
+    uint32_t nextUse[firstVirtual] = {}, blockedAt[firstVirtual] = {};
+    for (Reg r : allocatable) nextUse[r] = blockedAt[r] = never;
+    for (Interval* it : active_) nextUse[it->assigned] = std::min(nextUse[it->assigned], it->nextUse(start));
+    for (Interval* it : inactive_)
+        if (intersect(*it, *current) != never) nextUse[it->assigned] = std::min(nextUse[it->assigned], it->nextUse(start));
+    for (Reg r : allocatable) {
+        blockedAt[r] = intersect(*intervals_[r], *current);
+        nextUse[r] = std::min(nextUse[r], blockedAt[r]);
+    }
+
+    Reg reg = allocatable[0];
+    for (Reg r : allocatable) if (nextUse[r] > nextUse[reg]) reg = r;
+    uint32_t firstUse = current->nextUse(current->start());
+    if (firstUse > nextUse[reg]) {
+        spill(current);
+        if (firstUse != never) {
+            assert((firstUse & ~1u) > current->start());
+            schedule(split(current, firstUse & ~1u));
+        }
+        return;
+    }
+
+    assert(blockedAt[reg] > current->start());
+    current->assigned = reg;
+    if (blockedAt[reg] < current->end()) schedule(split(current, blockedAt[reg] & ~1u));
+
+    for (size_t i = 0; i < active_.size();) {
+        Interval* it = active_[i];
+        if (it->assigned != reg) {
+            i++;
+            continue;
+        }
+        active_.erase(active_.begin() + i);
+        splitAndSpill(it, start);
+    }
+    for (size_t i = 0; i < inactive_.size(); i++) {
+        Interval* it = inactive_[i];
+        uint32_t pos = it->assigned == reg ? intersect(*it, *current) : never;
+        if (pos != never) splitAndSpill(it, pos & ~1u);
+    }
+}
+
+/// Splits @p it at @p pos and returns the part from there on, which starts at its first range after @p pos.
+Interval* LinearScan::split(Interval* it, uint32_t pos) {
+    assert(pos > it->start() && pos < it->end());
+    storage_.emplace_back();
+    Interval* child = &storage_.back();
+    Interval* parent = it->parent ? it->parent : it;
+    child->reg = it->reg;
+    child->parent = parent;
+
+    auto range = std::upper_bound(it->ranges.begin(), it->ranges.end(), pos, [](uint32_t p, const Range& r) { return p < r.to; });
+    if (range->from < pos) {
+        child->ranges.push_back({pos, range->to});
+        range->to = pos;
+        ++range;
+    }
+    child->ranges.insert(child->ranges.end(), range, it->ranges.end());
+    it->ranges.erase(range, it->ranges.end());
+    auto use = std::lower_bound(it->uses.begin(), it->uses.end(), pos);
+    child->uses.assign(use, it->uses.end());
+    it->uses.erase(use, it->uses.end());
+
+    auto& parts = parent->parts;
+    parts.insert(std::upper_bound(parts.begin(), parts.end(), child, [](Interval* a, Interval* b) { return a->start() < b->start(); }), child);
+    stats_.splits++;
+    return child;
+}
+
+/// Takes the register of @p it away from @p pos on: that part waits in the stack slot until its next use.
+void LinearScan::splitAndSpill(Interval* it, uint32_t pos) {
+    Interval* part = pos > it->start() ? split(it, pos) : it;
+    uint32_t use = part->nextUse(part->start());
+    if (use != never && (use & ~1u) <= part->start()) {
+        part->assigned = noReg;
+        schedule(part);
+        return;
+    }
+    spill(part);
+    if (use != never) schedule(split(part, use & ~1u));
+}
+
+void LinearScan::spill(Interval* it) {
+    it->assigned = noReg;
+    Interval* parent = it->parent ? it->parent : it;
+    if (!parent->spilled) stats_.spilled++;
+    parent->spilled = true;
+}
+
+void LinearScan::schedule(Interval* it) {
+    assert(it->start() >= position_);
+    auto at = std::upper_bound(unhandled_.begin(), unhandled_.end(), it, [](Interval* a, Interval* b) { return a->start() > b->start(); });
+    unhandled_.insert(at, it);
+}
+
+/// Values in memory get stack slots below the allocas; values whose lifetimes do not overlap share one.
+void LinearScan::assignSlots() {
+    std::vector<Interval*> spilled;
+    for (uint32_t r = firstVirtual; r < f_.num_regs; r++) if (intervals_[r]->spilled) spilled.push_back(intervals_[r]);
+    std::sort(spilled.begin(), spilled.end(), [](Interval* a, Interval* b) { return a->start() < b->start(); });
+
+    std::vector<uint32_t> busyUntil;                                    // Per slot
+    for (Interval* it : spilled) {
+        uint32_t end = it->parts.back()->end();
+        for (auto part : it->parts) end = std::max(end, part->end());
+        size_t slot = 0;
+        while (slot < busyUntil.size() && busyUntil[slot] > it->start()) slot++;
+        if (slot == busyUntil.size()) busyUntil.push_back(0);
+        busyUntil[slot] = end;
+        it->slot = -(f_.locals + 8 * int32_t(slot + 1));
+    }
+    f_.locals += 8 * busyUntil.size();
+    stats_.slots += busyUntil.size();
+}
+
+/// Part of the interval of @p reg that covers @p pos, or the one before the hole @p pos is in.
+Interval* LinearScan::partAt(uint32_t reg, uint32_t pos) const {
+    auto& parts = intervals_[reg]->parts;
+    auto it = std::upper_bound(parts.begin(), parts.end(), pos, [](uint32_t p, Interval* part) { return p < part->start(); });
+    return it == parts.begin() ? nullptr : *(it - 1);
+}
+
+Operand LinearScan::location(const Interval* part) const {
+    if (part->assigned != noReg) return Operand::r(part->assigned);
+    Mem mem;
+    mem.base = x86::RBP;
+    mem.frame = true;
+    mem.disp = (part->parent ? part->parent : part)->slot;
+    return Operand::m(mem);
+}
+
+
+//! =================================================
+//! ================== Resolution ===================
+//! =================================================
+
+/// Replaces the virtual registers and inserts the moves between the parts of split intervals: inside a block where
+/// it was split, on the edges where the parts at the end of the predecessor and the start of the successor differ.
+void LinearScan::rewrite() {
+    size_t n = f_.blocks.size();
+    std::map<uint32_t, std::vector<Move>> at;                                   // Before the instruction at a position
+    std::vector<std::vector<Move>> atStart(n), atEnd(n);
+
+    std::vector<bool> blockStart(blockTo_.empty() ? 0 : blockTo_.back() + 1);
+    for (uint32_t from : blockFrom_) blockStart[from] = true;
+    for (uint32_t r = firstVirtual; r < f_.num_regs; r++) {
+        auto& parts = intervals_[r]->parts;
+        for (size_t i = 1; i < parts.size(); i++) {
+            uint32_t pos = parts[i]->start();
+            if (pos % 2 != 0 || blockStart[pos] || !parts[i - 1]->covers(pos - 1)) continue;
+            Operand from = location(parts[i - 1]), to = location(parts[i]);
+            if (!sameLocation(from, to)) at[pos].push_back({to, from});
+        }
+    }
+    for (size_t b = 0; b < n; b++) {
+        for (uint32_t pred : f_.blocks[b].preds) {
+            for (uint32_t r = firstVirtual; r < f_.num_regs; r++) {
+                if (!live(liveIn_[b], r)) continue;
+                Operand from = location(partAt(r, blockTo_[pred] - 1)), to = location(partAt(r, blockFrom_[b]));
+                if (sameLocation(from, to)) continue;
+                if (f_.blocks[b].preds.size() == 1) {
+                    atStart[b].push_back({to, from});
+                } else {
+                    assert(f_.blocks[pred].succs.size() == 1 && f_.blocks[pred].insts.back().opc == Opc::Jmp);
+                    atEnd[pred].push_back({to, from});
+                }
+            }
+        }
+    }
+
+    for (size_t b = 0; b < n; b++) {
+        auto& block = f_.blocks[b];
+        std::vector<Inst> insts;
+        sequentialize(std::move(atStart[b]), insts);
+        for (size_t i = 0; i < block.insts.size(); i++) {
+            uint32_t pos = blockFrom_[b] + 2 * i;
+            auto moves = at.find(pos);
+            if (moves != at.end()) sequentialize(std::move(moves->second), insts);
+            if (i + 1 == block.insts.size()) sequentialize(std::move(atEnd[b]), insts);
+
+            Inst inst = block.insts[i];
+            forEachReg(inst, [&](uint32_t& r, Role role) {
+                if (!isVirtual(r)) return;
+                Interval* part = partAt(r, role == Role::Def ? pos + 1 : pos);
+                assert(part != nullptr && part->assigned != noReg);
+                r = part->assigned;
+            });
+            insts.push_back(inst);
+        }
+        block.insts = std::move(insts);
+    }
+}
+
+/// Emits the parallel moves @p moves one by one: a move waits until no other one reads its destination, and a
+/// cycle of registers is broken through the scratch register.
+void LinearScan::sequentialize(std::vector<Move> moves, std::vector<Inst>& out) {
+    auto read = [&](const Operand& dst, size_t except) {
+        for (size_t i = 0; i < moves.size(); i++)
+            if (i != except && sameLocation(moves[i].src, dst)) return true;
+        return false;
+    };
+    auto mov = [&](Operand dst, Operand src) {
+        Inst inst;
+        inst.opc = Opc::Mov;
+        inst.w = x86::W64;
+        inst.a = dst;
+        inst.b = src;
+        out.push_back(inst);
+        stats_.moves++;
+    };
+    while (!moves.empty()) {
+        size_t i = 0;
+        while (i < moves.size() && read(moves[i].dst, i)) i++;
+        if (i == moves.size()) {
+            assert(moves[0].dst.isReg());
+            mov(Operand::r(scratch), moves[0].dst);
+            for (auto& move : moves) if (sameLocation(move.src, moves[0].dst)) move.src = Operand::r(scratch);
+            i = 0;
+        }
+        assert(moves[i].dst.isReg() || moves[i].src.isReg());
+        mov(moves[i].dst, moves[i].src);
+        moves.erase(moves.begin() + i);
+    }
+}
+
+
+//! =================================================
+//! ================== Clean Up =====================
+//! =================================================
+
+/// Removes moves within a register, turns a copy followed by the addition of a constant into lea, sends jumps
+/// through blocks that only jump straight to the final target and lets blocks fall through to the next one.
+void cleanUp(Function& f) {
+    for (auto& block : f.blocks) {
+        std::vector<Inst> insts;
+        for (auto& inst : block.insts) {
+            if (inst.opc == Opc::Mov && inst.a.isReg() && inst.b.isReg() && inst.a.reg == inst.b.reg) continue;
+            if ((inst.opc == Opc::Add || inst.opc == Opc::Sub) && inst.b.isImm() && !insts.empty()) {
+                Inst& prev = insts.back();
+                if (prev.opc == Opc::Mov && prev.w == inst.w && prev.a.isReg() && prev.b.isReg() && inst.a.isReg() && prev.a.reg == inst.a.reg) {
+                    Mem mem;
+                    mem.base = prev.b.reg;
+                    mem.disp = inst.opc == Opc::Add ? inst.b.imm : -inst.b.imm;
+                    prev.opc = Opc::Lea;
+                    prev.b = Operand::m(mem);
+                    continue;
+                }
+            }
+            insts.push_back(inst);
+        }
+        block.insts = std::move(insts);
+    }
+
+    auto trivial = [&](uint32_t b) { return f.blocks[b].insts.size() == 1 && f.blocks[b].insts[0].opc == Opc::Jmp; };
+    std::vector<bool> referenced(f.blocks.size());
+    referenced[0] = true;
+    for (auto& block : f.blocks) {
+        for (auto& inst : block.insts) {
+            if (inst.opc != Opc::Jmp && inst.opc != Opc::Jcc) continue;
+            for (size_t hops = 0; trivial(inst.target) && hops < f.blocks.size(); hops++) inst.target = f.blocks[inst.target].insts[0].target;
+            referenced[inst.target] = true;
+        }
+    }
+    for (uint32_t b = 0; b < f.blocks.size(); b++) if (!referenced[b]) f.blocks[b].insts.clear();
+
+    for (uint32_t b = 0; b < f.blocks.size(); b++) {
+        auto& insts = f.blocks[b].insts;
+        if (insts.empty()) continue;
+        uint32_t next = b + 1;
+        while (next < f.blocks.size() && f.blocks[next].insts.empty()) next++;
+        if (insts.back().opc == Opc::Jmp && insts.back().target == next) {
+            insts.pop_back();
+            if (!insts.empty() && insts.back().opc == Opc::Jcc && insts.back().target == next) insts.pop_back();
+        } else if (insts.size() >= 2 && insts.back().opc == Opc::Jmp && insts[insts.size() - 2].opc == Opc::Jcc
+                   && insts[insts.size() - 2].target == next) {
+            Inst& jcc = insts[insts.size() - 2];
+            jcc.cond = x86::negate(jcc.cond);
+            jcc.target = insts.back().target;
+            insts.pop_back();
+        }
+    }
+}
+
+}
+
+void allocateRegisters(Function& function, AllocationStats& stats) {
+    LinearScan(function, stats).run();
+    cleanUp(function);
+}
+
+}
@@ -0,0 +1,55 @@
+#ifndef PROG_OUTPUT_BUFFER_H
+#define PROG_OUTPUT_BUFFER_H
+
+#include <charconv>
+#include <cstring>
+#include <ostream>
+#include <string>
+
+namespace H {
+
+/// Text on its way to an @c std::ostream: collected in a buffer that goes to the sink in blocks of @p block_size, so
+/// writing costs one call into the stream per block. Whatever is left is handed over on destruction.
+class OutputBuffer {
+    public:
+        static constexpr size_t block_size = 1 << 16;
+
+        OutputBuffer(std::ostream& sink)
+            : sink_(sink)
+        {
+            buf_.reserve(2 * block_size);
+        }
+        OutputBuffer(const OutputBuffer&) = delete;
+        OutputBuffer& operator=(const OutputBuffer&) = delete;
+        ~OutputBuffer() { flush(); }
+
+        void put(char c) { buf_.push_back(c); }
+        void put(size_t n, char c) { buf_.append(n, c); }
+        void put(const char* s) { buf_.append(s); }
+        void put(const char* s, size_t size) { buf_.append(s, size); }
+        void put(const std::string& s) { buf_.append(s); }
+
+        /// Decimal digits of @p i.
+        template<class I>
+        void digits(I i) {
+            char digits[24];
+            buf_.append(digits, std::to_chars(digits, digits + sizeof(digits), i).ptr);
+        }
+
+        /// Flushes once a block is complete; writers call this at the end of each item rather than on every character.
+        void full() { if (buf_.size() >= block_size) flush(); }
+
+        /// Hands the buffered text to the sink.
+        void flush() {
+            sink_.write(buf_.data(), buf_.size());
+            buf_.clear();
+        }
+
+    private:
+        std::ostream& sink_;
+        std::string buf_;
+};
+
+}
+
+#endif
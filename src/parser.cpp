@@ -4,9 +4,10 @@
 
 #include "parser.h"
 
+#include "ast_cache.h"
+
 #include <fstream>
 #include <iostream>
-#include <cstring>
 
 namespace H {
 
@@ -14,31 +15,36 @@ namespace H {
     //! ================================ BASIC ================================
     //! =======================================================================
 
-    Parser::Parser(const char* file, std::istream& stream, bool evaluate_parsing, bool prettyPrint)
-        : lexer_(file, stream)
-        , prev_(lexer_.loc())
-        , ahead_(lexer_.lex())
-        , two_ahead_(lexer_.lex())
-        , evaluate_parsing_(evaluate_parsing)
-        , prettyPrint_(prettyPrint)
-
+    template<class Builder, class Trace>
+    Parser<Builder, Trace>::Parser(const char* file, std::istream& stream, Builder builder, Trace trace, Pos start)
+        : pp_(file, stream, start)
+        , prev_(pp_.loc())
+        , ahead_(pp_.lex())
+        , two_ahead_(pp_.lex())
+        , builder_(std::move(builder))
+        , trace_(std::move(trace))
     {}
 
-    Tok Parser::lex() {
+    template<class Builder, class Trace>
+    Tok Parser<Builder, Trace>::lex() {
         //std::cout << "ahead: " << ahead() << " | two_ahead: " << two_ahead() << std::endl;
         auto result = ahead();
+        prev_ = result.loc();                                           // End of the nodes finished by this token
         ahead_ = two_ahead();
-        two_ahead_ = lexer_.lex();
+        two_ahead_ = pp_.lex();
+        if constexpr (Trace::enabled) ++num_lexed_;
         return result;
     }
 
-    bool Parser::accept(Tok::Tag tag) {
+    template<class Builder, class Trace>
+    bool Parser<Builder, Trace>::accept(Tok::Tag tag) {
         if (tag != ahead().tag()) return false;
         lex();
         return true;
     }
 
-    bool Parser::expect(Tok::Tag tag, const char* ctxt) {
+    template<class Builder, class Trace>
+    bool Parser<Builder, Trace>::expect(Tok::Tag tag, const char* ctxt) {
         if (ahead().tag() == tag) {
             lex();
             return true;
@@ -48,91 +54,63 @@ namespace H {
         return false;
     }
 
-    void Parser::err(const std::string& what, const Tok& tok, const char* ctxt) {
+    template<class Builder, class Trace>
+    void Parser<Builder, Trace>::err(const std::string& what, const Tok& tok, const char* ctxt) {
         tok.loc().err() << "expected " << what << ", got '" << tok << "' while parsing " << ctxt << "\033[0m" << std::endl;
     }
 
-    void Parser::print_parsing(const char* ctxt, const char* status = ""){
-        if (evaluate_parsing()){
-
-            std::cout << ahead().loc().begin;
-            if (strcmp(ctxt, "program") == 0) {if (strcmp(status, "stopping") == 0) std::cout << std::endl;}
-            else if (strcmp(status, "starting") == 0) {
-                std::cout << std::string(prettyIndent, '\t') << ">>> " << ctxt << std::endl;
-                prettyIndent += 1;
-            }
-            else if (strcmp(status, "stopping") == 0) {
-                prettyIndent -= 1;
-                std::cout << std::string(prettyIndent, '\t') << "<<< " << ctxt << std::endl;
-            }
-            else {
-                std::cout << std::string(prettyIndent, '\t') << "- " << ctxt << std::endl;
-            }
-
-        }
-    }
-
 
 
     //! ===========================================================================
     //! ================================ MAIN LOOP ================================
     //! ===========================================================================
 
-    void Parser::parse_prg() {
+    template<class Builder, class Trace>
+    typename Builder::UnitNode Parser<Builder, Trace>::parse_prg() {
         Tracker track = tracker();
         if (ahead().tag() == Tok::Tag::M_EoF) {
             err(std::string("a non-empty file"), "program");
-            return;
+            return {};
         }
 
-        Ptrs<ExternalDeclaration> externalDeclarations;
+        ExtDeclList externalDeclarations;
 
         while (ahead().tag() != Tok::Tag::M_EoF) {
             // program = list of external definitions (variable declarations and function definitions)? 
-            if (evaluate_parsing_) std::cout << std::endl;
             externalDeclarations.emplace_back(parse_external_declaration());
         }
 
         expect(Tok::Tag::M_EoF, "program");
+        if constexpr (Trace::enabled) trace_.flush();                  // Trace precedes any pretty printed output
 
-        //Ptr<AST> ast = mk<AST>(std::move(externalDeclarations));
-        Ptr<TranslationUnit> translationUnit = mk<TranslationUnit>(track, std::move(externalDeclarations));
-
-
-        if (prettyPrint() && num_errors==0) translationUnit->dump();
-
-        Sema sema = Sema();
-
-        if (prettyPrint() && num_errors==0) translationUnit->dump();
-        if (semanticCheck && num_errors==0) translationUnit->check(sema);
-   
-
-
-
-        return;// exp;
+        return builder_.translation_unit(track, std::move(externalDeclarations));
     }
 
     //! ====================================================================================================
     //! ========================================= HELPER FUNCTIONS =========================================
     //! ====================================================================================================
 
-    void Parser::eat_rest_of_statement(bool with_semicolon){
+    template<class Builder, class Trace>
+    void Parser<Builder, Trace>::eat_rest_of_statement(bool with_semicolon){
         while (ahead().tag() != Tok::Tag::P_Semicolon && ahead().tag() != Tok::Tag::M_EoF) lex();
         if (with_semicolon && ahead().tag() == Tok::Tag::P_Semicolon) lex();
     }
 
-    bool Parser::type_follows(){
-        return (ahead().tag()==Tok::Tag::K_void || ahead().tag()==Tok::Tag::K_int || ahead().tag()==Tok::Tag::K_char || ahead().tag()==Tok::Tag::K_struct);
+    template<class Builder, class Trace>
+    bool Parser<Builder, Trace>::type_follows(){
+        return (ahead().tag()==Tok::Tag::K_void || ahead().tag()==Tok::Tag::K_int || ahead().tag()==Tok::Tag::K_char || ahead().tag()==Tok::Tag::K_struct || type_name(ahead()));
     }
 
-    bool Parser::type_follows_twoahead(){
-        return (two_ahead().tag()==Tok::Tag::K_void || two_ahead().tag()==Tok::Tag::K_int || two_ahead().tag()==Tok::Tag::K_char || two_ahead().tag()==Tok::Tag::K_struct);
+    template<class Builder, class Trace>
+    bool Parser<Builder, Trace>::type_follows_twoahead(){
+        return (two_ahead().tag()==Tok::Tag::K_void || two_ahead().tag()==Tok::Tag::K_int || two_ahead().tag()==Tok::Tag::K_char || two_ahead().tag()==Tok::Tag::K_struct || type_name(two_ahead()));
     }
 
-    Ptrs<Exp> Parser::parse_expr_list(const char* ctxt){
+    template<class Builder, class Trace>
+    typename Builder::ExpList Parser<Builder, Trace>::parse_expr_list(const char* ctxt){
         UNUSED(ctxt);
-        Ptrs<Exp> parameters;
-        Ptrs<Exp> error;
+        ExpList parameters;
+        ExpList error;
         lex();                                                      //opening paranthesis
         if (ahead().tag() != Tok::Tag::D_Parenthesis_R){
             do {
@@ -141,35 +119,34 @@ namespace H {
                     eat_rest_of_statement(false);
                     return error;
                 }
-                print_parsing("expression in list", "starting");
+                TraceScope scope(*this, Rule::ExpressionInList);
                 parameters.emplace_back(parse_exp("expression list"));
-                print_parsing("expression in list", "stopping");
             } while (accept(Tok::Tag::P_Comma));
         }
         expect(Tok::Tag::D_Parenthesis_R, "expression list");       //closing paranthesis
         return parameters;
     }
 
-    Ptr<ErrExp> Parser::createErrExp(Tracker track, bool with_semicolon, const char* ctxt, const char* status){
-        auto errExp = mk<ErrExp>(track);
+    template<class Builder, class Trace>
+    typename Builder::ExpNode Parser<Builder, Trace>::createErrExp(Tracker track, bool with_semicolon){
+        auto errExp = builder_.err_exp(track);
         eat_rest_of_statement(with_semicolon);
-        if (strcmp(ctxt, "")!=0) print_parsing(ctxt, status);
         //errstmt->dump();
         return errExp;
     }
 
-    Ptr<ErrStmt> Parser::createErrStmt(Tracker track, bool with_semicolon, const char* ctxt, const char* status){
-        auto errStmt = mk<ErrStmt>(track);
+    template<class Builder, class Trace>
+    typename Builder::StmtNode Parser<Builder, Trace>::createErrStmt(Tracker track, bool with_semicolon){
+        auto errStmt = builder_.err_stmt(track);
         eat_rest_of_statement(with_semicolon);
-        if (strcmp(ctxt, "")!=0) print_parsing(ctxt, status);
         //errstmt->dump();
         return errStmt;
     }
 
-    Ptr<ErrDecl> Parser::createErrDecl(Tracker track, bool with_semicolon, const char* ctxt, const char* status){
-        auto errdecl = mk<ErrDecl>(track);
+    template<class Builder, class Trace>
+    typename Builder::ExtDeclNode Parser<Builder, Trace>::createErrDecl(Tracker track, bool with_semicolon){
+        auto errdecl = builder_.err_decl(track);
         eat_rest_of_statement(with_semicolon);
-        if (strcmp(ctxt, "")!=0) print_parsing(ctxt, status);
         //errdecl->dump();
         return errdecl;
     }
@@ -178,62 +155,76 @@ namespace H {
     //! ====================================== DECLARATION NEW ======================================
     //! =========================================================================================
 
-    Ptr<ExternalDeclaration> Parser::parse_external_declaration(){
+    template<class Builder, class Trace>
+    typename Builder::ExtDeclNode Parser<Builder, Trace>::parse_external_declaration(){
         Tracker track = tracker();                
+        TraceScope scope(*this, Rule::ExternalDeclaration);
 
-        Ptr<SpecifierDeclarator> specifierDeclarator = parse_specifier_declarator();
+        SpecDeclNode specifierDeclarator = parse_specifier_declarator();
         
-        if (specifierDeclarator==nullptr) {
-            auto error = mk<ErrDecl>(track);
+        if (!specifierDeclarator) {
+            auto error = builder_.err_decl(track);
             eat_rest_of_statement(true);
             return error;
         }
-
-        if (ahead().tag() == Tok::Tag::D_Brace_L){
-            Ptr<Stmt> functionBody = parse_stmt("external declaration");
-            return mk<ExternalDeclaration>(track, std::move(specifierDeclarator), std::move(functionBody));
+        declare_name();
+
+        if (ahead().tag() == Tok::Tag::D_Brace_L && !typedef_){
+            type_names_.push();                                             // Parameters may hide type names in the body
+            for (auto& param : params_) type_names_.declare(param, false);
+            StmtNode functionBody = parse_stmt(Rule::FunctionBody);
+            type_names_.pop();
+            return builder_.function_definition(track, std::move(specifierDeclarator), std::move(functionBody));
         }
         if (!expect(Tok::Tag::P_Semicolon, "external declaration")) eat_rest_of_statement(true);
-        return mk<ExternalDeclaration>(track, std::move(specifierDeclarator));
+        return builder_.external_declaration(track, std::move(specifierDeclarator));
     }
 
-    Ptr<SpecifierDeclarator> Parser::parse_specifier_declarator(bool inside_paramlist){  
+    template<class Builder, class Trace>
+    typename Builder::SpecDeclNode Parser<Builder, Trace>::parse_specifier_declarator(bool inside_paramlist){  
         Tracker track = tracker();  
-        Ptr<Specifier> specifier = parse_specifier();
+        bool is_typedef = !inside_paramlist && accept(Tok::Tag::K_typedef);
+        bool is_inline = !inside_paramlist && !is_typedef && accept(Tok::Tag::K_inline);
+        SpecifierNode specifier = parse_specifier();
         
-        if (specifier == nullptr) return nullptr;
-
-        Ptr<Declarator> declarator = parse_declarator(inside_paramlist);
-        if (declarator==nullptr) return mk<SpecifierDeclarator>(track, std::move(specifier));
-        else return mk<SpecifierDeclarator>(track, std::move(specifier), std::move(declarator));
+        if (!specifier) return {};
+
+        declared_ = Tok();
+        DeclaratorNode declarator = parse_declarator(inside_paramlist);
+        typedef_ = is_typedef;
+        if (is_typedef) return builder_.typedef_declarator(track, std::move(specifier), std::move(declarator));
+        if (is_inline) return builder_.inline_declarator(track, std::move(specifier), std::move(declarator));
+        return builder_.specifier_declarator(track, std::move(specifier), std::move(declarator));
     }
 
-    Ptr<Specifier> Parser::parse_specifier(){                                                   // type specifier
+    template<class Builder, class Trace>
+    typename Builder::SpecifierNode Parser<Builder, Trace>::parse_specifier(){                                                   // type specifier
         Tracker track = tracker();  
         while (ahead().tag() == Tok::Tag::P_Semicolon) lex();                                   // eat away useless declarations with only a semicolon
         
-        if (ahead().tag() == Tok::Tag::K_char || ahead().tag() == Tok::Tag::K_int || ahead().tag() == Tok::Tag::K_void) return mk<PrimitiveSpecifier>(track, lex());
+        if (ahead().tag() == Tok::Tag::K_char || ahead().tag() == Tok::Tag::K_int || ahead().tag() == Tok::Tag::K_void) return builder_.primitive_specifier(track, lex());
+        if (type_name(ahead())) return builder_.type_name_specifier(track, lex());
 
         if (ahead().tag() == Tok::Tag::K_struct){
             Tok struct_specifier = lex();
             
             bool identifier_set = false;
             bool structDeclList_set = false;
-            Ptrs<SpecifierDeclarator> structDeclarationList;
+            SpecDeclList structDeclarationList;
             Tok struct_identifier;
 
             if (ahead().tag() == Tok::Tag::M_Id) {
                 struct_identifier = lex(); 
                 identifier_set=true;
-                print_parsing("struct identifier set");
+                trace_step(Rule::StructIdentifier);
             }
 
             if (identifier_set == false && ahead().tag()!=Tok::Tag::D_Brace_L){
                 err("struct declaration list", "struct declaration");
                 eat_rest_of_statement(false);
-                return nullptr;                                             //TODO: Error 
+                return {};                                                  //TODO: Error 
             } else if (ahead().tag()==Tok::Tag::D_Brace_L) {
-                print_parsing("struct-declaration-list", "starting");
+                TraceScope scope(*this, Rule::StructDeclarationList);
                 lex();
                 structDeclList_set=true;
                 if (ahead().tag() != Tok::Tag::D_Brace_R){
@@ -246,49 +237,61 @@ namespace H {
                 }
 
                 expect(Tok::Tag::D_Brace_R, "struct declaration");
-                print_parsing("struct-declaration-list", "stopping");
             }
             
-            if (identifier_set && structDeclList_set)   return mk<StructSpecifier>(track, struct_specifier, struct_identifier, std::move(structDeclarationList));
-            if (identifier_set && !structDeclList_set)  return mk<StructSpecifier>(track, struct_specifier, struct_identifier);
-            if (!identifier_set && structDeclList_set)  return mk<StructSpecifier>(track, struct_specifier, std::move(structDeclarationList));
-            return mk<StructSpecifier>(track, struct_specifier);
+            if (identifier_set && structDeclList_set)   return builder_.struct_specifier(track, struct_specifier, struct_identifier, std::move(structDeclarationList));
+            if (identifier_set && !structDeclList_set)  return builder_.struct_specifier(track, struct_specifier, struct_identifier);
+            if (!identifier_set && structDeclList_set)  return builder_.struct_specifier(track, struct_specifier, std::move(structDeclarationList));
+            return builder_.struct_specifier(track, struct_specifier);
         }
         err("type specifier", "");
-        return nullptr;
+        return {};
     }
 
-    Ptr<Declarator> Parser::parse_declarator(bool inside_paramlist){
+    template<class Builder, class Trace>
+    typename Builder::DeclaratorNode Parser<Builder, Trace>::parse_declarator(bool inside_paramlist){
         Tracker track = tracker();
-        Ptr<Declarator> declarator;
+        DeclaratorNode declarator;
 
         if (ahead().tag() == Tok::Tag::P_Multiplication) {                  // Pointer Declarator
             lex();
-            Ptr<Declarator> decl = parse_declarator();
-            declarator = mk<PointerDeclarator>(track, std::move(decl));
+            DeclaratorNode decl = parse_declarator();
+            declarator = builder_.pointer_declarator(track, std::move(decl));
         } else if (ahead().tag() == Tok::Tag::D_Parenthesis_L) {            // Paranthesized Declarator
             lex();
             if(type_follows() && inside_paramlist) goto parsing_paramlist;
             declarator = parse_declarator();
             expect(Tok::Tag::D_Parenthesis_R, "declarator");
-        } else if (ahead().tag() == Tok::Tag::M_Id) declarator = mk<NamedDeclarator>(track, lex());  // Named Declarator
-        else declarator=nullptr;
+        } else if (ahead().tag() == Tok::Tag::M_Id) {                       // Named Declarator
+            declared_ = ahead();
+            declarator = builder_.named_declarator(track, lex());
+        }
+        else declarator = {};
 
         if (ahead().tag() == Tok::Tag::D_Parenthesis_L) {                   // Parameter List
             lex();
 
 parsing_paramlist:
-            Ptrs<SpecifierDeclarator> paramList;
+            Tok name = declared_;
+            std::vector<std::string> params;
+            type_names_.push();                                             // Parameter scope
+            SpecDeclList paramList;
             do {
-                if (type_follows()) paramList.emplace_back(parse_specifier_declarator(true));
-                else {
+                if (type_follows()) {
+                    paramList.emplace_back(parse_specifier_declarator(true));
+                    if (type_names_.contains(declared_.str())) params.push_back(declared_.str());
+                    declare_name();
+                } else {
                     err("type specifier","parameter declaration");
                     do lex(); while (ahead().tag() != Tok::Tag::P_Comma && ahead().tag() != Tok::Tag::M_EoF && ahead().tag() != Tok::Tag::D_Parenthesis_R);
                 }
             } while (accept(Tok::Tag::P_Comma));
+            type_names_.pop();
+            declared_ = name;
+            params_ = std::move(params);
             
             expect(Tok::Tag::D_Parenthesis_R, "parameter list");
-            return mk<FunctionDeclarator>(track, std::move(declarator), std::move(paramList));
+            return builder_.function_declarator(track, std::move(declarator), std::move(paramList));
         }
             
         return declarator;
@@ -300,17 +303,19 @@ parsing_paramlist:
     //! ====================================== Statement ======================================
     //! =======================================================================================
 
-    Ptr<Stmt> Parser::parse_stmt(const char* ctxt, bool labeledStmt, bool nonblock){
+    template<class Builder, class Trace>
+    typename Builder::StmtNode Parser<Builder, Trace>::parse_stmt(Rule rule, bool labeledStmt, bool nonblock){
         auto track = tracker();
-        Ptr<Stmt> stmt;
-
-        if(strcmp(ctxt, "") != 0) print_parsing(ctxt, "starting");
+        TraceScope scope(*this, rule);
+        StmtNode stmt;
     
         switch (ahead().tag()) {
             case Tok::Tag::K_void:
             case Tok::Tag::K_char:
             case Tok::Tag::K_int: 
-            case Tok::Tag::K_struct:{
+            case Tok::Tag::K_struct:
+            case Tok::Tag::K_typedef:{
+declaration:
                 if (labeledStmt) {
                     err("statement", "labeled statement");
                     eat_rest_of_statement(true);
@@ -321,10 +326,11 @@ parsing_paramlist:
                     eat_rest_of_statement(true);
                     break;
                 }
-                Ptr<SpecifierDeclarator> specifierDeclarator = parse_specifier_declarator();
-                if (specifierDeclarator==nullptr) return nullptr;
+                SpecDeclNode specifierDeclarator = parse_specifier_declarator();
+                if (!specifierDeclarator) return {};
+                declare_name();
                 expect(Tok::Tag::P_Semicolon, "declaration");
-                return mk<Declaration>(track, std::move(specifierDeclarator));
+                return builder_.declaration(track, std::move(specifierDeclarator));
             }
 
             // Labeled Statement (First: identifier)
@@ -334,12 +340,14 @@ parsing_paramlist:
                     lex();                                              //colon wegknuspern
                     if(ahead().tag() == Tok::Tag::D_Brace_R) {
                         err("expression", "labeled statement");
-                        return createErrStmt(track, true, "expression", "labeled statement");
+                        return createErrStmt(track, true);
                     } else {                                            
-                        auto labeled_statement = parse_stmt("labeled statement", true);
-                        auto labeledStmt = mk<LabeledStmt>(track, label, std::move(labeled_statement));
+                        auto labeled_statement = parse_stmt(Rule::LabeledStatement, true);
+                        auto labeledStmt = builder_.labeled_stmt(track, label, std::move(labeled_statement));
                         return labeledStmt;
                     }
+                } else if (type_name(ahead())) {
+                    goto declaration;
                 } else {
                     goto expressionstatement;
                 }
@@ -349,25 +357,26 @@ parsing_paramlist:
             // compound statement (First: brace left)
             case Tok::Tag::D_Brace_L: {
                 lex();
-                print_parsing("compound statement list", "starting");
+                TraceScope scope(*this, Rule::CompoundStatementList);
 
-                Ptrs<Stmt> blockItems;
+                StmtList blockItems;
 
+                type_names_.push();
                 while (ahead().tag() != Tok::Tag::D_Brace_R && ahead().tag()!=Tok::Tag::M_EoF){
-                    blockItems.emplace_back(parse_stmt(""));
+                    blockItems.emplace_back(parse_stmt(Rule::None));
                 }
+                type_names_.pop();
                 expect(Tok::Tag::D_Brace_R, "compound statement");
-                print_parsing("compound statement list", "stopping");
                 
-                auto compoundStmt = mk<CompoundStmt>(track, std::move(blockItems));
+                auto compoundStmt = builder_.compound_stmt(track, std::move(blockItems));
                 return compoundStmt;
             }
                 
             // null statement (First: semicolon)
             case Tok::Tag::P_Semicolon: {
                 lex(); 
-                print_parsing("null statement"); 
-                auto nullStmt = mk<NullStmt>(track);
+                trace_step(Rule::NullStatement);
+                auto nullStmt = builder_.null_stmt(track);
                 return nullStmt;
             }
 
@@ -377,55 +386,55 @@ parsing_paramlist:
                 expect(Tok::Tag::D_Parenthesis_L, "if statement");
                 auto condition = parse_exp("if condition");
                 expect(Tok::Tag::D_Parenthesis_R, "if statement");
-                auto consequence = parse_stmt("if consequence", false, true);
+                auto consequence = parse_stmt(Rule::IfConsequence, false, true);
                 if (ahead().tag() == Tok::Tag::K_else) {
                     lex();
-                    auto alternative = parse_stmt("if alternative (else)");
-                    auto ifElseStmt = mk<IfElseStmt>(track, std::move(condition), std::move(consequence), std::move(alternative));
+                    auto alternative = parse_stmt(Rule::IfAlternative);
+                    auto ifElseStmt = builder_.if_else_stmt(track, std::move(condition), std::move(consequence), std::move(alternative));
                     return ifElseStmt;
                 }
 
-                auto ifStmt = mk<IfStmt>(track, std::move(condition), std::move(consequence));
+                auto ifStmt = builder_.if_stmt(track, std::move(condition), std::move(consequence));
                 return ifStmt;
             }
                 
             // iteration statement (First: while)
             case Tok::Tag::K_while: {
                 lex();
-                print_parsing("while loop", "starting");
-                if(!expect(Tok::Tag::D_Parenthesis_L, "while loop")) return createErrStmt(track, true, "while loop","stopping");
+                TraceScope scope(*this, Rule::WhileLoop);
+                if(!expect(Tok::Tag::D_Parenthesis_L, "while loop")) return createErrStmt(track, true);
                 auto condition = parse_exp("while loop");
-                if(!expect(Tok::Tag::D_Parenthesis_R, "while loop")) return createErrStmt(track, true, "while loop","stopping");
-                auto loop = parse_stmt("while loop", nonblock=true); //do something...
+                if(!expect(Tok::Tag::D_Parenthesis_R, "while loop")) return createErrStmt(track, true);
+                auto loop = parse_stmt(Rule::LoopBody, nonblock=true); //do something...
 
-                auto whilestmt = mk<WhileStmt>(track, std::move(condition), std::move(loop));
+                auto whilestmt = builder_.while_stmt(track, std::move(condition), std::move(loop));
                 return whilestmt;
             }
                 
             // jump statements (First: goto, continue, break, return)
             case Tok::Tag::K_continue: {
                 lex(); 
-                print_parsing("continue statement"); 
-                if(!expect(Tok::Tag::P_Semicolon, "continue")) return createErrStmt(track, true, "", ""); 
-                auto continuestmt = mk<ContinueStmt>(track); 
+                trace_step(Rule::ContinueStatement);
+                if(!expect(Tok::Tag::P_Semicolon, "continue")) return createErrStmt(track, true); 
+                auto continuestmt = builder_.continue_stmt(track); 
                 return continuestmt;
             }
             case Tok::Tag::K_break: {
                 lex(); 
-                print_parsing("break statement"); 
-                if(!expect(Tok::Tag::P_Semicolon, "break")) return createErrStmt(track, true, "", ""); 
-                auto breakstmt = mk<BreakStmt>(track); 
+                trace_step(Rule::BreakStatement);
+                if(!expect(Tok::Tag::P_Semicolon, "break")) return createErrStmt(track, true); 
+                auto breakstmt = builder_.break_stmt(track); 
                 return breakstmt;
             }
             case Tok::Tag::K_goto: {
                 lex();
                 Tok label;
                 if (ahead().tag() == Tok::Tag::M_Id) label = lex();
-                else if(!expect(Tok::Tag::M_Id, "goto statement")) return createErrStmt(track, true, "", "");
-                print_parsing("goto statement");
-                if (!expect(Tok::Tag::P_Semicolon, "goto statement")) return createErrStmt(track, true, "", "");
+                else if(!expect(Tok::Tag::M_Id, "goto statement")) return createErrStmt(track, true);
+                trace_step(Rule::GotoStatement);
+                if (!expect(Tok::Tag::P_Semicolon, "goto statement")) return createErrStmt(track, true);
                 
-                auto gotostmt = mk<GoToStmt>(track, label);
+                auto gotostmt = builder_.goto_stmt(track, label);
                 return gotostmt;
             }
 
@@ -433,13 +442,13 @@ parsing_paramlist:
                 lex();
                 if (ahead().tag() == Tok::Tag::P_Semicolon){
                     lex();
-                    auto emptyreturnstmt = mk<EmptyReturnStmt>(track);
+                    auto emptyreturnstmt = builder_.empty_return_stmt(track);
                     return emptyreturnstmt;
                 } else {
                     auto return_exp = parse_exp("return statement");
-                    print_parsing("return statement");
-                    if (!expect(Tok::Tag::P_Semicolon, "return statement")) return createErrStmt(track, true, "", "");
-                    auto returnstmt = mk<ReturnStmt>(track, std::move(return_exp));
+                    trace_step(Rule::ReturnStatement);
+                    if (!expect(Tok::Tag::P_Semicolon, "return statement")) return createErrStmt(track, true);
+                    auto returnstmt = builder_.return_stmt(track, std::move(return_exp));
                     return returnstmt;
                 }
                 break;
@@ -448,19 +457,15 @@ parsing_paramlist:
             default: {
 expressionstatement:
                 // expression-statement (First: expression) - fallback
-                print_parsing("expression statement", "starting");
+                TraceScope scope(*this, Rule::ExpressionStatement);
                 auto exp = parse_exp("expression statement");
                 
+                if (!expect(Tok::Tag::P_Semicolon, "expression statement")) return createErrStmt(track, true);
 
-                
-                if (!expect(Tok::Tag::P_Semicolon, "expression statement")) return createErrStmt(track, true, "expression statement", "stopping");
-
-                print_parsing("expression statement", "stopping");
-                auto expstmt = mk<ExpressionStmt>(track, std::move(exp));
+                auto expstmt = builder_.expression_stmt(track, std::move(exp));
                 return expstmt;
             }
         }
-        if(strcmp(ctxt, "") != 0) print_parsing(ctxt, "stopping");
         return stmt;
     }
 
@@ -470,20 +475,22 @@ expressionstatement:
     //! ====================================== Expression ======================================
     //! ========================================================================================
 
-    Ptr<Exp> Parser::parse_member_access(Tracker track, Ptr<Exp> lhs) {
+    template<class Builder, class Trace>
+    typename Builder::ExpNode Parser<Builder, Trace>::parse_member_access(Tracker track, ExpNode lhs) {
         auto operation = lex().tag();
         if (ahead().tag() != Tok::Tag::M_Id) {
             expect(Tok::Tag::M_Id, "member access");
             eat_rest_of_statement(false);
-            return mk<ErrExp>(track);                     //TODO: Return correct ptr
+            return builder_.err_exp(track);               //TODO: Return correct ptr
         }
         auto member_name = lex();
         //std::cout << "Member name: " << member_name.str() << " | Operator: " << Tok::tag2str(tag) << std::endl;
-        return mk<MemberAccessExp>(track, operation, std::move(lhs), member_name);  // ToDo: Create (Exp-)Node with lhs (union or struct we want to access), tag (method) and member_name
+        return builder_.member_access_exp(track, operation, std::move(lhs), member_name);  // ToDo: Create (Exp-)Node with lhs (union or struct we want to access), tag (method) and member_name
     }
 
     // Main Loop
-    Ptr<Exp> Parser::parse_exp(const char* ctxt, Tok::Prec p) {
+    template<class Builder, class Trace>
+    typename Builder::ExpNode Parser<Builder, Trace>::parse_exp(const char* ctxt, Tok::Prec p) {
         auto track = tracker();
         //std::cout << "Parse Expression: \t\t" << Tok::tag2str(ahead().tag()) << " " << ahead().str() << " | " << ctxt << std::endl;
         auto lhs = parse_primary_expr(ctxt);            // Just start
@@ -496,13 +503,12 @@ expressionstatement:
 
                 // Brackets (array subscripting)
                 case Tok::Tag::D_Bracket_L:{
-                    print_parsing("array subscripting", "starting");
+                    TraceScope scope(*this, Rule::ArraySubscripting);
                     lex();
                     auto index = parse_exp("array subscription");
                     expect(Tok::Tag::D_Bracket_R, "array subscription");
-                    print_parsing("array subscripting", "stopping");
 
-                    lhs = mk<ArrayExp>(track, std::move(lhs), std::move(index));
+                    lhs = builder_.array_exp(track, std::move(lhs), std::move(index));
                     continue;
                 }
                     
@@ -515,18 +521,17 @@ expressionstatement:
                     
                 // func() (function call)
                 case Tok::Tag::D_Parenthesis_L: {
-                    print_parsing("function call", "starting");
-                    Ptrs<Exp> parameters = parse_expr_list("function call");
-                    print_parsing("function call", "stopping");                   
+                    TraceScope scope(*this, Rule::FunctionCall);
+                    ExpList parameters = parse_expr_list("function call");
 
-                    lhs = mk<FuncCallExp>(track, std::move(lhs), std::move(parameters));
+                    lhs = builder_.func_call_exp(track, std::move(lhs), std::move(parameters));
                     continue;
                 }
 
                 // var++, var-- (postfix increment and decrement)
                 case Tok::Tag::P_Increment:
                 case Tok::Tag::P_Decrement: {
-                    lhs = mk<PostfixExp>(track, std::move(lhs), lex());
+                    lhs = builder_.postfix_exp(track, std::move(lhs), lex());
                     continue; 
                 }      
                 
@@ -541,36 +546,37 @@ expressionstatement:
             if (q < p) break;      
             if (ahead_tag == Tok::Tag::P_Inline_If){ // Ternary Expression
                 lex();
-                Ptr<Exp> consequence, alternative;
+                ExpNode consequence, alternative;
                 
                 if (ahead().tag() == Tok::Tag::P_Semicolon || ahead().tag()==Tok::Tag::M_EoF) {
                         err("expression", "alternative of ternary expression");
-                        lhs = createErrExp(track, false, "", "");
+                        lhs = createErrExp(track, false);
                 } else {
                     consequence = parse_exp("consequence of a ternary expression");
-                    if (!expect(Tok::Tag::P_Colon, "ternary expression")) lhs = createErrExp(track, false, "", "");
+                    if (!expect(Tok::Tag::P_Colon, "ternary expression")) lhs = createErrExp(track, false);
                     else {
                         if (ahead().tag() == Tok::Tag::P_Semicolon || ahead().tag()==Tok::Tag::M_EoF) {
                             err("expression", "alternative of ternary expression");
-                            lhs = createErrExp(track, false, "", "");
+                            lhs = createErrExp(track, false);
                         } else alternative = parse_exp("alternative of a ternary expression", Tok::Prec::Conditional);
                     }
                 }
-                lhs = mk<TernaryExp>(track, std::move(lhs), std::move(consequence), std::move(alternative));
+                lhs = builder_.ternary_exp(track, std::move(lhs), std::move(consequence), std::move(alternative));
                 
             } else { // Binary Expression
                 auto operation = lex();
                 //std::cout << Tok::tag2str(ahead().tag()) << std::endl;
                 auto rhs = parse_exp("right-hand side of a binary expression", Tok::tag2prec_r(operation.tag()));
                 
-                auto infixExp = mk<InfixExp>(track, std::move(lhs), operation, std::move(rhs));
+                auto infixExp = builder_.infix_exp(track, std::move(lhs), operation, std::move(rhs));
                 lhs = std::move(infixExp);
             }
         }
         return lhs;
     }
 
-    Ptr<Exp> Parser::parse_primary_expr(const char* ctxt) {
+    template<class Builder, class Trace>
+    typename Builder::ExpNode Parser<Builder, Trace>::parse_primary_expr(const char* ctxt) {
         //std::cout << "Parse Primary Expression: \t" << Tok::tag2str(ahead().tag()) << " " << ahead().str() << " | " << ctxt << std::endl;
         auto track = tracker();
         
@@ -586,7 +592,7 @@ expressionstatement:
             case Tok::Tag::P_Decrement:{                // Prefix decrement (--var)   
                 auto prefix = lex();
                 auto rhs = parse_exp("right-hand side of a unary expression", Tok::Prec::Unary);    // This assumes that all prefix expressions bind with precedence level "Unary".
-                auto prefixExp = mk<PrefixExp>(track, prefix, std::move(rhs));
+                auto prefixExp = builder_.prefix_exp(track, prefix, std::move(rhs));
                 return prefixExp;
             }           
 
@@ -594,49 +600,51 @@ expressionstatement:
             // sizeof unary-expression <-> sizeof ( type-name )
             case Tok::Tag::K_sizeof: { // TODO: return expression that represents a sizeof expression // TODO: 2-look-ahead
                 lex();
-                if (two_ahead().tag() == Tok::Tag::K_const || two_ahead().tag() == Tok::Tag::K_char || two_ahead().tag() == Tok::Tag::K_int){
-                    if (!expect(Tok::Tag::D_Parenthesis_L, "sizeof (type)")) return createErrExp(track, false, "", "");
+                if (two_ahead().tag() == Tok::Tag::K_const || two_ahead().tag() == Tok::Tag::K_char || two_ahead().tag() == Tok::Tag::K_int || type_name(two_ahead())){
+                    if (!expect(Tok::Tag::D_Parenthesis_L, "sizeof (type)")) return createErrExp(track, false);
                     Tok typetok = lex(); 
-                    if (!expect(Tok::Tag::D_Parenthesis_R, "sizeof (type)")) return createErrExp(track, false, "", "");
-                    return mk<SizeOfTypeExp>(track, typetok);
+                    if (!expect(Tok::Tag::D_Parenthesis_R, "sizeof (type)")) return createErrExp(track, false);
+                    return builder_.sizeof_type_exp(track, typetok);
                 } else {
                     auto sizeOfUnaryExp = parse_exp("sizeof unary-expression", Tok::Prec::Unary);
-                    return mk<SizeOfUnaryExp>(track, std::move(sizeOfUnaryExp));
+                    return builder_.sizeof_unary_exp(track, std::move(sizeOfUnaryExp));
                 }
             } 
 
             case Tok::Tag::C_Integer:{
-                auto integerNode = mk<Integer>(track, lex().value());
+                auto integerNode = builder_.integer(track, lex());
                 return integerNode;
             }
             case Tok::Tag::C_Character:{
-                std::string dd = lex().str();
-                // std::cout << "CHAR: " << dd << std::endl;
-                auto characterNode = mk<Character>(track, dd); 
+                auto characterNode = builder_.character(track, lex());
                 return characterNode;
             }
             case Tok::Tag::M_Id: {
-                auto identifierNode = mk<Identifier>(track, lex().str());
+                auto identifierNode = builder_.identifier(track, lex());
                 return identifierNode;
             }
             case Tok::Tag::S_Literal: {
-                std::string s = lex().str();
-                // std::cout << "LITERAL: " << s << std::endl;
-                auto literalNode = mk<Literal>(track, s);
+                auto literalNode = builder_.literal(track, lex());
                 return literalNode;
             }
             case Tok::Tag::D_Parenthesis_L: {
                 lex();
                 auto res = parse_exp("parenthesized expression");
-                if (!expect(Tok::Tag::D_Parenthesis_R, "parenthesized expression")) return createErrExp(track, false, "","");
+                if (!expect(Tok::Tag::D_Parenthesis_R, "parenthesized expression")) return createErrExp(track, false);
                 return res;
             }
             default: {
                 err("expression", ctxt);
-                auto errExp = createErrExp(track, false, "","");
+                auto errExp = createErrExp(track, false);
                 return errExp;
             }                           
                 
         }
     }
+
+    template class Parser<AstBuilder, NoTrace>;
+    template class Parser<AstBuilder, Tracer>;
+    template class Parser<NullBuilder, NoTrace>;
+    template class Parser<EventBuilder, NoTrace>;
+    template class Parser<RecordingBuilder, NoTrace>;
 }
\ No newline at end of file
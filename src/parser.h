@@ -1,26 +1,51 @@
 #ifndef PROG_PARSER_H
 #define PROG_PARSER_H
 
-#include "ast.h"
-#include "lexer.h"
+#include "builder.h"
+#include "preprocessor.h"
+#include "trace.h"
+#include "type_names.h"
 #include <vector>
 
 namespace H {
 
 
+/// Recursive descent parser.
+/// @p Builder constructs the nodes (see builder.h): @p AstBuilder yields the AST, @p NullBuilder nothing, @p EventBuilder a node stream.
+/// @p Trace is the tracing policy: @p NoTrace compiles all trace hooks away, @p Tracer emits the @c -ep events.
+template<class Builder, class Trace = NoTrace>
 class Parser {
 public:
-    Parser(const char* file, std::istream& stream, bool evaluate_parsing, bool prettyPrint);
+    using ExpNode = typename Builder::ExpNode;
+    using StmtNode = typename Builder::StmtNode;
+    using SpecifierNode = typename Builder::SpecifierNode;
+    using DeclaratorNode = typename Builder::DeclaratorNode;
+    using SpecDeclNode = typename Builder::SpecDeclNode;
+    using ExtDeclNode = typename Builder::ExtDeclNode;
+    using UnitNode = typename Builder::UnitNode;
+    using ExpList = typename Builder::ExpList;
+    using StmtList = typename Builder::StmtList;
+    using SpecDeclList = typename Builder::SpecDeclList;
+    using ExtDeclList = typename Builder::ExtDeclList;
 
-    void parse_prg();
+    Parser(const char* file, std::istream& stream, Builder builder = Builder(), Trace trace = Trace(), Pos start = Pos(1, 1));
+
+    /// Parses the whole input; the result is empty if the file is.
+    UnitNode parse_prg();
+
+    /// Typedef names in scope; seeded with those declared outside of the input (precompiled preludes, earlier chunks).
+    TypeNames& type_names() { return type_names_; }
+
+    /// Source of the tokens; knows which files the parse included.
+    const Preprocessor& preprocessor() const { return pp_; }
 
 private:
-    Ptr<Exp> parse_exp(const char* ctxt, Tok::Prec p = Tok::Prec::Bottom );
-    Ptr<Exp> parse_primary_expr(const char* ctxt);
-    Ptr<Stmt> parse_stmt(const char* ctxt, bool labeledStmt=false, bool nonblock=false);
+    ExpNode parse_exp(const char* ctxt, Tok::Prec p = Tok::Prec::Bottom );
+    ExpNode parse_primary_expr(const char* ctxt);
+    StmtNode parse_stmt(Rule rule, bool labeledStmt=false, bool nonblock=false);
 
 
-    Ptrs<Exp> parse_expr_list(const char* ctxt);
+    ExpList parse_expr_list(const char* ctxt);
     
 
 
@@ -43,17 +68,19 @@ private:
     void eat_rest_of_statement(bool with_semicolon);
     bool type_follows();
     bool type_follows_twoahead();
-    Ptr<ErrExp> createErrExp(Tracker track, bool with_semicolon, const char* ctxt, const char* status);
-    Ptr<ErrStmt> createErrStmt(Tracker track, bool with_semicolon, const char* ctxt, const char* status);
-    Ptr<ErrDecl> createErrDecl(Tracker track, bool with_semicolon, const char* ctxt, const char* status);
-    Ptr<Exp> parse_member_access(Parser::Tracker track, Ptr<Exp> lhs);
+    bool type_name(const Tok& tok) const { return tok.isa(Tok::Tag::M_Id) && type_names_.contains(tok.str()); }
+    void declare_name() { if (!declared_.str().empty()) type_names_.declare(declared_.str(), typedef_); }
+    ExpNode createErrExp(Tracker track, bool with_semicolon);
+    StmtNode createErrStmt(Tracker track, bool with_semicolon);
+    ExtDeclNode createErrDecl(Tracker track, bool with_semicolon);
+    ExpNode parse_member_access(Tracker track, ExpNode lhs);
 
 
     // New Declarations
-    Ptr<ExternalDeclaration> parse_external_declaration();
-    Ptr<SpecifierDeclarator> parse_specifier_declarator(bool inside_paramlist=false);
-    Ptr<Specifier> parse_specifier();
-    Ptr<Declarator> parse_declarator(bool inside_paramlist=false);
+    ExtDeclNode parse_external_declaration();
+    SpecDeclNode parse_specifier_declarator(bool inside_paramlist=false);
+    SpecifierNode parse_specifier();
+    DeclaratorNode parse_declarator(bool inside_paramlist=false);
     
 
 
@@ -61,12 +88,28 @@ private:
     /// Factory method to build a @p Tracker.
     Tracker tracker() { return Tracker(*this, ahead().loc().begin); }
 
-    /// Invoke @p Lexer to retrieve next @p Tok%en.
+    /// Invoke @p Preprocessor to retrieve next @p Tok%en.
     Tok lex();
 
-    void print_parsing(const char* ctxt, const char* status);
-    bool evaluate_parsing() const { return evaluate_parsing_; }
-    bool prettyPrint() const { return prettyPrint_; }
+    // Trace hooks; they vanish entirely for @p NoTrace
+    void trace_enter(Rule rule) { if constexpr (Trace::enabled) if (rule != Rule::None) trace_.enter(rule, num_lexed_, ahead_.loc().begin); }
+    void trace_exit(Rule rule) { if constexpr (Trace::enabled) if (rule != Rule::None) trace_.exit(rule, num_lexed_, ahead_.loc().begin); }
+    void trace_step(Rule rule) { if constexpr (Trace::enabled) trace_.step(rule, num_lexed_, ahead_.loc().begin); }
+
+    /// Emits balanced enter/exit events for @p rule around a scope.
+    class TraceScope {
+    public:
+        TraceScope(Parser& parser, Rule rule)
+            : parser_(parser)
+            , rule_(rule)
+        { parser_.trace_enter(rule_); }
+        ~TraceScope() { parser_.trace_exit(rule_); }
+
+    private:
+        Parser& parser_;
+        Rule rule_;
+    };
+
     bool meme() const { return meme_; }
 
     /// Get lookahead.
@@ -90,17 +133,19 @@ private:
     /// Same above but uses @p ahead() as @p tok.
     void err(const std::string& what, const char* ctxt) { err(what, ahead(), ctxt); }
 
-    Lexer lexer_;
+    Preprocessor pp_;
     Loc prev_;
     Tok ahead_;
     Tok two_ahead_;
-    bool evaluate_parsing_;
-    bool prettyPrint_;
+    Builder builder_;
     bool meme_;
     bool debugDump = false;
-    int prettyIndent = 1;
-
-    bool semanticCheck = true;
+    Trace trace_;
+    TypeNames type_names_;
+    Tok declared_;                                          ///< Name of the last declarator; empty if it was abstract.
+    bool typedef_ = false;                                  ///< The last specifier declarator was a typedef.
+    std::vector<std::string> params_;                       ///< Parameters of the last parameter list that hide a type name.
+    size_t num_lexed_ = 0;                                  ///< Tokens consumed so far (only counted when tracing).
 };
 
 }
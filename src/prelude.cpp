@@ -0,0 +1,97 @@
+#include "prelude.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace H {
+
+bool Prelude::emit(const std::string& path, const std::string& file, const AstRecord& record, const std::vector<MacroDefinition>& macros) {
+    AstRecord decls = record;
+    uint32_t name = decls.intern(file);
+    std::vector<CacheMacro> table;
+    for (auto& macro : macros) {
+        std::string params;
+        for (auto& param : macro.params) params += (params.empty() ? "" : ",") + param;
+        auto loc = macro.loc;
+        uint32_t flags = (macro.function_like ? 1 : 0) | (macro.variadic ? 2 : 0);
+        table.push_back({decls.intern(macro.name), decls.intern(params), uint32_t(decls.toks.size()), uint32_t(macro.body.size()),
+                         {{loc.begin.row, loc.begin.col}, {loc.finish.row, loc.finish.col}}, flags, 0});
+        for (auto& tok : macro.body) decls.addTok(tok);
+    }
+
+    PreludeHeader header = {{'H', 'P', 'C', 'H'}, version, decls.nodes.size(), decls.toks.size(), decls.strings.size(), table.size(), name, 0};
+    std::string head(reinterpret_cast<const char*>(&header), sizeof(header));
+    head.append(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(CacheMacro));
+    return writeRecord(path, head.data(), head.size(), decls);
+}
+
+bool Prelude::load(const std::string& path) {
+    MappedFile map(path);
+    if (!map || map.size() < sizeof(PreludeHeader)) return false;
+
+    auto base = map.data();
+    auto header = reinterpret_cast<const PreludeHeader*>(base);
+    size_t macros_size = header->num_macros * sizeof(CacheMacro);
+    size_t nodes_size = header->num_nodes * sizeof(CacheNode);
+    size_t toks_size = header->num_toks * sizeof(CacheTok);
+    if (std::memcmp(header->magic, "HPCH", 4) != 0 || header->version != version
+            || header->num_macros > map.size() || header->num_nodes > map.size() || header->num_toks > map.size()
+            || header->strings_size > map.size()
+            || sizeof(PreludeHeader) + macros_size + nodes_size + toks_size + header->strings_size != map.size())
+        return false;
+
+    auto table = reinterpret_cast<const CacheMacro*>(base + sizeof(PreludeHeader));
+    auto nodes = reinterpret_cast<const CacheNode*>(base + sizeof(PreludeHeader) + macros_size);
+    auto toks = reinterpret_cast<const CacheTok*>(base + sizeof(PreludeHeader) + macros_size + nodes_size);
+    auto strings = base + sizeof(PreludeHeader) + macros_size + nodes_size + toks_size;
+    if (!readString(strings, header->strings_size, header->file, file_)) return false;
+    const char* file = file_.c_str();                                   // Locations point into @p file_, which stays put
+
+    for (size_t i = 0; i != header->num_macros; ++i) {
+        const CacheMacro& m = table[i];
+        MacroDefinition macro;
+        std::string params;
+        if (!readString(strings, header->strings_size, m.name, macro.name) || !readString(strings, header->strings_size, m.params, params)
+                || size_t(m.tok) + m.num_toks > header->num_toks)
+            return false;
+        macro.loc = {file, {m.loc.begin.row, m.loc.begin.col}, {m.loc.finish.row, m.loc.finish.col}};
+        macro.function_like = m.flags & 1;
+        macro.variadic = m.flags & 2;
+        for (size_t begin = 0; begin < params.size(); ) {
+            size_t end = std::min(params.find(',', begin), params.size());
+            macro.params.push_back(params.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        macro.body.resize(m.num_toks);
+        for (size_t j = 0; j != m.num_toks; ++j)
+            if (!readTok(toks[m.tok + j], file, strings, header->strings_size, macro.body[j])) return false;
+        macros_.push_back(std::move(macro));
+    }
+
+    unit_ = AstCache::replay(file, nodes, header->num_nodes, toks, header->num_toks, strings, header->strings_size);
+    hash_ = AstCache::hash(base, map.size());
+    return unit_ != nullptr;
+}
+
+void Prelude::seed(Sema& sema) const {
+    if (unit_ == nullptr) return;
+    for (auto& decl : unit_->external_declarations()) decl->declare(sema);
+}
+
+void Prelude::checkBodies(Sema& sema) const {
+    if (unit_ == nullptr) return;
+    for (auto& decl : unit_->external_declarations()) if (decl->functionBody() != nullptr) decl->checkBody(sema);
+}
+
+std::vector<std::string> Prelude::type_names() const {
+    std::vector<std::string> names;
+    if (unit_ == nullptr) return names;
+    for (auto& decl : unit_->external_declarations()) {
+        auto specDecl = decl->specifierDeclarator();
+        if (specDecl != nullptr && specDecl->isTypedef() && !specDecl->name().empty()) names.push_back(specDecl->name());
+    }
+    return names;
+}
+
+}
@@ -0,0 +1,98 @@
+#ifndef PROG_PRELUDE_H
+#define PROG_PRELUDE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ast_cache.h"
+#include "preprocessor.h"
+
+namespace H {
+
+//! =================================================
+//! =========== Precompiled Prelude File ============
+//! =================================================
+//
+// A precompiled prelude is the AST of a checked file and the macros defined at its end:
+//
+//     PreludeHeader | CacheMacro[num_macros] | CacheNode[num_nodes] | CacheTok[num_toks] | strings
+//
+// The node, token and string layout is the one of the AST cache; macro bodies follow the tokens of the AST.
+
+struct PreludeHeader {
+    char magic[4];                                                      // "HPCH"
+    uint32_t version;
+    uint64_t num_nodes;
+    uint64_t num_toks;
+    uint64_t strings_size;
+    uint64_t num_macros;
+    uint32_t file;                                                      // Offset of the prelude's file name in the string table
+    uint32_t padding;
+};
+
+struct CacheMacro {
+    uint32_t name;                                                      // Offsets into the string table
+    uint32_t params;                                                    // Parameter names separated by ','
+    uint32_t tok;                                                       // Index of the first body token
+    uint32_t num_toks;
+    CacheLoc loc;
+    uint32_t flags;                                                     // 1: function-like, 2: variadic
+    uint32_t padding;
+};
+
+
+//! =================================================
+//! ============== Precompiled Prelude ==============
+//! =================================================
+
+/// Shared declarations checked once and entered into the global scope of later runs (@c --emit-pch, @c --include-pch).
+///
+/// The tables of @p Sema point into the AST, so the prelude keeps the AST rather than a separate symbol dump and enters
+/// its globals again, which is linear in their number instead of the prelude's size. Function bodies are only checked
+/// again when a code generator needs them. Its macros are kept as lexed tokens and predefined for the files that use it.
+class Prelude {
+    public:
+        static constexpr uint32_t version = 6;
+
+        Prelude() = default;
+        Prelude(const Prelude&) = delete;                              // Locations point into @p file_
+        Prelude& operator=(const Prelude&) = delete;
+
+        /// Writes @p record, the error-free parse of @p file, and the @p macros defined at its end to @p path.
+        static bool emit(const std::string& path, const std::string& file, const AstRecord& record, const std::vector<MacroDefinition>& macros);
+
+        /// Maps @p path and rebuilds its declarations; @c false if it is missing or malformed.
+        bool load(const std::string& path);
+
+        /// Enters the globals and structs of the prelude into the global scope of @p sema.
+        void seed(Sema& sema) const;
+
+        /// Checks the function bodies of the prelude in @p sema after @p seed(), so that they can be lowered.
+        void checkBodies(Sema& sema) const;
+
+        /// Typedef names the prelude declares; the parser needs them before @p seed() runs.
+        std::vector<std::string> type_names() const;
+
+        /// Macros the prelude defines; the preprocessor starts from them.
+        const std::vector<MacroDefinition>& macros() const { return macros_; }
+
+        /// Content hash of the precompiled file.
+        uint64_t hash() const { return hash_; }
+
+        /// The external declarations as the code generators lower them, before those of the file; @c nullptr if none
+        /// are loaded.
+        TranslationUnit* unit() const { return unit_.get(); }
+
+        const std::string& file() const { return file_; }
+
+    private:
+        std::string file_;
+        Ptr<TranslationUnit> unit_;
+        std::vector<MacroDefinition> macros_;
+        uint64_t hash_ = 0;
+};
+
+}
+
+#endif
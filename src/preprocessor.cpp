@@ -0,0 +1,793 @@
+#include "preprocessor.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace H {
+
+//! =================================================
+//! ================== File Cache ===================
+//! =================================================
+
+namespace {
+    /// Read-only stream buffer over a cached file, so lexing an included file copies nothing.
+    class TextBuf : public std::streambuf {
+        public:
+            TextBuf(const std::string& text) {
+                char* data = const_cast<char*>(text.data());
+                setg(data, data, data + text.size());
+            }
+    };
+}
+
+FileCache& FileCache::process() {
+    static FileCache cache;
+    return cache;
+}
+
+FileCache::File* FileCache::get(const std::string& path) {
+    auto known = paths_.find(path);
+    if (known != paths_.end()) return known->second;
+
+    File* result = nullptr;
+    if (char* canonical = realpath(path.c_str(), nullptr)) {
+        auto& file = files_[canonical];
+        std::free(canonical);
+        if (file == nullptr) {
+            std::ifstream ifs(path, std::ios::binary);
+            if (ifs) {
+                std::ostringstream text;
+                text << ifs.rdbuf();
+                file = std::make_unique<File>();
+                file->name = path;
+                file->text = text.str();
+            }
+        }
+        result = file.get();
+    }
+    paths_.emplace(path, result);
+    return result;
+}
+
+
+//! =================================================
+//! ================ Token Stream ===================
+//! =================================================
+
+Preprocessor::Frame::Frame(const char* name, std::istream& stream, Pos start, FileCache::File* file, size_t conds)
+    : lexer(name, stream, start)
+    , name(name)
+    , file(file)
+    , conds(conds)
+{}
+
+Preprocessor::Preprocessor(const char* file, std::istream& stream, Pos start, FileCache& cache)
+    : cache_(cache)
+{
+    frames_.emplace_back(std::make_unique<Frame>(file, stream, start, nullptr, 0));
+    frames_.back()->guard = Guard::None;
+
+    for (auto& definition : cache.predefined) {
+        Macro macro;
+        macro.name = Sym(definition.name);
+        macro.loc = definition.loc;
+        macro.function_like = definition.function_like;
+        macro.variadic = definition.variadic;
+        macro.params = definition.params;
+        macro.num_params = macro.params.size();
+        macro.body = definition.body;
+        find_params(macro);
+        macros_[definition.name] = std::move(macro);
+    }
+}
+
+Preprocessor::~Preprocessor() {}
+
+Tok Preprocessor::lex() {
+    while (true) {
+        Ref ref;
+        if (!pending_.empty()) {
+            ref = pending_.back();
+            pending_.pop_back();
+        } else {
+            if (!made_.empty()) made_.clear();                          // No reference is left
+            if (!hide_sets_.empty()) hide_sets_.clear();
+
+            Tok tok = next_tok();
+            if (tok.isa(Tok::Tag::M_EoF)) {
+                if (end_of_file()) continue;
+                return tok;
+            }
+            if (tok.isa(Tok::Tag::P_Preprocessor_Stringize) && tok.bol()) {
+                directive(tok);
+                continue;
+            }
+
+            Frame& frame = *frames_.back();
+            if (frame.guard != Guard::Inside) frame.guard = Guard::None;
+            if (!tok.isa(Tok::Tag::M_Id) || macros_.empty()) return tok;
+            auto it = macros_.find(tok.str());
+            if (it == macros_.end()) return tok;
+
+            ref = {make(std::move(tok)), nullptr, Loc()};
+            if (!expand(pending_, true, ref, it->second)) return output(ref);
+            continue;
+        }
+
+        auto m = macro(ref);
+        if (m == nullptr || !expand(pending_, true, ref, *m)) return output(ref);
+    }
+}
+
+/// Next token of the current file, without preprocessing.
+Tok Preprocessor::next_tok() {
+    if (has_lookahead_) {
+        has_lookahead_ = false;
+        return std::move(lookahead_);
+    }
+    return frames_.back()->lexer.lex();
+}
+
+std::vector<MacroDefinition> Preprocessor::definitions() const {
+    std::vector<MacroDefinition> result;
+    for (auto& [name, macro] : macros_) result.push_back({name, macro.loc, macro.function_like, macro.variadic, macro.params, macro.body});
+    std::sort(result.begin(), result.end(), [](auto& a, auto& b) { return a.name < b.name; });
+    return result;
+}
+
+/// Leaves the current file; @c false at the end of the main file.
+bool Preprocessor::end_of_file() {
+    Frame& frame = *frames_.back();
+    while (conds_.size() > frame.conds) {
+        conds_.back().loc.err() << "unterminated conditional directive" << conds_.back().loc.endErr();
+        conds_.pop_back();
+    }
+    if (frames_.size() == 1) return false;
+
+    if (frame.guard == Guard::After) frame.file->guard = frame.guard_name;
+    frames_.pop_back();
+    return true;
+}
+
+std::vector<Tok> Preprocessor::rest_of_line() {
+    std::vector<Tok> line;
+    Lexer& lexer = frames_.back()->lexer;
+    while (!lexer.at_line_end()) line.push_back(lexer.lex());
+    return line;
+}
+
+
+//! =================================================
+//! ================== Directives ===================
+//! =================================================
+
+void Preprocessor::directive(const Tok& hash) {
+    Frame& frame = *frames_.back();
+    std::vector<Tok> line = rest_of_line();
+    if (line.empty()) return;                                           // Null directive
+
+    const Tok& name = line.front();
+    std::vector<Tok> args(line.begin() + 1, line.end());
+    const std::string& d = name.str();
+
+    if (frame.guard == Guard::Start) {
+        frame.guard = Guard::None;
+        if (d == "ifndef" && args.size() == 1) {
+            frame.guard = Guard::Inside;
+            frame.guard_name = args.front().str();
+        }
+    } else if (frame.guard == Guard::After) {
+        frame.guard = Guard::None;
+    }
+
+    if (d == "if" || d == "ifdef" || d == "ifndef") {
+        bool value = condition(name, args);
+        conds_.push_back({hash.loc(), value, false});
+        if (!value) skip_group();
+    } else if (d == "elif" || d == "else") {
+        if (conds_.size() == frame.conds) {
+            name.loc().err() << "#" << d << " without #if" << name.loc().endErr();
+            return;
+        }
+        Cond& cond = conds_.back();
+        if (cond.else_seen) name.loc().err() << "#" << d << " after #else" << name.loc().endErr();
+        if (d == "else") cond.else_seen = true;
+        if (frame.guard == Guard::Inside && conds_.size() == frame.conds + 1) frame.guard = Guard::None;
+        skip_group();                                                   // The group before was included
+    } else if (d == "endif") {
+        endif(name);
+    } else if (d == "include") {
+        include(name, args);
+    } else if (d == "define") {
+        define(name, args);
+    } else if (d == "undef") {
+        if (args.size() != 1) name.loc().err() << "#undef expects a macro name" << name.loc().endErr();
+        else macros_.erase(args.front().str());
+    } else if (d == "pragma") {
+        if (args.size() == 1 && args.front().str() == "once" && frame.file != nullptr) {
+            frame.file->once = true;
+            entered_.insert(frame.file);
+        }
+    } else if (d == "error" || d == "warning") {
+        std::string message;
+        for (auto& arg : args) message += (message.empty() ? "" : " ") + arg.str();
+        if (d == "error") name.loc().err() << "#error " << message << name.loc().endErr();
+        else name.loc().warn() << "#warning " << message << name.loc().endErr();
+    } else {
+        name.loc().err() << "unknown preprocessing directive '#" << d << "'" << name.loc().endErr();
+    }
+}
+
+void Preprocessor::endif(const Tok& directive) {
+    Frame& frame = *frames_.back();
+    if (conds_.size() == frame.conds) {
+        directive.loc().err() << "#endif without #if" << directive.loc().endErr();
+        return;
+    }
+    conds_.pop_back();
+    if (frame.guard == Guard::Inside && conds_.size() == frame.conds) frame.guard = Guard::After;
+}
+
+/// Skips the lines of an excluded group up to the directive that ends it. Only directive names are lexed.
+void Preprocessor::skip_group() {
+    Frame& frame = *frames_.back();
+    Lexer& lexer = frame.lexer;
+    size_t depth = 0;
+    while (!lexer.at_eof()) {                                           // end_of_file() reports the open conditional
+        if (!lexer.directive_follows()) {
+            lexer.skip_line();
+            continue;
+        }
+        lexer.lex();
+        if (lexer.at_line_end()) continue;                              // Null directive
+
+        Tok name = lexer.lex();
+        const std::string& d = name.str();
+        if (d == "if" || d == "ifdef" || d == "ifndef") {
+            ++depth;
+        } else if (d == "endif") {
+            if (depth == 0) {
+                lexer.skip_line();
+                endif(name);
+                return;
+            }
+            --depth;
+        } else if (depth == 0 && (d == "elif" || d == "else")) {
+            Cond& cond = conds_.back();
+            if (cond.else_seen) name.loc().err() << "#" << d << " after #else" << name.loc().endErr();
+            if (frame.guard == Guard::Inside && conds_.size() == frame.conds + 1) frame.guard = Guard::None;
+            if (d == "else") {
+                cond.else_seen = true;
+                if (!cond.taken) {
+                    cond.taken = true;
+                    lexer.skip_line();
+                    return;
+                }
+            } else if (!cond.taken && condition(name, rest_of_line())) {
+                cond.taken = true;
+                return;
+            }
+        }
+        lexer.skip_line();
+    }
+}
+
+void Preprocessor::include(const Tok& directive, const std::vector<Tok>& args) {
+    // "name" is one string literal, <name> the spelling of the tokens between the angle brackets
+    std::string name;
+    bool angled = false;
+    if (args.size() == 1 && args.front().isa(Tok::Tag::S_Literal)) {
+        name = args.front().str().substr(1, args.front().str().size() - 2);
+    } else if (args.size() >= 3 && args.front().isa(Tok::Tag::P_Less) && args.back().isa(Tok::Tag::P_Greater)) {
+        angled = true;
+        for (size_t i = 1; i + 1 < args.size(); ++i) name += args[i].str();
+    } else {
+        directive.loc().err() << "#include expects \"FILE\" or <FILE>" << directive.loc().endErr();
+        return;
+    }
+
+    FileCache::File* file = nullptr;
+    if (!angled || name.front() == '/') {
+        std::string includer = frames_.back()->name;
+        size_t slash = includer.rfind('/');
+        file = cache_.get(name.front() == '/' || slash == std::string::npos ? name : includer.substr(0, slash + 1) + name);
+    }
+    for (size_t i = 0; file == nullptr && i != cache_.include_dirs.size(); ++i) file = cache_.get(cache_.include_dirs[i] + "/" + name);
+    if (file == nullptr) {
+        directive.loc().err() << "cannot find include file '" << name << "'" << directive.loc().endErr();
+        return;
+    }
+    if (found_.insert(file).second) included_.push_back(file);
+
+    // Multiple-include optimisation
+    if (file->once && entered_.count(file)) return;
+    if (!file->guard.empty() && macros_.count(file->guard)) return;
+
+    if (frames_.size() > 200) {
+        directive.loc().err() << "#include nested too deeply" << directive.loc().endErr();
+        return;
+    }
+    auto buf = std::make_unique<TextBuf>(file->text);
+    auto input = std::make_unique<std::istream>(buf.get());
+    frames_.emplace_back(std::make_unique<Frame>(file->name.c_str(), *input, Pos(1, 1), file, conds_.size()));
+    frames_.back()->buf = std::move(buf);
+    frames_.back()->input = std::move(input);
+    entered_.insert(file);
+}
+
+void Preprocessor::define(const Tok& directive, const std::vector<Tok>& args) {
+    if (args.empty() || !(args.front().isa(Tok::Tag::M_Id) || args.front().token_type() == "keyword")) {
+        directive.loc().err() << "#define expects a macro name" << directive.loc().endErr();
+        return;
+    }
+    const Tok& name = args.front();
+    Macro macro;
+    macro.name = Sym(name.str());
+    macro.loc = name.loc();
+
+    // A '(' right after the name starts a parameter list
+    size_t i = 1;
+    if (args.size() > 1 && args[1].isa(Tok::Tag::D_Parenthesis_L) && args[1].loc().begin.row == name.loc().finish.row
+            && args[1].loc().begin.col == name.loc().finish.col + 1) {
+        macro.function_like = true;
+        bool closed = false;
+        for (i = 2; i < args.size() && !closed; ) {
+            if (args[i].isa(Tok::Tag::D_Parenthesis_R) && macro.params.empty()) {
+                closed = true;
+            } else if (args[i].isa(Tok::Tag::P_Tripple_Dot)) {
+                macro.variadic = true;
+                macro.params.push_back("__VA_ARGS__");
+                closed = ++i < args.size() && args[i].isa(Tok::Tag::D_Parenthesis_R);
+                if (!closed) break;
+            } else if (args[i].isa(Tok::Tag::M_Id)) {
+                macro.params.push_back(args[i].str());
+                if (++i == args.size()) break;
+                closed = args[i].isa(Tok::Tag::D_Parenthesis_R);
+                if (!closed && !args[i].isa(Tok::Tag::P_Comma)) break;
+            } else {
+                break;
+            }
+            ++i;
+        }
+        if (!closed) {
+            name.loc().err() << "invalid parameter list of macro '" << name.str() << "'" << name.loc().endErr();
+            return;
+        }
+    }
+    macro.num_params = macro.params.size();
+    macro.body.assign(args.begin() + i, args.end());
+    find_params(macro);
+
+    auto& body = macro.body;
+    if (!body.empty() && (body.front().isa(Tok::Tag::P_Preprocessor_Concat) || body.back().isa(Tok::Tag::P_Preprocessor_Concat))) {
+        name.loc().err() << "'##' cannot appear at either end of a macro expansion" << name.loc().endErr();
+        return;
+    }
+    for (size_t j = 0; macro.function_like && j != body.size(); ++j) {
+        if (body[j].isa(Tok::Tag::P_Preprocessor_Stringize) && (j + 1 == body.size() || macro.param[j+1] < 0)) {
+            body[j].loc().err() << "'#' is not followed by a macro parameter" << body[j].loc().endErr();
+            return;
+        }
+    }
+
+    auto [it, inserted] = macros_.emplace(name.str(), macro);
+    if (inserted) return;
+
+    auto& old = it->second;
+    bool same = old.function_like == macro.function_like && old.params == macro.params && old.body.size() == body.size();
+    for (size_t j = 0; same && j != body.size(); ++j) same = old.body[j].str() == body[j].str();
+    if (!same) name.loc().warn() << "'" << name.str() << "' redefined" << name.loc().endErr();
+    old = std::move(macro);
+}
+
+/// Sets the parameter index of each body token of @p macro.
+void Preprocessor::find_params(Macro& macro) {
+    macro.param.clear();
+    for (auto& tok : macro.body) {
+        auto param = tok.isa(Tok::Tag::M_Id) ? std::find(macro.params.begin(), macro.params.end(), tok.str()) : macro.params.end();
+        macro.param.push_back(param == macro.params.end() ? -1 : int(param - macro.params.begin()));
+    }
+}
+
+
+//! =================================================
+//! =================== Macros ======================
+//! =================================================
+
+/// The macro @p ref invokes, unless it is hidden.
+const Preprocessor::Macro* Preprocessor::macro(const Ref& ref) const {
+    if (!ref.tok->isa(Tok::Tag::M_Id) || macros_.empty()) return nullptr;
+    auto it = macros_.find(ref.tok->str());
+    if (it == macros_.end() || hidden(ref.hide, it->second.name)) return nullptr;
+    return &it->second;
+}
+
+/// Pops the next token off @p stack or, once it is empty and @p from_file is set, reads it from the file; @c false at the end.
+bool Preprocessor::next_ref(std::vector<Ref>& stack, bool from_file, Ref& ref) {
+    if (!stack.empty()) {
+        ref = stack.back();
+        stack.pop_back();
+        return true;
+    }
+    if (!from_file) return false;
+
+    Tok tok = next_tok();
+    if (tok.isa(Tok::Tag::M_EoF)) {
+        lookahead_ = std::move(tok);
+        has_lookahead_ = true;
+        return false;
+    }
+    ref = {make(std::move(tok)), nullptr, Loc()};
+    return true;
+}
+
+/// Replaces the invocation of @p macro by @p name with its expansion on top of @p stack.
+/// @c false if a function-like macro is not followed by '(', which leaves @p name as an ordinary identifier.
+bool Preprocessor::expand(std::vector<Ref>& stack, bool from_file, const Ref& name, const Macro& macro) {
+    std::vector<std::vector<Ref>> args;
+    const HideSet* hide;
+    if (macro.function_like) {
+        if (!stack.empty()) {
+            if (!stack.back().tok->isa(Tok::Tag::D_Parenthesis_L)) return false;
+            stack.pop_back();
+        } else {
+            if (!from_file) return false;
+            Tok tok = next_tok();
+            if (!tok.isa(Tok::Tag::D_Parenthesis_L)) {
+                lookahead_ = std::move(tok);                            // May be a directive or the end of the file
+                has_lookahead_ = true;
+                return false;
+            }
+        }
+        if (!collect_args(stack, from_file, macro, name, args, hide)) return true;
+    } else {
+        hide = with(name.hide, macro.name);
+    }
+
+    Loc at = name.at.file != nullptr ? name.at : name.tok->loc();
+    auto result = substitute(macro, args, hide, at);
+    stack.insert(stack.end(), result.rbegin(), result.rend());
+    return true;
+}
+
+/// Reads the arguments of a function-like macro after its '('. The hide set of the expansion is that of the name and the ')'.
+bool Preprocessor::collect_args(std::vector<Ref>& stack, bool from_file, const Macro& macro, const Ref& name, std::vector<std::vector<Ref>>& args, const HideSet*& hide) {
+    args.assign(1, {});
+    size_t depth = 0;
+    Ref ref;
+    while (true) {
+        if (!next_ref(stack, from_file, ref)) {
+            Loc loc = name.tok->loc();
+            loc.err() << "unterminated argument list invoking macro '" << name.tok->str() << "'" << loc.endErr();
+            return false;
+        }
+        Tok::Tag tag = ref.tok->tag();
+        if (tag == Tok::Tag::D_Parenthesis_R && depth == 0) break;
+        if (tag == Tok::Tag::D_Parenthesis_L) ++depth;
+        if (tag == Tok::Tag::D_Parenthesis_R) --depth;
+        if (tag == Tok::Tag::P_Comma && depth == 0 && !(macro.variadic && args.size() == macro.num_params)) {
+            args.emplace_back();
+            continue;
+        }
+        args.back().push_back(ref);
+    }
+
+    if (macro.num_params == 0 && args.size() == 1 && args.front().empty()) args.clear();
+    if (macro.variadic && args.size() + 1 == macro.num_params) args.emplace_back();
+    if (args.size() != macro.num_params) {
+        Loc loc = name.tok->loc();
+        loc.err() << "macro '" << name.tok->str() << "' expects " << macro.num_params << " arguments, got " << args.size() << loc.endErr();
+        return false;
+    }
+    hide = with(intersect(name.hide, ref.hide), macro.name);
+    return true;
+}
+
+/// The body of @p macro with its parameters replaced, # and ## applied and @p hide added to every token.
+std::vector<Preprocessor::Ref> Preprocessor::substitute(const Macro& macro, const std::vector<std::vector<Ref>>& args, const HideSet* hide, Loc at) {
+    std::vector<Ref> out;
+    std::vector<std::vector<Ref>> expanded(args.size());
+    std::vector<bool> done(args.size());
+    bool placemarker = false;                                           // The left operand of the next ## is an empty argument
+
+    auto& body = macro.body;
+    for (size_t i = 0; i != body.size(); ++i) {
+        bool stringizes = macro.function_like && body[i].isa(Tok::Tag::P_Preprocessor_Stringize);
+        if (body[i].isa(Tok::Tag::P_Preprocessor_Concat)) {
+            std::vector<Ref> rhs;
+            size_t j = i + 1;
+            if (macro.function_like && body[j].isa(Tok::Tag::P_Preprocessor_Stringize)) rhs = {{stringize(args[macro.param[++j]], at), nullptr, Loc()}};
+            else if (macro.param[j] >= 0) rhs = args[macro.param[j]];
+            else rhs = {{&body[j], nullptr, at}};
+
+            if (placemarker) {
+                out.insert(out.end(), rhs.begin(), rhs.end());
+            } else if (!rhs.empty()) {
+                paste(out.back(), rhs.front());
+                out.insert(out.end(), rhs.begin() + 1, rhs.end());
+            }
+            placemarker = placemarker && rhs.empty();
+            i = j;
+        } else if (stringizes) {
+            out.push_back({stringize(args[macro.param[++i]], at), nullptr, Loc()});
+            placemarker = false;
+        } else if (int p = macro.param[i]; p >= 0) {
+            bool pasted = i + 1 != body.size() && body[i+1].isa(Tok::Tag::P_Preprocessor_Concat);
+            if (pasted) {
+                out.insert(out.end(), args[p].begin(), args[p].end());
+                placemarker = args[p].empty();
+            } else {
+                if (!done[p]) {
+                    expanded[p] = expand_all(args[p]);
+                    done[p] = true;
+                }
+                out.insert(out.end(), expanded[p].begin(), expanded[p].end());
+            }
+        } else {
+            out.push_back({&body[i], nullptr, at});
+            placemarker = false;
+        }
+    }
+
+    for (auto& ref : out) ref.hide = unite(ref.hide, hide);
+    return out;
+}
+
+/// Fully expands @p toks on their own (the arguments of a macro before they are substituted).
+std::vector<Preprocessor::Ref> Preprocessor::expand_all(const std::vector<Ref>& toks) {
+    std::vector<Ref> stack(toks.rbegin(), toks.rend());
+    std::vector<Ref> out;
+    Ref ref;
+    while (next_ref(stack, false, ref)) {
+        auto m = macro(ref);
+        if (m == nullptr || !expand(stack, false, ref, *m)) out.push_back(ref);
+    }
+    return out;
+}
+
+/// String literal spelling @p arg; tokens are separated by a space where the source has white space.
+const Tok* Preprocessor::stringize(const std::vector<Ref>& arg, Loc at) {
+    std::string str = "\"";
+    for (size_t i = 0; i != arg.size(); ++i) {
+        const Tok& tok = *arg[i].tok;
+        if (i != 0) {
+            Loc prev = arg[i-1].tok->loc(), loc = tok.loc();
+            if (prev.finish.row != loc.begin.row || prev.finish.col + 1 != loc.begin.col) str += ' ';
+        }
+        bool quoted = tok.isa(Tok::Tag::S_Literal) || tok.isa(Tok::Tag::C_Character);
+        for (char c : tok.str()) {
+            if (quoted && (c == '"' || c == '\\')) str += '\\';
+            str += c;
+        }
+    }
+    str += '"';
+    std::string type = "string-literal";
+    return make(Tok(at, Tok::Tag::S_Literal, str, type));
+}
+
+/// Replaces @p lhs by the token spelled by @p lhs and @p rhs together.
+void Preprocessor::paste(Ref& lhs, const Ref& rhs) {
+    Tok left = output(lhs);
+    std::string spelling = left.str() + rhs.tok->str();
+    std::istringstream stream(spelling);
+    Lexer lexer(left.loc().file, stream, left.loc().begin);
+    Tok tok = lexer.lex();
+    if (tok.isa(Tok::Tag::M_EoF) || !lexer.lex().isa(Tok::Tag::M_EoF)) {
+        Loc loc = left.loc();
+        loc.err() << "pasting \"" << left.str() << "\" and \"" << rhs.tok->str() << "\" does not give a valid token" << loc.endErr();
+        return;
+    }
+    lhs = {make(tok.at(left.loc())), lhs.hide, Loc()};
+}
+
+bool Preprocessor::hidden(const HideSet* set, Sym name) {
+    for (; set != nullptr; set = set->next) {
+        if (set->name == name) return true;
+    }
+    return false;
+}
+
+const Preprocessor::HideSet* Preprocessor::with(const HideSet* set, Sym name) {
+    if (hidden(set, name)) return set;
+    hide_sets_.push_back({name, set});
+    return &hide_sets_.back();
+}
+
+const Preprocessor::HideSet* Preprocessor::unite(const HideSet* a, const HideSet* b) {
+    if (a == nullptr || a == b) return b;
+    for (; a != nullptr; a = a->next) b = with(b, a->name);
+    return b;
+}
+
+const Preprocessor::HideSet* Preprocessor::intersect(const HideSet* a, const HideSet* b) {
+    const HideSet* result = nullptr;
+    for (; a != nullptr; a = a->next) {
+        if (hidden(b, a->name)) result = with(result, a->name);
+    }
+    return result;
+}
+
+
+//! =================================================
+//! ============ Conditional Expressions ============
+//! =================================================
+
+namespace {
+    /// Evaluates the (already macro expanded) expression of an @c #if with @c int64_t arithmetic.
+    class CondEval {
+        public:
+            CondEval(const std::vector<Tok>& toks)
+                : toks_(toks)
+            {}
+
+            /// @c false if the expression is malformed.
+            bool eval(int64_t& value) {
+                value = conditional();
+                return ok_ && i_ == toks_.size();
+            }
+
+            bool divided_by_zero() const { return div_zero_; }
+
+        private:
+            int64_t conditional() {
+                int64_t cond = binary(Tok::Prec::LogicalOR);
+                if (!accept(Tok::Tag::P_Inline_If)) return cond;
+                if (!cond) ++dead_;
+                int64_t consequence = conditional();
+                if (!cond) --dead_;
+                if (!accept(Tok::Tag::P_Colon)) ok_ = false;
+                if (cond) ++dead_;
+                int64_t alternative = conditional();
+                if (cond) --dead_;
+                return cond ? consequence : alternative;
+            }
+
+            int64_t binary(Tok::Prec min) {
+                int64_t lhs = unary();
+                while (i_ != toks_.size()) {
+                    Tok::Tag op = toks_[i_].tag();
+                    Tok::Prec prec = Tok::tag2prec_l(op);
+                    if (prec < Tok::Prec::LogicalOR || prec > Tok::Prec::Multiplicative || prec < min) break;
+                    ++i_;
+                    bool skip = (op == Tok::Tag::P_Logical_And && !lhs) || (op == Tok::Tag::P_Logical_Or && lhs);
+                    if (skip) ++dead_;
+                    int64_t rhs = binary(Tok::tag2prec_r(op));
+                    if (skip) --dead_;
+                    lhs = apply(op, lhs, rhs);
+                }
+                return lhs;
+            }
+
+            int64_t unary() {
+                if (i_ == toks_.size()) {
+                    ok_ = false;
+                    return 0;
+                }
+                const Tok& tok = toks_[i_++];
+                switch (tok.tag()) {
+                    case Tok::Tag::P_Addition: return unary();
+                    case Tok::Tag::P_Substraction: return -(uint64_t) unary();
+                    case Tok::Tag::P_Logical_Not: return !unary();
+                    case Tok::Tag::P_Bitwise_Not: return ~unary();
+                    case Tok::Tag::D_Parenthesis_L: {
+                        int64_t value = conditional();
+                        if (!accept(Tok::Tag::D_Parenthesis_R)) ok_ = false;
+                        return value;
+                    }
+                    case Tok::Tag::C_Integer: return tok.value();
+                    case Tok::Tag::C_Character: return character(tok.str());
+                    case Tok::Tag::M_Id: return 0;                      // Identifiers left after expansion are 0
+                    default:
+                        if (tok.token_type() == "keyword") return 0;
+                        ok_ = false;
+                        return 0;
+                }
+            }
+
+            int64_t apply(Tok::Tag op, int64_t lhs, int64_t rhs) {
+                switch (op) {
+                    case Tok::Tag::P_Multiplication: return (uint64_t) lhs * (uint64_t) rhs;
+                    case Tok::Tag::P_Division:
+                    case Tok::Tag::P_Modulo:
+                        if (rhs == 0 || (lhs == INT64_MIN && rhs == -1)) {
+                            if (!dead_) div_zero_ = true;
+                            return 0;
+                        }
+                        return op == Tok::Tag::P_Division ? lhs / rhs : lhs % rhs;
+                    case Tok::Tag::P_Addition: return (uint64_t) lhs + (uint64_t) rhs;
+                    case Tok::Tag::P_Substraction: return (uint64_t) lhs - (uint64_t) rhs;
+                    case Tok::Tag::P_Bitwise_Shift_L: return rhs < 0 || rhs > 63 ? 0 : (uint64_t) lhs << rhs;
+                    case Tok::Tag::P_Bitwise_Shift_R: return rhs < 0 || rhs > 63 ? 0 : lhs >> rhs;
+                    case Tok::Tag::P_Less: return lhs < rhs;
+                    case Tok::Tag::P_Greater: return lhs > rhs;
+                    case Tok::Tag::P_Less_Equal: return lhs <= rhs;
+                    case Tok::Tag::P_Greater_Equal: return lhs >= rhs;
+                    case Tok::Tag::P_Equal: return lhs == rhs;
+                    case Tok::Tag::P_Unequal: return lhs != rhs;
+                    case Tok::Tag::P_Bitwise_And: return lhs & rhs;
+                    case Tok::Tag::P_Bitwise_Xor: return lhs ^ rhs;
+                    case Tok::Tag::P_Bitwise_Or: return lhs | rhs;
+                    case Tok::Tag::P_Logical_And: return lhs && rhs;
+                    case Tok::Tag::P_Logical_Or: return lhs || rhs;
+                    default:
+                        ok_ = false;                                    // Assignments
+                        return 0;
+                }
+            }
+
+            static int64_t character(const std::string& str) {
+                if (str.size() < 3) return 0;
+                if (str[1] != '\\') return (unsigned char) str[1];
+                switch (str[2]) {
+                    case 'a': return '\a';
+                    case 'b': return '\b';
+                    case 'f': return '\f';
+                    case 'n': return '\n';
+                    case 'r': return '\r';
+                    case 't': return '\t';
+                    case 'v': return '\v';
+                    default: return (unsigned char) str[2];
+                }
+            }
+
+            bool accept(Tok::Tag tag) {
+                if (i_ == toks_.size() || !toks_[i_].isa(tag)) return false;
+                ++i_;
+                return true;
+            }
+
+            const std::vector<Tok>& toks_;
+            size_t i_ = 0;
+            int dead_ = 0;                                              // Inside an operand that is not evaluated
+            bool ok_ = true;
+            bool div_zero_ = false;
+    };
+}
+
+/// Value of the condition of @c #if, @c #elif, @c #ifdef or @c #ifndef @p directive.
+bool Preprocessor::condition(const Tok& directive, const std::vector<Tok>& args) {
+    const std::string& d = directive.str();
+    if (d == "ifdef" || d == "ifndef") {
+        if (args.size() != 1) {
+            directive.loc().err() << "#" << d << " expects a macro name" << directive.loc().endErr();
+            return false;
+        }
+        return macros_.count(args.front().str()) == (d == "ifdef");
+    }
+
+    // 'defined X' and 'defined(X)' are replaced before macros are expanded
+    std::vector<Ref> refs;
+    for (size_t i = 0; i != args.size(); ++i) {
+        const Tok& tok = args[i];
+        if (tok.str() != "defined") {
+            refs.push_back({&tok, nullptr, Loc()});
+            continue;
+        }
+        bool paren = i + 1 < args.size() && args[i+1].isa(Tok::Tag::D_Parenthesis_L);
+        size_t name = i + 1 + paren;
+        if (name >= args.size() || (paren && (name + 1 >= args.size() || !args[name+1].isa(Tok::Tag::D_Parenthesis_R)))) {
+            tok.loc().err() << "'defined' expects a macro name" << tok.loc().endErr();
+            return false;
+        }
+        std::string value = macros_.count(args[name].str()) ? "1" : "0";
+        std::string type = "constant";
+        refs.push_back({make(Tok(tok.loc(), Tok::Tag::C_Integer, value, type, value == "1")), nullptr, Loc()});
+        i = name + paren;
+    }
+    std::vector<Tok> toks;
+    for (auto& ref : expand_all(refs)) toks.push_back(output(ref));
+
+    int64_t value;
+    CondEval eval(toks);
+    if (!eval.eval(value)) {
+        directive.loc().err() << "invalid expression in #" << d << directive.loc().endErr();
+        return false;
+    }
+    if (eval.divided_by_zero()) directive.loc().err() << "division by zero in #" << d << directive.loc().endErr();
+    return value != 0;
+}
+
+}
@@ -0,0 +1,174 @@
+#ifndef PROG_PREPROCESSOR_H
+#define PROG_PREPROCESSOR_H
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "lexer.h"
+#include "sym.h"
+
+namespace H {
+
+//! =================================================
+//! ================== File Cache ===================
+//! =================================================
+
+/// A macro as its @c #define spelled it; the form in which macros pass from one preprocessor to another.
+struct MacroDefinition {
+    std::string name;
+    Loc loc;
+    bool function_like = false;
+    bool variadic = false;                                              // The last parameter is __VA_ARGS__
+    std::vector<std::string> params;
+    std::vector<Tok> body;
+};
+
+/// Headers read by this process: each file is read from disk at most once.
+class FileCache {
+    public:
+        struct File {
+            std::string name;                                           // Path it was first opened by; its tokens' locations point here
+            std::string text;
+            std::string guard;                                          // Macro of an include guard around the whole file, if any
+            bool once = false;                                          // Contains #pragma once
+        };
+
+        /// The cache shared by all preprocessors of the process.
+        static FileCache& process();
+
+        /// The file at @p path, read on first use; @c nullptr if it cannot be read.
+        File* get(const std::string& path);
+
+        std::vector<std::string> include_dirs;                          // Searched for <...>, and after the includer's directory for "..."
+        std::vector<MacroDefinition> predefined;                        // Defined before the first line of every main file
+
+    private:
+        std::unordered_map<std::string, File*> paths_;                  // Spelling -> file (nullptr if unreadable)
+        std::unordered_map<std::string, std::unique_ptr<File>> files_;  // Canonical path -> file
+};
+
+
+//! =================================================
+//! ================= Preprocessor ==================
+//! =================================================
+
+/// Token source between @p Lexer and @p Parser that executes directives and expands macros:
+/// @c #include, @c #define / @c #undef, @c #if / @c #ifdef / @c #ifndef / @c #elif / @c #else / @c #endif,
+/// @c #pragma @c once, @c #error and @c #warning.
+///
+/// Multiple-include optimisation: a header whose tokens are all inside one @c #ifndef @c X ... @c #endif remembers @c X in
+/// the @p FileCache; while @c X is defined, including it again costs neither I/O nor lexing. The same holds for @c #pragma @c once.
+///
+/// Macro expansion follows Prosser's algorithm on token references: a macro body is lexed once when it is defined and an
+/// expansion splices references to its tokens and to the argument tokens; only @c # and @c ## make new tokens. Each reference
+/// carries a hide set (the macros it came out of), which stops recursion. Arguments are expanded at most once per invocation.
+class Preprocessor {
+    public:
+        Preprocessor(const char* file, std::istream& stream, Pos start = Pos(1, 1), FileCache& cache = FileCache::process());
+        ~Preprocessor();
+
+        Loc loc() const { return frames_.front()->lexer.loc(); }
+        Tok lex();                                                      ///< Next token after preprocessing.
+
+        /// Macros defined at this point, sorted by name.
+        std::vector<MacroDefinition> definitions() const;
+
+        /// Files found for an @c #include so far, each once, whether or not the multiple-include optimisation skipped them.
+        const std::vector<const FileCache::File*>& included() const { return included_; }
+
+    private:
+        enum class Guard { Start, Inside, After, None };               // Include guard detection per file
+
+        struct Frame {
+            Frame(const char* name, std::istream& stream, Pos start, FileCache::File* file, size_t conds);
+
+            std::unique_ptr<std::streambuf> buf;                        // Owned input of included files
+            std::unique_ptr<std::istream> input;
+            Lexer lexer;
+            const char* name;
+            FileCache::File* file;                                      // nullptr for the main file
+            size_t conds;                                               // Conditionals open when the file was entered
+            Guard guard = Guard::Start;
+            std::string guard_name;
+        };
+
+        struct Cond {
+            Loc loc;
+            bool taken;                                                 // A group of this conditional was included
+            bool else_seen;
+        };
+
+        struct Macro {
+            Sym name;
+            Loc loc;
+            bool function_like = false;
+            bool variadic = false;                                      // The last parameter is __VA_ARGS__
+            size_t num_params = 0;
+            std::vector<std::string> params;
+            std::vector<Tok> body;
+            std::vector<int> param;                                     // Parameter index of each body token; -1 for others
+        };
+
+        /// Persistent set of macro names; sets share their tails.
+        struct HideSet {
+            Sym name;
+            const HideSet* next;
+        };
+
+        /// A token of an expansion.
+        struct Ref {
+            const Tok* tok;
+            const HideSet* hide;
+            Loc at;                                                     // Where the token is reported; unset: its own location
+        };
+
+        std::vector<Tok> rest_of_line();
+        void directive(const Tok& hash);
+        void include(const Tok& directive, const std::vector<Tok>& args);
+        void define(const Tok& directive, const std::vector<Tok>& args);
+        void endif(const Tok& directive);
+        void skip_group();
+        bool condition(const Tok& directive, const std::vector<Tok>& args);
+        bool end_of_file();
+        static void find_params(Macro& macro);
+
+        Tok next_tok();
+        bool next_ref(std::vector<Ref>& stack, bool from_file, Ref& ref);
+        bool expand(std::vector<Ref>& stack, bool from_file, const Ref& name, const Macro& macro);
+        bool collect_args(std::vector<Ref>& stack, bool from_file, const Macro& macro, const Ref& name, std::vector<std::vector<Ref>>& args, const HideSet*& hide);
+        std::vector<Ref> substitute(const Macro& macro, const std::vector<std::vector<Ref>>& args, const HideSet* hide, Loc at);
+        std::vector<Ref> expand_all(const std::vector<Ref>& toks);
+        const Tok* stringize(const std::vector<Ref>& arg, Loc at);
+        void paste(Ref& lhs, const Ref& rhs);
+        const Macro* macro(const Ref& ref) const;
+        static Tok output(const Ref& ref) { return ref.at.file == nullptr ? *ref.tok : ref.tok->at(ref.at); }
+
+        const Tok* make(Tok&& tok) { made_.push_back(std::move(tok)); return &made_.back(); }
+        static bool hidden(const HideSet* set, Sym name);
+        const HideSet* with(const HideSet* set, Sym name);
+        const HideSet* unite(const HideSet* a, const HideSet* b);
+        const HideSet* intersect(const HideSet* a, const HideSet* b);
+
+        FileCache& cache_;
+        std::vector<std::unique_ptr<Frame>> frames_;
+        std::vector<Cond> conds_;
+        std::unordered_map<std::string, Macro> macros_;
+        std::unordered_set<const FileCache::File*> entered_;
+        std::vector<const FileCache::File*> included_;
+        std::unordered_set<const FileCache::File*> found_;              // Members of @p included_
+        std::vector<Ref> pending_;                                      // Rescanned expansion in reverse order
+        Tok lookahead_;                                                 // Token read from the file after a function-like macro name
+        bool has_lookahead_ = false;
+
+        // Only live while @p pending_ is not empty
+        std::deque<Tok> made_;                                          // Tokens read for arguments or made by # and ##
+        std::deque<HideSet> hide_sets_;
+};
+
+}
+
+#endif
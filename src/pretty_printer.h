@@ -0,0 +1,52 @@
+#ifndef PROG_PRETTY_PRINTER_H
+#define PROG_PRETTY_PRINTER_H
+
+#include "output_buffer.h"
+
+#include <cstdint>
+#include <type_traits>
+
+namespace H {
+
+/// Output of @c -pp: C source text with tab indentation.
+///
+/// A printer owns its indent level and its @c OutputBuffer, so printers of different translation units do not share
+/// any state.
+class PrettyPrinter {
+    public:
+        PrettyPrinter(std::ostream& sink)
+            : out_(sink)
+        {}
+
+        PrettyPrinter& operator<<(const std::string& s) { out_.put(s); return full(); }
+        PrettyPrinter& operator<<(const char* s) { out_.put(s); return full(); }
+        PrettyPrinter& operator<<(char c) { out_.put(c); return full(); }
+
+        template<class I, std::enable_if_t<std::is_integral_v<I> && !std::is_same_v<I, char> && !std::is_same_v<I, bool>, int> = 0>
+        PrettyPrinter& operator<<(I i) { out_.digits(i); return full(); }
+
+        void indent() { ++indent_; }
+        void dedent() { --indent_; }
+
+        /// Line break followed by the current indentation.
+        PrettyPrinter& newline() {
+            out_.put('\n');
+            out_.put(indent_, '\t');
+            return full();
+        }
+
+        void flush() { out_.flush(); }
+
+    private:
+        PrettyPrinter& full() {
+            out_.full();
+            return *this;
+        }
+
+        OutputBuffer out_;
+        size_t indent_ = 0;
+};
+
+}
+
+#endif
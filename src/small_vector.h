@@ -0,0 +1,138 @@
+#ifndef PROG_SMALL_VECTOR_H
+#define PROG_SMALL_VECTOR_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace H {
+
+/// Vector that keeps up to @p N elements inline and only allocates once it grows beyond that.
+/// AST child lists (arguments, parameters, members, block items) mostly hold a handful of elements,
+/// so they live inside their node instead of in a separate heap block.
+template<class T, size_t N>
+class SmallVector {
+    static_assert(N > 0, "use std::vector without inline storage");
+
+public:
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    SmallVector()
+        : data_(inline_data())
+    {}
+
+    SmallVector(SmallVector&& other)
+        : data_(inline_data())
+    {
+        take(std::move(other));
+    }
+
+    SmallVector& operator=(SmallVector&& other) {
+        if (this != &other) {
+            destroy();
+            data_ = inline_data();
+            capacity_ = N;
+            take(std::move(other));
+        }
+        return *this;
+    }
+
+    SmallVector(const SmallVector&) = delete;
+    SmallVector& operator=(const SmallVector&) = delete;
+
+    ~SmallVector() { destroy(); }
+
+    // Element access
+    T& operator[](size_t i) { assert(i < size_); return data_[i]; }
+    const T& operator[](size_t i) const { assert(i < size_); return data_[i]; }
+    T& back() { assert(size_ > 0); return data_[size_-1]; }
+    const T& back() const { assert(size_ > 0); return data_[size_-1]; }
+    T* data() { return data_; }
+    const T* data() const { return data_; }
+
+    iterator begin() { return data_; }
+    iterator end() { return data_ + size_; }
+    const_iterator begin() const { return data_; }
+    const_iterator end() const { return data_ + size_; }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+    bool isInline() const { return data_ == inline_data(); }
+
+    // Modifiers
+    template<class... Args>
+    T& emplace_back(Args&&... args) {
+        if (size_ == capacity_) grow(2 * capacity_);
+        T* elem = new (data_ + size_) T(std::forward<Args>(args)...);
+        ++size_;
+        return *elem;
+    }
+
+    void push_back(T&& value) { emplace_back(std::move(value)); }
+
+    void pop_back() {
+        assert(size_ > 0);
+        data_[--size_].~T();
+    }
+
+    void clear() {
+        for (size_t i = 0; i < size_; i++) data_[i].~T();
+        size_ = 0;
+    }
+
+    void reserve(size_t capacity) {
+        if (capacity > capacity_) grow(capacity);
+    }
+
+private:
+    T* inline_data() { return reinterpret_cast<T*>(inline_); }
+    const T* inline_data() const { return reinterpret_cast<const T*>(inline_); }
+
+    void grow(size_t capacity) {
+        T* heap = static_cast<T*>(::operator new(capacity * sizeof(T)));
+        for (size_t i = 0; i < size_; i++) {
+            new (heap + i) T(std::move(data_[i]));
+            data_[i].~T();
+        }
+        if (!isInline()) ::operator delete(data_);
+        data_ = heap;
+        capacity_ = capacity;
+    }
+
+    void destroy() {
+        clear();
+        if (!isInline()) ::operator delete(data_);
+    }
+
+    /// Precondition: @c this is empty and inline.
+    void take(SmallVector&& other) {
+        if (other.isInline()) {
+            for (size_t i = 0; i < other.size_; i++) new (data_ + i) T(std::move(other.data_[i]));
+            size_ = other.size_;
+            other.clear();
+        } else {                                                        // steal the heap block
+            data_ = other.data_;
+            size_ = other.size_;
+            capacity_ = other.capacity_;
+            other.data_ = other.inline_data();
+            other.size_ = 0;
+            other.capacity_ = N;
+        }
+    }
+
+    T* data_;
+    size_t size_ = 0;
+    size_t capacity_ = N;
+    alignas(T) unsigned char inline_[N * sizeof(T)];
+};
+
+}
+
+#endif
@@ -0,0 +1,35 @@
+#include "sym.h"
+
+#include <mutex>
+#include <unordered_set>
+
+namespace H {
+
+namespace {
+    /// Process-wide string pool; elements of an @c unordered_set never move, so handing out pointers is safe.
+    std::unordered_set<std::string>& pool() {
+        static std::unordered_set<std::string> strings;
+        return strings;
+    }
+
+    std::mutex& pool_mutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    const std::string* intern(const std::string& str) {
+        std::lock_guard<std::mutex> lock(pool_mutex());
+        return &*pool().insert(str).first;
+    }
+}
+
+Sym::Sym() {
+    static const std::string* empty = intern(std::string());
+    str_ = empty;
+}
+
+Sym::Sym(const std::string& str)
+    : str_(intern(str))
+{}
+
+}
@@ -0,0 +1,35 @@
+#ifndef PROG_SYM_H
+#define PROG_SYM_H
+
+#include <functional>
+#include <string>
+
+namespace H {
+
+/// Interned name.
+/// Two @p Sym%s with equal spelling share the same storage, so comparing and hashing them is a pointer operation.
+class Sym {
+public:
+    Sym();
+    explicit Sym(const std::string& str);
+
+    const std::string& str() const { return *str_; }
+    const std::string* ptr() const { return str_; }
+    bool empty() const { return str_->empty(); }
+
+    bool operator==(Sym other) const { return str_ == other.str_; }
+    bool operator!=(Sym other) const { return str_ != other.str_; }
+
+private:
+    const std::string* str_;
+};
+
+}
+
+namespace std {
+    template<> struct hash<H::Sym> {
+        size_t operator()(H::Sym sym) const { return hash<const void*>()(sym.ptr()); }
+    };
+}
+
+#endif
@@ -73,6 +73,9 @@ public:
     std::string token_type() const { return token_type_; }
     uint64_t value() const { return value_; }
     bool isa(Tag tag) const { return tag == tag_; }
+    bool bol() const { return bol_; }                   ///< First token of its line (directives start with such a '#').
+    void set_bol(bool bol) { bol_ = bol; }
+    Tok at(Loc loc) const { Tok result = *this; result.loc_ = loc; return result; }  ///< Same token at @p loc (macro expansions are reported where they are used).
     const std::string& str() const { /*assert(isa(Tag::M_Id)); TODO*/ return str_; }
 
     static const char* tag2str(Tok::Tag);
@@ -84,8 +87,9 @@ public:
         Loc loc_;
         Tag tag_;
         std::string str_;
-        uint64_t value_;
+        uint64_t value_ = 0;
         std::string token_type_;
+        bool bol_ = false;
 
 };
 
@@ -0,0 +1,46 @@
+#include "trace.h"
+
+#include <string>
+
+namespace H {
+
+const char* rule2str(Rule rule) {
+    switch (rule) {
+        #define CODE(r, str) \
+            case Rule::r: return str;
+            H_RULE(CODE)
+        #undef CODE
+        default: return "<unknown rule>";
+    }
+}
+
+Tracer::Tracer(Sink& sink)
+    : sink_(&sink)
+    , start_(std::chrono::steady_clock::now())
+{
+    buffer_.reserve(buffer_size);
+}
+
+void Tracer::flush() {
+    if (buffer_.empty()) return;
+    sink_->events(buffer_.data(), buffer_.data() + buffer_.size());
+    buffer_.clear();
+}
+
+void Tracer::TextSink::events(const TraceEvent* begin, const TraceEvent* end) {
+    std::string out;
+    for (auto event = begin; event != end; ++event) {
+        out += std::to_string(event->pos.row) + ":" + std::to_string(event->pos.col);
+        out.append(event->depth + 1, '\t');
+        switch (event->kind) {
+            case TraceEvent::Kind::Enter: out += ">>> "; break;
+            case TraceEvent::Kind::Exit:  out += "<<< "; break;
+            case TraceEvent::Kind::Step:  out += "- ";   break;
+        }
+        out += rule2str(event->rule);
+        out += "\t[tok " + std::to_string(event->tok_index) + ", " + std::to_string(event->time_ns / 1000) + "us]\n";
+    }
+    o_ << out;
+}
+
+}
@@ -0,0 +1,116 @@
+#ifndef PROG_TRACE_H
+#define PROG_TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "loc.h"
+
+namespace H {
+
+/// Grammar rules reported by the parser trace (@c -ep).
+#define H_RULE(m) \
+m(None,                     "") \
+m(ExternalDeclaration,      "external declaration") \
+m(FunctionBody,             "function body") \
+m(StructIdentifier,         "struct identifier set") \
+m(StructDeclarationList,    "struct-declaration-list") \
+m(CompoundStatementList,    "compound statement list") \
+m(NullStatement,            "null statement") \
+m(LabeledStatement,         "labeled statement") \
+m(IfConsequence,            "if consequence") \
+m(IfAlternative,            "if alternative (else)") \
+m(WhileLoop,                "while loop") \
+m(LoopBody,                 "loop body") \
+m(ContinueStatement,        "continue statement") \
+m(BreakStatement,           "break statement") \
+m(GotoStatement,            "goto statement") \
+m(ReturnStatement,          "return statement") \
+m(ExpressionStatement,      "expression statement") \
+m(ArraySubscripting,        "array subscripting") \
+m(FunctionCall,             "function call") \
+m(ExpressionInList,         "expression in list")
+
+enum class Rule {
+    #define CODE(r, str) r,
+        H_RULE(CODE)
+    #undef CODE
+};
+
+const char* rule2str(Rule);
+
+struct TraceEvent {
+    enum class Kind : uint8_t { Enter, Exit, Step };
+
+    Kind kind;
+    Rule rule;
+    uint32_t depth;
+    size_t tok_index;           ///< Number of tokens consumed when the event fired.
+    Pos pos;                    ///< Position of the lookahead token.
+    uint64_t time_ns;           ///< Nanoseconds since the @p Tracer was created.
+};
+
+/// Tracing policy of a non-tracing @p Parser: every hook is compiled away.
+struct NoTrace {
+    static constexpr bool enabled = false;
+
+    void enter(Rule, size_t, Pos) {}
+    void exit(Rule, size_t, Pos) {}
+    void step(Rule, size_t, Pos) {}
+};
+
+/// Tracing policy of the @c -ep @p Parser.
+/// Events are collected in a fixed-size buffer and handed to the sink in blocks.
+class Tracer {
+public:
+    static constexpr bool enabled = true;
+    static constexpr size_t buffer_size = 4096;
+
+    /// Receives buffered trace events.
+    class Sink {
+    public:
+        virtual ~Sink() {}
+        virtual void events(const TraceEvent* begin, const TraceEvent* end) = 0;
+    };
+
+    /// Formats events as the indented @c -ep listing.
+    class TextSink : public Sink {
+    public:
+        TextSink(std::ostream& o)
+            : o_(o)
+        {}
+
+        void events(const TraceEvent* begin, const TraceEvent* end) override;
+
+    private:
+        std::ostream& o_;
+    };
+
+    Tracer(Sink& sink);
+    Tracer(Tracer&&) = default;
+    ~Tracer() { flush(); }
+
+    void enter(Rule rule, size_t tok_index, Pos pos) { record(TraceEvent::Kind::Enter, rule, tok_index, pos); ++depth_; }
+    void exit(Rule rule, size_t tok_index, Pos pos) { --depth_; record(TraceEvent::Kind::Exit, rule, tok_index, pos); }
+    void step(Rule rule, size_t tok_index, Pos pos) { record(TraceEvent::Kind::Step, rule, tok_index, pos); }
+
+    void flush();
+
+private:
+    void record(TraceEvent::Kind kind, Rule rule, size_t tok_index, Pos pos) {
+        auto now = std::chrono::steady_clock::now() - start_;
+        buffer_.push_back({kind, rule, depth_, tok_index, pos, uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count())});
+        if (buffer_.size() == buffer_size) flush();
+    }
+
+    Sink* sink_;
+    std::vector<TraceEvent> buffer_;
+    uint32_t depth_ = 0;
+    std::chrono::steady_clock::time_point start_;
+};
+
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef PROG_TYPE_NAMES_H
+#define PROG_TYPE_NAMES_H
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace H {
+
+/// Scoped set of typedef names the parser uses to tell declarations from expressions.
+///
+/// Every name that was ever declared as a type has one entry holding its current meaning, so classifying an identifier
+/// is a single hash lookup (none at all while no typedef is visible). Declarations in a block scope log the entry they
+/// overwrite; leaving the block undoes the log. Ordinary identifiers are only recorded where they hide a type name.
+class TypeNames {
+    public:
+        /// Is @p name a typedef name in the current scope?
+        bool contains(const std::string& name) const {
+            if (num_types_ == 0) return false;
+            auto it = names_.find(name);
+            return it != names_.end() && it->second;
+        }
+
+        /// Declares @p name in the current scope as a typedef name (@p type) or as an ordinary identifier.
+        void declare(const std::string& name, bool type) {
+            if (!type && !contains(name)) return;
+            bool& entry = names_[name];
+            if (entry == type) return;
+            if (!marks_.empty()) undo_.emplace_back(&entry, entry);    // Global declarations are never undone
+            entry = type;
+            type ? ++num_types_ : --num_types_;
+        }
+
+        void push() { marks_.push_back(undo_.size()); }
+
+        void pop() {
+            for (size_t mark = marks_.back(); undo_.size() != mark; undo_.pop_back()) {
+                auto [entry, old] = undo_.back();
+                *entry = old;
+                old ? ++num_types_ : --num_types_;
+            }
+            marks_.pop_back();
+        }
+
+    private:
+        std::unordered_map<std::string, bool> names_;                   // Entries are never erased, so pointers stay valid
+        std::vector<std::pair<bool*, bool>> undo_;                      // Entry and its value before the declaration
+        std::vector<size_t> marks_;                                     // Size of @p undo_ when each open scope was entered
+        size_t num_types_ = 0;                                          // Entries that are currently true
+};
+
+}
+
+#endif
@@ -0,0 +1,225 @@
+#include "vm.h"
+
+#include <cstring>
+#include <dlfcn.h>
+#include <stdexcept>
+
+namespace H {
+
+namespace {
+    constexpr size_t num_registers  = 1 << 20;
+    constexpr size_t memory_bytes   = 8 << 20;
+    constexpr size_t max_depth      = 1 << 18;
+
+    int64_t wrap(int64_t v) { return int32_t(uint32_t(uint64_t(v))); }
+
+    /// Calls native code with the System V convention: every H value fits an integer register.
+    int64_t callNative(void* fn, size_t n, const int64_t* a) {
+        using F = int64_t (*)(...);
+        auto f = reinterpret_cast<F>(fn);
+        switch (n) {
+            case 0: return f();
+            case 1: return f(a[0]);
+            case 2: return f(a[0], a[1]);
+            case 3: return f(a[0], a[1], a[2]);
+            case 4: return f(a[0], a[1], a[2], a[3]);
+            case 5: return f(a[0], a[1], a[2], a[3], a[4]);
+            case 6: return f(a[0], a[1], a[2], a[3], a[4], a[5]);
+            case 7: return f(a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+            case 8: return f(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+            default: throw std::runtime_error("external functions take at most 8 arguments");
+        }
+    }
+
+    int64_t normalize(Repr repr, int64_t v) {
+        switch (repr) {
+            case Repr::Char:    return int8_t(v);
+            case Repr::Int:     return int32_t(v);
+            case Repr::Void:    return 0;
+            default:            return v;
+        }
+    }
+}
+
+std::vector<void*> resolveExterns(const Program& program) {
+    std::vector<void*> externs;
+    for (auto& ext : program.externs) {
+        void* fn = dlsym(RTLD_DEFAULT, ext.name.c_str());
+        if (fn == nullptr) throw std::runtime_error("undefined function '" + ext.name + "'");
+        externs.push_back(fn);
+    }
+    return externs;
+}
+
+VM::VM(const Program& program)
+    : program_(program)
+    , data_(new char[program.data.size() + 1])
+    , regs_(num_registers)
+    , memory_(new char[memory_bytes])
+    , memory_size_(memory_bytes)
+{
+    std::memcpy(data_.get(), program.data.data(), program.data.size());
+    externs_ = resolveExterns(program);
+}
+
+int64_t VM::call(uint32_t index, const std::vector<int64_t>& args) {
+    return count_ ? execute<true>(index, args.data(), args.size()) : execute<false>(index, args.data(), args.size());
+}
+
+int VM::runMain(int argc, char** argv) {
+    int64_t index = program_.function("main");
+    if (index < 0) throw std::runtime_error("no function 'main'");
+    std::vector<int64_t> args;
+    if (program_.functions[index].num_params == 2) args = {argc, int64_t(argv)};
+    return int(call(index, args));
+}
+
+template<bool Count>
+int64_t VM::execute(uint32_t index, const int64_t* args, size_t num_args) {
+    static const void* handlers[] = {
+#define CODE(op, str) &&L_##op,
+        H_BYTECODE(CODE)
+#undef CODE
+    };
+
+    // Translate once per instantiation; jump targets become pointers into the threaded code
+    static std::vector<Threaded> threaded;
+    static const Program* translated = nullptr;
+    if (translated != &program_ || threaded.size() != program_.code.size()) {
+        threaded.clear();
+        for (auto& insn : program_.code) threaded.push_back({handlers[size_t(insn.op)], insn.a, insn.b, insn.c});
+        translated = &program_;
+    }
+    Threaded* code = threaded.data();
+
+    struct Frame {
+        const Threaded* ret;
+        int64_t* regs;
+        char* memory;
+        const BcFunction* fn;
+        int32_t dst;
+    };
+    std::vector<Frame> frames;
+
+    const BcFunction* fn = &program_.functions[index];
+    if (num_args != fn->num_params) throw std::runtime_error("'" + fn->name + "' called with the wrong number of arguments");
+    int64_t* regs = regs_.data();
+    int64_t* regs_end = regs + regs_.size();
+    char* memory = memory_.get();
+    char* memory_end = memory + memory_size_;
+    char* data = data_.get();
+    if (fn->num_regs > regs_.size() || fn->frame_size > memory_size_) throw std::runtime_error("stack overflow");
+    std::copy(args, args + num_args, regs);
+    const Threaded* pc = code + fn->entry;
+    uint64_t executed = 0;
+    int64_t result = 0;
+
+#define A   (pc->a)
+#define B   (pc->b)
+#define C   (pc->c)
+#define R(x) regs[x]
+#define DISPATCH() do { if constexpr (Count) ++executed; goto *pc->handler; } while (0)
+#define NEXT() do { ++pc; DISPATCH(); } while (0)
+#define JUMP(cond) do { if (cond) { pc = code + C; DISPATCH(); } NEXT(); } while (0)
+
+    DISPATCH();
+
+    L_Const:     R(A) = C; NEXT();
+    L_Mov:       R(A) = R(B); NEXT();
+    L_Add:       R(A) = wrap(R(B) + R(C)); NEXT();
+    L_Sub:       R(A) = wrap(R(B) - R(C)); NEXT();
+    L_Mul:       R(A) = wrap(R(B) * R(C)); NEXT();
+    L_Div:
+        if (R(C) == 0) throw std::runtime_error("division by zero in '" + fn->name + "'");
+        R(A) = wrap(R(B) / R(C)); NEXT();
+    L_Mod:
+        if (R(C) == 0) throw std::runtime_error("division by zero in '" + fn->name + "'");
+        R(A) = wrap(R(B) % R(C)); NEXT();
+    L_Shl:       R(A) = wrap(uint64_t(R(B)) << (R(C) & 31)); NEXT();
+    L_Shr:       R(A) = wrap(int32_t(R(B)) >> (R(C) & 31)); NEXT();
+    L_And:       R(A) = R(B) & R(C); NEXT();
+    L_Or:        R(A) = R(B) | R(C); NEXT();
+    L_Xor:       R(A) = R(B) ^ R(C); NEXT();
+    L_AddI:      R(A) = wrap(R(B) + C); NEXT();
+    L_MulI:      R(A) = wrap(R(B) * C); NEXT();
+    L_AddP:      R(A) = R(B) + R(C); NEXT();
+    L_AddPI:     R(A) = R(B) + C; NEXT();
+    L_SubP:      R(A) = R(B) - R(C); NEXT();
+    L_Neg:       R(A) = wrap(-uint64_t(R(B))); NEXT();
+    L_Not:       R(A) = !R(B); NEXT();
+    L_BitNot:    R(A) = ~R(B); NEXT();
+    L_SExt8:     R(A) = int8_t(R(B)); NEXT();
+    L_SExt32:    R(A) = int32_t(R(B)); NEXT();
+    L_Eq:        R(A) = R(B) == R(C); NEXT();
+    L_Ne:        R(A) = R(B) != R(C); NEXT();
+    L_Lt:        R(A) = R(B) < R(C); NEXT();
+    L_Le:        R(A) = R(B) <= R(C); NEXT();
+    L_Gt:        R(A) = R(B) > R(C); NEXT();
+    L_Ge:        R(A) = R(B) >= R(C); NEXT();
+    L_Ld8:       R(A) = *reinterpret_cast<int8_t*>(R(B) + C); NEXT();
+    L_Ld32:      { int32_t v; std::memcpy(&v, reinterpret_cast<char*>(R(B) + C), 4); R(A) = v; } NEXT();
+    L_Ld64:      { int64_t v; std::memcpy(&v, reinterpret_cast<char*>(R(B) + C), 8); R(A) = v; } NEXT();
+    L_St8:       *reinterpret_cast<int8_t*>(R(A) + C) = int8_t(R(B)); NEXT();
+    L_St32:      { int32_t v = int32_t(R(B)); std::memcpy(reinterpret_cast<char*>(R(A) + C), &v, 4); } NEXT();
+    L_St64:      std::memcpy(reinterpret_cast<char*>(R(A) + C), &R(B), 8); NEXT();
+    L_Copy:      std::memmove(reinterpret_cast<char*>(R(A)), reinterpret_cast<char*>(R(B)), C); NEXT();
+    L_FrameAddr: R(A) = int64_t(memory + C); NEXT();
+    L_DataAddr:  R(A) = int64_t(data + C); NEXT();
+    L_Jmp:       pc = code + C; DISPATCH();
+    L_Jz:        JUMP(!R(B));
+    L_Jnz:       JUMP(R(B));
+    L_JEq:       JUMP(R(A) == R(B));
+    L_JNe:       JUMP(R(A) != R(B));
+    L_JLt:       JUMP(R(A) < R(B));
+    L_JLe:       JUMP(R(A) <= R(B));
+    L_JGt:       JUMP(R(A) > R(B));
+    L_JGe:       JUMP(R(A) >= R(B));
+    L_Call: {
+        const BcFunction* callee = &program_.functions[B];
+        int64_t* window = regs + C;
+        char* frame = memory + fn->frame_size;
+        if (window + callee->num_regs > regs_end || frame + callee->frame_size > memory_end || frames.size() == max_depth)
+            throw std::runtime_error("stack overflow in '" + callee->name + "'");
+        frames.push_back({pc + 1, regs, memory, fn, A});
+        if constexpr (Count) ++stats_.calls;
+        regs = window;
+        memory = frame;
+        fn = callee;
+        pc = code + callee->entry;
+        DISPATCH();
+    }
+    L_CallExt: {
+        auto& ext = program_.externs[B];
+        R(A) = normalize(ext.ret, callNative(externs_[B], ext.num_params, &R(C)));
+        NEXT();
+    }
+    L_Ret:
+        result = R(B);
+        goto ret;
+    L_RetVoid:
+        result = 0;
+    ret:
+        if (frames.empty()) {
+            stats_.instructions += executed;
+            return result;
+        } else {
+            Frame& frame = frames.back();
+            pc = frame.ret;
+            regs = frame.regs;
+            memory = frame.memory;
+            fn = frame.fn;
+            R(frame.dst) = result;
+            frames.pop_back();
+            DISPATCH();
+        }
+
+#undef JUMP
+#undef NEXT
+#undef DISPATCH
+#undef R
+#undef C
+#undef B
+#undef A
+}
+
+}
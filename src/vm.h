@@ -0,0 +1,65 @@
+#ifndef PROG_VM_H
+#define PROG_VM_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "bytecode.h"
+
+namespace H {
+
+//! =================================================
+//! ================== Interpreter ==================
+//! =================================================
+//
+// Direct threaded: the bytecode is translated once into a vector of handler addresses (computed goto) with their
+// operands. A call slides the register window up to the argument block of the caller, so arguments are never copied.
+// Pointers are host pointers, so external functions (resolved with dlsym) can be called directly.
+
+/// Addresses of the external functions of @p program in the running process; throws std::runtime_error if one is
+/// missing.
+std::vector<void*> resolveExterns(const Program& program);
+
+class VM {
+    public:
+        struct Stats {
+            uint64_t instructions = 0;
+            uint64_t calls = 0;
+        };
+
+        /// Resolves the externals of @p program; throws std::runtime_error if one is missing.
+        VM(const Program& program);
+
+        /// Runs function @p index with @p args and returns its result; runtime errors throw std::runtime_error.
+        int64_t call(uint32_t index, const std::vector<int64_t>& args);
+
+        /// Runs @c main, passing @c argc and @c argv if it takes them, and returns the exit status.
+        int runMain(int argc, char** argv);
+
+        /// Count executed instructions (slower); see @p stats().
+        void count(bool enable) { count_ = enable; }
+        const Stats& stats() const { return stats_; }
+
+    private:
+        struct Threaded {
+            const void* handler;
+            int32_t a, b, c;
+        };
+
+        template<bool Count>
+        int64_t execute(uint32_t index, const int64_t* args, size_t num_args);
+
+        const Program& program_;
+        std::unique_ptr<char[]> data_;
+        std::vector<void*> externs_;
+        std::vector<int64_t> regs_;
+        std::unique_ptr<char[]> memory_;
+        size_t memory_size_;
+        bool count_ = false;
+        Stats stats_;
+};
+
+}
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef PROG_X86_H
+#define PROG_X86_H
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace H::x86 {
+
+/// General purpose registers in encoding order.
+enum Reg : uint8_t { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+/// Condition codes of Jcc / SETcc.
+enum Cond : uint8_t { O, NO, B, AE, E, NE, BE, A, S, NS, P, NP, L, GE, LE, G };
+
+/// Condition that holds when @p cond does not.
+inline Cond negate(Cond cond) { return Cond(cond ^ 1); }
+
+/// Integer argument registers of the System V AMD64 calling convention.
+constexpr Reg arg_regs[] = {RDI, RSI, RDX, RCX, R8, R9};
+
+/// Operand size in bits of the general purpose forms.
+enum Width : uint8_t { W8 = 8, W32 = 32, W64 = 64 };
+
+/// The r/m operand: a register, or memory at @p base + @p index * @p scale + @p disp, or at the end of the
+/// instruction + @p disp.
+struct Operand {
+    bool mem;
+    Reg reg;                                                            // Register, or base of the memory
+    int32_t disp;
+    bool indexed = false;
+    Reg index = RAX;
+    uint8_t scale = 1;
+    bool rip = false;
+
+    static Operand r(Reg reg) { return {false, reg, 0}; }
+    static Operand m(Reg base, int32_t disp = 0) { return {true, base, disp}; }
+    static Operand m(Reg base, Reg index, uint8_t scale, int32_t disp) { return {true, base, disp, true, index, scale}; }
+    static Operand ripRelative(int32_t disp) { return {true, RAX, disp, false, RAX, 1, true}; }
+};
+
+/// Group 1 arithmetic in the /digit order of opcodes 0x81 and 0x83.
+enum Alu : uint8_t { ADD = 0, OR = 1, AND = 4, SUB = 5, XOR = 6, CMP = 7 };
+
+/// Shifts by CL (opcode 0xD3).
+enum Shift : uint8_t { SHL = 4, SHR = 5, SAR = 7 };
+
+//! =================================================
+//! ================== Assembler ====================
+//! =================================================
+
+/// Appends encoded x86-64 instructions to a byte buffer; only the forms the code generators need.
+/// Branches and calls return the offset of their rel32 field, to be resolved with @p patch(); so does ripField() for
+/// the displacement of the last rip-relative operand.
+class Assembler {
+    public:
+        std::vector<uint8_t>& code() { return code_; }
+        const std::vector<uint8_t>& code() const { return code_; }
+        size_t size() const { return code_.size(); }
+        size_t ripField() const { return ripField_; }
+
+        // Moves
+        void mov(Reg dst, Operand src, Width w = W64) { op(w, 0x8B, dst, src); }
+        void mov(Operand dst, Reg src, Width w = W64) {
+            if (w == W8) op8(0x88, src, dst);
+            else op(w, 0x89, src, dst);
+        }
+        void mov(Reg dst, Reg src, Width w = W64) { if (dst != src) mov(dst, Operand::r(src), w); }
+        void mov(Operand dst, int32_t imm, Width w = W64) {
+            if (w == W8) {
+                op8(0xC6, 0, dst);
+                byte(imm);
+            } else {
+                op(w, 0xC7, 0, dst);
+                imm32(imm);
+            }
+        }
+        /// Zeroes with xor unless @p keepFlags.
+        void mov(Reg dst, int64_t imm, bool keepFlags = false) {
+            if (imm == 0 && !keepFlags) {
+                alu(XOR, dst, Operand::r(dst), W32);
+            } else if (imm >= 0 && imm <= int64_t(UINT32_MAX)) {             // mov r32, imm32 zero-extends
+                rex(false, 0, dst);
+                byte(0xB8 + (dst & 7));
+                imm32(uint32_t(imm));
+            } else if (imm >= INT32_MIN && imm <= INT32_MAX) {
+                mov(Operand::r(dst), int32_t(imm));
+            } else {
+                rex(true, 0, dst);
+                byte(0xB8 + (dst & 7));
+                uint64_t u = imm;
+                for (int i = 0; i != 8; ++i) byte(u >> (8 * i));
+            }
+        }
+        void movsx8(Reg dst, Operand src, Width w = W64) { op8(0xBE, dst, src, true, w == W64); }  // movsx r, r/m8
+        void movzx8(Reg dst, Operand src) { op8(0xB6, dst, src, true, false); }                  // movzx r32, r/m8
+        void movsxd(Reg dst, Operand src) { op(W64, 0x63, dst, src); }
+        void movsxd(Reg dst, Reg src) { movsxd(dst, Operand::r(src)); }
+        void lea(Reg dst, Operand src, Width w = W64) { assert(src.mem); op(w, 0x8D, dst, src); }
+
+        // Arithmetic
+        void alu(Alu kind, Reg dst, Operand src, Width w = W64) { op(w, (kind << 3) | 3, dst, src); }
+        void alu(Alu kind, Operand dst, int32_t imm, Width w = W64) {
+            if (imm >= -128 && imm <= 127) {
+                op(w, 0x83, kind, dst);
+                byte(imm);
+            } else {
+                op(w, 0x81, kind, dst);
+                imm32(imm);
+            }
+        }
+        void test(Reg a, Operand b, Width w = W64) { op(w, 0x85, a, b); }
+        void imul(Reg dst, Operand src, Width w = W64) { op(w, 0xAF, dst, src, true); }
+        void imul(Reg dst, Operand src, int32_t imm, Width w = W64) {
+            if (imm >= -128 && imm <= 127) {
+                op(w, 0x6B, dst, src);
+                byte(imm);
+            } else {
+                op(w, 0x69, dst, src);
+                imm32(imm);
+            }
+        }
+        void idiv(Operand divisor, Width w = W64) { op(w, 0xF7, 7, divisor); }
+        void cdq() { byte(0x99); }                                      // edx:eax = sign extended eax
+        void cqo() { byte(0x48); byte(0x99); }                          // rdx:rax = sign extended rax
+        void neg(Operand x, Width w = W64) { op(w, 0xF7, 3, x); }
+        void not_(Operand x, Width w = W64) { op(w, 0xF7, 2, x); }
+        void shift(Shift kind, Operand x, Width w = W64) { op(w, 0xD3, kind, x); }  // By CL
+        void shift(Shift kind, Operand x, uint8_t count, Width w = W64) { op(w, 0xC1, kind, x); byte(count); }
+        void setcc(Cond cond, Reg dst) { op8(0x90 + cond, 0, Operand::r(dst), true, false); }
+
+        // Stack and control flow
+        void push(Reg r) { rex(false, 0, r); byte(0x50 + (r & 7)); }
+        void push(Operand src) { op(W32, 0xFF, 6, src); }
+        void pop(Reg r) { rex(false, 0, r); byte(0x58 + (r & 7)); }
+        void ret() { byte(0xC3); }
+        void leave() { byte(0xC9); }
+        void call(Operand target) { op(W32, 0xFF, 2, target); }
+        size_t call() { byte(0xE8); return rel32(); }
+        size_t jmp() { byte(0xE9); return rel32(); }
+        size_t jcc(Cond cond) { byte(0x0F); byte(0x80 + cond); return rel32(); }
+        /// Jumps back to the code offset @p target, in two bytes if it is close.
+        void jmp(size_t target) {
+            if (int64_t(target) - int64_t(size() + 2) >= -128) byte(0xEB), byte(target - (size() + 1));
+            else patch(jmp(), target);
+        }
+        void jcc(Cond cond, size_t target) {
+            if (int64_t(target) - int64_t(size() + 2) >= -128) byte(0x70 + cond), byte(target - (size() + 1));
+            else patch(jcc(cond), target);
+        }
+        void rep_movsb() { byte(0xF3); byte(0xA4); }
+
+        /// Points the rel32 field at @p at to the code offset @p target.
+        void patch(size_t at, size_t target) {
+            int32_t rel = int32_t(int64_t(target) - int64_t(at + 4));
+            std::memcpy(&code_[at], &rel, 4);
+        }
+
+        void byte(uint8_t b) { code_.push_back(b); }
+        void imm32(uint32_t v) { for (int i = 0; i != 4; ++i) byte(v >> (8 * i)); }
+
+    private:
+        size_t rel32() { imm32(0); return size() - 4; }
+
+        void rex(bool w, uint8_t reg, Reg rm, bool force = false, uint8_t index = 0) {
+            uint8_t prefix = 0x40 | (w << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (rm >> 3);
+            if (prefix != 0x40 || force) byte(prefix);
+        }
+
+        /// Opcode @p opcode (0x0F-prefixed if @p twoByte) with ModRM reg field @p reg and r/m @p rm.
+        void op(Width w, uint8_t opcode, uint8_t reg, Operand rm, bool twoByte = false) {
+            assert(w != W8);
+            rex(w == W64, reg, rm.reg, false, rm.indexed ? rm.index : 0);
+            if (twoByte) byte(0x0F);
+            byte(opcode);
+            modrm(reg, rm);
+        }
+
+        /// Byte-register forms; a REX prefix makes SPL..DIL addressable instead of AH..BH.
+        void op8(uint8_t opcode, uint8_t reg, Operand rm, bool twoByte = false, bool w = false) {
+            bool byteReg = (!rm.mem && rm.reg >= RSP && rm.reg <= RDI) || (opcode == 0x88 && reg >= RSP && reg <= RDI);
+            rex(w, reg, rm.reg, byteReg, rm.indexed ? rm.index : 0);
+            if (twoByte) byte(0x0F);
+            byte(opcode);
+            modrm(reg, rm);
+        }
+
+        void modrm(uint8_t reg, Operand rm) {
+            reg &= 7;
+            uint8_t base = rm.reg & 7;
+            if (!rm.mem) {
+                byte(0xC0 | (reg << 3) | base);
+                return;
+            }
+            if (rm.rip) {
+                byte((reg << 3) | 5);
+                ripField_ = size();
+                imm32(rm.disp);
+                return;
+            }
+            uint8_t mod = rm.disp == 0 && base != RBP ? 0 : rm.disp >= -128 && rm.disp <= 127 ? 1 : 2;
+            if (rm.indexed) {
+                assert(rm.index != RSP);
+                uint8_t scale = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+                byte((mod << 6) | (reg << 3) | 4);
+                byte((scale << 6) | ((rm.index & 7) << 3) | base);
+            } else {
+                byte((mod << 6) | (reg << 3) | base);
+                if (base == RSP) byte(0x24);                            // SIB: base only
+            }
+            if (mod == 1) byte(rm.disp);
+            if (mod == 2) imm32(rm.disp);
+        }
+
+        std::vector<uint8_t> code_;
+        size_t ripField_ = 0;
+};
+
+}
+
+#endif
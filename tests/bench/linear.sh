@@ -0,0 +1,64 @@
+#!/bin/sh
+# Checks that type checking stays linear: generates deep sizeof nesting, a long argument list and a state machine of
+# gotos at size n and 4n, checks them with H -p --stats and fails when the number of typed expressions or the checking
+# time grows faster than the input.
+# Usage: linear.sh <H> [n]
+H=${1:?usage: linear.sh <H> [n]}
+N=${2:-2000}
+DIR=$(mktemp -d)
+trap 'rm -fr "$DIR"' EXIT
+
+# x = sizeof sizeof ... x; nested n / 4 deep, as the parser recurses for each level
+sizeof_nesting() {
+    awk -v n="$(($1 / 4))" 'BEGIN {
+        print "int main(void) {\n    int x;"
+        printf "    x = "
+        for (i = 0; i < n; i++) printf "sizeof "
+        print "x;\n    return x;\n}"
+    }'
+}
+
+# a call passing n arguments, each with its own nested sizeof
+long_arglist() {
+    awk -v n="$1" 'BEGIN {
+        printf "int f("
+        for (i = 0; i < n; i++) printf "%sint a%d", i ? ", " : "", i
+        printf ") {\n    return f("
+        for (i = 0; i < n; i++) printf "%s(a%d + sizeof sizeof a%d)", i ? ", " : "", i, i
+        print ");\n}"
+    }'
+}
+
+# n labels in one function, each jumping forward or backward
+goto_state_machine() {
+    awk -v n="$1" 'BEGIN {
+        printf "int run(int state) {\n    goto s%d;\n", n - 1
+        for (i = 0; i < n; i++) printf "s%d:\n    if (state == %d) goto s%d;\n", i, i, (1 + i * (n - 81)) % n
+        print "    return state;\n}"
+    }'
+}
+
+# <what> <stat> <small> <large>: fails if <large> exceeds <limit> times <small>
+compare() {
+    if awk -v s="$3" -v l="$4" -v limit="$5" 'BEGIN { exit !(l > limit * s) }'; then
+        echo "$1: $2 grew from $3 to $4 for 4 times the input" >&2
+        exit 1
+    fi
+}
+
+for input in sizeof_nesting long_arglist goto_state_machine; do
+    for size in "$N" $((4 * N)); do
+        $input $size > "$DIR/$input.$size.h"
+        "$H" -p --stats "$DIR/$input.$size.h" 2> "$DIR/$input.$size.stats" || { cat "$DIR/$input.$size.stats" >&2; exit 1; }
+    done
+    small=$DIR/$input.$N.stats
+    large=$DIR/$input.$((4 * N)).stats
+    checks=$(sed -n 's/^typechecks: //p' "$small")
+    checks4=$(sed -n 's/^typechecks: //p' "$large")
+    time=$(sed -n 's/^check time: \(.*\) s$/\1/p' "$small")
+    time4=$(sed -n 's/^check time: \(.*\) s$/\1/p' "$large")
+    echo "$input: $checks -> $checks4 typechecks, $time -> $time4 s"
+    compare "$input" typechecks "$checks" "$checks4" 4.4
+    # Quadratic checking would take 16 times as long; leave room for noise, and ignore times too short to measure
+    if awk -v t="$time4" 'BEGIN { exit !(t >= 0.01) }'; then compare "$input" "check time" "$time" "$time4" 8; fi
+done
@@ -0,0 +1,32 @@
+// Calls with several arguments, char parameters, strings, short-circuit conditions and goto.
+int printf(char* format, int value);
+int strlen(char* s);
+
+int count(char* s, char c) {
+    int n;
+    n = 0;
+    while (*s) {
+        if (*s == c || (c == '?' && *s != ' ')) n++;
+        s++;
+    }
+    return n;
+}
+
+int mix(int a, int b, int c, int d, int e) {
+    return a * 5 + b * 4 - c * 3 + d * 2 - e;
+}
+
+int main(int argc, char** argv) {
+    char* text;
+    int i;
+    int total;
+    text = "the quick brown fox jumps over the lazy dog";
+    total = 0;
+    i = 0;
+again:
+    total = total + count(text, 'o') + mix(i, i + 1, i + 2, i & 3, argc) + strlen(text);
+    if (++i < 200000 && total >= 0) goto again;
+    printf("total = %d\n", total);
+    printf("argc = %d\n", argc);
+    return 0;
+}
@@ -0,0 +1,20 @@
+// Nested loops and integer arithmetic with wrap-around.
+int printf(char* format, int value);
+
+int main(void) {
+    int i;
+    int j;
+    int sum;
+    sum = 0;
+    i = 0;
+    while (i < 3000) {
+        j = 0;
+        while (j < 3000) {
+            sum = sum * 31 + (i ^ j) % 7 - (j >> 2);
+            j++;
+        }
+        i++;
+    }
+    printf("sum = %d\n", sum);
+    return 0;
+}
@@ -0,0 +1,39 @@
+// Pointer arithmetic, pointer differences and address-taken locals.
+int* malloc(int size);
+int printf(char* format, int value);
+
+void swap(int* a, int* b) {
+    int t;
+    t = *a;
+    *a = *b;
+    *b = t;
+}
+
+void reverse(int* begin, int* end) {
+    while (begin < --end) swap(begin++, end);
+}
+
+int main(void) {
+    int* values;
+    int* p;
+    int n;
+    int round;
+    int checksum;
+    n = 10000;
+    values = malloc(n * sizeof(int));
+    p = values;
+    while (p - values < n) {
+        *p = (p - values) * 3;
+        p++;
+    }
+    round = 0;
+    while (round < 100) {
+        reverse(values, values + n);
+        round++;
+    }
+    checksum = 0;
+    p = values + n;
+    while (p != values) checksum = checksum * 7 + *--p;
+    printf("checksum = %d\n", checksum);
+    return 0;
+}
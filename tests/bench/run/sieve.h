@@ -0,0 +1,41 @@
+// Byte loads and stores through pointers into malloc'ed memory.
+char* malloc(int size);
+void free(char* p);
+int printf(char* format, int value);
+
+int sieve(int n) {
+    char* composite;
+    int i;
+    int j;
+    int count;
+    composite = malloc(n + 1);
+    i = 0;
+    while (i <= n) composite[i++] = ' ';
+    count = 0;
+    i = 2;
+    while (i <= n) {
+        if (composite[i] == ' ') {
+            count++;
+            j = i + i;
+            while (j <= n) {
+                composite[j] = 'x';
+                j = j + i;
+            }
+        }
+        i++;
+    }
+    free(composite);
+    return count;
+}
+
+int main(void) {
+    int round;
+    int count;
+    round = 0;
+    while (round < 20) {
+        count = sieve(1000000);
+        round++;
+    }
+    printf("primes below 1000000: %d\n", count);
+    return 0;
+}
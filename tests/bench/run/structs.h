@@ -0,0 +1,39 @@
+// Struct members in frame memory, through pointers, and struct assignment.
+int printf(char* format, int value);
+
+struct Point {
+    int x;
+    char tag;
+    int y;
+};
+
+struct Box {
+    struct Point min;
+    struct Point max;
+};
+
+int area(struct Box* box) {
+    return (box->max.x - box->min.x) * (box->max.y - box->min.y);
+}
+
+int main(void) {
+    struct Box box;
+    struct Box copy;
+    int i;
+    int total;
+    total = 0;
+    i = 0;
+    while (i < 1000000) {
+        box.min.x = i % 10;
+        box.min.y = i % 7;
+        box.max.x = box.min.x + 5;
+        box.max.y = box.min.y + 3;
+        box.min.tag = 'k';
+        if (i % 3 == 0) box.min.tag = 'z';
+        copy = box;
+        total = total + area(&copy) + copy.min.tag;
+        i++;
+    }
+    printf("total = %d\n", total);
+    return 0;
+}
@@ -0,0 +1,94 @@
+#!/bin/sh
+# Checks that --cache-dir agrees with an uncached run: runs each program without the cache, then twice with it (a miss
+# and a hit), and compares the output and exit status.
+# Usage: cache.sh <H>
+H=${1:?usage: cache.sh <H>}
+H=$(cd "$(dirname "$H")" && pwd)/$(basename "$H")
+DIR=$(mktemp -d)
+trap 'rm -fr "$DIR"' EXIT
+cd "$DIR" || exit 1
+failed=0
+
+# <what> <arguments of H>
+check() {
+    what=$1
+    shift
+    "$H" "$@" > plain 2>&1
+    echo "exit $?" >> plain
+    for run in miss hit; do
+        "$H" --cache-dir cache "$@" > cached 2>&1
+        echo "exit $?" >> cached
+        if ! cmp -s plain cached; then
+            echo "cache: $what ($run): differs from an uncached run" >&2
+            diff plain cached >&2
+            failed=1
+        fi
+    done
+}
+
+cat > errors.h <<'EOF'
+int f(void) {
+    return x;
+}
+EOF
+check "diagnostics" -p errors.h
+
+cat > syntax.h <<'EOF'
+int f(void) {
+    return 1
+}
+EOF
+check "syntax error" -p syntax.h
+
+cat > run.h <<'EOF'
+typedef int T;
+struct P { T x; T y; };
+int main(void) {
+    struct P p;
+    p.x = 20;
+    p.y = 22;
+    return p.x + p.y;
+}
+EOF
+check "typedefs and structs" --run run.h
+
+cat > header.h <<'EOF'
+int k(void) { return 1; }
+EOF
+cat > main.h <<'EOF'
+#include "header.h"
+int main(void) {
+    return k();
+}
+EOF
+check "included header" --run main.h
+cat > header.h <<'EOF'
+int k(void) { return 2; }
+EOF
+check "edited header" --run main.h
+
+# The same file in two directories includes the header next to it
+mkdir d1 d2
+echo 'int k(void) { return 1; }' > d1/a.h
+echo 'int k(void) { return 2; }' > d2/a.h
+cp main.h d1/m.h
+cp main.h d2/m.h
+sed -i 's/header.h/a.h/' d1/m.h d2/m.h
+check "quoted include in d1" --run d1/m.h
+check "quoted include in d2" --run d2/m.h
+
+# Angled names are looked up in the include dirs, in order
+mkdir i1 i2
+echo 'int k(void) { return 3; }' > i1/b.h
+echo 'int k(void) { return 4; }' > i2/b.h
+cat > angled.h <<'EOF'
+#include <b.h>
+int main(void) {
+    return k();
+}
+EOF
+check "include dir i1" -I i1 --run angled.h
+check "include dir i2" -I i2 --run angled.h
+check "include dirs i2, i1" -I i2 -I i1 --run angled.h
+
+exit $failed
@@ -0,0 +1,109 @@
+#!/bin/sh
+# Checks that --incremental agrees with a full check: edits one file step by step and compares the diagnostics and
+# exit status of H --incremental with those of H -p after every step.
+# Usage: incremental.sh <H>
+H=${1:?usage: incremental.sh <H>}
+DIR=$(mktemp -d)
+trap 'rm -fr "$DIR"' EXIT
+failed=0
+
+# <what>: writes stdin to the file, then checks it both ways
+step() {
+    cat > "$DIR/t.h"
+    "$H" --incremental "$DIR/state" "$DIR/t.h" > "$DIR/incremental" 2>&1
+    echo "exit $?" >> "$DIR/incremental"
+    "$H" -p "$DIR/t.h" > "$DIR/full" 2>&1
+    echo "exit $?" >> "$DIR/full"
+    if ! cmp -s "$DIR/incremental" "$DIR/full"; then
+        echo "incremental: $1: differs from a full check" >&2
+        diff "$DIR/full" "$DIR/incremental" >&2
+        failed=1
+    fi
+}
+
+step "first run" <<'EOF'
+struct S { int a; };
+typedef struct S T;
+int f(T* p) {
+    return p->a;
+}
+EOF
+
+# f only names T, which is declared through S
+step "member renamed behind a typedef" <<'EOF'
+struct S { int b; };
+typedef struct S T;
+int f(T* p) {
+    return p->a;
+}
+EOF
+
+step "member renamed back" <<'EOF'
+struct S { int a; };
+typedef struct S T;
+int f(T* p) {
+    return p->a;
+}
+EOF
+
+step "typedef of a typedef" <<'EOF'
+struct S { int a; };
+typedef struct S T;
+typedef T U;
+int f(U* p) {
+    return p->a;
+}
+EOF
+
+step "member renamed behind two typedefs" <<'EOF'
+struct S { int c; };
+typedef struct S T;
+typedef T U;
+int f(U* p) {
+    return p->a;
+}
+EOF
+
+step "function added and called" <<'EOF'
+struct S { int a; };
+typedef struct S T;
+int g(int x) {
+    return x;
+}
+int f(T* p) {
+    return g(p->a);
+}
+EOF
+
+step "callee changes its parameters" <<'EOF'
+struct S { int a; };
+typedef struct S T;
+int g(int x, int y) {
+    return x + y;
+}
+int f(T* p) {
+    return g(p->a);
+}
+EOF
+
+step "macro used by a later function" <<'EOF'
+#define N 3
+int f(void) {
+    return N;
+}
+EOF
+
+step "macro renamed" <<'EOF'
+#define M 3
+int f(void) {
+    return N;
+}
+EOF
+
+step "directives removed" <<'EOF'
+int f(void) {
+    return 3;
+}
+EOF
+
+exit $failed
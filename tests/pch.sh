@@ -0,0 +1,83 @@
+#!/bin/sh
+# Checks that --include-pch agrees with checking the prelude and the file as one: precompiles each prelude with
+# --emit-pch, runs the file against it and compares the output and exit status with a run of both files concatenated.
+# Usage: pch.sh <H>
+H=${1:?usage: pch.sh <H>}
+H=$(cd "$(dirname "$H")" && pwd)/$(basename "$H")
+DIR=$(mktemp -d)
+trap 'rm -fr "$DIR"' EXIT
+cd "$DIR" || exit 1
+failed=0
+
+# <what>: prelude.h and use.h hold the two parts
+check() {
+    if ! "$H" --emit-pch prelude.pch prelude.h; then
+        echo "pch: $1: --emit-pch failed" >&2
+        failed=1
+        return
+    fi
+    cat prelude.h use.h > whole.h
+    for mode in --run --jit -run "--run -O2"; do
+        "$H" $mode whole.h > whole 2>&1
+        echo "exit $?" >> whole
+        "$H" --include-pch prelude.pch $mode use.h > split 2>&1
+        echo "exit $?" >> split
+        if ! cmp -s whole split; then
+            echo "pch: $1 ($mode): differs from a run of both files" >&2
+            diff whole split >&2
+            failed=1
+        fi
+    done
+}
+
+cat > prelude.h <<'EOF'
+typedef int T;
+struct P { T x; T y; };
+T scale;
+EOF
+cat > use.h <<'EOF'
+int main(void) {
+    struct P p;
+    scale = 2;
+    p.x = 10;
+    p.y = 11;
+    return (p.x + p.y) * scale;
+}
+EOF
+check "globals, typedefs and structs"
+
+cat > prelude.h <<'EOF'
+int base;
+int add(int a, int b) {
+    return a + b + base;
+}
+inline int twice(int a) {
+    return add(a, a);
+}
+EOF
+cat > use.h <<'EOF'
+int main(void) {
+    base = 1;
+    return twice(20);
+}
+EOF
+check "function definitions"
+
+cat > prelude.h <<'EOF'
+#ifndef PRELUDE_H
+#define PRELUDE_H
+#define N 40
+#define ADD(a, b) ((a) + (b))
+#define FIRST(x, ...) x
+int version;
+#endif
+EOF
+cat > use.h <<'EOF'
+#include "prelude.h"
+int main(void) {
+    return FIRST(ADD(N, 2), 0);
+}
+EOF
+check "macros and include guards"
+
+exit $failed
@@ -0,0 +1,7 @@
+// comment before the guard is fine
+#ifndef POINT_H
+#define POINT_H
+#include "types.h"
+struct Point { COORD x; COORD y; };
+int norm(struct Point* p);
+#endif
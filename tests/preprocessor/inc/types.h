@@ -0,0 +1,3 @@
+#pragma once
+#define COORD int
+#define LIMIT (1 << 4)
@@ -0,0 +1,20 @@
+#define f(x) f(x) + 1
+#define STR(x) #x
+#define XSTR(x) STR(x)
+#define CAT(a, b) a ## b
+#define N 3
+#define EMPTY
+#define LOG(fmt, ...) printf(fmt, __VA_ARGS__)
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define ID(x) x
+#define g f
+int printf(char* s, int a, int b);
+int CAT(va, r1);
+int CAT(v, EMPTY);
+int CAT(, w);
+int h(int x) { return f(f(x)) + g(2) + g; }
+int k(void) { char* s; char* t; s = STR(a  "b\n" + c); t = XSTR(N); return max(N, CAT(va, r1)) + ID(ID(N)); }
+int l(void) { return LOG("%d %d", 1, 2); }
+#if ID(N) == 3 && defined(f) && max(1, 2) == 2
+int cond_ok;
+#endif
@@ -0,0 +1,35 @@
+#include <point.h>
+#include <point.h>
+#include "inc/point.h"
+#define DEBUG 1
+#if DEBUG && LIMIT > 8 && defined(POINT_H) && !defined NOPE
+int debug_level;
+#elif 1
+int wrong1;
+#else
+int wrong2;
+#endif
+#ifdef NOPE
+  #if 1
+  this is ' not lexed
+  #else
+  #endif
+int wrong3;
+#elif LIMIT == 16
+int limit_ok;
+#endif
+#undef DEBUG
+#ifndef DEBUG
+int undef_ok;
+#endif
+  # if 0 /* comment */
+int wrong4;
+  # endif
+int norm(struct Point* p) {
+    return p->x * p->x + p->y * p->y + LIMIT;
+}
+int main(void) {
+    struct Point p;
+    p.x = LIMIT;
+    return norm(&p) + undeclared;
+}
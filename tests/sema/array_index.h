@@ -0,0 +1,17 @@
+int sum(int* a, int n) {
+    int s;
+    s = 0;
+    while (n > 0) {
+        n = n - 1;
+        s = s + a[n];
+    }
+    return s;
+}
+char last(char* s, int n) {
+    char c;
+    c = s[n - 1];
+    return c;
+}
+int* row(int** m, int i) {
+    return m[i];
+}
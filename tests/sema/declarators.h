@@ -0,0 +1,12 @@
+char* name(int i);
+int (*pick(int i))(int a);
+int* first(int** p) {
+    return *p;
+}
+int main(void) {
+    char* s;
+    int* q;
+    s = name(1);
+    q = first(&q);
+    return *s + *q;
+}
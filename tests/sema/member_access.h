@@ -0,0 +1,11 @@
+struct Point { int x; int y; };
+struct Line { struct Point from; struct Point to; };
+int length(struct Line* l) {
+    return l->to.x - l->from.x;
+}
+int origin(struct Line l) {
+    return l.from.x + l.from.y;
+}
+int deref(struct Point* p) {
+    return (*p).x;
+}
@@ -0,0 +1,7 @@
+int none(void);
+int bytes(void* p);
+int both(void* p, int n);
+int main(void) {
+    void* p;
+    return none() + bytes(p) + both(p, 4);
+}
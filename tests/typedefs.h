@@ -0,0 +1,28 @@
+typedef int Int;
+typedef struct Point { Int x; Int y; } Point;
+typedef Point* PointPtr;
+typedef char* String;
+Int printf(String fmt, Int a);
+Int norm(PointPtr p) {
+    return p->x * p->x + p->y * p->y;
+}
+Int shadow(Int Int2, String s) {
+    typedef Int Local;
+    Local a;
+    Point q;
+    a = sizeof(Point) + sizeof(Int);
+    q.x = a;
+    {
+        Int Local;
+        Local = 3;
+        a = Local;
+    }
+    Local b;
+    b = a;
+    return norm(&q) + b;
+}
+Int param(Int String) {
+    String = 2;
+    return String;
+}
+String name;